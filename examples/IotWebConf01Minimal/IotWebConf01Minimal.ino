@@ -49,22 +49,14 @@ void setup() {
 	iotWebConf.init();
 	// -- Set up required URL handlers on the web server.
 	server.on("/", HTTP_GET, handleRoot);
-	server.on("/config", HTTP_ANY, [](AsyncWebServerRequest* request) {
-        auto* asyncWebRequestWrapper = new AsyncWebRequestWrapper(request);
-        iotWebConf.handleConfig(asyncWebRequestWrapper);
-		}
-	);
+	// -- Config page, captive portal probes and not found handler.
+	iotWebConf.setupWebHandlers();
 	server.on("/favicon.ico", HTTP_GET, [](AsyncWebServerRequest* request) {
 		AsyncWebServerResponse* response = request->beginResponse_P(200, "image/x-icon", favicon_ico_gz, favicon_ico_gz_len);
 		response->addHeader("Content-Encoding", "gzip");
 		request->send(response);
 		}
 	);
-	server.onNotFound([](AsyncWebServerRequest* request) { 
-			AsyncWebRequestWrapper asyncWebRequestWrapper(request);
-			iotWebConf.handleNotFound(&asyncWebRequestWrapper);
-		}
-	);
 
 	Serial.println("Ready.");
 }
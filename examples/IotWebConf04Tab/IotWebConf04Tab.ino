@@ -184,17 +184,8 @@ void setup()
   // -- Setup web server routes --
   server.on("/", HTTP_GET, handleRoot);
 
-  server.on("/config", HTTP_ANY, [](AsyncWebServerRequest* request) {
-    // IMPORTANT: You must create the AsyncWebRequestWrapper with 'new' and do NOT delete it manually.
-    // The object will delete itself when it is no longer needed.
-    auto* asyncWebRequestWrapper = new AsyncWebRequestWrapper(request);
-    iotWebConf.handleConfig(asyncWebRequestWrapper);
-  });
-
-  server.onNotFound([](AsyncWebServerRequest* request) {
-    AsyncWebRequestWrapper asyncWebRequestWrapper(request);
-    iotWebConf.handleNotFound(&asyncWebRequestWrapper);
-  });
+  // -- Config page, captive portal probes and not found handler.
+  iotWebConf.setupWebHandlers();
 
   Serial.println("Ready.");
 }
@@ -18,18 +18,257 @@ bool debugIotAsyncWebRequest = false;
 #define DEBUGASYNC_PRINTLN(x) if (debugIotAsyncWebRequest) Serial.println(x)
 #define DEBUGASYNC_PRINTF(...) if (debugIotAsyncWebRequest) Serial.printf(__VA_ARGS__)
 
+#define IOTWEBCONFASYNC_STR_(x) #x
+#define IOTWEBCONFASYNC_STR(x) IOTWEBCONFASYNC_STR_(x)
+
+const char IOTWEBCONFASYNC_HTML_BUSY[] PROGMEM =
+    "<!DOCTYPE html><html><head><meta http-equiv=\"refresh\" content=\"" IOTWEBCONFASYNC_STR(IOTWEBCONFASYNC_RETRY_AFTER_SECONDS) "\">"
+    "<title>Busy</title></head><body>The device is busy, the page will reload shortly.</body></html>";
+
+// -- Answer to a deferred save, polls the save status until doLoop() wrote the config.
+const char IOTWEBCONFASYNC_HTML_SAVED[] PROGMEM =
+    "<!DOCTYPE html><html><head><title>Saved</title></head><body>"
+    "<div id=\"s\">Saving configuration...</div><a href=\"\">Return to configuration page</a>"
+    "<script>(function p(){fetch('?saveStatus').then(function(r){return r.json();})"
+    ".then(function(j){var s=document.getElementById('s');"
+    "if(j.failed>=j.generation)s.textContent='Saving the configuration failed.';"
+    "else if(j.saved>=j.generation)s.textContent='Configuration saved.';"
+    "else setTimeout(p,500);}).catch(function(){setTimeout(p,1000);});})();</script></body></html>";
+
+const char IOTWEBCONFASYNC_HTML_SAVE_FAILED[] PROGMEM =
+    "<!DOCTYPE html><html><head><title>Not saved</title></head><body>"
+    "<div>Saving the configuration failed.</div><a href=\"\">Return to configuration page</a></body></html>";
+
+const char IOTWEBCONFASYNC_TAB_STYLE[] PROGMEM =
+    ".tab{overflow:hidden;border-bottom:2px solid #16A1E7;background-color:#f1f1f1;margin-bottom:10px;display:flex;}" IOTWEBCONFASYNC_NL
+    ".tab button{background-color:#f1f1f1!important;flex:1 1 0;min-width:0;border:1px solid #ccc!important;outline:none;cursor:pointer;"
+    "padding:14px 16px;transition:0.3s;font-size:16px;border-top-left-radius:5px;border-top-right-radius:5px;"
+    "margin-right:2px;border-bottom:none!important;color:#333!important;line-height:normal!important;width:auto!important;box-sizing:border-box;}" IOTWEBCONFASYNC_NL
+    ".tab button:hover{background-color:#ddd!important;}" IOTWEBCONFASYNC_NL
+    ".tab button.active{background-color:#16A1E7!important;color:white!important;border:1px solid #16A1E7!important;"
+    "border-bottom:2px solid #fff!important;position:relative;z-index:1;}" IOTWEBCONFASYNC_NL
+    ".tabcontent{display:none;padding:12px;border:1px solid #ccc;border-top:none;background-color:#fff;}" IOTWEBCONFASYNC_NL
+    "fieldset{width:100%;box-sizing:border-box;}" IOTWEBCONFASYNC_NL;
+
+const char IOTWEBCONFASYNC_HTML_PORTAL_REDIRECT[] PROGMEM =
+    "<!DOCTYPE html><html><head><title>Redirect</title></head><body><a href=\"/\">Configuration portal</a></body></html>";
+
+namespace {
+    // -- FNV-1a, evaluated at compile time for the probe table.
+    constexpr uint32_t probeHash(const char* s, uint32_t h = 2166136261u) {
+        return *s ? probeHash(s + 1, (h ^ static_cast<uint8_t>(*s)) * 16777619u) : h;
+    }
+
+    struct CaptivePortalProbe {
+        uint32_t hash;
+        const char* path;
+    };
+
+    const CaptivePortalProbe CAPTIVE_PORTAL_PROBES[] = {
+        { probeHash("/generate_204"), "/generate_204" },                              // Android
+        { probeHash("/gen_204"), "/gen_204" },                                        // Android
+        { probeHash("/hotspot-detect.html"), "/hotspot-detect.html" },                // Apple
+        { probeHash("/library/test/success.html"), "/library/test/success.html" },    // Apple
+        { probeHash("/connecttest.txt"), "/connecttest.txt" },                        // Windows
+        { probeHash("/ncsi.txt"), "/ncsi.txt" },                                      // Windows
+        { probeHash("/redirect"), "/redirect" },                                      // Windows
+        { probeHash("/fwlink"), "/fwlink" },                                          // Windows
+        { probeHash("/canonical.html"), "/canonical.html" },                          // Firefox
+        { probeHash("/success.txt"), "/success.txt" }                                 // Firefox
+    };
+
+    uint32_t pageRandom() {
+#ifdef ESP32
+        return esp_random();
+#elif defined(ESP8266)
+        return ESP.random();
+#else
+        return (uint32_t)random(0x7FFFFFFF);
+#endif
+    }
+
+    // -- If-None-Match is "*" or a list of entity tags. They are compared weakly,
+    //    a W/ prefix is ignored and the quoted tag must match as a whole.
+    bool matchesETag(const char* list, const char* etag) {
+        size_t length_ = strlen(etag);
+        const char* p_ = list;
+        while (true) {
+            while (*p_ == ' ' || *p_ == '\t' || *p_ == ',') {
+                p_++;
+            }
+            if (*p_ == '\0') {
+                return false;
+            }
+            if (p_[0] == 'W' && p_[1] == '/') {
+                p_ += 2;
+            }
+            const char* start_ = p_;
+            if (*p_ == '"') {
+                // -- A quoted tag may hold commas.
+                const char* end_ = strchr(p_ + 1, '"');
+                p_ = end_ != nullptr ? end_ + 1 : p_ + strlen(p_);
+            }
+            else {
+                while (*p_ != '\0' && *p_ != ',' && *p_ != ' ' && *p_ != '\t') {
+                    p_++;
+                }
+            }
+            size_t entry_ = p_ - start_;
+            if ((entry_ == 1 && *start_ == '*') || (entry_ == length_ && strncmp(start_, etag, length_) == 0)) {
+                return true;
+            }
+            // -- Anything else up to the next comma does not belong to a tag.
+            while (*p_ != '\0' && *p_ != ',') {
+                p_++;
+            }
+        }
+    }
+}
+
+std::atomic<uint32_t> AsyncWebRequestWrapper::_liveCount{ 0 };
+std::atomic<uint32_t> AsyncWebRequestWrapper::_peakLiveCount{ 0 };
+std::atomic<uint32_t> AsyncWebRequestWrapper::_abortedStreams{ 0 };
+
 AsyncWebRequestWrapper::AsyncWebRequestWrapper(AsyncWebServerRequest* request) :
     _request(request),
+    _response(nullptr),
+    _configuration(nullptr),
     _contentLength(0),
     _isChunked(false),
-	_isFinished(false)
+	_isFinished(false),
+    _renderConfig(false),
+    _admitted(false),
+    _sessionValid(false),
+    _selfOwned(false),
+    _disconnectArmed(false),
+    _form(nullptr),
+    _argIndex(nullptr)
 {
+    sendHeader("Server", "ESP Async Web Server");
+    sendHeader(asyncsrv::T_Cache_Control, "public,max-age=60");
+
+    uint32_t live_ = _liveCount.fetch_add(1) + 1;
+    uint32_t peak_ = _peakLiveCount.load();
+    while (live_ > peak_ && !_peakLiveCount.compare_exchange_weak(peak_, live_)) {
+    }
+}
 
+AsyncWebRequestWrapper::~AsyncWebRequestWrapper() {
+    // -- A streamed response ends with the handler that created the wrapper.
+    if (_content) {
+        _content->close();
+    }
+    delete _form;
+    delete _argIndex;
+    _liveCount.fetch_sub(1);
+}
+
+AsyncWebRequestWrapper* AsyncWebRequestWrapper::create(AsyncWebServerRequest* request) {
+    AsyncWebRequestWrapper* wrapper_ = new AsyncWebRequestWrapper(request);
+    wrapper_->armDisconnect(true);
+    return wrapper_;
+}
+
+AsyncWebRequestWrapper* AsyncWebRequestWrapper::adopt(AsyncWebRequestWrapper* wrapper) {
+    if (wrapper->_selfOwned) {
+        return wrapper;
+    }
+    AsyncWebRequestWrapper* wrapper_ = create(wrapper->_request);
+    wrapper_->_headers = std::move(wrapper->_headers);
+    wrapper_->_form = wrapper->_form;
+    wrapper_->_argIndex = wrapper->_argIndex;
+    wrapper->_form = nullptr;
+    wrapper->_argIndex = nullptr;
+    if (wrapper->_request->_tempObject == wrapper) {
+        wrapper->_request->_tempObject = wrapper_;
+    }
+    return wrapper_;
+}
+
+bool AsyncWebRequestWrapper::hasArg(const String& name) {
+    return argValue(name.c_str()) != nullptr;
+}
+
+String AsyncWebRequestWrapper::arg(const String name) {
+    const char* value_ = argValue(name.c_str());
+    return value_ ? String(value_) : String();
+}
+
+const char* AsyncWebRequestWrapper::argValue(const char* name) {
+    if (_form) {
+        return _form->value(name);
+    }
+
+    // -- validateForm() and the parameter update look up every argument, so the
+    //    linear search of the request parameters is replaced by one index.
+    if (_argIndex == nullptr) {
+        _argIndex = new AsyncArgIndex();
+        size_t count_ = _request->params();
+        _argIndex->reset(count_);
+        for (size_t i = 0; i < count_; i++) {
+            const AsyncWebParameter* param_ = _request->getParam(i);
+            if (param_ != nullptr && !param_->isFile()) {
+                _argIndex->add(param_->name().c_str(), param_->value().c_str());
+            }
+        }
+        _argIndex->setBuilt();
+    }
+    return _argIndex->find(name);
+}
+
+void AsyncWebRequestWrapper::parseBody(const uint8_t* data, size_t len, size_t index, size_t total) {
+    if (index == 0) {
+        delete _form;
+        delete _argIndex;
+        _argIndex = nullptr;
+        _form = new AsyncFormParser();
+        _form->begin(total);
+    }
+    if (_form == nullptr) {
+        return;
+    }
+    _form->feed(data, len);
+    if (index + len >= total) {
+        _form->finish();
+        DEBUGASYNC_PRINTF("AsyncWebRequestWrapper::parseBody: %u fields, overflow: %d\n",
+            (unsigned int)_form->count(), _form->isOverflow());
+    }
+}
+
+void AsyncWebRequestWrapper::armDisconnect(bool selfOwned) {
+    _selfOwned = _selfOwned || selfOwned;
+    if (_disconnectArmed) {
+        return;
+    }
+    _disconnectArmed = true;
     _request->onDisconnect([this]() {
-    });
+        this->handleDisconnect();
+        });
+}
 
-    sendHeader("Server", "ESP Async Web Server");
-    sendHeader(asyncsrv::T_Cache_Control, "public,max-age=60");
+void AsyncWebRequestWrapper::handleDisconnect() {
+    DEBUGASYNC_PRINTLN("AsyncWebRequestWrapper::handleDisconnect");
+    if (_configuration) {
+        if (_configuration->_webRequestWrapper == this) {
+            _configuration->abortRender();
+        }
+        else {
+            _configuration->releaseRequest(this);
+        }
+    }
+    if (_request->_tempObject == this) {
+        _request->_tempObject = nullptr;
+    }
+    DEBUGASYNC_PRINTF("    Live wrappers: %u\n", (unsigned int)_liveCount.load());
+    if (_selfOwned) {
+        release();
+    }
+}
+
+void AsyncWebRequestWrapper::release() {
+    if (_references.fetch_sub(1) == 1) {
+        delete this;
+    }
 }
 
 void AsyncWebRequestWrapper::send(int code, const char* content_type, const String& content) {
@@ -40,18 +279,29 @@ void AsyncWebRequestWrapper::send(int code, const char* content_type, const Stri
     DEBUGASYNC_PRINT("    Content length: "); DEBUGASYNC_PRINTLN(content.length());
 
     if (_isChunked) {
-        if (_configuration == nullptr) {
-            auto* stream_ = _request->beginResponseStream(content_type);
-            stream_->setCode(500);
-            stream_->print("Internal Server Error: No configuration for chunked response.");
-            for (const auto& h_ : _headers) stream_->addHeader(h_.first, h_.second);
-            _request->send(stream_);
-            return;
-        }
         _contentType = content_type;
-        _response = new AsyncChunkedResponse(_contentType, [this](uint8_t* buffer, size_t maxLen, size_t) {
-            return this->readChunk(buffer, maxLen);
-            });
+        if (_renderConfig) {
+            _response = new AsyncChunkedResponse(_contentType, [this](uint8_t* buffer, size_t maxLen, size_t) {
+                return this->readChunk(buffer, maxLen);
+                });
+        }
+        else {
+            // -- Content comes through sendContent(). The response shares the queue,
+            //    it may still be sending when the wrapper is gone.
+            _content = std::make_shared<AsyncContentQueue>();
+            pushContent(content);
+            std::shared_ptr<AsyncContentQueue> content_ = _content;
+            AsyncWebServerRequest* request_ = _request;
+            _response = new AsyncChunkedResponse(_contentType, [content_, request_](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+                if (content_->isOverflow()) {
+                    // -- Content was dropped, a complete looking page with a gap must not
+                    //    reach the client. AsyncTCP reports the disconnect as a later event.
+                    request_->client()->close(true);
+                    return 0;
+                }
+                return content_->read(buffer, maxLen);
+                });
+        }
         for (const auto& h_ : _headers) _response->addHeader(h_.first, h_.second);
         _response->setCode(code);
         _request->send(_response);
@@ -67,12 +317,53 @@ void AsyncWebRequestWrapper::send(int code, const char* content_type, const Stri
 }
 
 void AsyncWebRequestWrapper::sendHeader(const String& name, const String& value, bool first) {
+    // -- A later value replaces the default one, e.g. the Cache-Control set by the constructor.
+    if (!name.equalsIgnoreCase("Set-Cookie")) {
+        for (auto& h_ : _headers) {
+            if (h_.first.equalsIgnoreCase(name)) {
+                h_.second = value;
+                return;
+            }
+        }
+    }
     _headers.emplace_back(name, value);
 }
 
 void AsyncWebRequestWrapper::sendContent(const String& content) {
     DEBUGASYNC_PRINTLN("AsyncWebRequestWrapper::sendContent");
     DEBUGASYNC_PRINT("    Content length: "); DEBUGASYNC_PRINTLN(content.length());
+    if (!_content) {
+        return;
+    }
+    // -- An empty chunk ends the response, like with the synchronous web server.
+    if (content.length() == 0) {
+        _content->close();
+    }
+    else {
+        pushContent(content);
+    }
+}
+
+void AsyncWebRequestWrapper::pushContent(const String& content) {
+    bool overflow_ = _content->isOverflow();
+    if (!_content->push(content) && !overflow_ && _content->isOverflow()) {
+        DEBUGASYNC_PRINTLN("    Content queue full, response aborted");
+        _abortedStreams++;
+    }
+}
+
+bool AsyncWebRequestWrapper::waitContentSpace(size_t len, uint32_t timeoutMs) {
+    if (!_content) {
+        return false;
+    }
+    uint32_t start_ = millis();
+    while (!_content->fits(len)) {
+        if (_content->isClosed() || millis() - start_ >= timeoutMs) {
+            return false;
+        }
+        delay(1);
+    }
+    return !_content->isClosed();
 }
 
 void AsyncWebRequestWrapper::setContentLength(const size_t contentLength) {
@@ -88,11 +379,15 @@ void AsyncWebRequestWrapper::setContentLength(const size_t contentLength) {
 void AsyncWebRequestWrapper::stop() {
     DEBUGASYNC_PRINTLN("AsyncWebRequestWrapper::stop");
 	_isFinished = true;
+    if (_content) {
+        _content->close();
+    }
 
 }
 
 void AsyncWebRequestWrapper::setConfiguration(AsyncIotWebConf* configuration) {
     this->_configuration = configuration;
+    _renderConfig = configuration != nullptr;
     if (_configuration) {
         _configuration->resetChunkState();
     }
@@ -108,204 +403,1040 @@ size_t AsyncWebRequestWrapper::readChunk(uint8_t* buffer, size_t maxLen) {
     return 0;
 }
 
+void AsyncDeferredSave::takeArgs(AsyncWebRequestWrapper* webRequestWrapper) {
+    if (webRequestWrapper->_form != nullptr) {
+        // -- The decoded body and its index move along, nothing is copied.
+        _form = webRequestWrapper->_form;
+        webRequestWrapper->_form = nullptr;
+        return;
+    }
+    AsyncWebServerRequest* request_ = webRequestWrapper->_request;
+    size_t count_ = request_->params();
+    _args.reserve(count_);
+    for (size_t i = 0; i < count_; i++) {
+        const AsyncWebParameter* param_ = request_->getParam(i);
+        if (param_ != nullptr && !param_->isFile()) {
+            _args.emplace_back(param_->name(), param_->value());
+        }
+    }
+}
+
+String AsyncDeferredSave::arg(const String name) {
+    const char* value_ = argValue(name.c_str());
+    return value_ ? String(value_) : String();
+}
+
+const char* AsyncDeferredSave::argValue(const char* name) {
+    if (_form) {
+        return _form->value(name);
+    }
+    // -- The index points into _args, which is not changed after the copy.
+    if (!_index.isBuilt()) {
+        _index.reset(_args.size());
+        for (const auto& arg_ : _args) {
+            _index.add(arg_.first.c_str(), arg_.second.c_str());
+        }
+        _index.setBuilt();
+    }
+    return _index.find(name);
+}
+
+AsyncCaptivePortalHandler::AsyncCaptivePortalHandler(AsyncIotWebConf* iotWebConf) :
+    _iotWebConf(iotWebConf),
+    _locationIp(0)
+{
+    _location[0] = '\0';
+}
+
+bool AsyncCaptivePortalHandler::isProbe(const char* path) {
+    uint32_t hash_ = 2166136261u;
+    for (const char* p_ = path; *p_; p_++) {
+        hash_ = (hash_ ^ static_cast<uint8_t>(*p_)) * 16777619u;
+    }
+    for (const CaptivePortalProbe& probe_ : CAPTIVE_PORTAL_PROBES) {
+        if (probe_.hash == hash_ && strcmp(probe_.path, path) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AsyncCaptivePortalHandler::canHandle(AsyncWebServerRequest* request) const {
+    iotwebconf::NetworkState state_ = _iotWebConf->getState();
+    if (state_ != iotwebconf::ApMode && state_ != iotwebconf::NotConfigured) {
+        return false;
+    }
+    return isProbe(request->url().c_str());
+}
+
+void AsyncCaptivePortalHandler::handleRequest(AsyncWebServerRequest* request) {
+    if (!_iotWebConf->admitRequest(nullptr, AsyncIotWebConf::REQUEST_LIGHT)) {
+        AsyncIotWebConf::sendBusy(request);
+        return;
+    }
+
+    // -- The AP address rarely changes, so the Location header is built only once.
+    IPAddress ip_ = request->client()->localIP();
+    if (static_cast<uint32_t>(ip_) != _locationIp || _location[0] == '\0') {
+        snprintf(_location, sizeof(_location), "http://%u.%u.%u.%u/", ip_[0], ip_[1], ip_[2], ip_[3]);
+        _locationIp = static_cast<uint32_t>(ip_);
+    }
+
+    AsyncWebServerResponse* response_ = request->beginResponse_P(302, "text/html",
+        reinterpret_cast<const uint8_t*>(IOTWEBCONFASYNC_HTML_PORTAL_REDIRECT), sizeof(IOTWEBCONFASYNC_HTML_PORTAL_REDIRECT) - 1);
+    response_->addHeader("Location", _location);
+    response_->addHeader("Cache-Control", "no-store");
+    request->send(response_);
+}
+
+AsyncIotWebConfHandler::AsyncIotWebConfHandler(AsyncIotWebConf* iotWebConf, const char* configPath) :
+    _iotWebConf(iotWebConf),
+    _configPath(configPath),
+    _configPathLength(strlen(configPath))
+{
+}
+
+bool AsyncIotWebConfHandler::canHandle(AsyncWebServerRequest* request) const {
+    const String& url_ = request->url();
+    return url_.length() == _configPathLength && memcmp(url_.c_str(), _configPath, _configPathLength) == 0;
+}
+
+AsyncWebRequestWrapper* AsyncIotWebConfHandler::getWrapper(AsyncWebServerRequest* request) {
+    // -- The wrapper is created with the first body chunk or when the request is complete.
+    if (request->_tempObject == nullptr) {
+        request->_tempObject = AsyncWebRequestWrapper::create(request);
+    }
+    return static_cast<AsyncWebRequestWrapper*>(request->_tempObject);
+}
+
+void AsyncIotWebConfHandler::handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    const String& contentType_ = request->contentType();
+    if (!contentType_.startsWith(IOTWEBCONFASYNC_FORM_CONTENT_TYPE) &&
+        !contentType_.startsWith("application/x-www-form-urlencoded")) {
+        return;
+    }
+    getWrapper(request)->parseBody(data, len, index, total);
+}
+
+void AsyncIotWebConfHandler::handleRequest(AsyncWebServerRequest* request) {
+    AsyncWebRequestWrapper* wrapper_ = getWrapper(request);
+    if (wrapper_->isBodyOverflow()) {
+        request->send(413, "text/plain", "Form too large");
+        return;
+    }
+    _iotWebConf->handleConfig(wrapper_);
+}
+
+void AsyncIotWebConfHandler::handleNotFound(AsyncWebServerRequest* request) {
+    AsyncWebRequestWrapper wrapper_(request);
+    _iotWebConf->handleNotFound(&wrapper_);
+}
+
 AsyncIotWebConf::AsyncIotWebConf(const char* defaultThingName, DNSServer* dnsServer, 
     AsyncWebServerWrapper* webServerWrapper, const char* initialApPassword, const char* configVersion) :
-    IotWebConf(defaultThingName, dnsServer, webServerWrapper, initialApPassword, configVersion) {
+    IotWebConf(defaultThingName, dnsServer, webServerWrapper, initialApPassword, configVersion),
+    _asyncWebServerWrapper(webServerWrapper),
+    _configVersion(configVersion) {
+
+    _pageRevision.store(pageRandom());
 
 	resetChunkState();
 }
 
 void AsyncIotWebConf::handleConfig(AsyncWebRequestWrapper* webRequestWrapper) {
+    // -- The page is sent after this returns, so it needs a wrapper that lives until the
+    //    client disconnects. A wrapper owned by the caller is never deleted here.
+    webRequestWrapper = AsyncWebRequestWrapper::adopt(webRequestWrapper);
+
     if (this->getState() == iotwebconf::OnLine) {
-        // -- Authenticate
-        if (!webRequestWrapper->authenticate(
-            IOTWEBCONF_ADMIN_USER_NAME, this->getApPassword())) {
+        // -- Authenticate, a session cookie spares the following requests the credential check.
+        AsyncSessionAuth::Result auth_ = _auth.check(webRequestWrapper->_request,
+            IOTWEBCONF_ADMIN_USER_NAME, this->getApPassword());
+        if (auth_ == AsyncSessionAuth::SESSION_DENIED) {
             IOTWEBCONF_DEBUG_LINE(F("Requesting authentication."));
             webRequestWrapper->requestAuthentication();
             return;
         }
+        webRequestWrapper->_sessionValid = true;
+        if (auth_ == AsyncSessionAuth::SESSION_NEW) {
+            webRequestWrapper->sendHeader("Set-Cookie", _auth.createCookie(webRequestWrapper->_request,
+                IOTWEBCONF_ADMIN_USER_NAME, this->getApPassword()));
+        }
+    }
+
+    if (webRequestWrapper->hasArg("saveStatus")) {
+        sendSaveStatus(webRequestWrapper);
+        return;
+    }
+
+#if IOTWEBCONFASYNC_CONFIG_ETAG
+    // -- Checked before the admission, a 304 costs less than the busy response.
+    char etag_[32];
+    getConfigPageETag(etag_, sizeof(etag_));
+    if (webRequestWrapper->_request->method() == HTTP_GET && sendNotModified(webRequestWrapper, etag_)) {
+        return;
     }
+#endif
+
+    if (!admitRequest(webRequestWrapper, REQUEST_HEAVY)) {
+        DEBUGASYNC_PRINTLN("Config request rejected, sending busy response.");
+        sendBusy(webRequestWrapper->_request);
+        return;
+    }
+
 	_webRequestWrapper = webRequestWrapper;
+    if (_savingConfig.load()) {
+        // -- doLoop() is writing a save, it checked _webRequestWrapper before.
+        _webRequestWrapper = nullptr;
+        releaseRequest(webRequestWrapper);
+        sendBusy(webRequestWrapper->_request);
+        return;
+    }
     bool dataArrived = webRequestWrapper->hasArg("iotSave");
-    if (!dataArrived || !this->validateForm(webRequestWrapper)) {
+    bool valid_ = dataArrived && this->validateForm(webRequestWrapper);
+    if (dataArrived) {
+        // -- Error messages stay in the parameters until the next valid save.
+        _renderCacheBypass = !valid_;
+        if (!valid_) {
+            invalidateConfigPage();
+        }
+    }
+    if (!valid_) {
         // -- Display config portal
         IOTWEBCONF_DEBUG_LINE(F("Configuration page requested."));
 
+        if (isRenderOffloadBusy()) {
+            releaseRequest(webRequestWrapper);
+            sendBusy(webRequestWrapper->_request);
+            return;
+        }
+
         webRequestWrapper->setConfiguration(this);
+#if IOTWEBCONFASYNC_CONFIG_ETAG
+        // -- A page with validation errors must not be revalidated later.
+        if (dataArrived) {
+            webRequestWrapper->sendHeader("Cache-Control", "no-store");
+        }
+        else {
+            webRequestWrapper->sendHeader("Cache-Control", "no-cache, private");
+            webRequestWrapper->sendHeader("ETag", etag_);
+        }
+#else
         webRequestWrapper->sendHeader("Cache-Control", "no-cache, no-store, must-revalidate");
         webRequestWrapper->sendHeader("Pragma", "no-cache");
         webRequestWrapper->sendHeader("Expires", "-1");
+#endif
         webRequestWrapper->setContentLength(CONTENT_LENGTH_UNKNOWN);
+        _pageBytes = 0;
+        startRenderOffload();
         webRequestWrapper->send(200, "text/html; charset=UTF-8", "");
         webRequestWrapper->stop();
     }
     else {
+#if IOTWEBCONFASYNC_DEFER_SAVE
+        deferSave(webRequestWrapper);
+#else
+        uint32_t generation_ = _saveGeneration.fetch_add(1) + 1;
+        SaveResult result_ = writeConfig(webRequestWrapper);
+        if (result_ == SAVE_FAILED) {
+            _failedGeneration.store(generation_);
+            sendSaveFailed(webRequestWrapper->_request, generation_);
+        }
+        else {
+            _savedGeneration.store(generation_);
+            if (result_ == SAVE_STORED) {
+                DEBUGASYNC_PRINTLN("Configuration saved, sending saved page.");
+                sendSaved(webRequestWrapper->_request, generation_);
+            }
+        }
+#endif
+        releaseRequest(webRequestWrapper);
+        // -- Nothing is rendered for this client, a queued save must not wait for it.
+        _webRequestWrapper = nullptr;
+    }
+
+}
+
+void AsyncIotWebConf::deferSave(AsyncWebRequestWrapper* webRequestWrapper) {
+    uint32_t generation_ = _saveGeneration.fetch_add(1) + 1;
+    AsyncDeferredSave* save_ = new AsyncDeferredSave(generation_);
+    save_->takeArgs(webRequestWrapper);
+
+    // -- Every post carries the whole form, so a newer save replaces one doLoop() did not write yet.
+    AsyncDeferredSave* replaced_ = _pendingSave.exchange(save_);
+    if (replaced_ != nullptr) {
+        _metrics.coalescedSaves++;
+        delete replaced_;
+    }
+    DEBUGASYNC_PRINTF("Configuration save %u queued.\n", (unsigned int)generation_);
+    sendSaved(webRequestWrapper->_request, generation_);
+}
+
+void AsyncIotWebConf::sendSaved(AsyncWebServerRequest* request, uint32_t generation) {
+    AsyncWebServerResponse* response_ = request->beginResponse_P(200, "text/html",
+        reinterpret_cast<const uint8_t*>(IOTWEBCONFASYNC_HTML_SAVED), sizeof(IOTWEBCONFASYNC_HTML_SAVED) - 1);
+    response_->addHeader("X-Config-Generation", String(generation));
+    response_->addHeader("Cache-Control", "no-store");
+    request->send(response_);
+}
+
+void AsyncIotWebConf::sendSaveFailed(AsyncWebServerRequest* request, uint32_t generation) {
+    AsyncWebServerResponse* response_ = request->beginResponse_P(500, "text/html",
+        reinterpret_cast<const uint8_t*>(IOTWEBCONFASYNC_HTML_SAVE_FAILED), sizeof(IOTWEBCONFASYNC_HTML_SAVE_FAILED) - 1);
+    response_->addHeader("X-Config-Generation", String(generation));
+    response_->addHeader("Cache-Control", "no-store");
+    request->send(response_);
+}
+
+void AsyncIotWebConf::sendSaveStatus(AsyncWebRequestWrapper* webRequestWrapper) {
+    char json_[80];
+    snprintf(json_, sizeof(json_), "{\"generation\":%u,\"saved\":%u,\"failed\":%u}",
+        (unsigned int)_saveGeneration.load(), (unsigned int)_savedGeneration.load(), (unsigned int)_failedGeneration.load());
+    AsyncWebServerResponse* response_ = webRequestWrapper->_request->beginResponse(200, "application/json", json_);
+    response_->addHeader("Cache-Control", "no-store");
+    webRequestWrapper->_request->send(response_);
+}
+
+void AsyncIotWebConf::getConfigPageETag(char* etag, size_t size) {
+    // -- What the page depends on besides the parameters, the format provider is
+    //    covered by the revision setHtmlFormatProvider() changes.
+    uint32_t hash_ = probeHash(this->getThingName());
+    hash_ = probeHash(_configVersion != nullptr ? _configVersion : "", hash_);
+    hash_ = (hash_ ^ this->getState()) * 16777619u;
+    snprintf(etag, size, "\"%08lx-%08lx\"", (unsigned long)_pageRevision.load(), (unsigned long)hash_);
+}
+
+bool AsyncIotWebConf::sendNotModified(AsyncWebRequestWrapper* webRequestWrapper, const char* etag) {
+    const AsyncWebHeader* header_ = webRequestWrapper->_request->getHeader("If-None-Match");
+    if (header_ == nullptr) {
+        return false;
+    }
+    if (!matchesETag(header_->value().c_str(), etag)) {
+        return false;
+    }
+    AsyncWebServerResponse* response_ = webRequestWrapper->_request->beginResponse(304);
+    webRequestWrapper->sendHeader("Cache-Control", "no-cache, private");
+    webRequestWrapper->sendHeader("ETag", etag);
+    for (const auto& h_ : webRequestWrapper->_headers) response_->addHeader(h_.first, h_.second);
+    webRequestWrapper->_request->send(response_);
+    _metrics.notModified++;
+    return true;
+}
+
+AsyncIotWebConf::SaveResult AsyncIotWebConf::writeConfig(iotwebconf::WebRequestWrapper* webRequestWrapper) {
+    iotwebconf::ParameterGroup* root_ = getRootParameterGroup();
+    // -- The values change in all cases below, pages sent so far are outdated.
+    invalidateConfigPage();
+    // -- The first configuration goes through IotWebConf, it writes the config
+    //    version to EEPROM and leaves the not configured state.
+    if (_storage == nullptr || getState() == iotwebconf::NotConfigured) {
         IotWebConf::handleConfig(webRequestWrapper);
-		DEBUGASYNC_PRINTLN("Configuration saved, sending saved page.");
+        // -- The config is in EEPROM already, the storage takes it over at the next init() otherwise.
+        if (_storage != nullptr) {
+            _storage->storeItems(root_);
+        }
+        return SAVE_PAGE_SENT;
     }
 
+    AsyncConfigItemAccess::updateItem(root_, webRequestWrapper);
+    if (!_storage->storeItems(root_)) {
+        DEBUGASYNC_PRINTLN("AsyncIotWebConf::writeConfig: config storage failed");
+        return SAVE_FAILED;
+    }
+    setApTimeoutMs(atoi(getApTimeoutParameter()->valueBuffer) * 1000);
+    if (_configSavedCallback) {
+        _configSavedCallback();
+    }
+    return SAVE_STORED;
 }
 
-size_t AsyncIotWebConf::getNextChunk(uint8_t* buffer, size_t maxLen) {
-    DEBUGASYNC_PRINTLN("AsyncIotWebConf::getNextChunk");
-    DEBUGASYNC_PRINT("  Current chunk step: "); DEBUGASYNC_PRINTLN(_currentChunkStep);
-    bool dataArrived_ = false;
-    size_t written_ = 0;
+bool AsyncIotWebConf::init() {
+    bool validConfig_ = IotWebConf::init();
+    if (_storage == nullptr) {
+        return validConfig_;
+    }
+    if (!_storage->begin(_configVersion)) {
+        DEBUGASYNC_PRINTLN("AsyncIotWebConf::init: config storage not available");
+        _storage = nullptr;
+        return validConfig_;
+    }
 
-    const size_t MAX_INTERNAL_BUFFER = 32000;
+    iotwebconf::ParameterGroup* root_ = getRootParameterGroup();
+    size_t loaded_ = _storage->loadItems(root_);
+    DEBUGASYNC_PRINTF("AsyncIotWebConf::init: %u values from the config storage\n", (unsigned int)loaded_);
+    if (loaded_ > 0) {
+        setApTimeoutMs(atoi(getApTimeoutParameter()->valueBuffer) * 1000);
+    }
+    else if (validConfig_) {
+        // -- Take over the config from EEPROM.
+        _storage->storeItems(root_);
+    }
+    return validConfig_;
+}
 
-    while (_currentChunkStep != CHUNK_DONE && written_ < maxLen) {
-        yield();
+bool AsyncIotWebConf::saveConfig() {
+    // -- The storage is written first, the config saved callback sees the stored values.
+    bool stored_ = _storage == nullptr || _storage->storeItems(getRootParameterGroup());
+    if (!stored_) {
+        DEBUGASYNC_PRINTLN("AsyncIotWebConf::saveConfig: config storage failed");
+    }
+    IotWebConf::saveConfig();
+    invalidateConfigPage();
+    return stored_;
+}
 
-        // Generate new chunk data if buffer is empty or exhausted
-        if (_chunkBufferPos >= _chunkBuffer.length()) {
-            _chunkBuffer = "";
-            _chunkBufferPos = 0;
+void AsyncIotWebConf::setConfigSavedCallback(std::function<void()> func) {
+    _configSavedCallback = func;
+    IotWebConf::setConfigSavedCallback(func);
+}
 
-            HtmlChunkCallback writer_ = [&](const char* data, size_t len) -> size_t {
-                yield();
+void AsyncIotWebConf::doLoop() {
+    if (_pendingSave.load() != nullptr) {
+        applyPendingSave();
+    }
+    IotWebConf::doLoop();
+}
 
-                // Check how much we can actually accept
-                size_t available = MAX_INTERNAL_BUFFER - _chunkBuffer.length();
-                if (available == 0) {
-                    DEBUGASYNC_PRINTF("  Writer: Buffer full! (%u bytes)\n", (unsigned int)_chunkBuffer.length());
-                    return 0;  // Cannot accept any data
-                }
+void AsyncIotWebConf::applyPendingSave() {
+    // -- handleConfig() sets _webRequestWrapper before it checks _savingConfig, this
+    //    checks in the opposite order, so a save and a render never overlap.
+    _savingConfig.store(true);
+    if (_webRequestWrapper.load() != nullptr || _offloadState.load() != OFFLOAD_IDLE) {
+        _savingConfig.store(false);
+        return;
+    }
+    AsyncDeferredSave* save_ = _pendingSave.exchange(nullptr);
+    if (save_ != nullptr) {
+        DEBUGASYNC_PRINTF("AsyncIotWebConf::doLoop: writing configuration save %u\n", (unsigned int)save_->getGeneration());
+        if (writeConfig(save_) == SAVE_FAILED) {
+            _failedGeneration.store(save_->getGeneration());
+        }
+        else {
+            _savedGeneration.store(save_->getGeneration());
+        }
+        delete save_;
+    }
+    _savingConfig.store(false);
+}
 
-                // Accept as much as we can
-                size_t toWrite = (len < available) ? len : available;
+void AsyncIotWebConf::handleNotFound(AsyncWebRequestWrapper* webRequestWrapper) {
+    if (!admitRequest(webRequestWrapper, REQUEST_LIGHT)) {
+        sendBusy(webRequestWrapper->_request);
+        return;
+    }
+    IotWebConf::handleNotFound(webRequestWrapper);
+}
 
-                size_t oldLen = _chunkBuffer.length();
-                _chunkBuffer.concat(data, toWrite);
+bool AsyncIotWebConf::handleCaptivePortal(AsyncWebRequestWrapper* webRequestWrapper) {
+    if (!admitRequest(webRequestWrapper, REQUEST_LIGHT)) {
+        sendBusy(webRequestWrapper->_request);
+        return true;
+    }
+    return IotWebConf::handleCaptivePortal(webRequestWrapper);
+}
 
-                // Verify it worked
-                size_t actuallyWritten = _chunkBuffer.length() - oldLen;
-                if (actuallyWritten != toWrite) {
-                    DEBUGASYNC_PRINTF("  Writer: Partial write! Requested: %u, Written: %u\n",
-                        (unsigned int)toWrite, (unsigned int)actuallyWritten);
-                }
+void AsyncIotWebConf::setupCaptivePortalHandler() {
+    if (_captivePortalHandler != nullptr || _asyncWebServerWrapper == nullptr) {
+        return;
+    }
+    // -- The web server takes ownership of the handler.
+    _captivePortalHandler = new AsyncCaptivePortalHandler(this);
+    _asyncWebServerWrapper->getServer()->addHandler(_captivePortalHandler);
+}
 
-                return actuallyWritten;
-                };
+void AsyncIotWebConf::setupWebHandlers(const char* configPath) {
+    if (_webHandler != nullptr || _asyncWebServerWrapper == nullptr) {
+        return;
+    }
+    AsyncWebServer* server_ = _asyncWebServerWrapper->getServer();
 
-            switch (_currentChunkStep) {
-            case CHUNK_HEAD:
-                _chunkBuffer = this->getHtmlFormatProvider()->getHead();
-                _chunkBuffer.replace("{v}", String("Config ") + this->getThingName());
-                _lastStepFinished = true;
-                break;
-            case CHUNK_SCRIPT:
-                _chunkBuffer = this->getHtmlFormatProvider()->getScript();
-                _lastStepFinished = true;
-                break;
-            case CHUNK_STYLE:
-                _chunkBuffer = this->getHtmlFormatProvider()->getStyle();
-                _lastStepFinished = true;
-                break;
-            case CHUNK_HEADEXT:
-                _chunkBuffer = this->getHtmlFormatProvider()->getHeadExtension();
-                _lastStepFinished = true;
-                break;
-            case CHUNK_HEADEND:
-                _chunkBuffer = this->getHtmlFormatProvider()->getHeadEnd();
-                _lastStepFinished = true;
-                break;
-            case CHUNK_FORMSTART:
-                _chunkBuffer = this->getHtmlFormatProvider()->getFormStart();
-                _lastStepFinished = true;
-                break;
-            case CHUNK_SYSTEMPARAMS:
-                _lastStepFinished = this->getSystemParameterGroup()->renderHtml(dataArrived_, _webRequestWrapper, writer_);
-                DEBUGASYNC_PRINT("  CHUNK_SYSTEMPARAMS finish: "); DEBUGASYNC_PRINTLN(_lastStepFinished);
-                break;
-            case CHUNK_CUSTOMPARAMS:
-                _lastStepFinished = this->getCustomParameterGroup()->renderHtml(dataArrived_, _webRequestWrapper, writer_);
-                DEBUGASYNC_PRINT("  CHUNK_CUSTOMPARAMS finish: "); DEBUGASYNC_PRINTLN(_lastStepFinished);
-                break;
-            case CHUNK_FORMEND:
-                _chunkBuffer = this->getHtmlFormatProvider()->getFormEnd();
-                _lastStepFinished = true;
-                break;
-            case CHUNK_UPDATE:
-                _chunkBuffer = getUpdateLinkHtml();
-                _lastStepFinished = true;
-                break;
-            case CHUNK_CONFIGVER:
-                _chunkBuffer = getConfigVersionHtml();
-                _lastStepFinished = true;
-                break;
-            case CHUNK_END:
-                _chunkBuffer = this->getHtmlFormatProvider()->getEnd();
-                _lastStepFinished = true;
-                break;
-            default:
-                _chunkBuffer = "";
-                _lastStepFinished = true;
+    setupCaptivePortalHandler();
+
+    _webHandler = new AsyncIotWebConfHandler(this, configPath);
+    server_->addHandler(_webHandler);
+
+    AsyncIotWebConfHandler* handler_ = _webHandler;
+    server_->onNotFound([handler_](AsyncWebServerRequest* request) {
+        handler_->handleNotFound(request);
+        });
+}
+
+void AsyncIotWebConf::setAdmissionLimits(size_t minFreeHeapRender, size_t minFreeHeapLight) {
+    _minFreeHeapRender = minFreeHeapRender;
+    _minFreeHeapLight = minFreeHeapLight;
+}
+
+bool AsyncIotWebConf::admitRequest(AsyncWebRequestWrapper* webRequestWrapper, RequestWeight weight) {
+    size_t budget_ = getFreeHeapBudget();
+    if (budget_ < _metrics.minFreeHeapBudget) {
+        _metrics.minFreeHeapBudget = budget_;
+    }
+
+    if (weight == REQUEST_LIGHT) {
+        if (budget_ < _minFreeHeapLight) {
+            DEBUGASYNC_PRINTF("Admission: light request rejected, largest free block %u bytes\n", (unsigned int)budget_);
+            _metrics.rejectedRequests++;
+            return false;
+        }
+        return true;
+    }
+
+    if (_activeRenders >= IOTWEBCONFASYNC_MAX_CONCURRENT_RENDERS || budget_ < _minFreeHeapRender) {
+        DEBUGASYNC_PRINTF("Admission: render rejected, active: %u, largest free block %u bytes\n",
+            (unsigned int)_activeRenders, (unsigned int)budget_);
+        _metrics.rejectedRequests++;
+        return false;
+    }
+
+    _activeRenders++;
+    _metrics.admittedRenders++;
+    if (_activeRenders > _metrics.peakActiveRenders) {
+        _metrics.peakActiveRenders = _activeRenders;
+    }
+    webRequestWrapper->_admitted = true;
+    webRequestWrapper->_configuration = this;
+
+    // -- Give the slot back if the client goes away before the page is complete.
+    webRequestWrapper->armDisconnect(false);
+    return true;
+}
+
+void AsyncIotWebConf::releaseRequest(AsyncWebRequestWrapper* webRequestWrapper) {
+    if (webRequestWrapper == nullptr || !webRequestWrapper->_admitted) {
+        return;
+    }
+    if (webRequestWrapper == _webRequestWrapper) {
+        cancelRenderOffload();
+    }
+    webRequestWrapper->_admitted = false;
+    if (_activeRenders > 0) {
+        _activeRenders--;
+    }
+}
+
+void AsyncIotWebConf::sendBusy(AsyncWebServerRequest* request) {
+    AsyncWebServerResponse* response_ = request->beginResponse_P(503, "text/html",
+        reinterpret_cast<const uint8_t*>(IOTWEBCONFASYNC_HTML_BUSY), sizeof(IOTWEBCONFASYNC_HTML_BUSY) - 1);
+    response_->addHeader("Retry-After", IOTWEBCONFASYNC_STR(IOTWEBCONFASYNC_RETRY_AFTER_SECONDS));
+    response_->addHeader("Cache-Control", "no-store");
+    request->send(response_);
+}
+
+size_t AsyncIotWebConf::getFreeHeapBudget() {
+    // -- The largest free block matters more than the total free heap,
+    //    a fragmented heap cannot hold the render buffers.
+#ifdef ESP32
+    return ESP.getMaxAllocHeap();
+#elif defined(ESP8266)
+    return ESP.getMaxFreeBlockSize();
+#else
+    return SIZE_MAX;
+#endif
+}
+
+size_t AsyncIotWebConf::getNextChunk(uint8_t* buffer, size_t maxLen) {
+    DEBUGASYNC_PRINTLN("AsyncIotWebConf::getNextChunk");
+    uint32_t start_ = micros();
+    size_t written_;
+
+    if (_offloadState.load(std::memory_order_acquire) != OFFLOAD_IDLE) {
+        // -- The render task owns the chunk state, only take what it produced.
+        written_ = drainRenderOffload(buffer, maxLen);
+    }
+    else if (_webRequestWrapper == nullptr) {
+        // -- The render was aborted, there is nothing left to send.
+        return 0;
+    }
+    else if (isChunkDone()) {
+        // -- The last step is flushed together with other data, the response
+        //    is only terminated by the call after it.
+        DEBUGASYNC_PRINTLN("All chunks sent, resetting chunk state.");
+        DEBUGASYNC_PRINTF("  Max chunk size sent: %u bytes\n", (unsigned int)_maxChunkSize);
+        DEBUGASYNC_PRINTF("  Total bytes sent: %u bytes\n", (unsigned int)_totalBytesSent);
+        _metrics.lastPageBytes = _pageBytes;
+        releaseRequest(_webRequestWrapper);
+        resetChunkState();
+        // -- The page is complete, the client may keep its connection open.
+        _webRequestWrapper = nullptr;
+        return 0;
+    }
+    else {
+        written_ = renderChunk(buffer, maxLen);
+        if (written_ == 0 && !isChunkDone()) {
+            // -- An empty chunk ends the response, the rest of the page is lost.
+            DEBUGASYNC_PRINTLN("No data before the page was complete, response truncated.");
+            _metrics.truncatedPages++;
+        }
+    }
+
+    _metrics.renderLatency.record(micros() - start_);
+    recordChunk(written_);
+    return written_;
+}
+
+void AsyncIotWebConf::recordChunk(size_t written) {
+    _metrics.chunkCalls++;
+    if (written == RESPONSE_TRY_AGAIN) {
+        _metrics.emptyChunkCalls++;
+    }
+    else if (written > 0) {
+        _metrics.chunkBytes += written;
+        _metrics.chunkSize.record(written);
+        _pageBytes += written;
+    }
+}
+
+size_t AsyncIotWebConf::renderChunk(uint8_t* buffer, size_t maxLen) {
+    size_t written_ = 0;
+    _sliceStart = micros();
+
+    while (!isChunkDone() && written_ < maxLen) {
+        // Generate new chunk data if buffer is empty or exhausted
+        if (_chunkBufferPos >= getChunkLength()) {
+            // -- Give the AsyncTCP task back once the budget is used up, the
+            //    step cursor is kept and rendering resumes with the next callback.
+            if (written_ > 0 && isRenderBudgetExceeded()) {
+                DEBUGASYNC_PRINTLN("  Render budget used up, continuing next call");
                 break;
             }
 
+            _chunkBuffer = "";
+            _chunkView = nullptr;
+            _chunkViewLength = 0;
             _chunkBufferPos = 0;
-            _maxChunkSize = max(_maxChunkSize, _chunkBuffer.length());
+
+            HtmlChunkCallback writer_ = [this](const char* data, size_t len) -> size_t {
+                return this->writeChunkData(data, len);
+                };
+
+            renderChunkStep(writer_);
+
+            _chunkBufferPos = 0;
+            size_t length_ = getChunkLength();
+            _maxChunkSize = max(_maxChunkSize, length_);
 
             DEBUGASYNC_PRINTF("  Generated chunk data, length: %u bytes, stepFinished: %d\n",
-                (unsigned int)_chunkBuffer.length(), _lastStepFinished);
+                (unsigned int)length_, _lastStepFinished);
 
-            if (_chunkBuffer.length() == 0 && _lastStepFinished) {
+            if (length_ == 0 && _lastStepFinished) {
                 DEBUGASYNC_PRINTLN("  Empty chunk and step finished, moving to next step");
-                _currentChunkStep = static_cast<ChunkStep>(_currentChunkStep + 1);
+                nextChunkStep(false);
                 continue;
             }
 
-            if (_chunkBuffer.length() == 0 && !_lastStepFinished) {
+            if (length_ == 0 && !_lastStepFinished) {
                 DEBUGASYNC_PRINTLN("  Step incomplete but no data generated, will retry next call");
                 break;
             }
         }
 
-        DEBUGASYNC_PRINTF("  Requested max chunk length: %u bytes\n", (unsigned int)maxLen);
-        DEBUGASYNC_PRINTF("  Chunk buffer length: %u bytes\n", (unsigned int)_chunkBuffer.length());
-        DEBUGASYNC_PRINTF("  Chunk buffer pos: %u bytes\n", (unsigned int)_chunkBufferPos);
-
-        size_t toCopy_ = std::min(maxLen - written_, _chunkBuffer.length() - _chunkBufferPos);
-        memcpy(buffer + written_, _chunkBuffer.c_str() + _chunkBufferPos, toCopy_);
+        size_t toCopy_ = std::min(maxLen - written_, getChunkLength() - _chunkBufferPos);
+        memcpy(buffer + written_, getChunkData() + _chunkBufferPos, toCopy_);
         _chunkBufferPos += toCopy_;
         written_ += toCopy_;
         _totalBytesSent += toCopy_;
 
         DEBUGASYNC_PRINTF("  Copied %u bytes, total written: %u bytes\n", (unsigned int)toCopy_, (unsigned int)written_);
 
-        if (_chunkBufferPos >= _chunkBuffer.length()) {
-            DEBUGASYNC_PRINTLN("  Current chunk buffer completely sent");
+        if (_chunkBufferPos >= getChunkLength() && _lastStepFinished) {
+            DEBUGASYNC_PRINTLN("  Step was finished, moving to next step");
+            nextChunkStep(true);
+        }
+    }
+
+    return written_;
+}
 
-            if (_lastStepFinished) {
-                DEBUGASYNC_PRINTLN("  Step was finished, moving to next step");
-                _currentChunkStep = static_cast<ChunkStep>(_currentChunkStep + 1);
-            }
-            else {
-                DEBUGASYNC_PRINTLN("  Step not finished, will generate more data on next call");
+void AsyncIotWebConf::renderChunkStep(HtmlChunkCallback& writer) {
+    switch (_currentChunkStep) {
+    case CHUNK_HEAD:
+        renderHeadChunk();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_SCRIPT:
+        _chunkBuffer = this->getHtmlFormatProvider()->getScript();
+        appendFormStreamScript();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_STYLE:
+        _chunkBuffer = this->getHtmlFormatProvider()->getStyle();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_HEADEXT:
+        _chunkBuffer = this->getHtmlFormatProvider()->getHeadExtension();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_HEADEND:
+        _chunkBuffer = this->getHtmlFormatProvider()->getHeadEnd();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_FORMSTART:
+        _chunkBuffer = this->getHtmlFormatProvider()->getFormStart();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_SYSTEMPARAMS:
+        _lastStepFinished = renderGroup(this->getSystemParameterGroup(), writer);
+        DEBUGASYNC_PRINT("  CHUNK_SYSTEMPARAMS finish: "); DEBUGASYNC_PRINTLN(_lastStepFinished);
+        break;
+    case CHUNK_CUSTOMPARAMS:
+        _lastStepFinished = renderGroup(this->getCustomParameterGroup(), writer);
+        DEBUGASYNC_PRINT("  CHUNK_CUSTOMPARAMS finish: "); DEBUGASYNC_PRINTLN(_lastStepFinished);
+        break;
+    case CHUNK_FORMEND:
+        _chunkBuffer = this->getHtmlFormatProvider()->getFormEnd();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_UPDATE:
+        _chunkBuffer = getUpdateLinkHtml();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_CONFIGVER:
+        _chunkBuffer = getConfigVersionHtml();
+        _lastStepFinished = true;
+        break;
+    case CHUNK_END:
+        _chunkBuffer = this->getHtmlFormatProvider()->getEnd();
+        _lastStepFinished = true;
+        break;
+    default:
+        _chunkBuffer = "";
+        _lastStepFinished = true;
+        break;
+    }
+}
+
+bool AsyncIotWebConf::isChunkDone() const {
+    return _currentChunkStep == CHUNK_DONE;
+}
+
+void AsyncIotWebConf::nextChunkStep(bool afterCopy) {
+    _currentChunkStep = static_cast<ChunkStep>(_currentChunkStep + 1);
+}
+
+size_t AsyncIotWebConf::writeChunkData(const char* data, size_t len) {
+    const size_t MAX_INTERNAL_BUFFER = 32000;
+
+    // -- Over budget, refuse the whole write so renderHtml() resumes with it later.
+    //    At least one write per step is accepted to guarantee progress.
+    if (_chunkBuffer.length() > 0 && isRenderBudgetExceeded()) {
+        return 0;
+    }
+
+    // Check how much we can actually accept
+    size_t available = MAX_INTERNAL_BUFFER - _chunkBuffer.length();
+    if (available == 0) {
+        DEBUGASYNC_PRINTF("  Writer: Buffer full! (%u bytes)\n", (unsigned int)_chunkBuffer.length());
+        return 0;  // Cannot accept any data
+    }
+
+    // Accept as much as we can
+    size_t toWrite = (len < available) ? len : available;
+
+    size_t oldLen = _chunkBuffer.length();
+    _chunkBuffer.concat(data, toWrite);
+
+    // Verify it worked
+    size_t actuallyWritten = _chunkBuffer.length() - oldLen;
+    if (actuallyWritten != toWrite) {
+        DEBUGASYNC_PRINTF("  Writer: Partial write! Requested: %u, Written: %u\n",
+            (unsigned int)toWrite, (unsigned int)actuallyWritten);
+    }
+
+    return actuallyWritten;
+}
+
+const AsyncIotWebConfMetrics& AsyncIotWebConf::getMetrics() {
+    // -- Streamed responses do not belong to a configuration, their aborts are counted by the wrapper.
+    _metrics.abortedStreams = AsyncWebRequestWrapper::getAbortedStreams();
+    return _metrics;
+}
+
+void AsyncIotWebConf::setRenderBudget(uint32_t budgetUs) {
+    _renderBudgetUs = budgetUs;
+}
+
+bool AsyncIotWebConf::isRenderBudgetExceeded() const {
+    return _renderBudgetUs > 0 && static_cast<uint32_t>(micros() - _sliceStart) >= _renderBudgetUs;
+}
+
+bool AsyncIotWebConf::enableRenderOffload(int8_t core) {
+#if IOTWEBCONFASYNC_RENDER_OFFLOAD == 1 && defined(ESP32)
+    if (_offloadTask != nullptr) {
+        return true;
+    }
+    if (core < 0) {
+        core = xPortGetCoreID() == 0 ? 1 : 0;
+    }
+    _offloadQueue = new AsyncSpscQueue(IOTWEBCONFASYNC_OFFLOAD_QUEUE_SIZE);
+    TaskHandle_t task_ = nullptr;
+    if (xTaskCreatePinnedToCore(renderOffloadTask, "iwcRender", IOTWEBCONFASYNC_OFFLOAD_STACK_SIZE,
+        this, IOTWEBCONFASYNC_OFFLOAD_PRIORITY, &task_, core) != pdPASS) {
+        DEBUGASYNC_PRINTLN("Render offload: task could not be created");
+        delete _offloadQueue;
+        _offloadQueue = nullptr;
+        return false;
+    }
+    _offloadTask = task_;
+    return true;
+#else
+    (void)core;
+    return false;
+#endif
+}
+
+bool AsyncIotWebConf::isRenderOffloadBusy() const {
+    // -- A cancelled render is still winding down in the render task.
+    return _offloadState.load(std::memory_order_acquire) != OFFLOAD_IDLE;
+}
+
+void AsyncIotWebConf::startRenderOffload() {
+#if IOTWEBCONFASYNC_RENDER_OFFLOAD == 1 && defined(ESP32)
+    if (_offloadTask == nullptr) {
+        return;
+    }
+    _offloadQueue->clear();
+    // -- handleConfig() adopted the wrapper, so it is self owned.
+    _offloadWrapper = _webRequestWrapper;
+    _offloadWrapper->retain();
+    _offloadState.store(OFFLOAD_RUNNING, std::memory_order_release);
+    xTaskNotifyGive(static_cast<TaskHandle_t>(_offloadTask));
+#endif
+}
+
+void AsyncIotWebConf::cancelRenderOffload() {
+    uint8_t expected_ = OFFLOAD_RUNNING;
+    if (_offloadState.compare_exchange_strong(expected_, OFFLOAD_CANCELLED)) {
+        // -- The render task resets the chunk state when it sees the cancel.
+        return;
+    }
+    if (expected_ == OFFLOAD_FINISHED) {
+        _offloadState.store(OFFLOAD_IDLE, std::memory_order_release);
+        resetChunkState();
+    }
+}
+
+void AsyncIotWebConf::abortRender() {
+    AsyncWebRequestWrapper* webRequestWrapper_ = _webRequestWrapper;
+    if (webRequestWrapper_ == nullptr) {
+        return;
+    }
+    // -- The request stays admitted until its last chunk was sent.
+    bool inFlight_ = webRequestWrapper_->_admitted;
+    bool offloaded_ = _offloadState.load(std::memory_order_acquire) != OFFLOAD_IDLE;
+
+    releaseRequest(webRequestWrapper_);
+    if (!offloaded_) {
+        resetChunkState();
+    }
+    // -- An offloaded render is not waited for: the render task resets the chunk
+    //    state when it sees the cancel and drops its reference to the wrapper.
+    //    Until then handleConfig() answers with the busy page.
+    _webRequestWrapper = nullptr;
+
+    if (inFlight_) {
+        _metrics.abortedRenders++;
+        DEBUGASYNC_PRINTLN("Render aborted, client disconnected");
+    }
+}
+
+size_t AsyncIotWebConf::drainRenderOffload(uint8_t* buffer, size_t maxLen) {
+    uint32_t start_ = micros();
+    do {
+        size_t len_ = _offloadQueue->pop(buffer, maxLen);
+        if (len_ > 0) {
+            return len_;
+        }
+        uint8_t state_ = _offloadState.load(std::memory_order_acquire);
+        if (state_ == OFFLOAD_FINISHED) {
+            // -- Data pushed before the state change is visible now.
+            len_ = _offloadQueue->pop(buffer, maxLen);
+            if (len_ > 0) {
+                return len_;
             }
-            break;
+            DEBUGASYNC_PRINTLN("Render offload: all chunks sent");
+            _metrics.lastPageBytes = _pageBytes;
+            _offloadState.store(OFFLOAD_IDLE, std::memory_order_release);
+            releaseRequest(_webRequestWrapper);
+            resetChunkState();
+            _webRequestWrapper = nullptr;
+            return 0;
         }
-        else {
-            DEBUGASYNC_PRINTLN("  More data in buffer, will continue next call");
-            break;
+        if (state_ != OFFLOAD_RUNNING) {
+            return 0;
+        }
+    } while (micros() - start_ < IOTWEBCONFASYNC_OFFLOAD_WAIT_US);
+
+    // -- The render task is behind, the response polls again later.
+    return RESPONSE_TRY_AGAIN;
+}
+
+void AsyncIotWebConf::produceRenderOffload(uint8_t* buffer, size_t maxLen) {
+#if IOTWEBCONFASYNC_RENDER_OFFLOAD == 1 && defined(ESP32)
+    while (!isChunkDone() && _offloadState.load(std::memory_order_acquire) == OFFLOAD_RUNNING) {
+        size_t len_ = renderChunk(buffer, maxLen);
+        size_t pos_ = 0;
+        while (pos_ < len_) {
+            size_t pushed_ = _offloadQueue->push(buffer + pos_, len_ - pos_);
+            pos_ += pushed_;
+            if (pushed_ == 0) {
+                if (_offloadState.load(std::memory_order_acquire) != OFFLOAD_RUNNING) {
+                    break;
+                }
+                // -- Queue full, wait for the AsyncTCP task to drain it.
+                vTaskDelay(1);
+            }
         }
     }
 
-    if (_currentChunkStep == CHUNK_DONE) {
-        DEBUGASYNC_PRINTLN("All chunks sent, resetting chunk state.");
-        DEBUGASYNC_PRINTF("  Max chunk size sent: %u bytes\n", (unsigned int)_maxChunkSize);
-        DEBUGASYNC_PRINTF("  Total bytes sent: %u bytes\n", (unsigned int)_totalBytesSent);
+    // -- The wrapper may have lost its client already, the task drops it before
+    //    the state change makes the chunk state available again.
+    AsyncWebRequestWrapper* webRequestWrapper_ = _offloadWrapper;
+    _offloadWrapper = nullptr;
+    uint8_t expected_ = OFFLOAD_RUNNING;
+    if (!_offloadState.compare_exchange_strong(expected_, OFFLOAD_FINISHED)) {
+        DEBUGASYNC_PRINTLN("Render offload: cancelled");
         resetChunkState();
-        return 0;
+        webRequestWrapper_->release();
+        _offloadState.store(OFFLOAD_IDLE, std::memory_order_release);
+        return;
     }
+    webRequestWrapper_->release();
+#else
+    (void)buffer;
+    (void)maxLen;
+#endif
+}
 
-    return written_;
+void AsyncIotWebConf::renderOffloadTask(void* parameter) {
+#if IOTWEBCONFASYNC_RENDER_OFFLOAD == 1 && defined(ESP32)
+    AsyncIotWebConf* self_ = static_cast<AsyncIotWebConf*>(parameter);
+    uint8_t buffer_[512];
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        self_->produceRenderOffload(buffer_, sizeof(buffer_));
+    }
+#else
+    (void)parameter;
+#endif
+}
+
+void AsyncIotWebConf::appendFormStreamScript() {
+#if IOTWEBCONFASYNC_STREAM_FORM_POST == 1
+    // -- Only the native handler receives the streamed body.
+    if (_webHandler != nullptr) {
+        _chunkBuffer += FPSTR(IOTWEBCONFASYNC_HTML_FORM_STREAM_SCRIPT);
+    }
+#endif
 }
 
 void AsyncIotWebConf::resetChunkState() {
     _currentChunkStep = CHUNK_HEAD;
     _chunkBuffer = "";
+    _chunkView = nullptr;
+    _chunkViewLength = 0;
     _chunkBufferPos = 0;
     _lastStepFinished = true;
+    // -- A fragment cut short by an aborted render is not kept.
+    _renderCache.abortFill();
+    // -- The groups keep their position between renderHtml() calls. One left in the
+    //    middle by an aborted render would continue there on the next page, so it is
+    //    rendered to its end without sending anything.
+    if (_unfinishedGroup != nullptr) {
+        HtmlChunkCallback discard_ = [](const char* data, size_t len) -> size_t { return len; };
+        while (!_unfinishedGroup->renderHtml(false, nullptr, discard_)) {
+        }
+        _unfinishedGroup = nullptr;
+    }
+
+    // -- All temporaries of the render go back to the heap in one step.
+    if (_arena.getAllocations() > 0) {
+        DEBUGASYNC_PRINTF("Render arena: %u allocations in %u blocks\n",
+            (unsigned int)_arena.getAllocations(), (unsigned int)_arena.getBlockAllocations());
+    }
+    _arena.release();
+    _arena.resetCounters();
+}
+
+bool AsyncIotWebConf::renderGroup(iotwebconf::ParameterGroup* group, HtmlChunkCallback& writer) {
+    if (!_renderCache.isEnabled() || _renderCacheBypass) {
+        bool finished_ = group->renderHtml(false, renderWrapper(), writer);
+        _unfinishedGroup = finished_ ? nullptr : group;
+        return finished_;
+    }
+    // -- The fragment is looked up once per group, later calls resume the fill.
+    if (!_renderCache.isFilling(group)) {
+        uint32_t fingerprint_ = getGroupFingerprint(group);
+        size_t length_ = 0;
+        const char* fragment_ = _renderCache.find(group, fingerprint_, &length_);
+        if (fragment_ != nullptr) {
+            _metrics.renderCacheHits++;
+            setChunkView(fragment_, length_);
+            return true;
+        }
+        _metrics.renderCacheMisses++;
+        _renderCache.beginFill(group, fingerprint_);
+    }
+    HtmlChunkCallback capture_ = [this, &writer](const char* data, size_t len) -> size_t {
+        size_t written_ = writer(data, len);
+        _renderCache.append(data, written_);
+        return written_;
+        };
+    bool finished_ = group->renderHtml(false, renderWrapper(), capture_);
+    _unfinishedGroup = finished_ ? nullptr : group;
+    if (finished_) {
+        _renderCache.endFill();
+    }
+    return finished_;
+}
+
+uint32_t AsyncIotWebConf::getGroupFingerprint(iotwebconf::ParameterGroup* group) {
+    // -- FNV-1a over the serialized values, the same data a save writes.
+    uint32_t hash_ = 2166136261u;
+    AsyncConfigItemAccess::storeItem(group, [&hash_](iotwebconf::SerializationData* serializationData) {
+        for (int i = 0; i < serializationData->length; i++) {
+            hash_ = (hash_ ^ serializationData->data[i]) * 16777619u;
+        }
+        // -- Separates the values, "ab"+"c" and "a"+"bc" hash differently.
+        hash_ = (hash_ ^ 0xFF) * 16777619u;
+        });
+    return hash_;
+}
+
+void AsyncIotWebConf::invalidateRenderCache(iotwebconf::ParameterGroup* group) {
+    if (group == nullptr) {
+        _renderCache.invalidateAll();
+    }
+    else {
+        _renderCache.invalidate(group);
+    }
+}
+
+void AsyncIotWebConf::setChunkView(const char* data, size_t length) {
+    _chunkView = data;
+    _chunkViewLength = data != nullptr ? length : 0;
+}
+
+void AsyncIotWebConf::renderHeadChunk() {
+    static const char* const HEAD_SLOTS[] = { "v" };
+
+    // -- The head comes from the format provider, it is scanned once per
+    //    provider and expanded straight into the arena.
+    iotwebconf::HtmlFormatProvider* provider_ = this->getHtmlFormatProvider();
+    if (provider_ != _headProvider) {
+        _headSource = provider_->getHead();
+        _headTemplate = AsyncHtmlTemplate(_headSource.c_str(), false, HEAD_SLOTS, 1, '{', '}');
+        _headProvider = provider_;
+    }
+    String title_ = String("Config ") + this->getThingName();
+    AsyncTemplateValue values_[] = { AsyncTemplateValue::ram(title_) };
+
+    size_t length_ = _headTemplate.length(values_);
+    char* chunk_ = static_cast<char*>(_arena.allocate(length_));
+    if (chunk_ == nullptr) {
+        // -- Arena exhausted, send the template through the heap string.
+        _chunkBuffer = _headTemplate.toString(values_);
+        return;
+    }
+    _headTemplate.read(0, reinterpret_cast<uint8_t*>(chunk_), length_, values_);
+    setChunkView(chunk_, length_);
 }
\ No newline at end of file
@@ -50,8 +50,165 @@
 
 #include <DNSServer.h> 
 
+#include "IotWebConfAsyncForm.h"
+#include "IotWebConfAsyncSpscQueue.h"
+#include "IotWebConfAsyncArena.h"
+#include "IotWebConfAsyncTemplate.h"
+#include "IotWebConfAsyncContentQueue.h"
+#include "IotWebConfAsyncStorage.h"
+#include "IotWebConfAsyncSession.h"
+#include "IotWebConfAsyncRenderCache.h"
+
+#include <memory>
+
+// -- Number of config pages that may be rendered at the same time. The chunk state lives
+//    in AsyncIotWebConf, so more than one concurrent render is not supported.
+#ifndef IOTWEBCONFASYNC_MAX_CONCURRENT_RENDERS
+#define IOTWEBCONFASYNC_MAX_CONCURRENT_RENDERS 1
+#endif
+
+// -- Largest free heap block required before a config page render or save is accepted.
+#ifndef IOTWEBCONFASYNC_MIN_FREE_HEAP_RENDER
+#define IOTWEBCONFASYNC_MIN_FREE_HEAP_RENDER 16384
+#endif
+
+// -- Largest free heap block required before a light request (redirects, not found) is accepted.
+#ifndef IOTWEBCONFASYNC_MIN_FREE_HEAP_LIGHT
+#define IOTWEBCONFASYNC_MIN_FREE_HEAP_LIGHT 4096
+#endif
+
+// -- Value of the Retry-After header sent with the 503 busy response.
+#ifndef IOTWEBCONFASYNC_RETRY_AFTER_SECONDS
+#define IOTWEBCONFASYNC_RETRY_AFTER_SECONDS 2
+#endif
+
+// -- Time in microseconds a single chunk callback may spend rendering before it
+//    returns the partial chunk to the AsyncTCP task. 0 disables the budget.
+#ifndef IOTWEBCONFASYNC_RENDER_BUDGET_US
+#define IOTWEBCONFASYNC_RENDER_BUDGET_US 4000
+#endif
+
+// -- ESP32 only: compile in the render offload, a task on the other core pre-renders
+//    the config page into a queue that the AsyncTCP callbacks only drain.
+//    Enabled at runtime with enableRenderOffload().
+#ifndef IOTWEBCONFASYNC_RENDER_OFFLOAD
+#define IOTWEBCONFASYNC_RENDER_OFFLOAD 0
+#endif
+
+// -- Size of the queue between the render task and the AsyncTCP callbacks.
+#ifndef IOTWEBCONFASYNC_OFFLOAD_QUEUE_SIZE
+#define IOTWEBCONFASYNC_OFFLOAD_QUEUE_SIZE 4096
+#endif
+
+#ifndef IOTWEBCONFASYNC_OFFLOAD_STACK_SIZE
+#define IOTWEBCONFASYNC_OFFLOAD_STACK_SIZE 6144
+#endif
+
+#ifndef IOTWEBCONFASYNC_OFFLOAD_PRIORITY
+#define IOTWEBCONFASYNC_OFFLOAD_PRIORITY 1
+#endif
+
+// -- Time in microseconds a chunk callback waits for the render task before
+//    it asks the response to try again later.
+#ifndef IOTWEBCONFASYNC_OFFLOAD_WAIT_US
+#define IOTWEBCONFASYNC_OFFLOAD_WAIT_US 1000
+#endif
+
+// -- Send the config page with an ETag and answer a matching If-None-Match with 304,
+//    so an unchanged page is not rendered again.
+#ifndef IOTWEBCONFASYNC_CONFIG_ETAG
+#define IOTWEBCONFASYNC_CONFIG_ETAG 1
+#endif
+
+// -- Persist a saved config from doLoop() instead of the AsyncTCP callback. The client
+//    gets its response at once, saves posted before doLoop() runs are coalesced.
+#ifndef IOTWEBCONFASYNC_DEFER_SAVE
+#define IOTWEBCONFASYNC_DEFER_SAVE 1
+#endif
+
+// -- Emit the markup generated by this library without line breaks. The markup
+//    IotWebConf renders itself is not changed.
+#ifndef IOTWEBCONFASYNC_MINIFY_HTML
+#define IOTWEBCONFASYNC_MINIFY_HTML 0
+#endif
+
+#if IOTWEBCONFASYNC_MINIFY_HTML
+#define IOTWEBCONFASYNC_NL ""
+#else
+#define IOTWEBCONFASYNC_NL "\n"
+#endif
+
+// -- Tab styling shared by the tab format providers, without the container width.
+extern const char IOTWEBCONFASYNC_TAB_STYLE[] PROGMEM;
+
 class AsyncIotWebConf;
 
+/**
+ * Histogram of durations with power of two buckets, bucket i counts
+ * durations from 2^i to 2^(i+1)-1 microseconds.
+ */
+struct AsyncLatencyHistogram {
+    static const uint8_t BUCKETS = 21;
+    uint32_t buckets[BUCKETS] = {};
+    uint32_t count = 0;
+    uint32_t maxUs = 0;
+
+    void record(uint32_t us) {
+        uint8_t bucket_ = 0;
+        while (bucket_ < BUCKETS - 1 && (us >> (bucket_ + 1)) != 0) {
+            bucket_++;
+        }
+        buckets[bucket_]++;
+        count++;
+        if (us > maxUs) {
+            maxUs = us;
+        }
+    }
+
+    /**
+     * Upper bound of the bucket holding the given percentile.
+     * @param percent Percentile from 1 to 100, e.g. 50 or 99
+     */
+    uint32_t percentile(uint8_t percent) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint32_t rank_ = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+        uint32_t seen_ = 0;
+        for (uint8_t i = 0; i < BUCKETS; i++) {
+            seen_ += buckets[i];
+            if (seen_ >= rank_) {
+                uint32_t upper_ = (i == BUCKETS - 1) ? maxUs : ((1UL << (i + 1)) - 1);
+                return upper_ < maxUs ? upper_ : maxUs;
+            }
+        }
+        return maxUs;
+    }
+};
+
+/**
+ * Counters describing how the config portal handled its load
+ */
+struct AsyncIotWebConfMetrics {
+    uint32_t admittedRenders = 0;
+    uint32_t rejectedRequests = 0;
+    uint8_t peakActiveRenders = 0;
+    uint32_t abortedRenders = 0;            // renders cancelled by a client disconnect
+    uint32_t coalescedSaves = 0;            // deferred saves replaced by a newer one before doLoop() ran
+    size_t minFreeHeapBudget = SIZE_MAX;    // smallest largest free block seen by the admission control
+    AsyncLatencyHistogram renderLatency;    // duration of each chunk callback
+    uint32_t chunkCalls = 0;                // chunk callbacks of config page responses
+    uint32_t emptyChunkCalls = 0;           // callbacks that had no data yet and asked to be called again
+    uint32_t truncatedPages = 0;            // responses ended by an empty chunk before the page was complete
+    uint64_t chunkBytes = 0;                // bytes returned by the chunk callbacks
+    uint32_t notModified = 0;               // config page requests answered with 304
+    uint32_t renderCacheHits = 0;           // groups sent from the render cache
+    uint32_t renderCacheMisses = 0;         // groups rendered because their fragment was missing or dirty
+    size_t lastPageBytes = 0;               // size of the last config page sent completely
+    uint32_t abortedStreams = 0;            // sendContent() responses aborted because content did not fit the queue
+    AsyncLatencyHistogram chunkSize;        // bytes per chunk callback, in the same power of two buckets
+};
+
 /**
  * Custom HTML format provider that combines tab support with optional groups
  */
@@ -61,16 +218,8 @@ protected:
         String style_ = iotwebconf::OptionalGroupHtmlFormatProvider::getStyleInner();
 
         // Add Tab styling
-        style_ += F("body > div{min-width:260px;max-width:600px;width:100%;box-sizing:border-box;}\n");
-        style_ += F(".tab{overflow:hidden;border-bottom:2px solid #16A1E7;background-color:#f1f1f1;margin-bottom:10px;display:flex;}\n");
-        style_ += F(".tab button{background-color:#f1f1f1 !important;flex:1 1 0;min-width:0;border:1px solid #ccc !important;outline:none;cursor:pointer;");
-        style_ += F("padding:14px 16px;transition:0.3s;font-size:16px;border-top-left-radius:5px;border-top-right-radius:5px;");
-        style_ += F("margin-right:2px;border-bottom:none !important;color:#333 !important;line-height:normal !important;width:auto !important;box-sizing:border-box;}\n");
-        style_ += F(".tab button:hover{background-color:#ddd !important;}\n");
-        style_ += F(".tab button.active{background-color:#16A1E7 !important;color:white !important;border:1px solid #16A1E7 !important;");
-        style_ += F("border-bottom:2px solid #fff !important;position:relative;z-index:1;}\n");
-        style_ += F(".tabcontent{display:none;padding:12px;border:1px solid #ccc;border-top:none;background-color:#fff;}\n");
-        style_ += F("fieldset{width:100%;box-sizing:border-box;}\n");
+        style_ += F("body>div{min-width:260px;max-width:600px;width:100%;box-sizing:border-box;}" IOTWEBCONFASYNC_NL);
+        style_ += FPSTR(IOTWEBCONFASYNC_TAB_STYLE);
 
         return style_;
     }
@@ -80,7 +229,19 @@ protected:
 class AsyncWebRequestWrapper : public iotwebconf::WebRequestWrapper {
 public:
     explicit AsyncWebRequestWrapper(AsyncWebServerRequest* request);
-    ~AsyncWebRequestWrapper() {}
+    ~AsyncWebRequestWrapper();
+
+    /**
+     * Create a wrapper on the heap that deletes itself when the client disconnects.
+     */
+    static AsyncWebRequestWrapper* create(AsyncWebServerRequest* request);
+
+    /**
+     * Hand the request of a wrapper owned by the caller over to a wrapper created
+     * with create(). The parsed body and headers move along, the caller's wrapper
+     * is not referenced afterwards. Self owned wrappers are returned unchanged.
+     */
+    static AsyncWebRequestWrapper* adopt(AsyncWebRequestWrapper* wrapper);
 
     void send(int code, const char* content_type = nullptr, const String& content = String("")) override;
     void sendHeader(const String& name, const String& value, bool first = false) override;
@@ -92,13 +253,54 @@ public:
     IPAddress localIP() override { return _request->client()->localIP(); }
     uint16_t localPort() override { return _request->client()->localPort(); }
     const String uri() const override { return _request->url(); }
-    bool authenticate(const char* username, const char* password) override { return _request->authenticate(username, password); }
+    bool authenticate(const char* username, const char* password) override { return _sessionValid || _request->authenticate(username, password); }
     void requestAuthentication() override { _request->requestAuthentication(); }
-    bool hasArg(const String& name) override { return _request->hasArg(name.c_str()); }
-    String arg(const String name) override { return _request->arg(name); }
+    bool hasArg(const String& name) override;
+    String arg(const String name) override;
+
+    /**
+     * Get an argument without copying it. Arguments are looked up through a hash
+     * index, which is built on the first access.
+     * @return The value or nullptr if the argument is missing
+     */
+    const char* argValue(const char* name);
 
     void setConfiguration(AsyncIotWebConf* configuration);
 
+    /**
+     * Number of wrappers alive right now and the highest number seen. Once all
+     * clients are gone the live count must be back to 0, otherwise wrappers leak.
+     */
+    static uint32_t getLiveCount() { return _liveCount.load(); }
+    static uint32_t getPeakLiveCount() { return _peakLiveCount.load(); }
+
+    /**
+     * Bytes sendContent() can still queue for a streamed response, see
+     * IOTWEBCONFASYNC_CONTENT_QUEUE_SIZE.
+     */
+    size_t contentSpace() const { return _content ? _content->space() : 0; }
+
+    /**
+     * Wait until sendContent() can queue len bytes, for code streaming from
+     * another task. A handler in the AsyncTCP task must not wait, the response
+     * is only sent after it returned.
+     * @return False on timeout or if the response is finished or aborted
+     */
+    bool waitContentSpace(size_t len, uint32_t timeoutMs);
+
+    /**
+     * Streamed responses aborted since the start, because sendContent() got
+     * more than the queue holds. Also reported in AsyncIotWebConfMetrics.
+     */
+    static uint32_t getAbortedStreams() { return _abortedStreams.load(); }
+
+    /**
+     * Feed a part of the request body to the form parser. Arguments are read from
+     * the parsed body instead of the request parameters once this was called.
+     */
+    void parseBody(const uint8_t* data, size_t len, size_t index, size_t total);
+    bool isBodyOverflow() const { return _form != nullptr && _form->isOverflow(); }
+
 protected:
     AsyncWebServerRequest* _request;
     AsyncWebServerResponse* _response;
@@ -108,10 +310,89 @@ protected:
     String _contentType;
     bool _isChunked;
     bool _isFinished;
+    bool _renderConfig;
+    std::shared_ptr<AsyncContentQueue> _content;
+
+    bool _admitted;
+    // -- Set by AsyncIotWebConf::handleConfig() once the client was authenticated.
+    bool _sessionValid;
+    bool _selfOwned;
+    bool _disconnectArmed;
+    // -- Owners of a self owned wrapper: its request until the disconnect and
+    //    the render task while it renders the page for it.
+    std::atomic<uint8_t> _references{ 1 };
+    AsyncFormParser* _form;
+    AsyncArgIndex* _argIndex;
+
+    static std::atomic<uint32_t> _liveCount;
+    static std::atomic<uint32_t> _peakLiveCount;
+    static std::atomic<uint32_t> _abortedStreams;
+
+    /**
+     * Queue content of a streamed response, counts the abort if it does not fit.
+     */
+    void pushContent(const String& content);
 
     size_t readChunk(uint8_t* buffer, size_t maxLen);
 
+    /**
+     * Register the disconnect callback, which releases the render slot and
+     * deletes wrappers created with create().
+     */
+    void armDisconnect(bool selfOwned);
+    void handleDisconnect();
+
+    void retain() { _references.fetch_add(1); }
+    /**
+     * Drop one owner, the last one deletes the wrapper.
+     */
+    void release();
+
     friend class AsyncIotWebConf;
+    friend class AsyncIotWebConfHandler;
+    friend class AsyncDeferredSave;
+};
+
+/**
+ * Arguments of a validated config post, replayed through IotWebConf::handleConfig()
+ * from AsyncIotWebConf::doLoop(). The page rendered for it is discarded.
+ */
+class AsyncDeferredSave : public iotwebconf::WebRequestWrapper {
+public:
+    explicit AsyncDeferredSave(uint32_t generation) : _form(nullptr), _generation(generation) {}
+    ~AsyncDeferredSave() { delete _form; }
+
+    /**
+     * Take the posted arguments. A parsed body is moved over from the wrapper,
+     * which reads the request parameters afterwards, only request parameters
+     * are copied.
+     */
+    void takeArgs(AsyncWebRequestWrapper* webRequestWrapper);
+    uint32_t getGeneration() const { return _generation; }
+
+    void send(int code, const char* content_type = nullptr, const String& content = String("")) override {}
+    void sendHeader(const String& name, const String& value, bool first = false) override {}
+    void sendContent(const String& content) override {}
+    void setContentLength(const size_t contentLength) override {}
+    void stop() override {}
+
+    const String hostHeader() const override { return String(); }
+    IPAddress localIP() override { return IPAddress(); }
+    uint16_t localPort() override { return 0; }
+    const String uri() const override { return String(); }
+    // -- The post was authenticated when it arrived.
+    bool authenticate(const char* username, const char* password) override { return true; }
+    void requestAuthentication() override {}
+    bool hasArg(const String& name) override { return argValue(name.c_str()) != nullptr; }
+    String arg(const String name) override;
+
+protected:
+    AsyncFormParser* _form;
+    std::vector<std::pair<String, String>> _args;
+    AsyncArgIndex _index;
+    uint32_t _generation;
+
+    const char* argValue(const char* name);
 };
 
 class AsyncWebServerWrapper : public iotwebconf::WebServerWrapper {
@@ -120,11 +401,58 @@ public:
 
     void handleClient() override {};
     void begin() override { this->_server->begin(); };
+    AsyncWebServer* getServer() { return this->_server; };
 private:
     AsyncWebServer* _server;
     AsyncWebServerWrapper() {};
 };
 
+/**
+ * Handler answering the connectivity checks phones and computers send while the
+ * device is in AP mode (e.g. /generate_204, /hotspot-detect.html, /connecttest.txt).
+ * Probes are recognized by a precomputed hash of their path and answered with a
+ * prebuilt redirect to the portal, without creating an AsyncWebRequestWrapper.
+ */
+class AsyncCaptivePortalHandler : public AsyncWebHandler {
+public:
+    explicit AsyncCaptivePortalHandler(AsyncIotWebConf* iotWebConf);
+
+    bool canHandle(AsyncWebServerRequest* request) const override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+    bool isRequestHandlerTrivial() const override { return true; }
+
+    static bool isProbe(const char* path);
+
+private:
+    AsyncIotWebConf* _iotWebConf;
+    uint32_t _locationIp;
+    char _location[24];
+};
+
+/**
+ * Handler that owns the routing of the config page. It replaces the lambda
+ * glue of server.on("/config", ...) and parses posted form bodies while they
+ * arrive in handleBody().
+ */
+class AsyncIotWebConfHandler : public AsyncWebHandler {
+public:
+    AsyncIotWebConfHandler(AsyncIotWebConf* iotWebConf, const char* configPath);
+
+    bool canHandle(AsyncWebServerRequest* request) const override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+    void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) override;
+    bool isRequestHandlerTrivial() const override { return false; }
+
+    void handleNotFound(AsyncWebServerRequest* request);
+
+private:
+    AsyncIotWebConf* _iotWebConf;
+    const char* _configPath;
+    size_t _configPathLength;
+
+    static AsyncWebRequestWrapper* getWrapper(AsyncWebServerRequest* request);
+};
+
 class AsyncIotWebConf : public iotwebconf::IotWebConf {
 public:
     enum ChunkStep {
@@ -142,28 +470,319 @@ public:
         CHUNK_END,
         CHUNK_DONE
     };
+
+    /**
+     * Cost class of a request, used by the admission control.
+     * Light requests only need a small amount of heap and are still accepted
+     * when full page renders are already rejected.
+     */
+    enum RequestWeight {
+        REQUEST_LIGHT,
+        REQUEST_HEAVY
+    };
+
     AsyncIotWebConf(
         const char* defaultThingName, DNSServer* dnsServer, AsyncWebServerWrapper* webServerWrapper,
         const char* initialApPassword, const char* configVersion = "init");
     void handleConfig(AsyncWebRequestWrapper* webRequestWrapper);
+
+    /**
+     * Replaces IotWebConf::init(), loads the values of the config storage
+     * (setConfigStorage()) over the values IotWebConf read from EEPROM.
+     */
+    bool init();
+
+    /**
+     * Keep the config in a storage backend, e.g. an AsyncJournalStorage, instead of
+     * rewriting the EEPROM with every save. Must be called before init().
+     * EEPROM still holds the config version and the first configuration.
+     */
+    void setConfigStorage(AsyncConfigStorage* storage) { _storage = storage; }
+
+    /**
+     * Replaces IotWebConf::saveConfig() for values changed from the code, they are
+     * also written to the config storage. IotWebConf::saveConfig() is not virtual,
+     * call this through AsyncIotWebConf.
+     * @return False if the config storage did not take the values
+     */
+    bool saveConfig();
+
+    /**
+     * Replaces IotWebConf::setConfigSavedCallback(), the callback is also
+     * called after saves to the config storage.
+     */
+    void setConfigSavedCallback(std::function<void()> func);
+
+    /**
+     * Replaces IotWebConf::doLoop(), writes a deferred config save
+     * (IOTWEBCONFASYNC_DEFER_SAVE) before the state machine runs.
+     */
+    void doLoop();
+
+    /**
+     * Generation of the last accepted config save, 0 if there was none.
+     * A save is persisted once getSavedGeneration() reached its generation,
+     * getFailedGeneration() is the last save the config storage did not take.
+     */
+    uint32_t getSaveGeneration() const { return _saveGeneration.load(); }
+    uint32_t getSavedGeneration() const { return _savedGeneration.load(); }
+    uint32_t getFailedGeneration() const { return _failedGeneration.load(); }
+
+    /**
+     * Change the ETag of the config page (IOTWEBCONFASYNC_CONFIG_ETAG). Saves do this
+     * on their own, call it after parameter values were changed from the code.
+     */
+    void invalidateConfigPage() { _pageRevision++; }
+
+    /**
+     * Set the format provider of the config page, pages sent with the old one
+     * get a new ETag.
+     */
+    void setHtmlFormatProvider(iotwebconf::HtmlFormatProvider* provider) {
+        IotWebConf::setHtmlFormatProvider(provider);
+        invalidateConfigPage();
+    }
+
+    /**
+     * Render a group again the next time, e.g. after its labels changed. Changed
+     * values are noticed without this. Not while a page is rendered.
+     * @param group The group, nullptr for all groups
+     */
+    void invalidateRenderCache(iotwebconf::ParameterGroup* group = nullptr);
+    void handleNotFound(AsyncWebRequestWrapper* webRequestWrapper);
+    bool handleCaptivePortal(AsyncWebRequestWrapper* webRequestWrapper);
     virtual size_t getNextChunk(uint8_t* buffer, size_t maxLen);
 
     virtual void resetChunkState();
 
+    /**
+     * Set the heap thresholds used by the admission control.
+     * @param minFreeHeapRender Largest free block needed to render or save the config page
+     * @param minFreeHeapLight Largest free block needed for light requests
+     */
+    void setAdmissionLimits(size_t minFreeHeapRender, size_t minFreeHeapLight);
+
+    /**
+     * Check whether a request may be served right now. Admitted heavy requests
+     * hold a render slot until releaseRequest() is called or the client disconnects.
+     */
+    bool admitRequest(AsyncWebRequestWrapper* webRequestWrapper, RequestWeight weight);
+    void releaseRequest(AsyncWebRequestWrapper* webRequestWrapper);
+
+    /**
+     * Send the flash resident 503 response with a Retry-After header.
+     */
+    static void sendBusy(AsyncWebServerRequest* request);
+
+    const AsyncIotWebConfMetrics& getMetrics();
+
+    /**
+     * Number of admitted renders and saves that still hold a slot.
+     */
+    uint8_t getActiveRenders() const { return _activeRenders; }
+
+    /**
+     * Set the time a single chunk callback may spend rendering. Once it is used up
+     * the callback returns what it has and continues with the next callback.
+     * @param budgetUs Budget in microseconds, 0 disables the budget
+     */
+    void setRenderBudget(uint32_t budgetUs);
+
+    /**
+     * Start the render task of the offload mode (IOTWEBCONFASYNC_RENDER_OFFLOAD).
+     * Parameters must not be changed from loop() while a page is rendered.
+     * @param core Core the render task is pinned to, -1 for the core that does not run this call
+     * @return False if the offload is not compiled in or the task could not be created
+     */
+    bool enableRenderOffload(int8_t core = -1);
+
+    /**
+     * Register the captive portal probe handler on the web server. Call this before
+     * the other routes are set up, so probes are answered before any other handler.
+     */
+    void setupCaptivePortalHandler();
+
+    /**
+     * Register all handlers of the config portal on the web server:
+     * the captive portal probes, the config page and the not found handler.
+     * Replaces the server.on("/config", ...) and server.onNotFound(...) glue.
+     * @param configPath Path of the config page
+     */
+    void setupWebHandlers(const char* configPath = "/config");
+
 protected:
     ChunkStep _currentChunkStep = CHUNK_HEAD;
     String _chunkBuffer;
     size_t _chunkBufferPos = 0;
+    // -- Set instead of _chunkBuffer when a step points at static or arena data.
+    const char* _chunkView = nullptr;
+    size_t _chunkViewLength = 0;
+    // -- Temporary strings of the current render, released by resetChunkState().
+    AsyncRenderArena _arena;
     bool _lastStepFinished = true;
+    // -- Group whose renderHtml() asked to be called again, finished by resetChunkState().
+    iotwebconf::ParameterGroup* _unfinishedGroup = nullptr;
+    // -- Head of the format provider in _headProvider, scanned at its first render.
+    const iotwebconf::HtmlFormatProvider* _headProvider = nullptr;
+    String _headSource;
+    AsyncHtmlTemplate _headTemplate{ "", false, nullptr, 0 };
 
     size_t _maxChunkSize = 0;
     size_t _totalBytesSent = 0;
+    // -- Bytes of the current response, counted on the AsyncTCP side.
+    size_t _pageBytes = 0;
+
+    uint32_t _renderBudgetUs = IOTWEBCONFASYNC_RENDER_BUDGET_US;
+    uint32_t _sliceStart = 0;
+
+    enum OffloadState : uint8_t {
+        OFFLOAD_IDLE,
+        OFFLOAD_RUNNING,
+        OFFLOAD_FINISHED,
+        OFFLOAD_CANCELLED
+    };
+
+    AsyncSpscQueue* _offloadQueue = nullptr;
+    void* _offloadTask = nullptr;
+    // -- Wrapper the render task renders for. It holds a reference, so a disconnect
+    //    does not wait for the task, the task drops the wrapper when it stops.
+    AsyncWebRequestWrapper* _offloadWrapper = nullptr;
+    std::atomic<uint8_t> _offloadState{ OFFLOAD_IDLE };
+
+    // -- Request handleConfig() works on: a post until it was checked and queued, a
+    //    page until its last chunk was sent or its client disconnected. Read by
+    //    doLoop(), which must not change values during a render.
+    std::atomic<AsyncWebRequestWrapper*> _webRequestWrapper{ nullptr };
+    AsyncWebServerWrapper* _asyncWebServerWrapper = nullptr;
+    AsyncCaptivePortalHandler* _captivePortalHandler = nullptr;
+    AsyncIotWebConfHandler* _webHandler = nullptr;
+
+    uint8_t _activeRenders = 0;
+    size_t _minFreeHeapRender = IOTWEBCONFASYNC_MIN_FREE_HEAP_RENDER;
+    size_t _minFreeHeapLight = IOTWEBCONFASYNC_MIN_FREE_HEAP_LIGHT;
+    AsyncIotWebConfMetrics _metrics;
+    AsyncSessionAuth _auth{ "iwc_session" };
+    AsyncRenderCache _renderCache;
+    // -- Set while the parameters hold error messages of a rejected save, these are not cached.
+    bool _renderCacheBypass = false;
+
+    const char* _configVersion;
+    AsyncConfigStorage* _storage = nullptr;
+    std::function<void()> _configSavedCallback;
+
+    std::atomic<AsyncDeferredSave*> _pendingSave{ nullptr };
+    std::atomic<uint32_t> _saveGeneration{ 0 };
+    std::atomic<uint32_t> _savedGeneration{ 0 };
+    // -- Generation of the last save the config storage did not take.
+    std::atomic<uint32_t> _failedGeneration{ 0 };
+    // -- Set while doLoop() writes a deferred save, handleConfig() does not start a render then.
+    std::atomic<bool> _savingConfig{ false };
+    // -- Part of the config page ETag, starts at a random value so ETags of an earlier boot do not match.
+    std::atomic<uint32_t> _pageRevision{ 0 };
+
+    /**
+     * Queue a validated post for doLoop() and answer it with the generation of the save.
+     */
+    void deferSave(AsyncWebRequestWrapper* webRequestWrapper);
+    void sendSaved(AsyncWebServerRequest* request, uint32_t generation);
+    void sendSaveFailed(AsyncWebServerRequest* request, uint32_t generation);
+
+    /**
+     * Write the pending deferred save, unless a config page is being rendered.
+     * The save stays pending until the render is over.
+     */
+    void applyPendingSave();
+
+    enum SaveResult : uint8_t {
+        SAVE_PAGE_SENT,     // -- IotWebConf saved the config and answered the request
+        SAVE_STORED,
+        SAVE_FAILED         // -- the config storage did not take the values
+    };
+
+    /**
+     * Update the parameters from a validated post and save them, to the config
+     * storage if there is one.
+     */
+    SaveResult writeConfig(iotwebconf::WebRequestWrapper* webRequestWrapper);
+    void sendSaveStatus(AsyncWebRequestWrapper* webRequestWrapper);
+
+    /**
+     * ETag of the config page from the page revision, the thing name, the config
+     * version and the state.
+     */
+    void getConfigPageETag(char* etag, size_t size);
+
+    /**
+     * Answer the request with 304 if it carries the current ETag of the config page.
+     * @return True if the request was answered
+     */
+    bool sendNotModified(AsyncWebRequestWrapper* webRequestWrapper, const char* etag);
+
+    static size_t getFreeHeapBudget();
+    void appendFormStreamScript();
+
+    /**
+     * Generate the data of the current step into _chunkBuffer (or through the writer)
+     * and set _lastStepFinished. Derived classes provide their own steps.
+     */
+    virtual void renderChunkStep(HtmlChunkCallback& writer);
+    virtual bool isChunkDone() const;
+    /**
+     * Move to the next step.
+     * @param afterCopy True if called after the generated data was sent completely,
+     *   false if the step generated no data
+     */
+    virtual void nextChunkStep(bool afterCopy);
+
+    size_t writeChunkData(const char* data, size_t len);
+
+    /**
+     * Send data without copying it into _chunkBuffer. The data must stay valid
+     * until the step is sent, e.g. a literal or a string from _arena.
+     */
+    void setChunkView(const char* data, size_t length);
+    const char* getChunkData() const { return _chunkView != nullptr ? _chunkView : _chunkBuffer.c_str(); }
+    size_t getChunkLength() const { return _chunkView != nullptr ? _chunkViewLength : _chunkBuffer.length(); }
+    void renderHeadChunk();
+
+    /**
+     * Render a group through the render cache, a clean fragment is sent as chunk view.
+     * @return True if the group is complete, like ParameterGroup::renderHtml()
+     */
+    bool renderGroup(iotwebconf::ParameterGroup* group, HtmlChunkCallback& writer);
+    static uint32_t getGroupFingerprint(iotwebconf::ParameterGroup* group);
+    bool isRenderBudgetExceeded() const;
+    void recordChunk(size_t written);
+
+    /**
+     * Render the next part of the page into buffer, used by the AsyncTCP callbacks
+     * and by the render task.
+     */
+    size_t renderChunk(uint8_t* buffer, size_t maxLen);
+
+    /**
+     * Wrapper the parameters are rendered for. The render task uses its own
+     * reference, _webRequestWrapper is cleared by a disconnect at any time.
+     */
+    AsyncWebRequestWrapper* renderWrapper() const { return _offloadWrapper != nullptr ? _offloadWrapper : _webRequestWrapper.load(); }
+
+    bool isRenderOffloadBusy() const;
+    void startRenderOffload();
+    void cancelRenderOffload();
 
-    AsyncWebRequestWrapper* _webRequestWrapper = nullptr;
+    /**
+     * Cancel the render of the current request after its client disconnected
+     * and give its buffers back.
+     */
+    void abortRender();
+    size_t drainRenderOffload(uint8_t* buffer, size_t maxLen);
+    void produceRenderOffload(uint8_t* buffer, size_t maxLen);
+    static void renderOffloadTask(void* parameter);
 
     friend class AsyncWebRequestWrapper;
     friend class IotWebConf;
     friend class AsyncIotWebConfTab;
+    friend class AsyncCaptivePortalHandler;
 
 };
 
@@ -0,0 +1,200 @@
+/**
+ * IotWebConfAsyncArena.h -- Bump allocator for the temporary strings of one
+ *   config page render.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCARENA_h
+#define _IOTWEBCONFASYNCARENA_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+// -- Size of one arena block. Strings that do not fit get a block of their own.
+#ifndef IOTWEBCONFASYNC_ARENA_BLOCK_SIZE
+#define IOTWEBCONFASYNC_ARENA_BLOCK_SIZE 1024
+#endif
+
+/**
+ * Bump allocator with fixed size blocks. Memory is never freed on its own,
+ * all blocks are given back at once with release() when the render is complete.
+ * Strings are built in place with beginString(), append() and endString().
+ */
+class AsyncRenderArena {
+public:
+    explicit AsyncRenderArena(size_t blockSize = IOTWEBCONFASYNC_ARENA_BLOCK_SIZE) :
+        _blockSize(blockSize)
+    {
+    }
+
+    ~AsyncRenderArena() {
+        release();
+    }
+
+    AsyncRenderArena(const AsyncRenderArena&) = delete;
+    AsyncRenderArena& operator=(const AsyncRenderArena&) = delete;
+
+    /**
+     * Must not be called while a string is built.
+     * @return Memory for size bytes, valid until release(), or nullptr if the heap is exhausted
+     */
+    void* allocate(size_t size) {
+        size = (size + 3) & ~static_cast<size_t>(3);
+        if (!reserve(size)) {
+            return nullptr;
+        }
+        void* p_ = _current->data() + _current->used;
+        _current->used += size;
+        _allocations++;
+        return p_;
+    }
+
+    void beginString() {
+        _stringLength = 0;
+        _stringFailed = !reserve(1);
+    }
+
+    void append(const char* s, size_t len) {
+        if (_stringFailed || len == 0) {
+            return;
+        }
+        if (!reserve(_stringLength + len + 1)) {
+            _stringFailed = true;
+            return;
+        }
+        memcpy(_current->data() + _current->used + _stringLength, s, len);
+        _stringLength += len;
+    }
+
+    void append(const char* s) {
+        append(s, strlen(s));
+    }
+
+    void append(const String& s) {
+        append(s.c_str(), s.length());
+    }
+
+    /**
+     * Append a string located in flash.
+     */
+    void append_P(PGM_P s) {
+        size_t len_ = strlen_P(s);
+        if (_stringFailed || len_ == 0) {
+            return;
+        }
+        if (!reserve(_stringLength + len_ + 1)) {
+            _stringFailed = true;
+            return;
+        }
+        memcpy_P(_current->data() + _current->used + _stringLength, s, len_);
+        _stringLength += len_;
+    }
+
+    /**
+     * Terminate the string started with beginString().
+     * @param length Receives the length of the string
+     * @return The string, valid until release(), or nullptr if the heap is exhausted
+     */
+    const char* endString(size_t* length = nullptr) {
+        size_t length_ = _stringLength;
+        _stringLength = 0;
+        if (_stringFailed) {
+            if (length) *length = 0;
+            return nullptr;
+        }
+        char* s_ = _current->data() + _current->used;
+        s_[length_] = '\0';
+        _current->used += length_ + 1;
+        _allocations++;
+        if (length) *length = length_;
+        return s_;
+    }
+
+    /**
+     * Give all blocks back to the heap.
+     */
+    void release() {
+        while (_current != nullptr) {
+            Block* next_ = _current->next;
+            free(_current);
+            _current = next_;
+        }
+        _blocks = 0;
+    }
+
+    /**
+     * Number of allocations since the last resetCounters(), blocks only
+     * count while they are held.
+     */
+    uint32_t getAllocations() const { return _allocations; }
+    uint32_t getBlockAllocations() const { return _blockAllocations; }
+    size_t getBlocks() const { return _blocks; }
+    void resetCounters() {
+        _allocations = 0;
+        _blockAllocations = 0;
+    }
+
+protected:
+    struct Block {
+        Block* next;
+        size_t size;
+        size_t used;
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    Block* _current = nullptr;
+    size_t _blockSize;
+    size_t _blocks = 0;
+    size_t _stringLength = 0;
+    bool _stringFailed = false;
+    uint32_t _allocations = 0;
+    uint32_t _blockAllocations = 0;
+
+    /**
+     * Make sure the current block has size free bytes. A string under
+     * construction is moved to the new block.
+     */
+    bool reserve(size_t size) {
+        if (_current != nullptr && _current->size - _current->used >= size) {
+            return true;
+        }
+        size_t blockSize_ = size > _blockSize ? size : _blockSize;
+        Block* block_ = static_cast<Block*>(malloc(sizeof(Block) + blockSize_));
+        if (block_ == nullptr) {
+            return false;
+        }
+        block_->next = _current;
+        block_->size = blockSize_;
+        block_->used = 0;
+        if (_current != nullptr && _stringLength > 0) {
+            memcpy(block_->data(), _current->data() + _current->used, _stringLength);
+        }
+        _current = block_;
+        _blocks++;
+        _blockAllocations++;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "IotWebConfAsyncBundle.h"
+
+AsyncBundleParser::AsyncBundleParser(AsyncBundleSink* sink) :
+    _sink(sink),
+    _state(STATE_HEADER),
+    _headerPos(0),
+    _sectionCount(0),
+    _section(0),
+    _remaining(0),
+    _error(nullptr)
+{
+}
+
+bool AsyncBundleParser::isBundle(const uint8_t* data, size_t len) {
+    return len >= 4 && memcmp(data, IOTWEBCONFASYNC_BUNDLE_MAGIC, 4) == 0;
+}
+
+bool AsyncBundleParser::feed(const uint8_t* data, size_t len) {
+    size_t pos_ = 0;
+    while (pos_ < len) {
+        switch (_state) {
+        case STATE_HEADER:
+        case STATE_SECTION_HEADER: {
+            size_t needed_ = (_state == STATE_HEADER ? IOTWEBCONFASYNC_BUNDLE_HEADER_SIZE : IOTWEBCONFASYNC_BUNDLE_SECTION_HEADER_SIZE) - _headerPos;
+            size_t take_ = len - pos_ < needed_ ? len - pos_ : needed_;
+            memcpy(_header + _headerPos, data + pos_, take_);
+            _headerPos += take_;
+            pos_ += take_;
+            if (take_ < needed_) {
+                break;
+            }
+            _headerPos = 0;
+            if (!(_state == STATE_HEADER ? parseHeader() : parseSectionHeader())) {
+                return false;
+            }
+            break;
+        }
+        case STATE_PAYLOAD: {
+            size_t take_ = len - pos_ < _remaining ? len - pos_ : _remaining;
+            if (!_sink->writeSection(data + pos_, take_)) {
+                return fail("Section write failed");
+            }
+            pos_ += take_;
+            _remaining -= take_;
+            break;
+        }
+        case STATE_DONE:
+            return fail("Data after the last section");
+        case STATE_FAILED:
+            return false;
+        }
+
+        if (_state == STATE_PAYLOAD && _remaining == 0) {
+            if (!_sink->endSection()) {
+                return fail("Section verification failed");
+            }
+            _section++;
+            _state = _section < _sectionCount ? STATE_SECTION_HEADER : STATE_DONE;
+        }
+    }
+    return true;
+}
+
+bool AsyncBundleParser::fail(const char* error) {
+    _state = STATE_FAILED;
+    _error = error;
+    return false;
+}
+
+bool AsyncBundleParser::parseHeader() {
+    if (!isBundle(_header, IOTWEBCONFASYNC_BUNDLE_HEADER_SIZE)) {
+        return fail("Not an update bundle");
+    }
+    if (_header[4] != IOTWEBCONFASYNC_BUNDLE_VERSION) {
+        return fail("Unsupported bundle version");
+    }
+    _sectionCount = _header[5];
+    if (_sectionCount == 0) {
+        return fail("Bundle without sections");
+    }
+    _state = STATE_SECTION_HEADER;
+    return true;
+}
+
+bool AsyncBundleParser::parseSectionHeader() {
+    uint8_t type_ = _header[0];
+    _remaining = readUint32(_header + 4);
+    if (!_sink->beginSection(type_, _remaining, _header + 8)) {
+        return fail("Section rejected");
+    }
+    _state = STATE_PAYLOAD;
+    // -- An empty section has no payload to wait for.
+    if (_remaining == 0) {
+        if (!_sink->endSection()) {
+            return fail("Section verification failed");
+        }
+        _section++;
+        _state = _section < _sectionCount ? STATE_SECTION_HEADER : STATE_DONE;
+    }
+    return true;
+}
+
+uint32_t AsyncBundleParser::readUint32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+        (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
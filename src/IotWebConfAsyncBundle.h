@@ -0,0 +1,116 @@
+/**
+ * IotWebConfAsyncBundle.h -- Parser for update bundles, that carry firmware,
+ *   file system and configuration sections in one upload.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCBUNDLE_h
+#define _IOTWEBCONFASYNCBUNDLE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+/**
+ * Bundle layout, all numbers little endian:
+ *   header:  "IWCB", version (1 byte), section count (1 byte), 2 bytes reserved
+ *   section: type (1 byte), 3 bytes reserved, payload size (4 bytes), MD5 of the payload (16 bytes),
+ *            followed by the payload
+ */
+#define IOTWEBCONFASYNC_BUNDLE_MAGIC "IWCB"
+#define IOTWEBCONFASYNC_BUNDLE_VERSION 1
+#define IOTWEBCONFASYNC_BUNDLE_HEADER_SIZE 8
+#define IOTWEBCONFASYNC_BUNDLE_SECTION_HEADER_SIZE 24
+
+enum AsyncBundleSectionType : uint8_t {
+    BUNDLE_SECTION_FIRMWARE = 1,
+    BUNDLE_SECTION_FILESYSTEM = 2,
+    BUNDLE_SECTION_CONFIG = 3
+};
+
+/**
+ * Receives the sections of a bundle. Every call may fail, which aborts the bundle.
+ */
+class AsyncBundleSink {
+public:
+    virtual ~AsyncBundleSink() {}
+    virtual bool beginSection(uint8_t type, uint32_t size, const uint8_t* md5) = 0;
+    virtual bool writeSection(const uint8_t* data, size_t len) = 0;
+    /**
+     * Called after the last byte of a section, the sink verifies the MD5 here.
+     */
+    virtual bool endSection() = 0;
+};
+
+/**
+ * Splits a bundle into its sections while it is uploaded. The data can
+ * be fed in chunks of any size, payloads are passed through without copying.
+ */
+class AsyncBundleParser {
+public:
+    explicit AsyncBundleParser(AsyncBundleSink* sink);
+
+    /**
+     * Check whether an upload starts with the bundle magic.
+     */
+    static bool isBundle(const uint8_t* data, size_t len);
+
+    /**
+     * @return False if the bundle is invalid or the sink failed, see getError()
+     */
+    bool feed(const uint8_t* data, size_t len);
+
+    /**
+     * @return True if all sections were received completely
+     */
+    bool isComplete() const { return _state == STATE_DONE; }
+    bool hasFailed() const { return _state == STATE_FAILED; }
+    const char* getError() const { return _error; }
+    uint8_t getSectionCount() const { return _sectionCount; }
+    uint8_t getCurrentSection() const { return _section; }
+
+protected:
+    enum State {
+        STATE_HEADER,
+        STATE_SECTION_HEADER,
+        STATE_PAYLOAD,
+        STATE_DONE,
+        STATE_FAILED
+    };
+
+    AsyncBundleSink* _sink;
+    State _state;
+    uint8_t _header[IOTWEBCONFASYNC_BUNDLE_SECTION_HEADER_SIZE];
+    size_t _headerPos;
+    uint8_t _sectionCount;
+    uint8_t _section;
+    uint32_t _remaining;
+    const char* _error;
+
+    bool fail(const char* error);
+    bool parseHeader();
+    bool parseSectionHeader();
+    static uint32_t readUint32(const uint8_t* p);
+};
+
+#endif
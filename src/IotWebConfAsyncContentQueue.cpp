@@ -0,0 +1,74 @@
+#include "IotWebConfAsyncContentQueue.h"
+#include <ESPAsyncWebServer.h>
+
+AsyncContentQueue::AsyncContentQueue() :
+    _head(0),
+    _tail(0),
+    _bytes(0),
+    _closed(false),
+    _overflow(false),
+    _readPos(0)
+{
+}
+
+bool AsyncContentQueue::push(const String& content) {
+    if (content.length() == 0) {
+        return true;
+    }
+    if (_closed.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    if (!fits(content.length())) {
+        _overflow.store(true, std::memory_order_release);
+        close();
+        return false;
+    }
+    size_t head_ = _head.load(std::memory_order_relaxed);
+    // -- The consumer has released this slot, it only touches slots before _head.
+    _segments[head_ % IOTWEBCONFASYNC_CONTENT_SEGMENTS] = content;
+    _bytes.fetch_add(content.length(), std::memory_order_relaxed);
+    _head.store(head_ + 1, std::memory_order_release);
+    return true;
+}
+
+bool AsyncContentQueue::fits(size_t len) const {
+    return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire) < IOTWEBCONFASYNC_CONTENT_SEGMENTS &&
+        len <= space();
+}
+
+size_t AsyncContentQueue::space() const {
+    size_t bytes_ = _bytes.load(std::memory_order_relaxed);
+    return bytes_ < IOTWEBCONFASYNC_CONTENT_QUEUE_SIZE ? IOTWEBCONFASYNC_CONTENT_QUEUE_SIZE - bytes_ : 0;
+}
+
+size_t AsyncContentQueue::read(uint8_t* buffer, size_t maxLen) {
+    size_t written_ = 0;
+    size_t tail_ = _tail.load(std::memory_order_relaxed);
+    // -- Read _closed before _head, a close after the last push is never missed.
+    bool closed_ = _closed.load(std::memory_order_acquire);
+    size_t head_ = _head.load(std::memory_order_acquire);
+
+    while (tail_ != head_ && written_ < maxLen) {
+        String& segment_ = _segments[tail_ % IOTWEBCONFASYNC_CONTENT_SEGMENTS];
+        size_t len_ = segment_.length() - _readPos;
+        if (len_ > maxLen - written_) {
+            len_ = maxLen - written_;
+        }
+        memcpy(buffer + written_, segment_.c_str() + _readPos, len_);
+        written_ += len_;
+        _readPos += len_;
+
+        if (_readPos >= segment_.length()) {
+            _bytes.fetch_sub(segment_.length(), std::memory_order_relaxed);
+            segment_ = String();
+            _readPos = 0;
+            tail_++;
+            _tail.store(tail_, std::memory_order_release);
+        }
+    }
+
+    if (written_ > 0) {
+        return written_;
+    }
+    return closed_ ? 0 : RESPONSE_TRY_AGAIN;
+}
@@ -0,0 +1,101 @@
+/**
+ * IotWebConfAsyncContentQueue.h -- Bounded queue of content segments, that
+ *   lets sendContent() stream a page through an AsyncChunkedResponse.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCCONTENTQUEUE_h
+#define _IOTWEBCONFASYNCCONTENTQUEUE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <atomic>
+
+// -- Number of sendContent() segments waiting to be sent.
+#ifndef IOTWEBCONFASYNC_CONTENT_SEGMENTS
+#define IOTWEBCONFASYNC_CONTENT_SEGMENTS 32
+#endif
+
+// -- Bytes waiting to be sent. Content beyond this aborts the response, handlers
+//    running in the AsyncTCP task fill the queue before the response starts sending.
+#ifndef IOTWEBCONFASYNC_CONTENT_QUEUE_SIZE
+#define IOTWEBCONFASYNC_CONTENT_QUEUE_SIZE 16384
+#endif
+
+/**
+ * Ring of String segments for one producer (the code calling sendContent())
+ * and one consumer (the chunked response). Segments are sent as they are,
+ * the page is never joined into one buffer.
+ */
+class AsyncContentQueue {
+public:
+    AsyncContentQueue();
+
+    AsyncContentQueue(const AsyncContentQueue&) = delete;
+    AsyncContentQueue& operator=(const AsyncContentQueue&) = delete;
+
+    /**
+     * Producer side. Queue a copy of content. Content that does not fit marks
+     * the queue as overflowed and closes it, the page would have a gap.
+     * @return False if the queue is full or closed, the content is dropped
+     */
+    bool push(const String& content);
+
+    /**
+     * Producer side. Check whether push() would take len bytes now.
+     */
+    bool fits(size_t len) const;
+
+    /**
+     * Producer side. No more content follows.
+     */
+    void close() { _closed.store(true, std::memory_order_release); }
+
+    /**
+     * Bytes that can still be queued, a producer in another task can wait for space.
+     */
+    size_t space() const;
+
+    /**
+     * Consumer side, used as chunked response filler.
+     * @return Bytes copied, RESPONSE_TRY_AGAIN while the queue is empty but
+     *   open, 0 when it is closed and sent completely
+     */
+    size_t read(uint8_t* buffer, size_t maxLen);
+
+    bool isOverflow() const { return _overflow.load(std::memory_order_acquire); }
+    bool isClosed() const { return _closed.load(std::memory_order_acquire); }
+
+protected:
+    String _segments[IOTWEBCONFASYNC_CONTENT_SEGMENTS];
+    std::atomic<size_t> _head;
+    std::atomic<size_t> _tail;
+    std::atomic<size_t> _bytes;
+    std::atomic<bool> _closed;
+    std::atomic<bool> _overflow;
+    size_t _readPos;
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include "IotWebConfAsyncForm.h"
+
+const char IOTWEBCONFASYNC_HTML_FORM_STREAM_SCRIPT[] PROGMEM =
+    "<script>document.addEventListener('DOMContentLoaded',function(){"
+    "var f=document.querySelector('form');"
+    "if(!f||!window.fetch||!window.URLSearchParams||!window.FormData)return;"
+    "f.addEventListener('submit',function(e){"
+    "e.preventDefault();"
+    "fetch(f.action||location.href,{method:'POST',headers:{'Content-Type':'" IOTWEBCONFASYNC_FORM_CONTENT_TYPE "'},"
+    "body:new URLSearchParams(new FormData(f)).toString()})"
+    ".then(function(r){return r.text();})"
+    ".then(function(t){document.open();document.write(t);document.close();})"
+    ".catch(function(){f.submit();});"
+    "});});</script>\n";
+
+AsyncFormParser::AsyncFormParser(size_t maxSize) :
+    _maxSize(maxSize),
+    _fieldStart(0),
+    _count(0),
+    _state(STATE_DATA),
+    _percentHigh(0),
+    _inValue(false),
+    _overflow(false),
+    _finished(false)
+{
+}
+
+void AsyncFormParser::begin(size_t expectedSize) {
+    // -- Two terminators per field never exceed the "=" and "&" they replace,
+    //    except for the very last field.
+    size_t size_ = expectedSize + 2;
+    if (size_ > _maxSize) {
+        size_ = _maxSize;
+    }
+    _buffer.reserve(size_);
+}
+
+void AsyncFormParser::feed(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len && !_overflow; i++) {
+        uint8_t c_ = data[i];
+
+        if (_state == STATE_PERCENT_HIGH) {
+            if (hexValue(c_) >= 0) {
+                _percentHigh = c_;
+                _state = STATE_PERCENT_LOW;
+                continue;
+            }
+            // -- Not an escape sequence, keep the '%' as it is
+            put('%');
+            _state = STATE_DATA;
+        }
+        else if (_state == STATE_PERCENT_LOW) {
+            _state = STATE_DATA;
+            if (hexValue(c_) >= 0) {
+                char decoded_ = static_cast<char>((hexValue(_percentHigh) << 4) | hexValue(c_));
+                if (decoded_ != '\0') {
+                    put(decoded_);
+                }
+                continue;
+            }
+            put('%');
+            put(static_cast<char>(_percentHigh));
+        }
+
+        switch (c_) {
+        case '%':
+            _state = STATE_PERCENT_HIGH;
+            break;
+        case '+':
+            put(' ');
+            break;
+        case '=':
+            if (_inValue) {
+                put('=');
+            }
+            else {
+                endName();
+            }
+            break;
+        case '&':
+            endField();
+            break;
+        default:
+            put(static_cast<char>(c_));
+            break;
+        }
+    }
+}
+
+void AsyncFormParser::finish() {
+    if (_state == STATE_PERCENT_HIGH) {
+        put('%');
+    }
+    else if (_state == STATE_PERCENT_LOW) {
+        put('%');
+        put(static_cast<char>(_percentHigh));
+    }
+    _state = STATE_DATA;
+    endField();
+    _finished = true;
+}
+
+const char* AsyncFormParser::value(const char* name) const {
+    if (!_index.isBuilt()) {
+        buildIndex();
+    }
+    return _index.find(name);
+}
+
+void AsyncFormParser::buildIndex() const {
+    _index.reset(_count);
+    forEach([this](const char* name, const char* value) {
+        _index.add(name, value);
+        });
+    _index.setBuilt();
+}
+
+void AsyncFormParser::put(char c) {
+    if (_overflow) {
+        return;
+    }
+    if (_buffer.size() >= _maxSize) {
+        _overflow = true;
+        return;
+    }
+    _buffer.push_back(c);
+}
+
+void AsyncFormParser::endName() {
+    put('\0');
+    _inValue = true;
+}
+
+void AsyncFormParser::endField() {
+    if (_buffer.size() == _fieldStart && !_inValue) {
+        // -- Empty field, e.g. "a=1&&b=2"
+        return;
+    }
+    if (!_inValue) {
+        put('\0');
+    }
+    put('\0');
+    if (!_overflow) {
+        _count++;
+        _fieldStart = _buffer.size();
+        _index.reset(0);
+    }
+    _inValue = false;
+}
+
+int AsyncFormParser::hexValue(uint8_t c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void AsyncArgIndex::reset(size_t count) {
+    // -- Keep the load factor below 3/4, the table size is a power of two.
+    size_t size_ = 8;
+    while (size_ * 3 < count * 4) {
+        size_ <<= 1;
+    }
+    _entries.assign(count > 0 ? size_ : 0, Entry{ 0, nullptr, nullptr });
+    _mask = count > 0 ? size_ - 1 : 0;
+    _built = false;
+}
+
+void AsyncArgIndex::add(const char* name, const char* value) {
+    if (_entries.empty()) {
+        return;
+    }
+    uint32_t hash_ = hash(name);
+    size_t slot_ = hash_ & _mask;
+    while (_entries[slot_].name != nullptr) {
+        // -- The first occurrence of a name wins, like in ESPAsyncWebServer.
+        if (_entries[slot_].hash == hash_ && strcmp(_entries[slot_].name, name) == 0) {
+            return;
+        }
+        slot_ = (slot_ + 1) & _mask;
+    }
+    _entries[slot_] = Entry{ hash_, name, value };
+}
+
+const char* AsyncArgIndex::find(const char* name) const {
+    if (_entries.empty()) {
+        return nullptr;
+    }
+    uint32_t hash_ = hash(name);
+    size_t slot_ = hash_ & _mask;
+    while (_entries[slot_].name != nullptr) {
+        if (_entries[slot_].hash == hash_ && strcmp(_entries[slot_].name, name) == 0) {
+            return _entries[slot_].value;
+        }
+        slot_ = (slot_ + 1) & _mask;
+    }
+    return nullptr;
+}
+
+uint32_t AsyncArgIndex::hash(const char* s) {
+    // -- FNV-1a
+    uint32_t hash_ = 2166136261u;
+    for (; *s; s++) {
+        hash_ = (hash_ ^ static_cast<uint8_t>(*s)) * 16777619u;
+    }
+    return hash_;
+}
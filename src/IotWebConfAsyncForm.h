@@ -0,0 +1,166 @@
+/**
+ * IotWebConfAsyncForm.h -- Incremental parser for url encoded form bodies
+ *   posted to the configuration page.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCFORM_h
+#define _IOTWEBCONFASYNCFORM_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <vector>
+
+// -- Maximum size of a decoded form body. Larger posts are rejected with 413.
+#ifndef IOTWEBCONFASYNC_MAX_FORM_SIZE
+#define IOTWEBCONFASYNC_MAX_FORM_SIZE 16384
+#endif
+
+// -- Let the config page post its form through fetch() with IOTWEBCONFASYNC_FORM_CONTENT_TYPE.
+//    ESPAsyncWebServer buffers application/x-www-form-urlencoded bodies into its parameter
+//    list, other content types are handed to AsyncIotWebConfHandler::handleBody() as a stream.
+#ifndef IOTWEBCONFASYNC_STREAM_FORM_POST
+#define IOTWEBCONFASYNC_STREAM_FORM_POST 1
+#endif
+
+#ifndef IOTWEBCONFASYNC_FORM_CONTENT_TYPE
+#define IOTWEBCONFASYNC_FORM_CONTENT_TYPE "application/x-iotwebconf-form"
+#endif
+
+/**
+ * Script added to the config page, that submits the form as a url encoded stream
+ * with IOTWEBCONFASYNC_FORM_CONTENT_TYPE. Falls back to a normal submit without fetch().
+ */
+extern const char IOTWEBCONFASYNC_HTML_FORM_STREAM_SCRIPT[] PROGMEM;
+
+/**
+ * Open addressing hash index over name/value pairs, used to look up form
+ * arguments in O(1). Names and values are not copied, the index only keeps
+ * pointers, so the storage must outlive the index.
+ */
+class AsyncArgIndex {
+public:
+    /**
+     * Drop all entries and size the table for the given number of arguments.
+     */
+    void reset(size_t count);
+    void add(const char* name, const char* value);
+    const char* find(const char* name) const;
+    bool isBuilt() const { return _built; }
+    void setBuilt() { _built = true; }
+
+    static uint32_t hash(const char* s);
+
+protected:
+    struct Entry {
+        uint32_t hash;
+        const char* name;
+        const char* value;
+    };
+
+    std::vector<Entry> _entries;
+    size_t _mask = 0;
+    bool _built = false;
+};
+
+/**
+ * Decodes an application/x-www-form-urlencoded body while it arrives.
+ * The body can be fed in chunks of any size, names and values are decoded
+ * into one contiguous buffer ("name\0value\0name\0value\0...") so no
+ * String is created per argument.
+ */
+class AsyncFormParser {
+public:
+    explicit AsyncFormParser(size_t maxSize = IOTWEBCONFASYNC_MAX_FORM_SIZE);
+
+    /**
+     * Reserve the buffer for the expected body size, so the decoded data
+     * is stored in a single allocation.
+     */
+    void begin(size_t expectedSize);
+
+    /**
+     * Decode the next part of the body.
+     */
+    void feed(const uint8_t* data, size_t len);
+
+    /**
+     * Complete the last field. Must be called after the last chunk.
+     */
+    void finish();
+
+    /**
+     * Get the decoded value of a field. The first lookup builds a hash index
+     * over all fields, further lookups are O(1) and return views into the buffer.
+     * @return The value or nullptr if the field was not posted
+     */
+    const char* value(const char* name) const;
+    bool has(const char* name) const { return value(name) != nullptr; }
+
+    /**
+     * Call fn(name, value) for every completed field, in the order they were posted.
+     */
+    template <typename F>
+    void forEach(F fn) const {
+        // -- Only completed fields are visited, they end at _fieldStart.
+        const char* p_ = _buffer.data();
+        const char* end_ = p_ + _fieldStart;
+        while (p_ < end_) {
+            const char* value_ = p_ + strlen(p_) + 1;
+            fn(p_, value_);
+            p_ = value_ + strlen(value_) + 1;
+        }
+    }
+
+    size_t count() const { return _count; }
+    bool isOverflow() const { return _overflow; }
+    bool isFinished() const { return _finished; }
+
+protected:
+    enum State {
+        STATE_DATA,
+        STATE_PERCENT_HIGH,
+        STATE_PERCENT_LOW
+    };
+
+    std::vector<char> _buffer;
+    mutable AsyncArgIndex _index;
+    size_t _maxSize;
+    size_t _fieldStart;
+    size_t _count;
+    State _state;
+    uint8_t _percentHigh;
+    bool _inValue;
+    bool _overflow;
+    bool _finished;
+
+    void buildIndex() const;
+    void put(char c);
+    void endName();
+    void endField();
+    static int hexValue(uint8_t c);
+};
+
+#endif
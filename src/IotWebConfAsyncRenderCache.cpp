@@ -0,0 +1,141 @@
+#include "IotWebConfAsyncRenderCache.h"
+
+#ifdef ESP32
+#include <esp_heap_caps.h>
+#endif
+
+AsyncRenderCache::AsyncRenderCache(size_t capacity) :
+    _fillIndex(-1),
+    _fillFailed(false),
+    _capacity(capacity),
+    _size(0)
+{
+}
+
+AsyncRenderCache::~AsyncRenderCache() {
+    clear();
+}
+
+const char* AsyncRenderCache::find(const void* key, uint32_t fingerprint, size_t* length) {
+    Entry* entry_ = findEntry(key);
+    if (entry_ == nullptr || !entry_->clean || entry_->fingerprint != fingerprint) {
+        return nullptr;
+    }
+    *length = entry_->length;
+    return entry_->data;
+}
+
+void AsyncRenderCache::beginFill(const void* key, uint32_t fingerprint) {
+    abortFill();
+    if (!isEnabled()) {
+        return;
+    }
+    Entry* entry_ = findEntry(key);
+    if (entry_ == nullptr) {
+        _entries.emplace_back();
+        entry_ = &_entries.back();
+        entry_->key = key;
+    }
+    // -- The buffer is reused, a fragment rarely changes its size.
+    entry_->length = 0;
+    entry_->clean = false;
+    entry_->fingerprint = fingerprint;
+    _fillIndex = static_cast<int>(entry_ - _entries.data());
+    _fillFailed = false;
+}
+
+void AsyncRenderCache::append(const char* data, size_t len) {
+    if (_fillIndex < 0 || _fillFailed || len == 0) {
+        return;
+    }
+    Entry& entry_ = _entries[_fillIndex];
+    size_t needed_ = entry_.length + len;
+    if (needed_ > entry_.allocated) {
+        // -- Grow in steps of 256 bytes, a group is written in many small parts.
+        size_t allocated_ = (needed_ + 255) & ~static_cast<size_t>(255);
+        void* data_ = nullptr;
+        if (_size - entry_.allocated + allocated_ <= _capacity) {
+            data_ = allocate(entry_.data, allocated_);
+        }
+        if (data_ == nullptr) {
+            // -- The group is rendered every time, the fragments of the other groups stay.
+            release(entry_);
+            _fillFailed = true;
+            return;
+        }
+        _size = _size - entry_.allocated + allocated_;
+        entry_.data = static_cast<char*>(data_);
+        entry_.allocated = allocated_;
+    }
+    memcpy(entry_.data + entry_.length, data, len);
+    entry_.length = needed_;
+}
+
+void AsyncRenderCache::endFill() {
+    if (_fillIndex < 0) {
+        return;
+    }
+    _entries[_fillIndex].clean = !_fillFailed;
+    _fillIndex = -1;
+}
+
+void AsyncRenderCache::abortFill() {
+    if (_fillIndex < 0) {
+        return;
+    }
+    _entries[_fillIndex].clean = false;
+    _fillIndex = -1;
+}
+
+void AsyncRenderCache::invalidate(const void* key) {
+    Entry* entry_ = findEntry(key);
+    if (entry_ != nullptr) {
+        entry_->clean = false;
+    }
+}
+
+void AsyncRenderCache::invalidateAll() {
+    for (Entry& entry_ : _entries) {
+        entry_.clean = false;
+    }
+}
+
+void AsyncRenderCache::clear() {
+    abortFill();
+    for (Entry& entry_ : _entries) {
+        release(entry_);
+    }
+    _entries.clear();
+}
+
+AsyncRenderCache::Entry* AsyncRenderCache::findEntry(const void* key) {
+    for (Entry& entry_ : _entries) {
+        if (entry_.key == key) {
+            return &entry_;
+        }
+    }
+    return nullptr;
+}
+
+void AsyncRenderCache::release(Entry& entry) {
+    deallocate(entry.data);
+    _size -= entry.allocated;
+    entry.data = nullptr;
+    entry.length = 0;
+    entry.allocated = 0;
+    entry.clean = false;
+}
+
+void* AsyncRenderCache::allocate(void* data, size_t size) {
+#ifdef ESP32
+    if (psramFound()) {
+        return heap_caps_realloc(data, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+#endif
+    return realloc(data, size);
+}
+
+void AsyncRenderCache::deallocate(void* data) {
+    // -- heap_caps_realloc() memory is given back with free() as well.
+    free(data);
+}
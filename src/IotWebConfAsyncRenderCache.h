@@ -0,0 +1,118 @@
+/**
+ * IotWebConfAsyncRenderCache.h -- Rendered HTML of parameter groups, kept
+ *   between config page renders until the values of a group change.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCRENDERCACHE_h
+#define _IOTWEBCONFASYNCRENDERCACHE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <vector>
+
+// -- Bytes of rendered group HTML kept between renders, 0 disables the cache.
+//    On ESP32 boards with PSRAM the fragments are kept there.
+#ifndef IOTWEBCONFASYNC_RENDER_CACHE_SIZE
+#if defined(ESP32)
+#define IOTWEBCONFASYNC_RENDER_CACHE_SIZE 8192
+#else
+#define IOTWEBCONFASYNC_RENDER_CACHE_SIZE 0
+#endif
+#endif
+
+/**
+ * HTML fragments of parameter groups. A fragment is clean while the fingerprint
+ * of the group values is unchanged and the group was not marked dirty. One
+ * fragment is filled at a time, while its group is rendered.
+ * Must only be used by the task that renders the config page.
+ */
+class AsyncRenderCache {
+public:
+    explicit AsyncRenderCache(size_t capacity = IOTWEBCONFASYNC_RENDER_CACHE_SIZE);
+    ~AsyncRenderCache();
+
+    AsyncRenderCache(const AsyncRenderCache&) = delete;
+    AsyncRenderCache& operator=(const AsyncRenderCache&) = delete;
+
+    /**
+     * @param fingerprint Fingerprint of the current group values
+     * @return The clean fragment of the group, or nullptr
+     */
+    const char* find(const void* key, uint32_t fingerprint, size_t* length);
+
+    /**
+     * Capture the HTML of a group from now on, its old fragment is dropped.
+     */
+    void beginFill(const void* key, uint32_t fingerprint);
+    void append(const char* data, size_t len);
+
+    /**
+     * Keep the captured fragment, unless it did not fit into the capacity.
+     */
+    void endFill();
+    void abortFill();
+    bool isFilling(const void* key) const { return _fillIndex >= 0 && _entries[_fillIndex].key == key; }
+
+    /**
+     * Mark the fragment of one group or of all groups dirty.
+     */
+    void invalidate(const void* key);
+    void invalidateAll();
+
+    /**
+     * Free all fragments.
+     */
+    void clear();
+
+    bool isEnabled() const { return _capacity > 0; }
+    size_t getCapacity() const { return _capacity; }
+    size_t getSize() const { return _size; }
+
+protected:
+    struct Entry {
+        const void* key = nullptr;
+        char* data = nullptr;
+        size_t length = 0;
+        size_t allocated = 0;
+        uint32_t fingerprint = 0;
+        bool clean = false;
+    };
+
+    std::vector<Entry> _entries;
+    int _fillIndex;
+    bool _fillFailed;
+    size_t _capacity;
+    // -- Bytes allocated for all fragments.
+    size_t _size;
+
+    Entry* findEntry(const void* key);
+    void release(Entry& entry);
+
+    static void* allocate(void* data, size_t size);
+    static void deallocate(void* data);
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include "IotWebConfAsyncSession.h"
+
+namespace {
+    uint64_t rotl(uint64_t x, int b) {
+        return (x << b) | (x >> (64 - b));
+    }
+
+    void sipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+    }
+
+    uint64_t readUint64(const uint8_t* p) {
+        uint64_t value_ = 0;
+        for (int i = 7; i >= 0; i--) {
+            value_ = (value_ << 8) | p[i];
+        }
+        return value_;
+    }
+
+    void putUint32(uint8_t* p, uint32_t value) {
+        for (uint8_t i = 0; i < 4; i++) {
+            p[i] = (value >> (8 * i)) & 0xFF;
+        }
+    }
+
+    void putUint64(uint8_t* p, uint64_t value) {
+        for (uint8_t i = 0; i < 8; i++) {
+            p[i] = (value >> (8 * i)) & 0xFF;
+        }
+    }
+
+    uint32_t sessionRandom() {
+#ifdef ESP32
+        return esp_random();
+#elif defined(ESP8266)
+        return ESP.random();
+#else
+        return (uint32_t)random(0x7FFFFFFF) ^ ((uint32_t)random(0x7FFFFFFF) << 1);
+#endif
+    }
+
+    // -- Parse fixed length hex, returns false on any other character.
+    bool parseHex(const char* s, size_t digits, uint64_t* value) {
+        uint64_t value_ = 0;
+        for (size_t i = 0; i < digits; i++) {
+            char c_ = s[i];
+            uint8_t nibble_;
+            if (c_ >= '0' && c_ <= '9') {
+                nibble_ = c_ - '0';
+            }
+            else if (c_ >= 'a' && c_ <= 'f') {
+                nibble_ = c_ - 'a' + 10;
+            }
+            else {
+                return false;
+            }
+            value_ = (value_ << 4) | nibble_;
+        }
+        *value = value_;
+        return true;
+    }
+}
+
+AsyncSessionAuth::AsyncSessionAuth(const char* cookieName, uint32_t lifetime) :
+    _cookieName(cookieName),
+    _lifetime(lifetime),
+    _keyed(false)
+{
+}
+
+AsyncSessionAuth::Result AsyncSessionAuth::check(AsyncWebServerRequest* request, const char* username, const char* password) {
+    if (_lifetime > 0) {
+        const char* token_ = findToken(request);
+        if (token_ != nullptr && verifyToken(token_, static_cast<uint32_t>(request->client()->remoteIP()), username, password)) {
+            return SESSION_VALID;
+        }
+    }
+    if (!request->authenticate(username, password)) {
+        return SESSION_DENIED;
+    }
+    return _lifetime > 0 ? SESSION_NEW : SESSION_VALID;
+}
+
+String AsyncSessionAuth::createCookie(AsyncWebServerRequest* request, const char* username, const char* password) {
+    ensureKey();
+    uint32_t expiry_ = now() + _lifetime;
+    uint32_t nonce_ = sessionRandom();
+    uint64_t mac_ = mac(expiry_, nonce_, static_cast<uint32_t>(request->client()->remoteIP()), username, password);
+
+    char cookie_[TOKEN_LENGTH + 1];
+    snprintf(cookie_, sizeof(cookie_), "%08lx%08lx%08lx%08lx", (unsigned long)expiry_, (unsigned long)nonce_,
+        (unsigned long)(mac_ >> 32), (unsigned long)(mac_ & 0xFFFFFFFF));
+    return String(_cookieName) + "=" + cookie_ + "; Max-Age=" + String(_lifetime) + "; Path=/; HttpOnly; SameSite=Strict";
+}
+
+const char* AsyncSessionAuth::findToken(AsyncWebServerRequest* request) const {
+    const AsyncWebHeader* header_ = request->getHeader("Cookie");
+    if (header_ == nullptr) {
+        return nullptr;
+    }
+    // -- Cookies are separated by "; ", the name must match as a whole.
+    const char* cookies_ = header_->value().c_str();
+    size_t nameLength_ = strlen(_cookieName);
+    for (const char* p_ = strstr(cookies_, _cookieName); p_ != nullptr; p_ = strstr(p_ + 1, _cookieName)) {
+        bool start_ = p_ == cookies_ || p_[-1] == ' ' || p_[-1] == ';';
+        if (start_ && p_[nameLength_] == '=') {
+            const char* token_ = p_ + nameLength_ + 1;
+            if (strnlen(token_, TOKEN_LENGTH + 1) >= TOKEN_LENGTH &&
+                (token_[TOKEN_LENGTH] == '\0' || token_[TOKEN_LENGTH] == ';' || token_[TOKEN_LENGTH] == ' ')) {
+                return token_;
+            }
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+bool AsyncSessionAuth::verifyToken(const char* token, uint32_t address, const char* username, const char* password) {
+    if (!_keyed) {
+        return false;
+    }
+    uint64_t expiry_, nonce_, macHigh_, macLow_;
+    if (!parseHex(token, 8, &expiry_) || !parseHex(token + 8, 8, &nonce_) ||
+        !parseHex(token + 16, 8, &macHigh_) || !parseHex(token + 24, 8, &macLow_)) {
+        return false;
+    }
+    // -- Counted from now, so a wrapped clock ends the session instead of extending it.
+    uint32_t remaining_ = (uint32_t)expiry_ - now();
+    if (remaining_ == 0 || remaining_ > _lifetime) {
+        return false;
+    }
+
+    uint8_t expected_[8];
+    uint8_t given_[8];
+    putUint64(expected_, mac((uint32_t)expiry_, (uint32_t)nonce_, address, username, password));
+    putUint64(given_, (macHigh_ << 32) | macLow_);
+    // -- Compare every byte, the time does not tell how much of the MAC was right.
+    uint8_t diff_ = 0;
+    for (uint8_t i = 0; i < sizeof(expected_); i++) {
+        diff_ |= expected_[i] ^ given_[i];
+    }
+    return diff_ == 0;
+}
+
+uint64_t AsyncSessionAuth::mac(uint32_t expiry, uint32_t nonce, uint32_t address, const char* username, const char* password) {
+    uint8_t data_[28];
+    putUint64(data_, sipHash(_key, reinterpret_cast<const uint8_t*>(username), strlen(username)));
+    putUint64(data_ + 8, sipHash(_key, reinterpret_cast<const uint8_t*>(password), strlen(password)));
+    putUint32(data_ + 16, expiry);
+    putUint32(data_ + 20, nonce);
+    putUint32(data_ + 24, address);
+    return sipHash(_key, data_, sizeof(data_));
+}
+
+void AsyncSessionAuth::ensureKey() {
+    if (_keyed) {
+        return;
+    }
+    for (uint8_t i = 0; i < sizeof(_key); i += 4) {
+        putUint32(_key + i, sessionRandom());
+    }
+    _keyed = true;
+}
+
+uint32_t AsyncSessionAuth::now() {
+    return millis() / 1000;
+}
+
+uint64_t AsyncSessionAuth::sipHash(const uint8_t* key, const uint8_t* data, size_t len) {
+    // -- SipHash-2-4 with a 64 bit result.
+    uint64_t k0_ = readUint64(key);
+    uint64_t k1_ = readUint64(key + 8);
+    uint64_t v0_ = 0x736f6d6570736575ULL ^ k0_;
+    uint64_t v1_ = 0x646f72616e646f6dULL ^ k1_;
+    uint64_t v2_ = 0x6c7967656e657261ULL ^ k0_;
+    uint64_t v3_ = 0x7465646279746573ULL ^ k1_;
+
+    size_t end_ = len - (len % 8);
+    for (size_t i = 0; i < end_; i += 8) {
+        uint64_t m_ = readUint64(data + i);
+        v3_ ^= m_;
+        sipRound(v0_, v1_, v2_, v3_);
+        sipRound(v0_, v1_, v2_, v3_);
+        v0_ ^= m_;
+    }
+
+    uint64_t last_ = (uint64_t)(len & 0xFF) << 56;
+    for (size_t i = 0; i < len % 8; i++) {
+        last_ |= (uint64_t)data[end_ + i] << (8 * i);
+    }
+    v3_ ^= last_;
+    sipRound(v0_, v1_, v2_, v3_);
+    sipRound(v0_, v1_, v2_, v3_);
+    v0_ ^= last_;
+
+    v2_ ^= 0xFF;
+    for (uint8_t i = 0; i < 4; i++) {
+        sipRound(v0_, v1_, v2_, v3_);
+    }
+    return v0_ ^ v1_ ^ v2_ ^ v3_;
+}
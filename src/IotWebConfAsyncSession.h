@@ -0,0 +1,94 @@
+/**
+ * IotWebConfAsyncSession.h -- Signed session cookies, so a client is only
+ *   checked against the credentials once per session.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCSESSION_h
+#define _IOTWEBCONFASYNCSESSION_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <ESPAsyncWebServer.h>
+
+// -- Lifetime of a session cookie in seconds, 0 disables the sessions.
+#ifndef IOTWEBCONFASYNC_SESSION_LIFETIME
+#define IOTWEBCONFASYNC_SESSION_LIFETIME 3600
+#endif
+
+/**
+ * Issues and checks session tokens, which are kept by the client in a cookie.
+ * A token holds its expiry, a nonce and a SipHash-2-4 MAC over these, the client
+ * address and the credentials. The key is random and only lives in RAM, so a
+ * reboot or other credentials end all sessions. No state is kept per client.
+ */
+class AsyncSessionAuth {
+public:
+    enum Result {
+        SESSION_DENIED,
+        SESSION_VALID,      // the request carried a valid token
+        SESSION_NEW         // the credentials were checked, send a token from createCookie()
+    };
+
+    /**
+     * @param cookieName Name of the cookie, must stay valid
+     * @param lifetime Lifetime of a token in seconds
+     */
+    explicit AsyncSessionAuth(const char* cookieName, uint32_t lifetime = IOTWEBCONFASYNC_SESSION_LIFETIME);
+
+    /**
+     * Accept a request with a valid token without checking its credentials.
+     * Checking the token does not allocate.
+     */
+    Result check(AsyncWebServerRequest* request, const char* username, const char* password);
+
+    /**
+     * Value of the Set-Cookie header with a new token for the client of the request.
+     */
+    String createCookie(AsyncWebServerRequest* request, const char* username, const char* password);
+
+    /**
+     * End all sessions.
+     */
+    void reset() { _keyed = false; }
+
+    static const size_t TOKEN_LENGTH = 32;
+
+protected:
+    const char* _cookieName;
+    uint32_t _lifetime;
+    uint8_t _key[16];
+    bool _keyed;
+
+    void ensureKey();
+    bool verifyToken(const char* token, uint32_t address, const char* username, const char* password);
+    uint64_t mac(uint32_t expiry, uint32_t nonce, uint32_t address, const char* username, const char* password);
+    const char* findToken(AsyncWebServerRequest* request) const;
+
+    static uint32_t now();
+    static uint64_t sipHash(const uint8_t* key, const uint8_t* data, size_t len);
+};
+
+#endif
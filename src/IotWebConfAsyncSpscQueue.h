@@ -0,0 +1,136 @@
+/**
+ * IotWebConfAsyncSpscQueue.h -- Lock-free single producer / single consumer
+ *   byte queue used to hand pre-rendered page data between tasks.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCSPSCQUEUE_h
+#define _IOTWEBCONFASYNCSPSCQUEUE_h
+
+// -- Only standard headers, so the queue can also be built and tested on a host.
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Ring buffer of bytes for exactly one producer and one consumer task.
+ * Head and tail are free running counters, the capacity is a power of two.
+ * The producer only writes _head, the consumer only writes _tail, so no
+ * lock is needed; acquire/release ordering publishes the copied bytes.
+ */
+class AsyncSpscQueue {
+public:
+    /**
+     * @param capacity Size of the ring, rounded up to the next power of two.
+     */
+    explicit AsyncSpscQueue(size_t capacity) :
+        _buffer(nullptr),
+        _capacity(1),
+        _head(0),
+        _tail(0)
+    {
+        while (_capacity < capacity) {
+            _capacity <<= 1;
+        }
+        _buffer = new uint8_t[_capacity];
+    }
+
+    ~AsyncSpscQueue() {
+        delete[] _buffer;
+    }
+
+    AsyncSpscQueue(const AsyncSpscQueue&) = delete;
+    AsyncSpscQueue& operator=(const AsyncSpscQueue&) = delete;
+
+    /**
+     * Producer side. Copies as much of data as fits.
+     * @return Number of bytes queued, 0 if the queue is full
+     */
+    size_t push(const uint8_t* data, size_t len) {
+        size_t head_ = _head.load(std::memory_order_relaxed);
+        size_t tail_ = _tail.load(std::memory_order_acquire);
+        size_t free_ = _capacity - (head_ - tail_);
+        if (len > free_) {
+            len = free_;
+        }
+        copyIn(head_, data, len);
+        _head.store(head_ + len, std::memory_order_release);
+        return len;
+    }
+
+    /**
+     * Consumer side. Copies up to maxLen queued bytes into buffer.
+     * @return Number of bytes taken, 0 if the queue is empty
+     */
+    size_t pop(uint8_t* buffer, size_t maxLen) {
+        size_t tail_ = _tail.load(std::memory_order_relaxed);
+        size_t head_ = _head.load(std::memory_order_acquire);
+        size_t len_ = head_ - tail_;
+        if (len_ > maxLen) {
+            len_ = maxLen;
+        }
+        copyOut(tail_, buffer, len_);
+        _tail.store(tail_ + len_, std::memory_order_release);
+        return len_;
+    }
+
+    size_t available() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return _capacity; }
+
+    /**
+     * Drop all queued bytes. Only call while neither side is using the queue.
+     */
+    void clear() {
+        _tail.store(_head.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+protected:
+    uint8_t* _buffer;
+    size_t _capacity;
+    std::atomic<size_t> _head;
+    std::atomic<size_t> _tail;
+
+    void copyIn(size_t pos, const uint8_t* data, size_t len) {
+        size_t offset_ = pos & (_capacity - 1);
+        size_t first_ = _capacity - offset_;
+        if (first_ > len) {
+            first_ = len;
+        }
+        memcpy(_buffer + offset_, data, first_);
+        memcpy(_buffer, data + first_, len - first_);
+    }
+
+    void copyOut(size_t pos, uint8_t* buffer, size_t len) const {
+        size_t offset_ = pos & (_capacity - 1);
+        size_t first_ = _capacity - offset_;
+        if (first_ > len) {
+            first_ = len;
+        }
+        memcpy(buffer, _buffer + offset_, first_);
+        memcpy(buffer + first_, _buffer, len - first_);
+    }
+};
+
+#endif
@@ -0,0 +1,437 @@
+#include "IotWebConfAsyncStorage.h"
+
+namespace {
+    const uint8_t JOURNAL_MAGIC[AsyncJournalStorage::HEADER_SIZE] = { 'I', 'W', 'J', '1' };
+
+    // -- Journal data is read and copied in blocks of this size.
+    const size_t JOURNAL_BLOCK_SIZE = 32;
+
+    void putUint16(uint8_t* p, uint16_t value) {
+        p[0] = value & 0xFF;
+        p[1] = value >> 8;
+    }
+
+    void putUint32(uint8_t* p, uint32_t value) {
+        for (uint8_t i = 0; i < 4; i++) {
+            p[i] = (value >> (8 * i)) & 0xFF;
+        }
+    }
+
+    uint32_t getUint32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+#if defined(ESP32) || defined(ESP8266)
+    class AsyncFsStorageFile : public AsyncStorageFile {
+    public:
+        explicit AsyncFsStorageFile(fs::File file) : _file(file) {}
+        ~AsyncFsStorageFile() { _file.close(); }
+
+        size_t size() override { return _file.size(); }
+        size_t read(size_t offset, uint8_t* data, size_t len) override {
+            return _file.seek(offset) ? _file.read(data, len) : 0;
+        }
+        // -- The file is opened with "a+", writes always go to the end.
+        bool append(const uint8_t* data, size_t len) override { return _file.write(data, len) == len; }
+        bool sync() override {
+            _file.flush();
+            return true;
+        }
+
+    private:
+        fs::File _file;
+    };
+#endif
+
+    class AsyncRamStorageFile : public AsyncStorageFile {
+    public:
+        explicit AsyncRamStorageFile(std::vector<uint8_t>& data) : _data(data) {}
+
+        size_t size() override { return _data.size(); }
+        size_t read(size_t offset, uint8_t* data, size_t len) override {
+            if (offset >= _data.size()) {
+                return 0;
+            }
+            size_t read_ = _data.size() - offset < len ? _data.size() - offset : len;
+            memcpy(data, _data.data() + offset, read_);
+            return read_;
+        }
+        bool append(const uint8_t* data, size_t len) override {
+            _data.insert(_data.end(), data, data + len);
+            return true;
+        }
+        bool sync() override { return true; }
+
+    private:
+        std::vector<uint8_t>& _data;
+    };
+}
+
+size_t AsyncConfigStorage::loadItems(iotwebconf::ConfigItem* root) {
+    size_t loaded_ = 0;
+    uint16_t key_ = 0;
+    AsyncConfigItemAccess::loadItem(root, [&](iotwebconf::SerializationData* serializationData) {
+        if (load(key_, serializationData->data, serializationData->length)) {
+            loaded_++;
+        }
+        key_++;
+        });
+    return loaded_;
+}
+
+bool AsyncConfigStorage::storeItems(iotwebconf::ConfigItem* root) {
+    bool ok_ = true;
+    uint16_t key_ = 0;
+    AsyncConfigItemAccess::storeItem(root, [&](iotwebconf::SerializationData* serializationData) {
+        // -- Stop at the first failure, the save is not committed then.
+        if (ok_) {
+            ok_ = store(key_, serializationData->data, serializationData->length);
+        }
+        key_++;
+        });
+    return ok_ && commit();
+}
+
+#if defined(ESP32) || defined(ESP8266)
+AsyncStorageFile* AsyncFsStorageFs::open(const char* path) {
+    fs::File file_ = _fs.open(path, "a+");
+    if (!file_) {
+        return nullptr;
+    }
+    return new AsyncFsStorageFile(file_);
+}
+
+bool AsyncFsStorageFs::rename(const char* from, const char* to) {
+    if (_fs.rename(from, to)) {
+        return true;
+    }
+    // -- Not every file system replaces an existing file. AsyncJournalStorage::begin()
+    //    recovers from a reset between remove and rename.
+    return _fs.remove(to) && _fs.rename(from, to);
+}
+#endif
+
+AsyncStorageFile* AsyncRamStorageFs::open(const char* path) {
+    return new AsyncRamStorageFile(_files[path]);
+}
+
+bool AsyncRamStorageFs::rename(const char* from, const char* to) {
+    auto from_ = _files.find(from);
+    if (from_ == _files.end()) {
+        return false;
+    }
+    std::vector<uint8_t> data_ = std::move(from_->second);
+    _files.erase(from_);
+    _files[to] = std::move(data_);
+    return true;
+}
+
+std::vector<uint8_t>* AsyncRamStorageFs::data(const char* path) {
+    auto file_ = _files.find(path);
+    return file_ != _files.end() ? &file_->second : nullptr;
+}
+
+AsyncJournalStorage::AsyncJournalStorage(AsyncStorageFs& fs, const char* path) :
+    _fs(fs),
+    _path(path),
+    _tempPath(String(path) + ".tmp"),
+    _version(""),
+    _file(nullptr),
+    _end(0),
+    _liveSize(0),
+    _versionMatches(false),
+    _dirty(false)
+{
+}
+
+AsyncJournalStorage::~AsyncJournalStorage() {
+    delete _file;
+}
+
+bool AsyncJournalStorage::begin(const char* version) {
+    _version = version;
+    delete _file;
+    _file = nullptr;
+
+    // -- A compaction that did not finish leaves its file behind. It is complete
+    //    if the journal itself is gone, the reset came between remove and rename.
+    if (_fs.exists(_tempPath.c_str())) {
+        if (_fs.exists(_path.c_str())) {
+            _fs.remove(_tempPath.c_str());
+        }
+        else {
+            _fs.rename(_tempPath.c_str(), _path.c_str());
+        }
+    }
+
+    _file = _fs.open(_path.c_str());
+    if (_file == nullptr) {
+        return false;
+    }
+    if (_file->size() == 0 && !(_file->append(JOURNAL_MAGIC, HEADER_SIZE) && _file->sync())) {
+        return false;
+    }
+    return scan();
+}
+
+bool AsyncJournalStorage::scan() {
+    _entries.clear();
+    _pending.clear();
+    _liveSize = 0;
+    _versionMatches = false;
+    _dirty = false;
+    _end = HEADER_SIZE;
+
+    size_t size_ = _file->size();
+    uint8_t block_[JOURNAL_BLOCK_SIZE];
+    if (_file->read(0, block_, HEADER_SIZE) != HEADER_SIZE || memcmp(block_, JOURNAL_MAGIC, HEADER_SIZE) != 0) {
+        // -- Not a journal, it is replaced with the first save.
+        _dirty = true;
+        return true;
+    }
+
+    size_t versionLength_ = strlen(_version);
+    std::vector<std::pair<uint16_t, Entry>> batch_;
+    size_t offset_ = HEADER_SIZE;
+    while (offset_ + RECORD_OVERHEAD <= size_) {
+        uint8_t head_[4];
+        if (_file->read(offset_, head_, sizeof(head_)) != sizeof(head_)) {
+            break;
+        }
+        uint16_t key_ = head_[0] | (head_[1] << 8);
+        uint16_t length_ = head_[2] | (head_[3] << 8);
+        if (offset_ + RECORD_OVERHEAD + length_ > size_) {
+            break;
+        }
+
+        // -- The data is read in blocks, only its position is kept.
+        uint32_t recordCrc_ = crc32(0, head_, sizeof(head_));
+        uint32_t dataCrc_ = 0;
+        bool versionMatches_ = key_ == COMMIT_KEY && length_ == versionLength_;
+        size_t pos_ = 0;
+        while (pos_ < length_) {
+            size_t len_ = length_ - pos_ < sizeof(block_) ? length_ - pos_ : sizeof(block_);
+            if (_file->read(offset_ + 4 + pos_, block_, len_) != len_) {
+                break;
+            }
+            recordCrc_ = crc32(recordCrc_, block_, len_);
+            dataCrc_ = crc32(dataCrc_, block_, len_);
+            versionMatches_ = versionMatches_ && memcmp(block_, _version + pos_, len_) == 0;
+            pos_ += len_;
+        }
+        uint8_t crc_[4];
+        if (pos_ != length_ || _file->read(offset_ + 4 + length_, crc_, sizeof(crc_)) != sizeof(crc_) ||
+            getUint32(crc_) != recordCrc_) {
+            break;
+        }
+
+        if (key_ == COMMIT_KEY) {
+            for (const auto& pending_ : batch_) {
+                if (pending_.first >= _entries.size()) {
+                    _entries.resize(pending_.first + 1);
+                }
+                _entries[pending_.first] = pending_.second;
+            }
+            batch_.clear();
+            _versionMatches = versionMatches_;
+            _end = offset_ + RECORD_OVERHEAD + length_;
+        }
+        else {
+            Entry entry_;
+            entry_.offset = offset_ + 4;
+            entry_.crc = dataCrc_;
+            entry_.length = length_;
+            entry_.present = true;
+            batch_.emplace_back(key_, entry_);
+        }
+        offset_ += RECORD_OVERHEAD + length_;
+    }
+
+    for (const Entry& entry_ : _entries) {
+        if (entry_.present) {
+            _liveSize += RECORD_OVERHEAD + entry_.length;
+        }
+    }
+    // -- A torn or uncommitted save at the end. New records must not follow it,
+    //    they would be committed together with it.
+    _dirty = _end < size_;
+    return true;
+}
+
+bool AsyncJournalStorage::load(uint16_t key, uint8_t* data, size_t length) {
+    if (_file == nullptr || !_versionMatches || key >= _entries.size()) {
+        return false;
+    }
+    const Entry& entry_ = _entries[key];
+    if (!entry_.present || entry_.length != length) {
+        return false;
+    }
+    // -- The value is only copied after it was verified.
+    std::vector<uint8_t> buffer_(length);
+    if (_file->read(entry_.offset, buffer_.data(), length) != length || crc32(0, buffer_.data(), length) != entry_.crc) {
+        return false;
+    }
+    memcpy(data, buffer_.data(), length);
+    return true;
+}
+
+bool AsyncJournalStorage::store(uint16_t key, const uint8_t* data, size_t length) {
+    if (_file == nullptr || key == COMMIT_KEY || length >= COMMIT_KEY) {
+        return false;
+    }
+    if (_pending.empty()) {
+        // -- Values of another config version are dropped with the first save.
+        if (!_versionMatches) {
+            _entries.clear();
+            _liveSize = 0;
+            _dirty = true;
+        }
+        if (_dirty && !compact()) {
+            return false;
+        }
+    }
+
+    uint32_t crc_ = crc32(0, data, length);
+    if (key < _entries.size() && _entries[key].present && _entries[key].length == length && _entries[key].crc == crc_) {
+        return true;
+    }
+
+    Entry entry_;
+    entry_.offset = _file->size() + 4;
+    entry_.crc = crc_;
+    entry_.length = length;
+    entry_.present = true;
+    if (!appendRecord(_file, key, data, length)) {
+        _pending.clear();
+        _dirty = true;
+        return false;
+    }
+    _pending.emplace_back(key, entry_);
+    return true;
+}
+
+bool AsyncJournalStorage::commit() {
+    if (_file == nullptr) {
+        return false;
+    }
+    if (_pending.empty()) {
+        // -- Nothing changed, nothing is written.
+        return true;
+    }
+    if (!appendRecord(_file, COMMIT_KEY, reinterpret_cast<const uint8_t*>(_version), strlen(_version)) || !_file->sync()) {
+        _pending.clear();
+        _dirty = true;
+        return false;
+    }
+
+    for (const auto& pending_ : _pending) {
+        if (pending_.first >= _entries.size()) {
+            _entries.resize(pending_.first + 1);
+        }
+        Entry& entry_ = _entries[pending_.first];
+        if (entry_.present) {
+            _liveSize -= RECORD_OVERHEAD + entry_.length;
+        }
+        entry_ = pending_.second;
+        _liveSize += RECORD_OVERHEAD + entry_.length;
+    }
+    _pending.clear();
+    _end = _file->size();
+
+    if (_end > IOTWEBCONFASYNC_JOURNAL_COMPACT_SIZE && _end > 2 * _liveSize) {
+        compact();
+    }
+    return true;
+}
+
+bool AsyncJournalStorage::compact() {
+    if (_file == nullptr) {
+        return false;
+    }
+    _fs.remove(_tempPath.c_str());
+    AsyncStorageFile* temp_ = _fs.open(_tempPath.c_str());
+    if (temp_ == nullptr) {
+        return false;
+    }
+
+    std::vector<Entry> entries_ = _entries;
+    bool ok_ = temp_->append(JOURNAL_MAGIC, HEADER_SIZE);
+    for (size_t key_ = 0; ok_ && key_ < entries_.size(); key_++) {
+        if (entries_[key_].present) {
+            entries_[key_].offset = temp_->size() + 4;
+            ok_ = copyRecord(temp_, key_, _entries[key_]);
+        }
+    }
+    ok_ = ok_ && appendRecord(temp_, COMMIT_KEY, reinterpret_cast<const uint8_t*>(_version), strlen(_version)) && temp_->sync();
+    size_t end_ = temp_->size();
+    delete temp_;
+    if (!ok_) {
+        _fs.remove(_tempPath.c_str());
+        return false;
+    }
+
+    // -- The rename replaces the journal in one step, a reset before it keeps the old one.
+    delete _file;
+    ok_ = _fs.rename(_tempPath.c_str(), _path.c_str());
+    _file = _fs.open(_path.c_str());
+    if (!ok_ || _file == nullptr) {
+        return false;
+    }
+    _entries = entries_;
+    _end = end_;
+    _versionMatches = true;
+    _dirty = false;
+    return true;
+}
+
+bool AsyncJournalStorage::appendRecord(AsyncStorageFile* file, uint16_t key, const uint8_t* data, size_t length) {
+    uint8_t head_[4];
+    putUint16(head_, key);
+    putUint16(head_ + 2, length);
+    uint8_t crc_[4];
+    putUint32(crc_, crc32(crc32(0, head_, sizeof(head_)), data, length));
+    return file->append(head_, sizeof(head_)) && file->append(data, length) && file->append(crc_, sizeof(crc_));
+}
+
+bool AsyncJournalStorage::copyRecord(AsyncStorageFile* file, uint16_t key, const Entry& entry) {
+    uint8_t head_[4];
+    putUint16(head_, key);
+    putUint16(head_ + 2, entry.length);
+    if (!file->append(head_, sizeof(head_))) {
+        return false;
+    }
+    uint32_t recordCrc_ = crc32(0, head_, sizeof(head_));
+    uint32_t dataCrc_ = 0;
+    uint8_t block_[JOURNAL_BLOCK_SIZE];
+    size_t pos_ = 0;
+    while (pos_ < entry.length) {
+        size_t len_ = entry.length - pos_ < sizeof(block_) ? entry.length - pos_ : sizeof(block_);
+        if (_file->read(entry.offset + pos_, block_, len_) != len_ || !file->append(block_, len_)) {
+            return false;
+        }
+        recordCrc_ = crc32(recordCrc_, block_, len_);
+        dataCrc_ = crc32(dataCrc_, block_, len_);
+        pos_ += len_;
+    }
+    // -- Do not carry a value over that changed on the flash since it was written.
+    if (dataCrc_ != entry.crc) {
+        return false;
+    }
+    uint8_t crc_[4];
+    putUint32(crc_, recordCrc_);
+    return file->append(crc_, sizeof(crc_));
+}
+
+uint32_t AsyncJournalStorage::crc32(uint32_t crc, const uint8_t* data, size_t len) {
+    // -- CRC-32 (IEEE) with a nibble table, chained like zlib's crc32().
+    static const uint32_t TABLE[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = TABLE[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = TABLE[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
@@ -0,0 +1,248 @@
+/**
+ * IotWebConfAsyncStorage.h -- Pluggable config storage for AsyncIotWebConf,
+ *   with a CRC protected append-only journal that only writes changed values.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCSTORAGE_h
+#define _IOTWEBCONFASYNCSTORAGE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <IotWebConf.h>
+#include <map>
+#include <vector>
+
+#if defined(ESP32) || defined(ESP8266)
+#include <FS.h>
+#endif
+
+// -- Default path of the journal file.
+#ifndef IOTWEBCONFASYNC_JOURNAL_PATH
+#define IOTWEBCONFASYNC_JOURNAL_PATH "/iwc.jnl"
+#endif
+
+// -- The journal is compacted after a commit once it is larger than this
+//    and more than half of it holds replaced values.
+#ifndef IOTWEBCONFASYNC_JOURNAL_COMPACT_SIZE
+#define IOTWEBCONFASYNC_JOURNAL_COMPACT_SIZE 4096
+#endif
+
+/**
+ * Storage of the config values. Values are identified by the position of the
+ * parameter in the parameter tree, the config version guards against a changed tree.
+ */
+class AsyncConfigStorage {
+public:
+    virtual ~AsyncConfigStorage() {}
+
+    /**
+     * Open the storage, called from AsyncIotWebConf::init().
+     * @param version Config version of the firmware
+     * @return False if the storage is not usable
+     */
+    virtual bool begin(const char* version) = 0;
+
+    /**
+     * Read a stored value.
+     * @return False if the value is not stored, or stored with another length or version
+     */
+    virtual bool load(uint16_t key, uint8_t* data, size_t length) = 0;
+
+    /**
+     * Write a value as part of the current save. Backends may skip unchanged values.
+     */
+    virtual bool store(uint16_t key, const uint8_t* data, size_t length) = 0;
+
+    /**
+     * Make the values of the current save durable, all or none of them.
+     */
+    virtual bool commit() = 0;
+
+    /**
+     * Load all parameters below root, unknown values keep their current content.
+     * @return Number of loaded values
+     */
+    size_t loadItems(iotwebconf::ConfigItem* root);
+
+    /**
+     * Store all parameters below root and commit them.
+     */
+    bool storeItems(iotwebconf::ConfigItem* root);
+};
+
+/**
+ * Gives the storage access to the serialization of the parameters,
+ * which IotWebConf keeps protected.
+ */
+struct AsyncConfigItemAccess : public iotwebconf::ConfigItem {
+    typedef std::function<void(iotwebconf::SerializationData* serializationData)> Serializer;
+
+    static void storeItem(iotwebconf::ConfigItem* item, Serializer doStore) {
+        (item->*(&AsyncConfigItemAccess::storeValue))(doStore);
+    }
+    static void loadItem(iotwebconf::ConfigItem* item, Serializer doLoad) {
+        (item->*(&AsyncConfigItemAccess::loadValue))(doLoad);
+    }
+    static void updateItem(iotwebconf::ConfigItem* item, iotwebconf::WebRequestWrapper* webRequestWrapper) {
+        (item->*(&AsyncConfigItemAccess::update))(webRequestWrapper);
+    }
+};
+
+/**
+ * File opened by an AsyncStorageFs. Reads are positioned, writes are appended.
+ */
+class AsyncStorageFile {
+public:
+    virtual ~AsyncStorageFile() {}
+    virtual size_t size() = 0;
+    virtual size_t read(size_t offset, uint8_t* data, size_t len) = 0;
+    virtual bool append(const uint8_t* data, size_t len) = 0;
+
+    /**
+     * Make the appended data durable.
+     */
+    virtual bool sync() = 0;
+};
+
+/**
+ * The part of a file system the journal needs.
+ */
+class AsyncStorageFs {
+public:
+    virtual ~AsyncStorageFs() {}
+
+    /**
+     * Open a file for reading and appending, it is created if missing.
+     * @return The file, deleted by the caller, or nullptr
+     */
+    virtual AsyncStorageFile* open(const char* path) = 0;
+    virtual bool exists(const char* path) = 0;
+
+    /**
+     * Replace the file at to with the file at from, atomically if the file system can.
+     */
+    virtual bool rename(const char* from, const char* to) = 0;
+    virtual bool remove(const char* path) = 0;
+};
+
+#if defined(ESP32) || defined(ESP8266)
+/**
+ * AsyncStorageFs over an Arduino file system, e.g. LittleFS.
+ * The file system must be mounted before AsyncIotWebConf::init().
+ */
+class AsyncFsStorageFs : public AsyncStorageFs {
+public:
+    explicit AsyncFsStorageFs(fs::FS& fs) : _fs(fs) {}
+
+    AsyncStorageFile* open(const char* path) override;
+    bool exists(const char* path) override { return _fs.exists(path); }
+    bool rename(const char* from, const char* to) override;
+    bool remove(const char* path) override { return _fs.remove(path); }
+
+protected:
+    fs::FS& _fs;
+};
+#endif
+
+/**
+ * AsyncStorageFs in RAM, for hosts without a flash file system and for tests.
+ * The content is lost on reset.
+ */
+class AsyncRamStorageFs : public AsyncStorageFs {
+public:
+    AsyncStorageFile* open(const char* path) override;
+    bool exists(const char* path) override { return _files.find(path) != _files.end(); }
+    bool rename(const char* from, const char* to) override;
+    bool remove(const char* path) override { return _files.erase(path) > 0; }
+
+    /**
+     * Content of a file, e.g. to cut it and simulate a power loss.
+     */
+    std::vector<uint8_t>* data(const char* path);
+
+protected:
+    std::map<String, std::vector<uint8_t>> _files;
+};
+
+/**
+ * Config storage as an append-only journal of CRC protected records. A save
+ * appends the changed values and a commit record, a save interrupted by a power
+ * loss is dropped as a whole when the journal is read. Only the position of each
+ * value is kept in RAM.
+ *
+ * Record: key (2 bytes), length (2 bytes), data, CRC32 of the previous fields.
+ * The commit record has the key 0xFFFF and the config version as data.
+ */
+class AsyncJournalStorage : public AsyncConfigStorage {
+public:
+    AsyncJournalStorage(AsyncStorageFs& fs, const char* path = IOTWEBCONFASYNC_JOURNAL_PATH);
+    ~AsyncJournalStorage();
+
+    bool begin(const char* version) override;
+    bool load(uint16_t key, uint8_t* data, size_t length) override;
+    bool store(uint16_t key, const uint8_t* data, size_t length) override;
+    bool commit() override;
+
+    /**
+     * Rewrite the journal with the current values only.
+     */
+    bool compact();
+
+    size_t getJournalSize() const { return _end; }
+    size_t getLiveSize() const { return _liveSize; }
+
+    static const uint16_t COMMIT_KEY = 0xFFFF;
+    static const size_t HEADER_SIZE = 4;
+    static const size_t RECORD_OVERHEAD = 8;
+
+protected:
+    struct Entry {
+        uint32_t offset = 0;    // offset of the data
+        uint32_t crc = 0;       // CRC32 of the data
+        uint16_t length = 0;
+        bool present = false;
+    };
+
+    AsyncStorageFs& _fs;
+    String _path;
+    String _tempPath;
+    const char* _version;
+    AsyncStorageFile* _file;
+    std::vector<Entry> _entries;
+    std::vector<std::pair<uint16_t, Entry>> _pending;
+    size_t _end;
+    size_t _liveSize;
+    bool _versionMatches;
+    // -- The journal ends in records that were never committed, it is rewritten before the next save.
+    bool _dirty;
+
+    bool scan();
+    bool appendRecord(AsyncStorageFile* file, uint16_t key, const uint8_t* data, size_t length);
+    bool copyRecord(AsyncStorageFile* file, uint16_t key, const Entry& entry);
+    static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len);
+};
+
+#endif
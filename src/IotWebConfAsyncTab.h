@@ -29,6 +29,56 @@
 #include <vector>
 #include <map>
 
+// -- Tab switching script, copied from flash into the render arena.
+static const char ASYNC_TAB_SCRIPT[] PROGMEM =
+    "<script>" IOTWEBCONFASYNC_NL
+    "function openTab(evt,tabName){" IOTWEBCONFASYNC_NL
+    "var i,tabcontent,tablinks;" IOTWEBCONFASYNC_NL
+    "tabcontent=document.getElementsByClassName('tabcontent');" IOTWEBCONFASYNC_NL
+    "for(i=0;i<tabcontent.length;i++){" IOTWEBCONFASYNC_NL
+    "tabcontent[i].style.display='none';" IOTWEBCONFASYNC_NL
+    "}" IOTWEBCONFASYNC_NL
+    "tablinks=document.getElementsByClassName('tablinks');" IOTWEBCONFASYNC_NL
+    "for(i=0;i<tablinks.length;i++){" IOTWEBCONFASYNC_NL
+    "tablinks[i].className=tablinks[i].className.replace(' active','');" IOTWEBCONFASYNC_NL
+    "}" IOTWEBCONFASYNC_NL
+    "var tabElement=document.getElementById(tabName);" IOTWEBCONFASYNC_NL
+    "if(tabElement){" IOTWEBCONFASYNC_NL
+    "tabElement.style.display='block';" IOTWEBCONFASYNC_NL
+    "}" IOTWEBCONFASYNC_NL
+    "if(evt&&evt.currentTarget){" IOTWEBCONFASYNC_NL
+    "evt.currentTarget.className+=' active';" IOTWEBCONFASYNC_NL
+    "}" IOTWEBCONFASYNC_NL
+    "}" IOTWEBCONFASYNC_NL
+    "</script>" IOTWEBCONFASYNC_NL;
+
+// -- Switches to the tab of an input that failed the browser validation.
+static const char ASYNC_TAB_VALIDATION_SCRIPT[] PROGMEM =
+    "document.addEventListener('DOMContentLoaded',function(){" IOTWEBCONFASYNC_NL
+    "var form=document.querySelector('form');" IOTWEBCONFASYNC_NL
+    "if(form){" IOTWEBCONFASYNC_NL
+    "var inputs=form.querySelectorAll('input,select,textarea');" IOTWEBCONFASYNC_NL
+    "inputs.forEach(function(input){" IOTWEBCONFASYNC_NL
+    "input.addEventListener('invalid',function(e){" IOTWEBCONFASYNC_NL
+    "var tabContent=this.closest('.tabcontent');" IOTWEBCONFASYNC_NL
+    "if(tabContent&&tabContent.style.display!=='block'){" IOTWEBCONFASYNC_NL
+    "e.preventDefault();" IOTWEBCONFASYNC_NL
+    "var tabId=tabContent.id;" IOTWEBCONFASYNC_NL
+    "var tabButton=document.querySelector('.tablinks[onclick*=\"'+tabId+'\"]');" IOTWEBCONFASYNC_NL
+    "if(tabButton){" IOTWEBCONFASYNC_NL
+    "tabButton.click();" IOTWEBCONFASYNC_NL
+    "setTimeout(function(){" IOTWEBCONFASYNC_NL
+    "input.reportValidity();" IOTWEBCONFASYNC_NL
+    "},100);" IOTWEBCONFASYNC_NL
+    "}" IOTWEBCONFASYNC_NL
+    "}" IOTWEBCONFASYNC_NL
+    "});" IOTWEBCONFASYNC_NL
+    "});" IOTWEBCONFASYNC_NL
+    "}" IOTWEBCONFASYNC_NL
+    "});" IOTWEBCONFASYNC_NL;
+
+static const char ASYNC_TAB_END[] = "</div>" IOTWEBCONFASYNC_NL;
+
  /**
   * Structure to hold tab information
   */
@@ -58,22 +108,9 @@ public:
         String style = HtmlFormatProvider::getStyleInner();
 
         // Main container - configurable width for consistency across tabs
-        style += "body > div{min-width:" + String(_minWidth) + "px;max-width:" + String(_maxWidth) + "px;width:100%;box-sizing:border-box;}\n";
-
-        // Tab container styling
-        style += ".tab{overflow:hidden;border-bottom:2px solid #16A1E7;background-color:#f1f1f1;margin-bottom:10px;display:flex;}\n";
-        // Tab button styling
-        style += ".tab button{background-color:#f1f1f1 !important;flex:1 1 0;min-width:0;border:1px solid #ccc !important;outline:none;cursor:pointer;";
-        style += "padding:14px 16px;transition:0.3s;font-size:16px;border-top-left-radius:5px;border-top-right-radius:5px;";
-        style += "margin-right:2px;border-bottom:none !important;color:#333 !important;line-height:normal !important;width:auto !important;box-sizing:border-box;}\n";
-        // Tab button hover
-        style += ".tab button:hover{background-color:#ddd !important;}\n";
-        // Active tab button
-        style += ".tab button.active{background-color:#16A1E7 !important;color:white !important;border:1px solid #16A1E7 !important;border-bottom:2px solid #fff !important;position:relative;z-index:1;}\n";
-        // Tab content - ALL hidden by default
-        style += ".tabcontent{display:none;padding:12px;border:1px solid #ccc;border-top:none;background-color:#fff;}\n";
-        // Fieldsets consistent width
-        style += "fieldset{width:100%;box-sizing:border-box;}\n";
+        style += "body>div{min-width:" + String(_minWidth) + "px;max-width:" + String(_maxWidth) + "px;width:100%;box-sizing:border-box;}" IOTWEBCONFASYNC_NL;
+        // Tabs, buttons and tab content, shared with TabOptionalGroupHtmlFormatProvider
+        style += FPSTR(IOTWEBCONFASYNC_TAB_STYLE);
 
         return style;
     }
@@ -82,29 +119,7 @@ public:
         String s = HtmlFormatProvider::getScriptInner();
 
         // Auto-switch to tab with validation error
-        s += F("\n// Auto-switch to tab with validation error\n");
-        s += F("document.addEventListener('DOMContentLoaded',function(){\n");
-        s += F("  var form=document.querySelector('form');\n");
-        s += F("  if(form){\n");
-        s += F("    var inputs=form.querySelectorAll('input,select,textarea');\n");
-        s += F("    inputs.forEach(function(input){\n");
-        s += F("      input.addEventListener('invalid',function(e){\n");
-        s += F("        var tabContent=this.closest('.tabcontent');\n");
-        s += F("        if(tabContent && tabContent.style.display!=='block'){\n");
-        s += F("          e.preventDefault();\n");
-        s += F("          var tabId=tabContent.id;\n");
-        s += F("          var tabButton=document.querySelector('.tablinks[onclick*=\"'+tabId+'\"]');\n");
-        s += F("          if(tabButton){\n");
-        s += F("            tabButton.click();\n");
-        s += F("            setTimeout(function(){\n");
-        s += F("              input.reportValidity();\n");
-        s += F("            },100);\n");
-        s += F("          }\n");
-        s += F("        }\n");
-        s += F("      });\n");
-        s += F("    });\n");
-        s += F("  }\n");
-        s += F("});\n");
+        s += FPSTR(ASYNC_TAB_VALIDATION_SCRIPT);
 
         return s;
     }
@@ -203,231 +218,173 @@ public:
         return &_tabs;
     }
 
-    size_t getNextChunk(uint8_t* buffer, size_t maxLen) override {
-        bool dataArrived_ = false;
-        size_t written_ = 0;
-        const size_t MAX_INTERNAL_BUFFER = 32000;
-
-        while (_currentTabChunkStep != CHUNK_TAB_DONE && written_ < maxLen) {
-            yield();
-
-            if (_chunkBufferPos >= _chunkBuffer.length()) {
-                _chunkBuffer = "";
-                _chunkBufferPos = 0;
-
-                HtmlChunkCallback writer_ = [&](const char* data, size_t len) -> size_t {
-                    yield();
-                    size_t available = MAX_INTERNAL_BUFFER - _chunkBuffer.length();
-                    if (available == 0) return 0;
-                    size_t toWrite = (len < available) ? len : available;
-                    size_t oldLen = _chunkBuffer.length();
-                    _chunkBuffer.concat(data, toWrite);
-                    return _chunkBuffer.length() - oldLen;
-                    };
-
-                switch (_currentTabChunkStep) {
-                case CHUNK_TAB_HEAD:
-                    _chunkBuffer = this->getHtmlFormatProvider()->getHead();
-                    _chunkBuffer.replace("{v}", String("Config ") + this->getThingName());
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_SCRIPT:
-                    _chunkBuffer = this->getHtmlFormatProvider()->getScript();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_STYLE:
-                    _chunkBuffer = this->getHtmlFormatProvider()->getStyle();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_HEADEXT:
-                    _chunkBuffer = this->getHtmlFormatProvider()->getHeadExtension();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_HEADEND:
-                    _chunkBuffer = this->getHtmlFormatProvider()->getHeadEnd();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_FORMSTART:
-                    _chunkBuffer = this->getHtmlFormatProvider()->getFormStart();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_TABSCRIPT:
-                    _chunkBuffer = generateTabScript();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_BUTTONS:
-                    _chunkBuffer = generateTabButtons();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_SYSTEM_TAB_START:
-                    // System tab visibility depends on its position
-                    _chunkBuffer = "<div id='" + String(_systemTabName) + "' class='tabcontent'";
-                    if (_systemTabPosition == 0) {
-                        _chunkBuffer += " style='display:block;'";
-                    }
-                    else {
-                        _chunkBuffer += " style='display:none;'";
-                    }
-                    _chunkBuffer += ">\n";
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_SYSTEMPARAMS:
-                    _lastStepFinished = this->getSystemParameterGroup()->renderHtml(dataArrived_, _webRequestWrapper, writer_);
-                    break;
-                case CHUNK_TAB_SYSTEM_CUSTOM:
-                    if (_systemCustomGroupIndex < _tabs.size()) {
-                        while (_systemCustomGroupIndex < _tabs.size() &&
-                            strcmp(_tabs[_systemCustomGroupIndex].tabName, _systemTabName) != 0) {
-                            _systemCustomGroupIndex++;
-                        }
-
-                        if (_systemCustomGroupIndex < _tabs.size() &&
-                            strcmp(_tabs[_systemCustomGroupIndex].tabName, _systemTabName) == 0) {
-                            _lastStepFinished = _tabs[_systemCustomGroupIndex].group->renderHtml(
-                                dataArrived_, _webRequestWrapper, writer_);
-
-                            if (_lastStepFinished) {
-                                _systemCustomGroupIndex++;
-                            }
-                        }
-                        else {
-                            _lastStepFinished = true;
-                        }
-                    }
-                    else {
-                        _lastStepFinished = true;
-                    }
-                    break;
-                case CHUNK_TAB_SYSTEM_TAB_END:
-                    _chunkBuffer = "</div>\n";
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_CUSTOM_TABS_START:
-                    _currentTabIndex = 0;
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_CUSTOM_TAB_START:
-                    if (_currentTabIndex < _uniqueTabsList.size()) {
-                        _chunkBuffer = "<div id='" + String(_uniqueTabsList[_currentTabIndex]) + "' class='tabcontent'";
-
-                        // Determine if this tab should be visible on load
-                        // Calculate the actual position of this custom tab
-                        int actualPosition = _currentTabIndex;
-                        if (_systemTabPosition >= 0 && _systemTabPosition <= (int)_currentTabIndex) {
-                            actualPosition++; // System tab comes before this one
-                        }
-
-                        // First tab (position 0) should be visible
-                        if (actualPosition == 0) {
-                            _chunkBuffer += " style='display:block;'";
-                        }
-                        else {
-                            _chunkBuffer += " style='display:none;'";
-                        }
-                        _chunkBuffer += ">\n";
-
-                        _currentTabGroupIndex = 0;
-                        _lastStepFinished = true;
-                    }
-                    else {
-                        _currentTabChunkStep = static_cast<ChunkStepTab>(CHUNK_TAB_FORMEND - 1);
-                        _lastStepFinished = true;
-                    }
-                    break;
-                case CHUNK_TAB_CUSTOM_TAB_CONTENT:
-                    if (_currentTabIndex < _uniqueTabsList.size()) {
-                        const char* currentTab = _uniqueTabsList[_currentTabIndex];
-
-                        while (_currentTabGroupIndex < _tabs.size() &&
-                            strcmp(_tabs[_currentTabGroupIndex].tabName, currentTab) != 0) {
-                            _currentTabGroupIndex++;
-                        }
-
-                        if (_currentTabGroupIndex < _tabs.size() &&
-                            strcmp(_tabs[_currentTabGroupIndex].tabName, currentTab) == 0) {
-                            _lastStepFinished = _tabs[_currentTabGroupIndex].group->renderHtml(
-                                dataArrived_, _webRequestWrapper, writer_);
-
-                            if (_lastStepFinished) {
-                                _currentTabGroupIndex++;
-                            }
-                        }
-                        else {
-                            _lastStepFinished = true;
-                        }
-                    }
-                    else {
-                        _lastStepFinished = true;
-                    }
-                    break;
-                case CHUNK_TAB_CUSTOM_TAB_END:
-                    if (_currentTabIndex < _uniqueTabsList.size()) {
-                        _chunkBuffer = "</div>\n";
-                        _currentTabIndex++;
-                        if (_currentTabIndex < _uniqueTabsList.size()) {
-                            _currentTabChunkStep = static_cast<ChunkStepTab>(CHUNK_TAB_CUSTOM_TAB_START - 1);
-                        }
-                    }
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_FORMEND:
-                    _chunkBuffer = this->getHtmlFormatProvider()->getFormEnd();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_UPDATE:
-                    _chunkBuffer = this->getUpdateLinkHtml();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_CONFIGVER:
-                    _chunkBuffer = this->getConfigVersionHtml();
-                    _lastStepFinished = true;
-                    break;
-                case CHUNK_TAB_END:
-                    _chunkBuffer = this->getHtmlFormatProvider()->getEnd();
-                    _lastStepFinished = true;
-                    break;
-                default:
-                    _chunkBuffer = "";
-                    _lastStepFinished = true;
-                    break;
+protected:
+    void renderChunkStep(HtmlChunkCallback& writer) override {
+        switch (_currentTabChunkStep) {
+        case CHUNK_TAB_HEAD:
+            renderHeadChunk();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_SCRIPT:
+            _chunkBuffer = this->getHtmlFormatProvider()->getScript();
+            appendFormStreamScript();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_STYLE:
+            _chunkBuffer = this->getHtmlFormatProvider()->getStyle();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_HEADEXT:
+            _chunkBuffer = this->getHtmlFormatProvider()->getHeadExtension();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_HEADEND:
+            _chunkBuffer = this->getHtmlFormatProvider()->getHeadEnd();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_FORMSTART:
+            _chunkBuffer = this->getHtmlFormatProvider()->getFormStart();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_TABSCRIPT:
+            generateTabScript();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_BUTTONS:
+            generateTabButtons();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_SYSTEM_TAB_START:
+            // System tab visibility depends on its position
+            generateTabStart(_systemTabName, _systemTabPosition == 0);
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_SYSTEMPARAMS:
+            _lastStepFinished = renderGroup(this->getSystemParameterGroup(), writer);
+            break;
+        case CHUNK_TAB_SYSTEM_CUSTOM:
+            if (_systemCustomGroupIndex < _tabs.size()) {
+                while (_systemCustomGroupIndex < _tabs.size() &&
+                    strcmp(_tabs[_systemCustomGroupIndex].tabName, _systemTabName) != 0) {
+                    _systemCustomGroupIndex++;
                 }
 
-                _chunkBufferPos = 0;
+                if (_systemCustomGroupIndex < _tabs.size() &&
+                    strcmp(_tabs[_systemCustomGroupIndex].tabName, _systemTabName) == 0) {
+                    _lastStepFinished = renderGroup(_tabs[_systemCustomGroupIndex].group, writer);
 
-                if (_chunkBuffer.length() == 0 && _lastStepFinished) {
-                    _currentTabChunkStep = static_cast<ChunkStepTab>(_currentTabChunkStep + 1);
-                    continue;
+                    if (_lastStepFinished) {
+                        _systemCustomGroupIndex++;
+                    }
                 }
-
-                if (_chunkBuffer.length() == 0 && !_lastStepFinished) {
-                    break;
+                else {
+                    _lastStepFinished = true;
                 }
             }
+            else {
+                _lastStepFinished = true;
+            }
+            break;
+        case CHUNK_TAB_SYSTEM_TAB_END:
+            setChunkView(ASYNC_TAB_END, sizeof(ASYNC_TAB_END) - 1);
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_CUSTOM_TABS_START:
+            _currentTabIndex = 0;
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_CUSTOM_TAB_START:
+            if (_currentTabIndex < _uniqueTabsList.size()) {
+                // Determine if this tab should be visible on load
+                // Calculate the actual position of this custom tab
+                int actualPosition = _currentTabIndex;
+                if (_systemTabPosition >= 0 && _systemTabPosition <= (int)_currentTabIndex) {
+                    actualPosition++; // System tab comes before this one
+                }
 
-            size_t toCopy_ = std::min(maxLen - written_, _chunkBuffer.length() - _chunkBufferPos);
-            memcpy(buffer + written_, _chunkBuffer.c_str() + _chunkBufferPos, toCopy_);
-            _chunkBufferPos += toCopy_;
-            written_ += toCopy_;
+                // First tab (position 0) should be visible
+                generateTabStart(_uniqueTabsList[_currentTabIndex], actualPosition == 0);
 
-            if (_chunkBufferPos >= _chunkBuffer.length()) {
-                if (_lastStepFinished && _currentTabChunkStep != CHUNK_TAB_CUSTOM_TAB_CONTENT && _currentTabChunkStep != CHUNK_TAB_SYSTEM_CUSTOM) {
-                    _currentTabChunkStep = static_cast<ChunkStepTab>(_currentTabChunkStep + 1);
+                _currentTabGroupIndex = 0;
+                _lastStepFinished = true;
+            }
+            else {
+                _currentTabChunkStep = static_cast<ChunkStepTab>(CHUNK_TAB_FORMEND - 1);
+                _lastStepFinished = true;
+            }
+            break;
+        case CHUNK_TAB_CUSTOM_TAB_CONTENT:
+            if (_currentTabIndex < _uniqueTabsList.size()) {
+                const char* currentTab = _uniqueTabsList[_currentTabIndex];
+
+                while (_currentTabGroupIndex < _tabs.size() &&
+                    strcmp(_tabs[_currentTabGroupIndex].tabName, currentTab) != 0) {
+                    _currentTabGroupIndex++;
+                }
+
+                if (_currentTabGroupIndex < _tabs.size() &&
+                    strcmp(_tabs[_currentTabGroupIndex].tabName, currentTab) == 0) {
+                    _lastStepFinished = renderGroup(_tabs[_currentTabGroupIndex].group, writer);
+
+                    if (_lastStepFinished) {
+                        _currentTabGroupIndex++;
+                    }
+                }
+                else {
+                    _lastStepFinished = true;
                 }
-                break;
             }
             else {
-                break;
+                _lastStepFinished = true;
             }
+            break;
+        case CHUNK_TAB_CUSTOM_TAB_END:
+            if (_currentTabIndex < _uniqueTabsList.size()) {
+                setChunkView(ASYNC_TAB_END, sizeof(ASYNC_TAB_END) - 1);
+                _currentTabIndex++;
+                if (_currentTabIndex < _uniqueTabsList.size()) {
+                    _currentTabChunkStep = static_cast<ChunkStepTab>(CHUNK_TAB_CUSTOM_TAB_START - 1);
+                }
+            }
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_FORMEND:
+            _chunkBuffer = this->getHtmlFormatProvider()->getFormEnd();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_UPDATE:
+            _chunkBuffer = this->getUpdateLinkHtml();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_CONFIGVER:
+            _chunkBuffer = this->getConfigVersionHtml();
+            _lastStepFinished = true;
+            break;
+        case CHUNK_TAB_END:
+            _chunkBuffer = this->getHtmlFormatProvider()->getEnd();
+            _lastStepFinished = true;
+            break;
+        default:
+            _chunkBuffer = "";
+            _lastStepFinished = true;
+            break;
         }
+    }
 
-        if (_currentTabChunkStep == CHUNK_TAB_DONE) {
-            resetChunkState();
-            return 0;
-        }
+    bool isChunkDone() const override {
+        return _currentTabChunkStep == CHUNK_TAB_DONE;
+    }
 
-        return written_;
+    void nextChunkStep(bool afterCopy) override {
+        // -- The group steps advance their own index and only move on
+        //    once no group of the tab is left.
+        if (afterCopy && (_currentTabChunkStep == CHUNK_TAB_CUSTOM_TAB_CONTENT || _currentTabChunkStep == CHUNK_TAB_SYSTEM_CUSTOM)) {
+            return;
+        }
+        _currentTabChunkStep = static_cast<ChunkStepTab>(_currentTabChunkStep + 1);
     }
 
+public:
     void resetChunkState() override {
         AsyncIotWebConf::resetChunkState();
         _currentTabChunkStep = CHUNK_TAB_HEAD;
@@ -449,34 +406,67 @@ private:
     size_t _systemCustomGroupIndex;
     ChunkStepTab _currentTabChunkStep;
 
-    String generateTabScript() {
-        String script = "<script type='text/javascript'>\n";
-        script += "function openTab(evt,tabName){\n";
-        script += "var i,tabcontent,tablinks;\n";
-        script += "tabcontent=document.getElementsByClassName('tabcontent');\n";
-        script += "for(i=0;i<tabcontent.length;i++){\n";
-        script += "tabcontent[i].style.display='none';\n";
-        script += "}\n";
-        script += "tablinks=document.getElementsByClassName('tablinks');\n";
-        script += "for(i=0;i<tablinks.length;i++){\n";
-        script += "tablinks[i].className=tablinks[i].className.replace(' active','');\n";
-        script += "}\n";
-        script += "var tabElement=document.getElementById(tabName);\n";
-        script += "if(tabElement){\n";
-        script += "tabElement.style.display='block';\n";
-        script += "}\n";
-        script += "if(evt&&evt.currentTarget){\n";
-        script += "evt.currentTarget.className+=' active';\n";
-        script += "}\n";
-        script += "}\n";
-        script += "</script>\n";
-        return script;
+    /**
+     * Appends to _chunkBuffer, stands in for the arena once it is exhausted.
+     */
+    struct ChunkBufferWriter {
+        String& buffer;
+        void append(const char* s) { buffer += s; }
+        void append(const String& s) { buffer += s; }
+    };
+
+    /**
+     * Send the string built in _arena.
+     * @return False if the arena is exhausted and nothing was sent
+     */
+    bool endArenaChunk() {
+        size_t length_ = 0;
+        const char* chunk_ = _arena.endString(&length_);
+        setChunkView(chunk_, length_);
+        return chunk_ != nullptr;
+    }
+
+    void generateTabStart(const char* tabName, bool visible) {
+        _arena.beginString();
+        appendTabStart(_arena, tabName, visible);
+        if (!endArenaChunk()) {
+            // -- Arena exhausted, build the chunk in the heap string like renderHeadChunk().
+            _chunkBuffer = "";
+            ChunkBufferWriter writer_{ _chunkBuffer };
+            appendTabStart(writer_, tabName, visible);
+        }
+    }
+
+    void generateTabButtons() {
+        _arena.beginString();
+        appendTabButtons(_arena);
+        if (!endArenaChunk()) {
+            _chunkBuffer = "";
+            ChunkBufferWriter writer_{ _chunkBuffer };
+            appendTabButtons(writer_);
+        }
+    }
+
+    void generateTabScript() {
+        _arena.beginString();
+        _arena.append_P(ASYNC_TAB_SCRIPT);
+        if (!endArenaChunk()) {
+            _chunkBuffer = FPSTR(ASYNC_TAB_SCRIPT);
+        }
+    }
+
+    template<typename Out>
+    void appendTabStart(Out& out, const char* tabName, bool visible) {
+        out.append("<div id='");
+        out.append(tabName);
+        out.append("' class='tabcontent'");
+        out.append(visible ? " style='display:block;'" : " style='display:none;'");
+        out.append(">" IOTWEBCONFASYNC_NL);
     }
 
-    String generateTabButtons() {
-        String buttons;
-        buttons.reserve(512);  // Reserve memory upfront
-        buttons = "<div class='tab'>\n";
+    template<typename Out>
+    void appendTabButtons(Out& out) {
+        out.append("<div class='tab'>" IOTWEBCONFASYNC_NL);
 
         // Calculate system tab position
         int systemPos = _systemTabPosition;
@@ -497,31 +487,30 @@ private:
         for (int pos = 0; pos <= (int)totalCustomTabs; pos++) {
             // Check if system tab should be at this position
             if (pos == systemPos && !systemTabAdded) {
-                buttons += "<button type='button' class='tablinks";
-                if (pos == 0) buttons += " active";  // First tab is active
-                buttons += "' onclick='openTab(event,\"";
-                buttons += _systemTabName;
-                buttons += "\");'>";
-                buttons += _systemTabName;
-                buttons += "</button>\n";
+                out.append("<button type='button' class='tablinks");
+                if (pos == 0) out.append(" active");  // First tab is active
+                out.append("' onclick='openTab(event,\"");
+                out.append(_systemTabName);
+                out.append("\");'>");
+                out.append(_systemTabName);
+                out.append("</button>" IOTWEBCONFASYNC_NL);
                 systemTabAdded = true;
             }
 
             // Add custom tab if available and we haven't added all yet
             if (customTabsAdded < (int)totalCustomTabs) {
-                buttons += "<button type='button' class='tablinks";
-                if (pos == 0 && !systemTabAdded) buttons += " active";
-                buttons += "' onclick='openTab(event,\"";
-                buttons += _uniqueTabsList[customTabsAdded];
-                buttons += "\");'>";
-                buttons += _uniqueTabsList[customTabsAdded];
-                buttons += "</button>\n";
+                out.append("<button type='button' class='tablinks");
+                if (pos == 0 && !systemTabAdded) out.append(" active");
+                out.append("' onclick='openTab(event,\"");
+                out.append(_uniqueTabsList[customTabsAdded]);
+                out.append("\");'>");
+                out.append(_uniqueTabsList[customTabsAdded]);
+                out.append("</button>" IOTWEBCONFASYNC_NL);
                 customTabsAdded++;
             }
         }
 
-        buttons += "</div>\n";
-        return buttons;
+        out.append(ASYNC_TAB_END);
     }
 
     friend class AsyncTabHtmlFormatProvider;
@@ -0,0 +1,146 @@
+#include "IotWebConfAsyncTemplate.h"
+
+AsyncHtmlTemplate::AsyncHtmlTemplate(const char* source, bool flash, const char* const* slots, uint8_t slotCount,
+    char open, char close) :
+    _source(source),
+    _slots(slots),
+    _slotCount(slotCount),
+    _flash(flash),
+    _open(open),
+    _close(close),
+    _compiled(false)
+{
+}
+
+size_t AsyncHtmlTemplate::length(const AsyncTemplateValue* values) const {
+    if (!_compiled) {
+        compile();
+    }
+    size_t length_ = 0;
+    for (const Segment& segment_ : _segments) {
+        length_ += segment_.slot < 0 ? segment_.length : values[segment_.slot].length;
+    }
+    return length_;
+}
+
+size_t AsyncHtmlTemplate::read(size_t index, uint8_t* buffer, size_t maxLen, const AsyncTemplateValue* values) const {
+    if (!_compiled) {
+        compile();
+    }
+    size_t written_ = 0;
+    size_t start_ = 0;
+    for (const Segment& segment_ : _segments) {
+        if (written_ >= maxLen) {
+            break;
+        }
+        const char* text_;
+        size_t length_;
+        bool flash_;
+        if (segment_.slot < 0) {
+            text_ = _source + segment_.offset;
+            length_ = segment_.length;
+            flash_ = _flash;
+        }
+        else {
+            text_ = values[segment_.slot].text;
+            length_ = values[segment_.slot].length;
+            flash_ = values[segment_.slot].flash;
+        }
+
+        // -- Skip the segments that were already sent.
+        if (index >= start_ + length_) {
+            start_ += length_;
+            continue;
+        }
+        size_t from_ = index > start_ ? index - start_ : 0;
+        size_t count_ = length_ - from_;
+        if (count_ > maxLen - written_) {
+            count_ = maxLen - written_;
+        }
+        if (flash_) {
+            memcpy_P(buffer + written_, text_ + from_, count_);
+        }
+        else {
+            memcpy(buffer + written_, text_ + from_, count_);
+        }
+        written_ += count_;
+        start_ += length_;
+    }
+    return written_;
+}
+
+String AsyncHtmlTemplate::toString(const AsyncTemplateValue* values) const {
+    String result_;
+    size_t length_ = length(values);
+    if (!result_.reserve(length_)) {
+        return result_;
+    }
+    char buffer_[64];
+    size_t index_ = 0;
+    while (index_ < length_) {
+        size_t read_ = read(index_, reinterpret_cast<uint8_t*>(buffer_), sizeof(buffer_), values);
+        result_.concat(buffer_, read_);
+        index_ += read_;
+    }
+    return result_;
+}
+
+char AsyncHtmlTemplate::charAt(size_t pos) const {
+    return _flash ? static_cast<char>(pgm_read_byte(_source + pos)) : _source[pos];
+}
+
+int8_t AsyncHtmlTemplate::findSlot(size_t start, size_t length) const {
+    for (uint8_t i = 0; i < _slotCount; i++) {
+        const char* name_ = _slots[i];
+        size_t j = 0;
+        while (j < length && name_[j] != '\0' && name_[j] == charAt(start + j)) {
+            j++;
+        }
+        if (j == length && name_[j] == '\0') {
+            return static_cast<int8_t>(i);
+        }
+    }
+    return -1;
+}
+
+void AsyncHtmlTemplate::addLiteral(size_t start, size_t end) const {
+    if (end <= start) {
+        return;
+    }
+    _segments.push_back(Segment{ static_cast<uint32_t>(start), static_cast<uint32_t>(end - start), -1 });
+}
+
+void AsyncHtmlTemplate::compile() const {
+    _segments.clear();
+    size_t literalStart_ = 0;
+    size_t pos_ = 0;
+    char c_;
+    while ((c_ = charAt(pos_)) != '\0') {
+        if (c_ != _open) {
+            pos_++;
+            continue;
+        }
+        size_t nameStart_ = pos_ + 1;
+        size_t nameEnd_ = nameStart_;
+        while (nameEnd_ - nameStart_ <= IOTWEBCONFASYNC_TEMPLATE_MAX_SLOT_NAME) {
+            char n_ = charAt(nameEnd_);
+            if (n_ == _close || n_ == '\0') {
+                break;
+            }
+            nameEnd_++;
+        }
+        int8_t slot_ = charAt(nameEnd_) == _close ? findSlot(nameStart_, nameEnd_ - nameStart_) : -1;
+        if (slot_ < 0) {
+            // -- Unknown placeholders stay part of the literal.
+            pos_++;
+            continue;
+        }
+        addLiteral(literalStart_, pos_);
+        _segments.push_back(Segment{ static_cast<uint32_t>(pos_), 0, slot_ });
+        pos_ = nameEnd_ + 1;
+        literalStart_ = pos_;
+    }
+    addLiteral(literalStart_, pos_);
+    _segments.shrink_to_fit();
+    _compiled = true;
+}
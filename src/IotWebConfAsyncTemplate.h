@@ -0,0 +1,120 @@
+/**
+ * IotWebConfAsyncTemplate.h -- Precompiled HTML templates with placeholders
+ *   that are streamed without copying the template.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCTEMPLATE_h
+#define _IOTWEBCONFASYNCTEMPLATE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <vector>
+
+// -- Longest placeholder name, longer bracketed text is kept as literal.
+#ifndef IOTWEBCONFASYNC_TEMPLATE_MAX_SLOT_NAME
+#define IOTWEBCONFASYNC_TEMPLATE_MAX_SLOT_NAME 16
+#endif
+
+/**
+ * Value inlined for a placeholder. The text is not copied and may live in
+ * RAM or in flash, it must stay valid while the template is streamed.
+ */
+struct AsyncTemplateValue {
+    const char* text;
+    size_t length;
+    bool flash;
+
+    static AsyncTemplateValue ram(const char* text) {
+        return AsyncTemplateValue{ text, text ? strlen(text) : 0, false };
+    }
+    static AsyncTemplateValue ram(const String& text) {
+        return AsyncTemplateValue{ text.c_str(), text.length(), false };
+    }
+    static AsyncTemplateValue progmem(PGM_P text) {
+        return AsyncTemplateValue{ text, text ? strlen_P(text) : 0, true };
+    }
+};
+
+/**
+ * Template with named placeholders like [PATH] or {v}. The source is split
+ * into literal and slot segments once, at first use. Afterwards any part of
+ * the output can be read directly into a response buffer, literals are copied
+ * from the source and values are inlined, so the expanded page never exists
+ * as a whole in RAM.
+ */
+class AsyncHtmlTemplate {
+public:
+    /**
+     * @param source Template text, in flash if flash is true
+     * @param slots Names of the placeholders, value i of read() belongs to slots[i]
+     * @param open Character starting a placeholder
+     * @param close Character ending a placeholder
+     */
+    AsyncHtmlTemplate(const char* source, bool flash, const char* const* slots, uint8_t slotCount,
+        char open = '[', char close = ']');
+
+    /**
+     * Length of the expanded template, e.g. for the Content-Length header.
+     */
+    size_t length(const AsyncTemplateValue* values) const;
+
+    /**
+     * Copy the expanded template from position index on into buffer.
+     * Fits the AwsResponseFiller signature, so the template can be streamed
+     * by a response with a known length.
+     * @return Number of bytes copied, 0 at the end
+     */
+    size_t read(size_t index, uint8_t* buffer, size_t maxLen, const AsyncTemplateValue* values) const;
+
+    /**
+     * Expand the whole template into a String with a single allocation.
+     */
+    String toString(const AsyncTemplateValue* values) const;
+
+protected:
+    // -- 32 bit positions, a head from a format provider may be longer than 64 KB.
+    struct Segment {
+        uint32_t offset;
+        uint32_t length;
+        int8_t slot;    // -1 for literal text
+    };
+
+    const char* _source;
+    const char* const* _slots;
+    uint8_t _slotCount;
+    bool _flash;
+    char _open;
+    char _close;
+    mutable bool _compiled;
+    mutable std::vector<Segment> _segments;
+
+    void compile() const;
+    char charAt(size_t pos) const;
+    int8_t findSlot(size_t start, size_t length) const;
+    void addLiteral(size_t start, size_t end) const;
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "IotWebConfAsyncUpdatePuller.h"
+#include "IotWebConfAsyncBundle.h"
+
+AsyncUpdatePuller::AsyncUpdatePuller(AsyncUpdateServer& updater) :
+    _updater(updater),
+    _state(PULL_IDLE),
+    _size(0),
+    _offset(0),
+    _skip(0),
+    _bandwidth(0),
+    _tokens(0),
+    _lastRefill(0),
+    _lastData(0),
+    _retryAt(0),
+    _retries(0)
+{
+}
+
+bool AsyncUpdatePuller::begin(const String& manifestUrl, const String& currentVersion) {
+    if (isRunning()) {
+        return false;
+    }
+    _manifestUrl = manifestUrl;
+    _currentVersion = currentVersion;
+    _version = "";
+    _imageUrl = "";
+    _md5 = "";
+    _error = "";
+    _size = 0;
+    _offset = 0;
+    _retries = 0;
+    _state = PULL_MANIFEST;
+    return true;
+}
+
+void AsyncUpdatePuller::loop() {
+    switch (_state) {
+    case PULL_MANIFEST:
+        fetchManifest();
+        break;
+    case PULL_CONNECT:
+        if (millis() - _retryAt >= IOTWEBCONFASYNCUPDATE_PULL_RETRY_MS) {
+            connect();
+        }
+        break;
+    case PULL_DOWNLOAD:
+        download();
+        break;
+    default:
+        break;
+    }
+}
+
+void AsyncUpdatePuller::cancel() {
+    if (_state == PULL_CONNECT || _state == PULL_DOWNLOAD) {
+        _http.end();
+        _updater.abortStream();
+    }
+    if (isRunning()) {
+        _error = "Cancelled";
+        _state = PULL_FAILED;
+    }
+}
+
+void AsyncUpdatePuller::fetchManifest() {
+    // -- The manifest is small, it is read in one go.
+    _http.begin(_client, _manifestUrl);
+    _http.setTimeout(IOTWEBCONFASYNCUPDATE_PULL_TIMEOUT_MS);
+    int code_ = _http.GET();
+    if (code_ != HTTP_CODE_OK) {
+        _http.end();
+        fail("Manifest request failed: " + (code_ < 0 ? HTTPClient::errorToString(code_) : String(code_)));
+        return;
+    }
+    String manifest_ = _http.getString();
+    _http.end();
+
+    if (!parseManifest(manifest_)) {
+        return;
+    }
+    if (_version == _currentVersion) {
+        _state = PULL_UP_TO_DATE;
+        return;
+    }
+    if (!_updater.beginStream(_size, _md5)) {
+        fail(_updater.getUpdaterError());
+        return;
+    }
+    Serial.println("Pulling version " + _version + " from " + _imageUrl);
+    _state = PULL_CONNECT;
+    _retryAt = millis() - IOTWEBCONFASYNCUPDATE_PULL_RETRY_MS;
+}
+
+bool AsyncUpdatePuller::parseManifest(const String& manifest) {
+    String url_;
+    int start_ = 0;
+    while (start_ < (int)manifest.length()) {
+        int end_ = manifest.indexOf('\n', start_);
+        if (end_ < 0) {
+            end_ = manifest.length();
+        }
+        String line_ = manifest.substring(start_, end_);
+        start_ = end_ + 1;
+
+        line_.trim();
+        int separator_ = line_.indexOf('=');
+        if (separator_ <= 0) {
+            continue;
+        }
+        String key_ = line_.substring(0, separator_);
+        String value_ = line_.substring(separator_ + 1);
+        key_.trim();
+        value_.trim();
+        if (key_ == "version") {
+            _version = value_;
+        }
+        else if (key_ == "url") {
+            url_ = value_;
+        }
+        else if (key_ == "size") {
+            // -- A size that is not positive leaves _size 0 and fails the manifest.
+            long size_ = value_.toInt();
+            _size = size_ > 0 ? (size_t)size_ : 0;
+        }
+        else if (key_ == "md5") {
+            _md5 = value_;
+        }
+    }
+
+    if (_version.length() == 0 || url_.length() == 0 || _size == 0 || _md5.length() != 32) {
+        fail("Invalid manifest");
+        return false;
+    }
+    _imageUrl = resolveUrl(url_);
+    return true;
+}
+
+String AsyncUpdatePuller::resolveUrl(const String& url) const {
+    if (url.indexOf("://") > 0) {
+        return url;
+    }
+    int host_ = _manifestUrl.indexOf("://");
+    if (url.startsWith("/")) {
+        int path_ = _manifestUrl.indexOf('/', host_ < 0 ? 0 : host_ + 3);
+        return (path_ < 0 ? _manifestUrl : _manifestUrl.substring(0, path_)) + url;
+    }
+    return _manifestUrl.substring(0, _manifestUrl.lastIndexOf('/') + 1) + url;
+}
+
+void AsyncUpdatePuller::connect() {
+    _http.begin(_client, _imageUrl);
+    _http.setTimeout(IOTWEBCONFASYNCUPDATE_PULL_TIMEOUT_MS);
+    if (_offset > 0) {
+        _http.addHeader("Range", "bytes=" + String(_offset) + "-");
+    }
+
+    int code_ = _http.GET();
+    if (code_ == HTTP_CODE_PARTIAL_CONTENT) {
+        _skip = 0;
+    }
+    else if (code_ == HTTP_CODE_OK) {
+        // -- The server ignored the range, skip what was already written.
+        _skip = _offset;
+        if (_http.getSize() > 0 && (size_t)_http.getSize() != _size) {
+            _http.end();
+            _updater.abortStream();
+            fail("Image size does not match the manifest");
+            return;
+        }
+    }
+    else {
+        retry("Image request failed");
+        return;
+    }
+
+    _state = PULL_DOWNLOAD;
+    _lastData = millis();
+    _lastRefill = _lastData;
+    _tokens = 0;
+}
+
+void AsyncUpdatePuller::download() {
+    WiFiClient* stream_ = _http.getStreamPtr();
+    size_t available_ = stream_ != nullptr ? stream_->available() : 0;
+    if (available_ == 0) {
+        if (stream_ == nullptr || !stream_->connected()) {
+            retry("Connection lost");
+        }
+        else if (millis() - _lastData > IOTWEBCONFASYNCUPDATE_PULL_TIMEOUT_MS) {
+            retry("Download stalled");
+        }
+        return;
+    }
+
+    size_t len_ = available_ < sizeof(_buffer) ? available_ : sizeof(_buffer);
+    if (_skip > 0) {
+        // -- Skipped data is not counted against the bandwidth.
+        int read_ = stream_->read(_buffer, len_ < _skip ? len_ : _skip);
+        if (read_ > 0) {
+            _skip -= read_;
+            _lastData = millis();
+        }
+        return;
+    }
+
+    size_t remaining_ = _size - _offset;
+    if (len_ > remaining_) {
+        len_ = remaining_;
+    }
+    size_t allowance_ = takeAllowance();
+    if (len_ > allowance_) {
+        len_ = allowance_;
+    }
+    // -- The first write must contain the bundle magic.
+    size_t minimum_ = _size < IOTWEBCONFASYNC_BUNDLE_HEADER_SIZE ? _size : IOTWEBCONFASYNC_BUNDLE_HEADER_SIZE;
+    if (len_ == 0 || (_offset == 0 && len_ < minimum_)) {
+        return;
+    }
+
+    int read_ = stream_->read(_buffer, len_);
+    if (read_ <= 0) {
+        return;
+    }
+    if (_bandwidth > 0) {
+        _tokens -= read_;
+    }
+    _lastData = millis();
+    _retries = 0;
+
+    if (!_updater.writeStream(_buffer, read_)) {
+        _http.end();
+        _updater.abortStream();
+        fail(_updater.getUpdaterError());
+        return;
+    }
+    _offset += read_;
+
+    if (_offset >= _size) {
+        _http.end();
+        if (_updater.endStream()) {
+            Serial.println("Pull update finished");
+            _state = PULL_DONE;
+        }
+        else {
+            fail(_updater.getUpdaterError());
+        }
+    }
+}
+
+size_t AsyncUpdatePuller::takeAllowance() {
+    if (_bandwidth == 0) {
+        return sizeof(_buffer);
+    }
+    // -- Token bucket, refilled with the configured rate and capped at one buffer.
+    unsigned long now_ = millis();
+    uint64_t refill_ = (uint64_t)_bandwidth * (now_ - _lastRefill) / 1000;
+    if (refill_ > 0) {
+        _lastRefill = now_;
+        _tokens = _tokens + refill_ > sizeof(_buffer) ? sizeof(_buffer) : _tokens + refill_;
+    }
+    return _tokens;
+}
+
+void AsyncUpdatePuller::retry(const char* reason) {
+    _http.end();
+    if (++_retries > IOTWEBCONFASYNCUPDATE_PULL_MAX_RETRIES) {
+        _updater.abortStream();
+        fail(String(reason) + " at " + String(_offset));
+        return;
+    }
+    Serial.printf("%s at %u, resuming\n", reason, (unsigned int)_offset);
+    _state = PULL_CONNECT;
+    _retryAt = millis();
+}
+
+void AsyncUpdatePuller::fail(const String& error) {
+    Serial.println("Pull update failed: " + error);
+    _error = error;
+    _state = PULL_FAILED;
+}
@@ -0,0 +1,141 @@
+/**
+ * IotWebConfAsyncUpdatePuller.h -- Pulls a firmware image or update bundle
+ *   from an HTTP mirror, described by a small manifest.
+ *
+ * Copyright (c) 2024 Andreas Zogg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _IOTWEBCONFASYNCUPDATEPULLER_h
+#define _IOTWEBCONFASYNCUPDATEPULLER_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#ifdef ESP8266
+#include <ESP8266HTTPClient.h>
+#else
+#include <HTTPClient.h>
+#endif
+#include <WiFiClient.h>
+
+#include "IotWebConfAsyncUpdateServer.h"
+
+// -- Bytes read from the connection per loop() call.
+#ifndef IOTWEBCONFASYNCUPDATE_PULL_BUFFER_SIZE
+#define IOTWEBCONFASYNCUPDATE_PULL_BUFFER_SIZE 1024
+#endif
+
+// -- Timeout for connecting and for a stalled download.
+#ifndef IOTWEBCONFASYNCUPDATE_PULL_TIMEOUT_MS
+#define IOTWEBCONFASYNCUPDATE_PULL_TIMEOUT_MS 10000
+#endif
+
+// -- Delay before a broken download is resumed with a range request.
+#ifndef IOTWEBCONFASYNCUPDATE_PULL_RETRY_MS
+#define IOTWEBCONFASYNCUPDATE_PULL_RETRY_MS 5000
+#endif
+
+#ifndef IOTWEBCONFASYNCUPDATE_PULL_MAX_RETRIES
+#define IOTWEBCONFASYNCUPDATE_PULL_MAX_RETRIES 5
+#endif
+
+/**
+ * Downloads an update from an HTTP server, e.g. a mirror in the LAN.
+ * The manifest is a text file with one key=value per line:
+ *   version=1.5.0
+ *   url=firmware-1.5.0.bin   (absolute, or relative to the manifest)
+ *   size=1234567
+ *   md5=<hex MD5 of the image>
+ * The image is downloaded in loop() and written through AsyncUpdateServer,
+ * so it can be a plain firmware image or a bundle. A broken connection is
+ * resumed with a range request at the current offset.
+ */
+class AsyncUpdatePuller {
+public:
+    enum State : uint8_t {
+        PULL_IDLE,
+        PULL_MANIFEST,
+        PULL_CONNECT,
+        PULL_DOWNLOAD,
+        PULL_UP_TO_DATE,
+        PULL_DONE,
+        PULL_FAILED
+    };
+
+    explicit AsyncUpdatePuller(AsyncUpdateServer& updater);
+
+    /**
+     * Check the manifest and download the image, if its version differs from
+     * the current one. The work is done in loop().
+     */
+    bool begin(const String& manifestUrl, const String& currentVersion);
+
+    /**
+     * Limit the download rate, so the application keeps running smoothly.
+     * @param bytesPerSecond 0 for no limit
+     */
+    void setBandwidth(uint32_t bytesPerSecond) { _bandwidth = bytesPerSecond; }
+
+    void loop();
+    void cancel();
+
+    State getState() const { return _state; }
+    bool isRunning() const { return _state == PULL_MANIFEST || _state == PULL_CONNECT || _state == PULL_DOWNLOAD; }
+    const String& getError() const { return _error; }
+    const String& getVersion() const { return _version; }
+    size_t getProgress() const { return _offset; }
+    size_t getSize() const { return _size; }
+
+protected:
+    AsyncUpdateServer& _updater;
+    HTTPClient _http;
+    WiFiClient _client;
+    State _state;
+    String _manifestUrl;
+    String _currentVersion;
+    String _version;
+    String _imageUrl;
+    String _md5;
+    String _error;
+    size_t _size;
+    size_t _offset;
+    size_t _skip;
+    uint32_t _bandwidth;
+    uint32_t _tokens;
+    unsigned long _lastRefill;
+    unsigned long _lastData;
+    unsigned long _retryAt;
+    uint8_t _retries;
+    uint8_t _buffer[IOTWEBCONFASYNCUPDATE_PULL_BUFFER_SIZE];
+
+    void fetchManifest();
+    bool parseManifest(const String& manifest);
+    void connect();
+    void download();
+    void retry(const char* reason);
+    void fail(const String& error);
+    size_t takeAllowance();
+    String resolveUrl(const String& url) const;
+};
+
+#endif
@@ -19,11 +19,17 @@
 
 #include <IotWebConf.h>
 #include "IotWebConfAsyncUpdateServer.h"
+#include "IotWebConfAsyncTemplate.h"
+#include "IotWebConfAsyncBundle.h"
 
 
 #include <WiFi.h>
 #include <WiFiClient.h>
 #include <StreamString.h>
+#include <MD5Builder.h>
+#ifdef ESP8266
+#include <eboot_command.h>
+#endif
 
 #ifdef ESP8266
 #include <Updater.h>
@@ -31,17 +37,26 @@
 #elif defined(ESP32)
 #include <Update.h>
 #include <esp_task_wdt.h>
+#include <esp_ota_ops.h>
 #define U_PART U_SPIFFS
 #endif
 
+#if defined(ESP32) && IOTWEBCONFASYNCUPDATE_BOOT_VERIFY
+// -- Keep a new image pending after boot, the Arduino core would confirm it
+//    right away otherwise. AsyncUpdateServer confirms or rolls it back.
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+#endif
+
+#define IOTWEBCONFASYNCUPDATE_STR_(x) #x
+#define IOTWEBCONFASYNCUPDATE_STR(x) IOTWEBCONFASYNCUPDATE_STR_(x)
 
 const char IOTWEBCONFASYNCUPDATE_HTML_REBOOT_MSG[] PROGMEM = R"(
 <!DOCTYPE html>
 <html>
 <head>
-    <style>
-        [STYLE]
-    </style>
+    <link rel="stylesheet" href=")" IOTWEBCONFASYNCUPDATE_STYLE_PATH R"(">
     <meta http-equiv="refresh" content="15; url=/">
     <title>Rebooting...</title>
 </head>
@@ -53,12 +68,12 @@ const char IOTWEBCONFASYNCUPDATE_HTML_REBOOT_MSG[] PROGMEM = R"(
 </html>
 )";
 
+const char IOTWEBCONFASYNCUPDATE_MSG_REBOOTING[] PROGMEM = "Update completed. Please wait while the device is rebooting...";
+
 const char IOTWEBCONFASYNCUPDATE_HTML_FORM_FIRMWARE[] PROGMEM = R"(
 <!DOCTYPE html>
 <html lang="en"><head><meta name="viewport" content="width=device-width, initial-scale=1, user-scalable=no"/>
-<style>
-[STYLE]
-</style>
+<link rel="stylesheet" href=")" IOTWEBCONFASYNCUPDATE_STYLE_PATH R"(">
 </head><body>
     <table border="0" align="center">
         <tbody><tr><td>
@@ -67,8 +82,21 @@ const char IOTWEBCONFASYNCUPDATE_HTML_FORM_FIRMWARE[] PROGMEM = R"(
                     <legend>Firmware update</legend>
                     <input type="file" name="update" id="updateFile" style="width: 500px"><br>
                     <button type="submit">Upload</button>
+                    <progress id="updateProgress" max="100" value="0" style="width: 500px; display: none"></progress>
                 </fieldset>
             </form>
+            <script>
+            document.querySelector('form').addEventListener('submit', function() {
+                var p = document.getElementById('updateProgress');
+                p.style.display = 'block';
+                if (!window.EventSource) return;
+                new EventSource('[PATH]/events').addEventListener('progress', function(e) {
+                    var d = JSON.parse(e.data);
+                    if (d.total) p.value = 100 * d.written / d.total;
+                    p.title = Math.round(d.rate / 1024) + ' kB/s, ' + d.eta + ' s left';
+                });
+            });
+            </script>
         </td></tr>
     </table>
     <table border=0 align=center>
@@ -78,26 +106,363 @@ const char IOTWEBCONFASYNCUPDATE_HTML_FORM_FIRMWARE[] PROGMEM = R"(
 </body></html>
 )";
 
+// -- Placeholders of the update pages, the values are passed in this order.
+static const char* const UPDATE_TEMPLATE_SLOTS[] = { "PATH", "Message" };
+
+enum UpdateTemplateSlot {
+    SLOT_PATH,
+    SLOT_MESSAGE,
+    SLOT_COUNT
+};
+
+static const AsyncHtmlTemplate UPDATE_FORM_TEMPLATE(IOTWEBCONFASYNCUPDATE_HTML_FORM_FIRMWARE, true, UPDATE_TEMPLATE_SLOTS, SLOT_COUNT);
+static const AsyncHtmlTemplate UPDATE_REBOOT_TEMPLATE(IOTWEBCONFASYNCUPDATE_HTML_REBOOT_MSG, true, UPDATE_TEMPLATE_SLOTS, SLOT_COUNT);
+
+static void setUpdateValues(AsyncTemplateValue* values, const String& path, const String& message, PGM_P flashMessage) {
+    values[SLOT_PATH] = AsyncTemplateValue::ram(path);
+    values[SLOT_MESSAGE] = flashMessage ? AsyncTemplateValue::progmem(flashMessage) : AsyncTemplateValue::ram(message);
+}
+
+/**
+ * Stream an update page template. The filler keeps its own copy of the
+ * text values, the response outlives the caller.
+ * @param flashMessage Message in flash, used instead of message if set
+ */
+static void sendUpdateTemplate(AsyncWebServerRequest* request, const AsyncHtmlTemplate& html,
+    const String& path, const String& message, PGM_P flashMessage = nullptr, const String& cookie = String()) {
+    AsyncTemplateValue values_[SLOT_COUNT];
+    setUpdateValues(values_, path, message, flashMessage);
+
+    AsyncWebServerResponse* response_ = request->beginResponse("text/html", html.length(values_),
+        [&html, path, message, flashMessage](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            AsyncTemplateValue values_[SLOT_COUNT];
+            setUpdateValues(values_, path, message, flashMessage);
+            return html.read(index, buffer, maxLen, values_);
+        });
+    if (cookie.length() > 0) {
+        response_->addHeader("Set-Cookie", cookie);
+    }
+    request->send(response_);
+}
+
+/**
+ * Disable the task watchdog while flash is written.
+ * @return True if it was active and has to be enabled again
+ */
+static bool suspendWatchdog(bool serialOutput) {
+#ifdef ESP32
+    // WICHTIG: Prfen ob Watchdog aktiv ist und dann deaktivieren
+    esp_err_t wdt_status_ = esp_task_wdt_status(NULL);
+    if (wdt_status_ == ESP_OK) {
+        esp_task_wdt_deinit();
+        if (serialOutput) {
+            Serial.println("Watchdog Timer disabled for firmware update");
+        }
+        return true;
+    }
+    if (serialOutput) {
+        Serial.println("Watchdog Timer was not active");
+    }
+#endif
+    return false;
+}
+
+static void resumeWatchdog(bool wasActive, const char* reason, bool serialOutput) {
+#ifdef ESP32
+    // Bei Fehler Watchdog nur wieder aktivieren, wenn er vorher aktiv war
+    if (wasActive) {
+        if (serialOutput) {
+            Serial.println(reason);
+        }
+        esp_task_wdt_config_t wdt_config_ = {
+            .timeout_ms = 30000,
+            .idle_core_mask = 0,
+            .trigger_panic = true
+        };
+        esp_task_wdt_init(&wdt_config_);
+        esp_task_wdt_add(NULL);
+    }
+#else
+    (void)wasActive;
+    (void)reason;
+#endif
+}
+
+/**
+ * Routes the sections of an update bundle: firmware and file system images go
+ * to the Updater with their MD5, the config section is buffered and verified.
+ * Nothing is activated before commit(), which runs once every section of the
+ * bundle was verified: the config goes to the config handler, then the new
+ * firmware becomes the boot partition (ESP32) or the eboot copy command is
+ * written (ESP8266). A file system section is written in
+ * place by the Updater and cannot be undone, a later failure leaves it written.
+ */
+class AsyncUpdateBundleSink : public AsyncBundleSink {
+public:
+    explicit AsyncUpdateBundleSink(const AsyncUpdateServer::THandlerFunction_Config& configHandler) :
+        _configHandler(configHandler),
+        _type(0)
+#ifdef ESP32
+        , _firmwarePartition(nullptr)
+#elif defined(ESP8266)
+        , _bootCommandHeld(false)
+#endif
+    {
+    }
+
+    bool beginSection(uint8_t type, uint32_t size, const uint8_t* md5) override {
+        _type = type;
+        memcpy(_md5, md5, sizeof(_md5));
+
+        if (type == BUNDLE_SECTION_CONFIG) {
+            if (!_configHandler || size > IOTWEBCONFASYNCUPDATE_MAX_CONFIG_SECTION) {
+                _error = F("Config section not accepted");
+                return false;
+            }
+            _config.clear();
+            _config.reserve(size);
+            return true;
+        }
+        if (type != BUNDLE_SECTION_FIRMWARE && type != BUNDLE_SECTION_FILESYSTEM) {
+            _error = F("Unknown section type");
+            return false;
+        }
+
+#ifdef ESP8266
+        Update.runAsync(true);
+#endif
+        if (!Update.begin(size, type == BUNDLE_SECTION_FIRMWARE ? U_FLASH : U_PART)) {
+            setUpdateError();
+            return false;
+        }
+        char hex_[33];
+        toHex(md5, hex_);
+        Update.setMD5(hex_);
+        return true;
+    }
+
+    bool writeSection(const uint8_t* data, size_t len) override {
+        if (_type == BUNDLE_SECTION_CONFIG) {
+            _config.insert(_config.end(), data, data + len);
+            return true;
+        }
+        if (Update.write(const_cast<uint8_t*>(data), len) != len) {
+            setUpdateError();
+            return false;
+        }
+        return true;
+    }
+
+    bool endSection() override {
+        if (_type == BUNDLE_SECTION_CONFIG) {
+            MD5Builder md5_;
+            md5_.begin();
+            md5_.add(_config.data(), _config.size());
+            md5_.calculate();
+            uint8_t digest_[16];
+            md5_.getBytes(digest_);
+            bool ok_ = memcmp(digest_, _md5, sizeof(digest_)) == 0;
+            if (!ok_) {
+                _error = F("Config section MD5 mismatch");
+                std::vector<uint8_t>().swap(_config);
+                return false;
+            }
+            // -- Kept until commit(), the handler must not see it before the other sections are verified.
+            _configVerified = true;
+            return true;
+        }
+        // -- Update.end() checks the MD5 given in beginSection().
+        if (!Update.end()) {
+            setUpdateError();
+            return false;
+        }
+#ifdef ESP32
+        if (_type == BUNDLE_SECTION_FIRMWARE) {
+            // -- Update.end() made the new image the boot partition, keep booting
+            //    the running one until commit().
+            _firmwarePartition = esp_ota_get_boot_partition();
+            if (esp_ota_set_boot_partition(esp_ota_get_running_partition()) != ESP_OK) {
+                _firmwarePartition = nullptr;
+                _error = F("Could not defer the boot partition switch");
+                return false;
+            }
+        }
+#elif defined(ESP8266)
+        if (_type == BUNDLE_SECTION_FIRMWARE) {
+            // -- Update.end() told eboot to copy the new image at the next boot,
+            //    the command is taken back and written again in commit().
+            if (eboot_command_read(&_bootCommand) != 0) {
+                _error = F("Could not defer the firmware copy");
+                return false;
+            }
+            eboot_command_clear();
+            _bootCommandHeld = true;
+        }
+#endif
+        return true;
+    }
+
+    /**
+     * Activate the bundle after all sections were verified.
+     * @return False if the config handler rejected the config or the new firmware could not be activated
+     */
+    bool commit() {
+        if (_configVerified) {
+            bool accepted_ = _configHandler(_config.data(), _config.size());
+            std::vector<uint8_t>().swap(_config);
+            _configVerified = false;
+            if (!accepted_) {
+                _error = F("Config section rejected by handler");
+                abort();
+                return false;
+            }
+        }
+#ifdef ESP32
+        if (_firmwarePartition != nullptr) {
+            const esp_partition_t* partition_ = _firmwarePartition;
+            _firmwarePartition = nullptr;
+            if (esp_ota_set_boot_partition(partition_) != ESP_OK) {
+                _error = F("Could not activate the new firmware");
+                return false;
+            }
+        }
+#elif defined(ESP8266)
+        if (_bootCommandHeld) {
+            _bootCommandHeld = false;
+            eboot_command_write(&_bootCommand);
+        }
+#endif
+        return true;
+    }
+
+    /**
+     * Stop a running image section after an error.
+     */
+    void abort() {
+#ifdef ESP32
+        if (Update.isRunning()) {
+            Update.abort();
+        }
+        // -- The boot partition still points at the running image.
+        _firmwarePartition = nullptr;
+#elif defined(ESP8266)
+        // -- The copy command was cleared in endSection(), the running image stays.
+        _bootCommandHeld = false;
+#endif
+        std::vector<uint8_t>().swap(_config);
+        _configVerified = false;
+    }
+
+    const String& getError() const { return _error; }
+
+protected:
+    const AsyncUpdateServer::THandlerFunction_Config& _configHandler;
+    uint8_t _type;
+    uint8_t _md5[16];
+    std::vector<uint8_t> _config;
+    bool _configVerified = false;
+#ifdef ESP32
+    // -- Verified firmware that becomes the boot partition in commit().
+    const esp_partition_t* _firmwarePartition;
+#elif defined(ESP8266)
+    // -- eboot command of the verified firmware, written in commit().
+    struct eboot_command _bootCommand;
+    bool _bootCommandHeld;
+#endif
+    String _error;
+
+    void setUpdateError() {
+        StreamString str_;
+        Update.printError(str_);
+        _error = str_.c_str();
+    }
+
+    static void toHex(const uint8_t* md5, char* hex) {
+        static const char digits_[] = "0123456789abcdef";
+        for (uint8_t i = 0; i < 16; i++) {
+            hex[i * 2] = digits_[md5[i] >> 4];
+            hex[i * 2 + 1] = digits_[md5[i] & 0x0f];
+        }
+        hex[32] = '\0';
+    }
+};
+
+/**
+ * Checks the clients of the progress event stream like the update pages, so the
+ * session cookie of the form page is accepted as well as the credentials.
+ * AsyncEventSource only knows the credentials. Added to the web server before
+ * the event source, which then only gets the requests this let through.
+ */
+class AsyncUpdateEventsHandler : public AsyncWebHandler {
+public:
+    AsyncUpdateEventsHandler(AsyncEventSource* events, std::shared_ptr<AsyncUpdateServer*> updater) :
+        _events(events),
+        _updater(updater)
+    {
+    }
+
+    bool canHandle(AsyncWebServerRequest* request) const override {
+        return request->method() == HTTP_GET && request->url() == _events->url();
+    }
+
+    void handleRequest(AsyncWebServerRequest* request) override {
+        AsyncUpdateServer* updater_ = *_updater;
+        if (updater_ == nullptr) {
+            request->send(404);
+            return;
+        }
+        // -- authorize() asked for credentials if it denied the request.
+        if (updater_->authorize(request) == AsyncSessionAuth::SESSION_DENIED) {
+            return;
+        }
+        _events->handleRequest(request);
+    }
+
+private:
+    AsyncEventSource* _events;
+    std::shared_ptr<AsyncUpdateServer*> _updater;
+};
+
 AsyncUpdateServer::AsyncUpdateServer(bool serial_debug) : 
     _serial_output(serial_debug),
     _server(nullptr),
     _username(String()),
     _password(String()),
-    _authenticated(false),
+    _auth("iwc_update_session"),
     _updaterError(""),
-    _handleUpdateFinished(false)
+    _handleUpdateFinished(false),
+    _writeRate(IOTWEBCONFASYNCUPDATE_WRITE_RATE),
+    _bundleSink(nullptr),
+    _bundleParser(nullptr),
+    _streamSize(0),
+    _bootState(BOOT_NORMAL),
+    _healthTimeout(0),
+    _bootStart(0),
+    _events(nullptr),
+    _progressSeq(0),
+    _progressWritten(0),
+    _progressTotal(0),
+    _progressRate(0),
+    _lastProgressEvent(0),
+    _lastProgressSeq(0)
 {
 }
 
+AsyncUpdateServer::~AsyncUpdateServer() {
+    delete _bundleParser;
+    delete _bundleSink;
+    // -- _events and its handler belong to the web server since addHandler(), which deletes them.
+    if (_self) {
+        *_self = nullptr;
+    }
+}
+
 void AsyncUpdateServer::setup(AsyncWebServer* server) {
     setup(server, String(), String());
 }
 
 void AsyncUpdateServer::setup(AsyncWebServer* server, const String& path) {
     setup(server, path, String(), String());
-#ifdef ESP32
-    Update.onProgress(printProgress);
-#endif
 }
 
 #ifdef ESP32
@@ -111,9 +476,6 @@ void AsyncUpdateServer::setup(AsyncWebServer* server, const String& path, THandl
 
 void AsyncUpdateServer::setup(AsyncWebServer* server, const String& username, const String& password) {
     setup(server, "/update", username, password);
-#ifdef ESP32
-    Update.onProgress(printProgress);
-#endif
 }
 
 void AsyncUpdateServer::setup(AsyncWebServer* server, const String& path, const String& username, const String& password) {
@@ -121,26 +483,102 @@ void AsyncUpdateServer::setup(AsyncWebServer* server, const String& path, const
     _username = username;
     _password = password;
 
+    checkBootState();
+
+    // handler for the update status, registered before the form page, which would match it too
+    _server->on((path + "/status").c_str(), HTTP_GET,
+        [this](AsyncWebServerRequest* request) {
+            AsyncSessionAuth::Result auth_ = authorize(request);
+            if (auth_ == AsyncSessionAuth::SESSION_DENIED) {
+                return;
+            }
+            AsyncWebServerResponse* response_ = request->beginResponse(200, "application/json", getStatusJson());
+            if (auth_ == AsyncSessionAuth::SESSION_NEW) {
+                response_->addHeader("Set-Cookie", sessionCookie(request, auth_));
+            }
+            request->send(response_);
+        }
+    );
+
+    // event stream with the progress of a running update, also matched by the form page handler
+    if (_events == nullptr) {
+        _events = new AsyncEventSource((path + "/events").c_str());
+        _self = std::make_shared<AsyncUpdateServer*>(this);
+        _server->addHandler(new AsyncUpdateEventsHandler(_events, _self));
+        _server->addHandler(_events);
+    }
+
+    // handler for the stylesheet shared by the update pages, served from flash and cached
+    // by the browser, so the reboot page does not need to send it again
+    _server->on(IOTWEBCONFASYNCUPDATE_STYLE_PATH, HTTP_GET,
+        [](AsyncWebServerRequest* request) {
+            AsyncWebServerResponse* response_ = request->beginResponse_P(200, "text/css",
+                reinterpret_cast<const uint8_t*>(IOTWEBCONF_HTML_STYLE_INNER), strlen_P(IOTWEBCONF_HTML_STYLE_INNER));
+            response_->addHeader("Cache-Control", "public, max-age=" IOTWEBCONFASYNCUPDATE_STR(IOTWEBCONFASYNCUPDATE_STYLE_MAX_AGE));
+            request->send(response_);
+        }
+    );
+
     // handler for the /update form page
     _server->on(path.c_str(), HTTP_GET,
         [this, path](AsyncWebServerRequest* request) {
-            _authenticated = (_username == String() || _password == String() || request->authenticate(_username.c_str(), _password.c_str()));
-            if (!_authenticated) {
-                request->requestAuthentication();
+            AsyncSessionAuth::Result auth_ = authorize(request);
+            if (auth_ == AsyncSessionAuth::SESSION_DENIED) {
                 return;
             }
-            String form = getFormFirmware(path);
-            request->send(200, "text/html", form);
+            sendUpdateTemplate(request, UPDATE_FORM_TEMPLATE, path, String(), nullptr, sessionCookie(request, auth_));
         }
     );
 
     // handler for the /update form POST (once file upload finishes)
     _server->on(path.c_str(), HTTP_POST,
-        [](AsyncWebServerRequest* request) {
-            Serial.println("Update POST request");
+        [this](AsyncWebServerRequest* request) {
+            if (_serial_output) {
+                Serial.println("Update POST request");
+            }
         },
         [this](AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
-            handleUpload(request, filename, index, data, len, final, _handleUpdateFinished, _updaterError, _serial_output);
+            if (!index) {
+                // -- The upload is checked on its own, the form page may have been opened by another client.
+                if (authorize(request) == AsyncSessionAuth::SESSION_DENIED) {
+                    if (_serial_output) {
+                        Serial.println("Update rejected, not authenticated");
+                    }
+                    return;
+                }
+                // -- Only one update at a time, others are rejected right away.
+                if (!beginSession(request)) {
+                    if (_serial_output) {
+                        Serial.println("Update rejected, another update is running");
+                    }
+                    request->send(409, "text/plain", "Another update is running");
+                    return;
+                }
+                request->onDisconnect([this, request]() {
+                    // -- The client is deleted after this returns, loop() must not acknowledge it anymore.
+                    dropThrottle(request->client());
+                    if (_session.request == request) {
+                        abortSession("Upload aborted, re-enabling watchdog");
+                    }
+                });
+                // -- A bundle is recognized by its magic, everything else is a single image.
+                _session.bundle = AsyncBundleParser::isBundle(data, len);
+            }
+            if (_session.request != request) {
+                return;
+            }
+
+            _session.written += len;
+            publishProgress();
+            if (_session.bundle) {
+                handleBundleUpload(request, index, data, len, final);
+            }
+            else {
+                handleUpload(request, filename, index, data, len, final);
+            }
+            if (!final) {
+                throttle(request);
+            }
         }
     );
 }
@@ -150,8 +588,113 @@ void AsyncUpdateServer::updateCredentials(const String& username, const String&
     _password = password;
 }
 
+AsyncSessionAuth::Result AsyncUpdateServer::authorize(AsyncWebServerRequest* request) {
+    if (_username == String() || _password == String()) {
+        return AsyncSessionAuth::SESSION_VALID;
+    }
+    AsyncSessionAuth::Result auth_ = _auth.check(request, _username.c_str(), _password.c_str());
+    if (auth_ == AsyncSessionAuth::SESSION_DENIED) {
+        request->requestAuthentication();
+    }
+    return auth_;
+}
+
+String AsyncUpdateServer::sessionCookie(AsyncWebServerRequest* request, AsyncSessionAuth::Result auth) {
+    if (auth != AsyncSessionAuth::SESSION_NEW) {
+        return String();
+    }
+    return _auth.createCookie(request, _username.c_str(), _password.c_str());
+}
+
 bool AsyncUpdateServer::isUpdating() {
-    return Update.isRunning();
+    return _session.active || Update.isRunning();
+}
+
+void AsyncUpdateServer::setWriteRate(uint32_t bytesPerSecond) {
+    _writeRate = bytesPerSecond;
+}
+
+bool AsyncUpdateServer::beginSession(AsyncWebServerRequest* request) {
+    if (_session.active || _handleUpdateFinished || Update.isRunning()) {
+        return false;
+    }
+    _session.active = true;
+    _session.request = request;
+    _session.bundle = false;
+    _session.written = 0;
+    _session.total = request != nullptr ? request->contentLength() : 0;
+    _session.start = millis();
+    _session.wdtWasActive = suspendWatchdog(_serial_output);
+    _updaterError = "";
+    return true;
+}
+
+void AsyncUpdateServer::endSession(bool success, const char* reason) {
+    // -- After a successful update the watchdog stays disabled, the reboot follows.
+    if (!success) {
+        resumeWatchdog(_session.wdtWasActive, reason, _serial_output);
+    }
+    _session.active = false;
+    _session.request = nullptr;
+}
+
+void AsyncUpdateServer::abortSession(const char* reason) {
+    if (!_session.active) {
+        return;
+    }
+    if (_bundleSink != nullptr) {
+        _bundleSink->abort();
+    }
+    endBundle();
+#ifdef ESP32
+    if (Update.isRunning()) {
+        Update.abort();
+    }
+#endif
+    endSession(false, reason);
+}
+
+void AsyncUpdateServer::throttle(AsyncWebServerRequest* request) {
+#ifdef ESP32
+    if (_writeRate == 0) {
+        return;
+    }
+    // -- While the upload is ahead of the write rate the received data is not
+    //    acknowledged, so the client stops sending once the TCP window is full.
+    //    The callback runs in the async TCP task, which must not be paused.
+    unsigned long due_ = (uint64_t)_session.written * 1000 / _writeRate;
+    unsigned long elapsed_ = millis() - _session.start;
+    if (due_ > elapsed_) {
+        std::lock_guard<std::mutex> lock_(_throttleMutex);
+        request->client()->ackLater();
+        _throttledClient = request->client();
+        _throttleUntil = _session.start + due_;
+    }
+#else
+    (void)request;
+#endif
+}
+
+void AsyncUpdateServer::releaseThrottle() {
+#ifdef ESP32
+    std::lock_guard<std::mutex> lock_(_throttleMutex);
+    if (_throttledClient == nullptr || (long)(millis() - _throttleUntil) < 0) {
+        return;
+    }
+    _throttledClient->ack(SIZE_MAX);
+    _throttledClient = nullptr;
+#endif
+}
+
+void AsyncUpdateServer::dropThrottle(AsyncClient* client) {
+#ifdef ESP32
+    std::lock_guard<std::mutex> lock_(_throttleMutex);
+    if (_throttledClient == client) {
+        _throttledClient = nullptr;
+    }
+#else
+    (void)client;
+#endif
 }
 
 String AsyncUpdateServer::getUpdaterError() {
@@ -162,111 +705,419 @@ bool AsyncUpdateServer::isFinished() {
     return _handleUpdateFinished;
 }
 
-void AsyncUpdateServer::handleUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final, bool& handleUpdateFinished, String& updaterError, bool serial_output) {
-    static bool wdt_was_active_ = false;
-    
-    if (!index) {
-        Serial.println("Update started...");
-        
+void AsyncUpdateServer::setHealthCheck(THandlerFunction_Health fn, unsigned long timeoutMs) {
+    _healthCheck = fn;
+    _healthTimeout = timeoutMs;
+}
+
+void AsyncUpdateServer::checkBootState() {
 #ifdef ESP32
-        // WICHTIG: Prfen ob Watchdog aktiv ist und dann deaktivieren
-        esp_err_t wdt_status_ = esp_task_wdt_status(NULL);
-        if (wdt_status_ == ESP_OK) {
-            wdt_was_active_ = true;
-            esp_task_wdt_deinit();
-            Serial.println("Watchdog Timer disabled for firmware update");
-        } else {
-            wdt_was_active_ = false;
-            Serial.println("Watchdog Timer was not active");
+    if (_bootState != BOOT_NORMAL) {
+        return;
+    }
+    _bootStart = millis();
+
+    esp_ota_img_states_t state_;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state_) == ESP_OK && state_ == ESP_OTA_IMG_PENDING_VERIFY) {
+        _bootState = BOOT_PENDING_VERIFY;
+        if (_serial_output) {
+            Serial.println("Firmware pending verification");
+        }
+        if (!_healthCheck) {
+            confirmBoot();
+        }
+    }
+    else if (esp_ota_get_last_invalid_partition() != nullptr) {
+        _bootState = BOOT_ROLLED_BACK;
+        _updaterError = "Previous update was rolled back";
+        if (_serial_output) {
+            Serial.println(_updaterError);
+        }
+    }
+#endif
+}
+
+void AsyncUpdateServer::loop() {
+    releaseThrottle();
+    sendProgress();
+
+    if (_bootState != BOOT_PENDING_VERIFY) {
+        return;
+    }
+    if (_healthCheck && _healthCheck()) {
+        confirmBoot();
+    }
+    else if (millis() - _bootStart > _healthTimeout) {
+        rollBack();
+    }
+}
+
+void AsyncUpdateServer::publishProgress() {
+    // -- Seqlock: the counter is odd while the snapshot is written. There is only
+    //    one writer, the update session.
+    unsigned long elapsed_ = millis() - _session.start;
+    uint32_t rate_ = elapsed_ > 0 ? (uint64_t)_session.written * 1000 / elapsed_ : 0;
+    uint32_t seq_ = _progressSeq.load(std::memory_order_relaxed);
+    _progressSeq.store(seq_ + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _progressWritten.store(_session.written, std::memory_order_relaxed);
+    _progressTotal.store(_session.total, std::memory_order_relaxed);
+    _progressRate.store(rate_, std::memory_order_relaxed);
+    _progressSeq.store(seq_ + 2, std::memory_order_release);
+}
+
+AsyncUpdateProgress AsyncUpdateServer::getProgress() const {
+    AsyncUpdateProgress progress_;
+    uint32_t seq_;
+    while (true) {
+        seq_ = _progressSeq.load(std::memory_order_acquire);
+        if (seq_ & 1) {
+            yield();
+            continue;
+        }
+        progress_.written = _progressWritten.load(std::memory_order_relaxed);
+        progress_.total = _progressTotal.load(std::memory_order_relaxed);
+        progress_.bytesPerSecond = _progressRate.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_progressSeq.load(std::memory_order_relaxed) == seq_) {
+            break;
+        }
+    }
+    progress_.etaSeconds = progress_.bytesPerSecond > 0 && progress_.total > progress_.written ?
+        (progress_.total - progress_.written) / progress_.bytesPerSecond : 0;
+    return progress_;
+}
+
+void AsyncUpdateServer::sendProgress() {
+    if (millis() - _lastProgressEvent < IOTWEBCONFASYNCUPDATE_PROGRESS_INTERVAL_MS) {
+        return;
+    }
+    _lastProgressEvent = millis();
+
+    uint32_t seq_ = _progressSeq.load(std::memory_order_acquire);
+    if (seq_ == _lastProgressSeq) {
+        return;
+    }
+    _lastProgressSeq = seq_;
+
+    AsyncUpdateProgress progress_ = getProgress();
+    if (_serial_output && progress_.total > 0) {
+        Serial.printf("Progress: %u%%\n", (unsigned int)((uint64_t)progress_.written * 100 / progress_.total));
+    }
+    if (_events == nullptr || _events->count() == 0) {
+        return;
+    }
+    char json_[96];
+    snprintf(json_, sizeof(json_), "{\"written\":%u,\"total\":%u,\"rate\":%u,\"eta\":%u}",
+        (unsigned int)progress_.written, (unsigned int)progress_.total,
+        (unsigned int)progress_.bytesPerSecond, (unsigned int)progress_.etaSeconds);
+    _events->send(json_, "progress", millis());
+}
+
+bool AsyncUpdateServer::confirmBoot() {
+#ifdef ESP32
+    if (_bootState == BOOT_PENDING_VERIFY && esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+        _bootState = BOOT_CONFIRMED;
+        if (_serial_output) {
+            Serial.println("Firmware confirmed");
+        }
+        return true;
+    }
+#endif
+    return false;
+}
+
+void AsyncUpdateServer::rollBack() {
+#ifdef ESP32
+    if (_bootState == BOOT_PENDING_VERIFY) {
+        if (_serial_output) {
+            Serial.println("Health check failed, rolling back firmware");
+        }
+        // -- Reboots into the previous image, does not return on success.
+        esp_err_t err_ = esp_ota_mark_app_invalid_rollback_and_reboot();
+        if (err_ == ESP_OK) {
+            _bootState = BOOT_ROLLED_BACK;
+            return;
         }
+        // -- No image to go back to, keep running this one and do not try again.
+        _bootState = BOOT_ROLLBACK_FAILED;
+        _updaterError = "Rollback failed: " + String(err_);
+        if (_serial_output) {
+            Serial.println(_updaterError);
+        }
+    }
 #endif
+}
+
+String AsyncUpdateServer::getStatusJson() {
+    static const char* const BOOT_STATES_[] = { "normal", "pending", "confirmed", "rolledback", "rollbackfailed" };
+
+    String json_;
+    json_.reserve(128 + _updaterError.length());
+    json_ = "{\"boot\":\"";
+    json_ += BOOT_STATES_[_bootState];
+    json_ += "\",\"updating\":";
+    json_ += Update.isRunning() ? "true" : "false";
+    json_ += ",\"finished\":";
+    json_ += _handleUpdateFinished ? "true" : "false";
+#ifdef ESP32
+    const esp_partition_t* running_ = esp_ota_get_running_partition();
+    if (running_ != nullptr) {
+        json_ += ",\"partition\":\"";
+        json_ += running_->label;
+        json_ += "\"";
+    }
+#endif
+    json_ += ",\"error\":\"";
+    for (size_t i = 0; i < _updaterError.length(); i++) {
+        char c_ = _updaterError[i];
+        if (c_ == '"' || c_ == '\\') {
+            json_ += '\\';
+        }
+        if (c_ >= ' ') {
+            json_ += c_;
+        }
+    }
+    json_ += "\"}";
+    return json_;
+}
+
+void AsyncUpdateServer::handleUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
+    if (!index) {
+        if (_serial_output) {
+            Serial.println("Update started...");
+        }
         
         size_t content_len_ = request->contentLength();
         int cmd_ = (filename.indexOf("spiffs") > -1) ? U_PART : U_FLASH;
 #ifdef ESP8266
         Update.runAsync(true);
-        if (!Update.begin(content_len, cmd_)) {
+        if (!Update.begin(content_len_, cmd_)) {
 #else
         if (!Update.begin(UPDATE_SIZE_UNKNOWN, cmd_)) {
 #endif
-            Update.printError(Serial);
-            
-#ifdef ESP32
-            // Bei Fehler Watchdog nur wieder aktivieren, wenn er vorher aktiv war
-            if (wdt_was_active_) {
-                Serial.println("Update begin failed, re-enabling watchdog");
-                esp_task_wdt_config_t wdt_config_ = {
-                    .timeout_ms = 30000,
-                    .idle_core_mask = 0,
-                    .trigger_panic = true
-                };
-                esp_task_wdt_init(&wdt_config_);
-                esp_task_wdt_add(NULL);
+            if (_serial_output) {
+                Update.printError(Serial);
             }
-#endif
         }
     }
 
-    if (Update.write(data, len) != len) {
-        Update.printError(Serial);
+    if (Update.write(data, len) != len && _updaterError.length() == 0) {
+        StreamString str_;
+        Update.printError(str_);
+        _updaterError = str_.c_str();
     }
 
     if (final) {
-        String html_ = FPSTR(IOTWEBCONFASYNCUPDATE_HTML_REBOOT_MSG);
-        html_.replace("[STYLE]", FPSTR(IOTWEBCONF_HTML_STYLE_INNER));
+        bool success_ = false;
+        String message_;
 
         if (!Update.end(true)) {
             StreamString str_;
             Update.printError(str_);
-            updaterError = str_.c_str();
+            _updaterError = str_.c_str();
 				
-            html_.replace("[Message]", "Update error: " + updaterError);
-            
-#ifdef ESP32
-            // Bei Fehler Watchdog nur wieder aktivieren, wenn er vorher aktiv war
-            if (wdt_was_active_) {
-                Serial.println("Update failed, re-enabling watchdog");
-                esp_task_wdt_config_t wdt_config_ = {
-                    .timeout_ms = 30000,
-                    .idle_core_mask = 0,
-                    .trigger_panic = true
-                };
-                esp_task_wdt_init(&wdt_config_);
-                esp_task_wdt_add(NULL);
-            }
-#endif
+            message_ = "Update error: " + _updaterError;
         }
         else {
-            html_.replace("[Message]", "Update completed. Please wait while the device is rebooting...");
-            Serial.println("Update completed. Please wait while the device is rebooting...");
-            handleUpdateFinished = true;
-            // Watchdog bleibt deaktiviert, da gleich Reboot folgt
+            success_ = true;
+            if (_serial_output) {
+                Serial.println(FPSTR(IOTWEBCONFASYNCUPDATE_MSG_REBOOTING));
+            }
+            _handleUpdateFinished = true;
         }
+        endSession(success_, "Update failed, re-enabling watchdog");
         
-        AsyncWebServerResponse* response_ = request->beginResponse(200, "text/html", html_);
         request->client()->setNoDelay(true);
-        request->send(response_);
-        
-        // Reset des Flags fr nchstes Update
-        wdt_was_active_ = false;
+        // -- On success all texts come from flash, the page needs no heap besides the response.
+        sendUpdateTemplate(request, UPDATE_REBOOT_TEMPLATE, String(), message_,
+            success_ ? IOTWEBCONFASYNCUPDATE_MSG_REBOOTING : nullptr);
     }
 }
 
-#ifdef ESP32
-void AsyncUpdateServer::printProgress(size_t prg, size_t sz) {
-    static size_t lastPrinted_ = 0;
-    size_t currentPercent_ = (prg * 100) / sz;
-    if (currentPercent_ != lastPrinted_) {
-        Serial.printf("Progress: %d%%\n", (int)currentPercent_);
-        lastPrinted_ = currentPercent_;
+void AsyncUpdateServer::onConfigSection(THandlerFunction_Config fn) {
+    _configHandler = fn;
+}
+
+void AsyncUpdateServer::handleBundleUpload(AsyncWebServerRequest* request, size_t index, uint8_t* data, size_t len, bool final) {
+    if (!index) {
+        if (_serial_output) {
+            Serial.println("Bundle update started...");
+        }
+        beginBundle();
+    }
+    if (_bundleParser == nullptr) {
+        return;
+    }
+
+    if (!_bundleParser->hasFailed()) {
+        feedBundle(data, len);
+    }
+
+    if (final) {
+        bool success_ = commitBundle();
+
+        String message_;
+        if (success_) {
+            // -- One reboot for all sections.
+            if (_serial_output) {
+                Serial.println(FPSTR(IOTWEBCONFASYNCUPDATE_MSG_REBOOTING));
+            }
+            _handleUpdateFinished = true;
+        }
+        else {
+            message_ = "Update error: " + _updaterError;
+        }
+
+        endBundle();
+        endSession(success_, "Bundle update failed, re-enabling watchdog");
+
+        request->client()->setNoDelay(true);
+        sendUpdateTemplate(request, UPDATE_REBOOT_TEMPLATE, String(), message_,
+            success_ ? IOTWEBCONFASYNCUPDATE_MSG_REBOOTING : nullptr);
     }
 }
-#endif
 
 String AsyncUpdateServer::getFormFirmware(const String & path) {
     // The action must match the update path
-    String form_ = FPSTR(IOTWEBCONFASYNCUPDATE_HTML_FORM_FIRMWARE);
-    form_.replace("[PATH]", path);
-    form_.replace("[STYLE]", FPSTR(IOTWEBCONF_HTML_STYLE_INNER));
-    return form_;
+    AsyncTemplateValue values_[SLOT_COUNT] = {
+        AsyncTemplateValue::ram(path), AsyncTemplateValue::ram("") };
+    return UPDATE_FORM_TEMPLATE.toString(values_);
+}
+void AsyncUpdateServer::beginBundle() {
+    endBundle();
+    _bundleSink = new AsyncUpdateBundleSink(_configHandler);
+    _bundleParser = new AsyncBundleParser(_bundleSink);
+    _updaterError = "";
+}
+
+bool AsyncUpdateServer::feedBundle(const uint8_t* data, size_t len) {
+    if (_bundleParser->feed(data, len)) {
+        return true;
+    }
+    _bundleSink->abort();
+    _updaterError = _bundleParser->getError();
+    if (_bundleSink->getError().length() > 0) {
+        _updaterError += ": " + _bundleSink->getError();
+    }
+    if (_serial_output) {
+        Serial.println("Bundle update failed: " + _updaterError);
+    }
+    return false;
+}
+
+bool AsyncUpdateServer::commitBundle() {
+    if (_bundleParser->hasFailed()) {
+        return false;
+    }
+    if (!_bundleParser->isComplete()) {
+        _bundleSink->abort();
+        _updaterError = "Bundle incomplete";
+        return false;
+    }
+    if (!_bundleSink->commit()) {
+        _updaterError = _bundleSink->getError();
+        if (_serial_output) {
+            Serial.println("Bundle update failed: " + _updaterError);
+        }
+        return false;
+    }
+    return true;
+}
+
+void AsyncUpdateServer::endBundle() {
+    delete _bundleParser;
+    _bundleParser = nullptr;
+    delete _bundleSink;
+    _bundleSink = nullptr;
+}
+
+bool AsyncUpdateServer::beginStream(size_t size, const String& md5) {
+    if (!beginSession(nullptr)) {
+        _updaterError = "Update already running";
+        return false;
+    }
+    if (_serial_output) {
+        Serial.println("Update stream started...");
+    }
+    _session.total = size;
+    _streamSize = size;
+    _streamMD5 = md5;
+    return true;
+}
+
+bool AsyncUpdateServer::writeStream(const uint8_t* data, size_t len) {
+    if (_session.written == 0) {
+        _session.bundle = AsyncBundleParser::isBundle(data, len);
+        if (_session.bundle) {
+            // -- The sections of a bundle carry their own MD5.
+            beginBundle();
+        }
+        else {
+#ifdef ESP8266
+            Update.runAsync(true);
+#endif
+            if (!Update.begin(_streamSize, U_FLASH)) {
+                StreamString str_;
+                Update.printError(str_);
+                _updaterError = str_.c_str();
+                return false;
+            }
+            if (_streamMD5.length() > 0) {
+                Update.setMD5(_streamMD5.c_str());
+            }
+        }
+    }
+    _session.written += len;
+    publishProgress();
+
+    if (_session.bundle) {
+        return feedBundle(data, len);
+    }
+    if (Update.write(const_cast<uint8_t*>(data), len) != len) {
+        StreamString str_;
+        Update.printError(str_);
+        _updaterError = str_.c_str();
+        return false;
+    }
+    return true;
+}
+
+bool AsyncUpdateServer::endStream() {
+    bool success_;
+    if (_session.bundle) {
+        success_ = _bundleParser != nullptr && commitBundle();
+        if (!success_ && _updaterError.length() == 0) {
+            _updaterError = "Bundle incomplete";
+        }
+        endBundle();
+    }
+    else {
+        success_ = Update.end();
+        if (!success_) {
+            StreamString str_;
+            Update.printError(str_);
+            _updaterError = str_.c_str();
+        }
+    }
+
+    if (success_) {
+        if (_serial_output) {
+            Serial.printf("Update stream success: %u\n", (unsigned int)_session.written);
+        }
+        _handleUpdateFinished = true;
+    }
+    else {
+        if (_serial_output) {
+            Serial.println("Update stream failed: " + _updaterError);
+        }
+    }
+    endSession(success_, "Update failed, re-enabling watchdog");
+    return success_;
+}
+
+void AsyncUpdateServer::abortStream() {
+    if (_session.request == nullptr) {
+        abortSession("Update aborted, re-enabling watchdog");
+    }
 }
\ No newline at end of file
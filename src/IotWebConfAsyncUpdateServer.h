@@ -27,12 +27,76 @@
 #endif
 
 #include <ESPAsyncWebServer.h>
+#include <atomic>
+#include <memory>
+#ifdef ESP32
+#include <mutex>
+#endif
+#include "IotWebConfAsyncSession.h"
+
+// -- Path of the stylesheet shared by the update form and the reboot page.
+#ifndef IOTWEBCONFASYNCUPDATE_STYLE_PATH
+#define IOTWEBCONFASYNCUPDATE_STYLE_PATH "/update.css"
+#endif
+
+// -- Time in seconds the browser may cache the stylesheet.
+#ifndef IOTWEBCONFASYNCUPDATE_STYLE_MAX_AGE
+#define IOTWEBCONFASYNCUPDATE_STYLE_MAX_AGE 86400
+#endif
+
+// -- Largest config section of an update bundle, it is buffered in RAM until its MD5 is verified.
+#ifndef IOTWEBCONFASYNCUPDATE_MAX_CONFIG_SECTION
+#define IOTWEBCONFASYNCUPDATE_MAX_CONFIG_SECTION 4096
+#endif
+
+// -- Keep a new image pending verification after boot (ESP32), so the health
+//    check decides between confirming and rolling it back. Needs a bootloader
+//    built with CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE.
+#ifndef IOTWEBCONFASYNCUPDATE_BOOT_VERIFY
+#define IOTWEBCONFASYNCUPDATE_BOOT_VERIFY 0
+#endif
+
+// -- Limit for the flash write rate of uploads in bytes per second, 0 for no limit (ESP32).
+#ifndef IOTWEBCONFASYNCUPDATE_WRITE_RATE
+#define IOTWEBCONFASYNCUPDATE_WRITE_RATE 0
+#endif
+
+// -- Interval of the progress events sent to the update page.
+#ifndef IOTWEBCONFASYNCUPDATE_PROGRESS_INTERVAL_MS
+#define IOTWEBCONFASYNCUPDATE_PROGRESS_INTERVAL_MS 500
+#endif
 
 class AsyncWebServer;
+class AsyncBundleParser;
+class AsyncUpdateBundleSink;
+
+/**
+ * State of the one upload or stream that writes to the Updater.
+ */
+struct AsyncUpdateSession {
+    AsyncWebServerRequest* request = nullptr;  // -- nullptr for a stream
+    bool active = false;
+    bool bundle = false;
+    bool wdtWasActive = false;
+    size_t written = 0;
+    size_t total = 0;  // -- Content length of an upload, including the multipart framing
+    unsigned long start = 0;
+};
+
+/**
+ * Progress of the running update, see AsyncUpdateServer::getProgress().
+ */
+struct AsyncUpdateProgress {
+    uint32_t written;
+    uint32_t total;
+    uint32_t bytesPerSecond;
+    uint32_t etaSeconds;
+};
 
 class AsyncUpdateServer {
 public:
     AsyncUpdateServer(bool serial_debug = false);
+    ~AsyncUpdateServer();
     void setup(AsyncWebServer* server);
     void setup(AsyncWebServer* server, const String& path);
 #ifdef ESP32
@@ -43,22 +107,135 @@ public:
     void setup(AsyncWebServer* server, const String& path, const String& username, const String& password);
     void updateCredentials(const String& username, const String& password);
     bool isUpdating();
+
+    /**
+     * Limit the flash write rate of uploads, to keep CPU time for the application.
+     * @param bytesPerSecond 0 for no limit
+     */
+    void setWriteRate(uint32_t bytesPerSecond);
+
+    /**
+     * Consistent snapshot of the update progress. It is published lock free by
+     * the write path and can be read from any task. loop() sends it to the
+     * update page as event stream at <path>/events.
+     */
+    AsyncUpdateProgress getProgress() const;
     String getUpdaterError();
     bool isFinished();
+
+    enum BootState : uint8_t {
+        BOOT_NORMAL,
+        BOOT_PENDING_VERIFY,
+        BOOT_CONFIRMED,
+        BOOT_ROLLED_BACK,
+        BOOT_ROLLBACK_FAILED
+    };
+
+    /**
+     * Health check for a new image. While the image is pending verification
+     * loop() calls the check, the image is confirmed as soon as it returns true
+     * and rolled back if it does not within the timeout. A rollback that fails,
+     * e.g. without a valid previous image, keeps the new image running and
+     * ends in BOOT_ROLLBACK_FAILED, it is not tried again. Set it before setup(),
+     * without a check a pending image is confirmed in setup().
+     */
+    typedef std::function<bool()> THandlerFunction_Health;
+    void setHealthCheck(THandlerFunction_Health fn, unsigned long timeoutMs);
+    void loop();
+    bool confirmBoot();
+    void rollBack();
+    BootState getBootState() const { return _bootState; }
+
+    /**
+     * State served at <path>/status, e.g. for monitoring a rollout.
+     */
+    String getStatusJson();
+
+    /**
+     * Handler for the config section of an update bundle. It is called with the
+     * whole section once all sections of the bundle were verified and before the
+     * new firmware is activated, returning false fails the update.
+     */
+    typedef std::function<bool(const uint8_t* data, size_t len)> THandlerFunction_Config;
+    void onConfigSection(THandlerFunction_Config fn);
+
+    /**
+     * Write an image that does not come from an upload, e.g. one pulled from a
+     * mirror by AsyncUpdatePuller. The data may be a plain firmware image or a
+     * bundle. endStream() marks the update as finished on success.
+     * @param md5 Hex MD5 of a plain image, may be empty
+     */
+    bool beginStream(size_t size, const String& md5);
+    bool writeStream(const uint8_t* data, size_t len);
+    bool endStream();
+    void abortStream();
 protected:
-    static void handleUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final, bool& handleUpdateFinished, String& updaterError, bool serial_output);
-#ifdef ESP32
-    static void printProgress(size_t prg, size_t sz);
-#endif
+    void handleUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final);
     String getFormFirmware(const String& path);
+    void handleBundleUpload(AsyncWebServerRequest* request, size_t index, uint8_t* data, size_t len, bool final);
+    void beginBundle();
+    bool feedBundle(const uint8_t* data, size_t len);
+    /**
+     * Activate a completely received bundle, sets _updaterError if it fails.
+     */
+    bool commitBundle();
+    void endBundle();
+    void checkBootState();
+    bool beginSession(AsyncWebServerRequest* request);
+    void endSession(bool success, const char* reason);
+    void abortSession(const char* reason);
+    void throttle(AsyncWebServerRequest* request);
+    /**
+     * Acknowledge the data held back by throttle(), once the write rate allows it.
+     */
+    void releaseThrottle();
+    void dropThrottle(AsyncClient* client);
+    void publishProgress();
+    void sendProgress();
+
+    /**
+     * Check the session cookie or the credentials, asks for credentials if both fail.
+     */
+    AsyncSessionAuth::Result authorize(AsyncWebServerRequest* request);
+    String sessionCookie(AsyncWebServerRequest* request, AsyncSessionAuth::Result auth);
+
+    friend class AsyncUpdateEventsHandler;
 private:
     bool _serial_output;
     AsyncWebServer* _server;
     String _username;
     String _password;
-    bool _authenticated;
+    AsyncSessionAuth _auth;
     String _updaterError;
     bool _handleUpdateFinished;
+    AsyncUpdateSession _session;
+    uint32_t _writeRate;
+    AsyncUpdateBundleSink* _bundleSink;
+    AsyncBundleParser* _bundleParser;
+    THandlerFunction_Config _configHandler;
+    size_t _streamSize;
+    String _streamMD5;
+    BootState _bootState;
+    THandlerFunction_Health _healthCheck;
+    unsigned long _healthTimeout;
+    unsigned long _bootStart;
+    AsyncEventSource* _events;
+    // -- Shared with the handler in front of _events, which the web server owns
+    //    and may keep longer. Cleared when this is deleted.
+    std::shared_ptr<AsyncUpdateServer*> _self;
+#ifdef ESP32
+    // -- Upload client whose received data is not acknowledged before _throttleUntil.
+    //    Set in the async TCP task, acknowledged by loop(), guarded by _throttleMutex.
+    std::mutex _throttleMutex;
+    AsyncClient* _throttledClient = nullptr;
+    unsigned long _throttleUntil = 0;
+#endif
+    std::atomic<uint32_t> _progressSeq;
+    std::atomic<uint32_t> _progressWritten;
+    std::atomic<uint32_t> _progressTotal;
+    std::atomic<uint32_t> _progressRate;
+    unsigned long _lastProgressEvent;
+    uint32_t _lastProgressSeq;
 };
 
 
@@ -0,0 +1,173 @@
+/**
+ * HostFixture.h -- Building blocks shared by the host tests: a config form of
+ *   generated parameters and requests posting it.
+ */
+
+#ifndef _HOST_FIXTURE_h
+#define _HOST_FIXTURE_h
+
+#include "IotWebConfAsync.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Text parameters p0..pN-1, grouped into fieldsets of perGroup parameters.
+ */
+class HostForm {
+public:
+    static constexpr int VALUE_LENGTH = 32;
+
+    explicit HostForm(size_t count, size_t perGroup = 10) : _ids(count), _labels(count), _values(count * VALUE_LENGTH, '\0') {
+        for (size_t i = 0; i < count; i++) {
+            if (i % perGroup == 0) {
+                _groupIds.push_back("g" + std::to_string(i / perGroup));
+                _groupLabels.push_back("Group " + std::to_string(i / perGroup));
+            }
+        }
+        // -- The ids must not move once the parameters point at them.
+        for (size_t g = 0; g < _groupIds.size(); g++) {
+            groups.emplace_back(new iotwebconf::ParameterGroup(_groupIds[g].c_str(), _groupLabels[g].c_str()));
+        }
+        for (size_t i = 0; i < count; i++) {
+            _ids[i] = "p" + std::to_string(i);
+            _labels[i] = "Parameter " + std::to_string(i);
+            parameters.emplace_back(new iotwebconf::TextParameter(_labels[i].c_str(), _ids[i].c_str(), value(i), VALUE_LENGTH, "default"));
+            groups[i / perGroup]->addItem(parameters.back().get());
+        }
+    }
+
+    size_t size() const { return parameters.size(); }
+    char* value(size_t index) { return &_values[index * VALUE_LENGTH]; }
+    const char* id(size_t index) const { return _ids[index].c_str(); }
+
+    template<typename Conf>
+    void addTo(Conf& conf) {
+        for (auto& group_ : groups) {
+            conf.addParameterGroup(group_.get());
+        }
+    }
+
+    /**
+     * Value posted for a parameter in save round `round`.
+     */
+    static std::string postedValue(size_t index, uint32_t round) {
+        return "v" + std::to_string(round) + "-" + std::to_string(index);
+    }
+
+    /**
+     * The urlencoded body of a save, system parameters included.
+     */
+    std::string body(uint32_t round) const {
+        std::string body_ = "iotSave=true&iwcThingName=thing&iwcApPassword=&iwcWifiSsid=net&iwcWifiPassword=&iwcApTimeout=30";
+        for (size_t i = 0; i < _ids.size(); i++) {
+            body_ += "&" + _ids[i] + "=" + postedValue(i, round);
+        }
+        return body_;
+    }
+
+    /**
+     * Add the save as request parameters, the way ESPAsyncWebServer parses small posts.
+     */
+    void addParams(AsyncWebServerRequest& request, uint32_t round) const {
+        request.addParam("iotSave", "true", true);
+        request.addParam("iwcThingName", "thing", true);
+        request.addParam("iwcApPassword", "", true);
+        request.addParam("iwcWifiSsid", "net", true);
+        request.addParam("iwcWifiPassword", "", true);
+        request.addParam("iwcApTimeout", "30", true);
+        for (size_t i = 0; i < _ids.size(); i++) {
+            request.addParam(_ids[i].c_str(), postedValue(i, round).c_str(), true);
+        }
+    }
+
+    /**
+     * Number of parameters not holding the values of save round `round`.
+     */
+    size_t mismatches(uint32_t round) {
+        size_t mismatches_ = 0;
+        for (size_t i = 0; i < size(); i++) {
+            if (postedValue(i, round) != value(i)) {
+                mismatches_++;
+            }
+        }
+        return mismatches_;
+    }
+
+    std::vector<std::unique_ptr<iotwebconf::ParameterGroup>> groups;
+    std::vector<std::unique_ptr<iotwebconf::TextParameter>> parameters;
+
+private:
+    std::vector<std::string> _ids;
+    std::vector<std::string> _labels;
+    std::vector<std::string> _groupIds;
+    std::vector<std::string> _groupLabels;
+    std::vector<char> _values;
+};
+
+/**
+ * Server, wrapper and DNS server an AsyncIotWebConf needs.
+ */
+struct HostServer {
+    AsyncWebServer server{ 80 };
+    AsyncWebServerWrapper wrapper{ &server };
+    DNSServer dnsServer;
+};
+
+/**
+ * A page as the client received it.
+ */
+struct HostPage {
+    int code = 0;
+    std::string body;
+    uint32_t fillCalls = 0;
+    uint32_t retries = 0;
+};
+
+// -- Authorization header for user admin with the AP password "password".
+#define HOST_AUTH_ADMIN "Basic YWRtaW46cGFzc3dvcmQ="
+
+/**
+ * Run a GET through the server and drain the response maxLen bytes at a time,
+ * the way AsyncTCP offers send buffer space.
+ */
+inline HostPage hostFetch(AsyncWebServer& server, const char* url, size_t maxLen = 1460, const char* authorization = HOST_AUTH_ADMIN) {
+    HostPage page_;
+    AsyncClient client_;
+    AsyncWebServerRequest* request_ = new AsyncWebServerRequest(&server, &client_);
+    request_->setUrl(url);
+    request_->setMethod(HTTP_GET);
+    if (authorization != nullptr) {
+        request_->addHeader("Authorization", authorization);
+    }
+    AsyncWebHandler* handler_ = server.findHandler(request_);
+    if (handler_ != nullptr) {
+        handler_->handleRequest(request_);
+    }
+    else {
+        server.handleNotFound(request_);
+    }
+    AsyncWebServerResponse* response_ = request_->response();
+    if (response_ != nullptr) {
+        page_.code = response_->code();
+        std::vector<uint8_t> buffer_(maxLen);
+        while (page_.retries < 100000) {
+            size_t len_ = response_->fillBody(buffer_.data(), maxLen);
+            page_.fillCalls++;
+            if (len_ == RESPONSE_TRY_AGAIN) {
+                page_.retries++;
+                continue;
+            }
+            if (len_ == 0) {
+                break;
+            }
+            page_.body.append(reinterpret_cast<const char*>(buffer_.data()), len_);
+        }
+    }
+    request_->disconnect();
+    delete request_;
+    return page_;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include "HostTest.h"
+
+#include <cstdlib>
+#include <vector>
+
+namespace {
+    struct Test {
+        const char* name;
+        void (*run)();
+    };
+
+    std::vector<Test>& tests() {
+        static std::vector<Test> tests_;
+        return tests_;
+    }
+
+    int failures_ = 0;
+    int reported_ = 0;
+}
+
+HostTest::Registration::Registration(const char* name, void (*test)()) {
+    tests().push_back(Test{ name, test });
+}
+
+bool HostTest::check(bool condition, const char* expression, const char* file, int line) {
+    if (!condition) {
+        failures_++;
+        // -- A broken loop would flood the log, the count still goes up.
+        if (reported_++ < 50) {
+            printf("%s:%d: CHECK(%s) failed\n", file, line, expression);
+        }
+    }
+    return condition;
+}
+
+bool HostTest::checkEqual(long long actual, long long expected, const char* expression, const char* file, int line) {
+    if (actual != expected) {
+        failures_++;
+        if (reported_++ < 50) {
+            printf("%s:%d: CHECK_EQ(%s) failed: %lld != %lld\n", file, line, expression, actual, expected);
+        }
+        return false;
+    }
+    return true;
+}
+
+uint32_t HostTest::seed(uint32_t fallback) {
+    const char* seed_ = getenv("IWC_HOST_SEED");
+    return seed_ != nullptr ? static_cast<uint32_t>(strtoul(seed_, nullptr, 0)) : fallback;
+}
+
+int main(int argc, char** argv) {
+    // -- An argument selects a single test by name.
+    const char* only_ = argc > 1 ? argv[1] : nullptr;
+    for (const Test& test_ : tests()) {
+        if (only_ != nullptr && std::string(only_) != test_.name) {
+            continue;
+        }
+        int before_ = failures_;
+        test_.run();
+        printf("%s %s\n", failures_ == before_ ? "PASS" : "FAIL", test_.name);
+        fflush(stdout);
+    }
+    return failures_ > 0 ? 1 : 0;
+}
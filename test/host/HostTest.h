@@ -0,0 +1,38 @@
+/**
+ * HostTest.h -- Minimal test runner for the host tests. Tests are registered
+ *   with TEST(name), HostTest.cpp runs them in order and returns the number
+ *   of failed checks, which ctest reports.
+ */
+
+#ifndef _HOST_TEST_h
+#define _HOST_TEST_h
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace HostTest {
+    struct Registration {
+        Registration(const char* name, void (*test)());
+    };
+
+    bool check(bool condition, const char* expression, const char* file, int line);
+    bool checkEqual(long long actual, long long expected, const char* expression, const char* file, int line);
+
+    /**
+     * Seed for the randomized tests, IWC_HOST_SEED in the environment overrides it.
+     */
+    uint32_t seed(uint32_t fallback);
+}
+
+#define TEST(name) \
+    static void name(); \
+    static HostTest::Registration name##Registration_(#name, name); \
+    static void name()
+
+#define CHECK(condition) HostTest::check((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) \
+    HostTest::checkEqual(static_cast<long long>(actual), static_cast<long long>(expected), #actual " == " #expected, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * Page size report for IOTWEBCONFASYNC_MINIFY_HTML.
+ *
+ * Built twice, against the library with and without the option. The build
+ * without it writes the size of every page to IWC_PAGE_SIZE_FILE, the
+ * minified build reads them back and prints both sizes side by side. The
+ * option only shortens the markup of this library, so the base page keeps
+ * its size and the pages with tab styling must get smaller. Every page keeps
+ * its form fields.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+#include "IotWebConfAsyncTab.h"
+
+#include <fstream>
+#include <map>
+
+namespace {
+    struct Page {
+        const char* name;
+        bool tabStyle;                  // -- Carries the tab styling of this library
+        std::string body;
+        size_t lastPageBytes;
+    };
+
+    template<typename Conf>
+    Page render(const char* name, bool tabStyle, HostServer& host, Conf& conf) {
+        conf.init();
+        conf.setupWebHandlers("/config");
+        conf.hostSetState(iotwebconf::OnLine);
+        HostPage page_ = hostFetch(host.server, "/config");
+        CHECK_EQ(page_.code, 200);
+        return Page{ name, tabStyle, page_.body, conf.getMetrics().lastPageBytes };
+    }
+
+    Page basePage() {
+        HostServer host_;
+        HostForm form_(20);
+        AsyncIotWebConf conf_("thing", &host_.dnsServer, &host_.wrapper, "password", "size");
+        form_.addTo(conf_);
+        return render("base", false, host_, conf_);
+    }
+
+    Page optionalGroupPage() {
+        HostServer host_;
+        HostForm form_(20);
+        TabOptionalGroupHtmlFormatProvider provider_;
+        AsyncIotWebConf conf_("thing", &host_.dnsServer, &host_.wrapper, "password", "size");
+        form_.addTo(conf_);
+        conf_.setHtmlFormatProvider(&provider_);
+        return render("optional groups", true, host_, conf_);
+    }
+
+    Page tabPage() {
+        HostServer host_;
+        HostForm form_(20, 4);
+        AsyncIotWebConfTab conf_("thing", &host_.dnsServer, &host_.wrapper, "password", "size");
+        const char* tabs_[] = { "Sensors", "Network", "Display", "Sensors", "Network" };
+        for (size_t i = 0; i < form_.groups.size(); i++) {
+            conf_.addParameterGroup(form_.groups[i].get(), tabs_[i]);
+        }
+        return render("tabs", true, host_, conf_);
+    }
+
+    std::vector<Page> pages() {
+        std::vector<Page> pages_;
+        pages_.push_back(basePage());
+        pages_.push_back(optionalGroupPage());
+        pages_.push_back(tabPage());
+        return pages_;
+    }
+
+    /**
+     * Number of input fields, the same in both builds.
+     */
+    size_t inputs(const std::string& body) {
+        size_t count_ = 0;
+        for (size_t at_ = body.find("<input"); at_ != std::string::npos; at_ = body.find("<input", at_ + 1)) {
+            count_++;
+        }
+        return count_;
+    }
+}
+
+TEST(pageSize) {
+    std::vector<Page> pages_ = pages();
+    for (const Page& page_ : pages_) {
+        CHECK_EQ(page_.lastPageBytes, page_.body.size());
+    }
+
+#if IOTWEBCONFASYNC_MINIFY_HTML
+    std::map<std::string, std::pair<size_t, size_t>> plain_;
+    std::ifstream in_(IWC_PAGE_SIZE_FILE);
+    std::string name_;
+    size_t bytes_;
+    size_t inputs_;
+    while (std::getline(in_, name_, '\t') && in_ >> bytes_ >> inputs_ && in_.ignore()) {
+        plain_[name_] = { bytes_, inputs_ };
+    }
+    CHECK(!plain_.empty());
+    printf("%-16s %10s %10s %8s\n", "page", "minify 0", "minify 1", "saved");
+    for (const Page& page_ : pages_) {
+        auto found_ = plain_.find(page_.name);
+        if (!CHECK(found_ != plain_.end())) {
+            continue;
+        }
+        size_t before_ = found_->second.first;
+        printf("%-16s %10zu %10zu %7.1f%%\n", page_.name, before_, page_.body.size(),
+            100.0 * (static_cast<double>(before_) - page_.body.size()) / before_);
+        CHECK(page_.tabStyle ? page_.body.size() < before_ : page_.body.size() == before_);
+        CHECK_EQ(inputs(page_.body), found_->second.second);
+    }
+#else
+    std::ofstream out_(IWC_PAGE_SIZE_FILE);
+    for (const Page& page_ : pages_) {
+        printf("%-16s %10zu bytes\n", page_.name, page_.body.size());
+        out_ << page_.name << '\t' << page_.body.size() << ' ' << inputs(page_.body) << '\n';
+    }
+    CHECK(out_.good());
+#endif
+}
@@ -0,0 +1,153 @@
+/**
+ * Save path microbenchmark with 50, 200 and 500 parameters.
+ *
+ * validateForm() and the parameter update look up every argument once. The
+ * linear wrapper reproduces the lookup before the argument index (String
+ * copies and a linear search of the request parameters), the other rows use
+ * AsyncWebRequestWrapper with request parameters, with a parsed body, and a
+ * complete post through the config handler and doLoop().
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+#include <chrono>
+#include <type_traits>
+
+namespace {
+    /**
+     * Argument lookup as it was before AsyncArgIndex.
+     */
+    class LinearWrapper : public iotwebconf::WebRequestWrapper {
+    public:
+        explicit LinearWrapper(AsyncWebServerRequest* request) : _request(request) {}
+
+        const String hostHeader() const override { return _request->host(); }
+        IPAddress localIP() override { return _request->client()->localIP(); }
+        uint16_t localPort() override { return 80; }
+        const String uri() const override { return _request->url(); }
+        bool authenticate(const char* username, const char* password) override { return true; }
+        void requestAuthentication() override {}
+        bool hasArg(const String& name) override { return _request->hasArg(name.c_str()); }
+        String arg(const String name) override { return _request->arg(name); }
+        void sendHeader(const String& name, const String& value, bool first = false) override {}
+        void setContentLength(const size_t contentLength) override {}
+        void send(int code, const char* content_type = nullptr, const String& content = String("")) override {}
+        void sendContent(const String& content) override {}
+        void stop() override {}
+
+    private:
+        AsyncWebServerRequest* _request;
+    };
+
+    class BenchIotWebConf : public AsyncIotWebConf {
+    public:
+        using AsyncIotWebConf::AsyncIotWebConf;
+        using iotwebconf::IotWebConf::validateForm;
+    };
+
+    struct Bench {
+        explicit Bench(size_t count) :
+            form(count),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "bench") {
+            form.addTo(conf);
+            conf.init();
+            conf.setupWebHandlers("/config");
+        }
+
+        HostServer host;
+        HostForm form;
+        BenchIotWebConf conf;
+        AsyncClient client;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    double microsPerRound(Clock::time_point start, uint32_t rounds) {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / rounds;
+    }
+
+    uint32_t roundsFor(size_t count) {
+        return count >= 500 ? 20 : count >= 200 ? 50 : 200;
+    }
+
+    // -- validateForm() and the update of all parameters, the part the index speeds up.
+    template<typename Wrapper>
+    double validateAndUpdate(Bench& bench, bool parseBody, bool& valid) {
+        uint32_t rounds_ = roundsFor(bench.form.size());
+        double total_ = 0;
+        valid = true;
+        for (uint32_t round_ = 1; round_ <= rounds_; round_++) {
+            AsyncWebServerRequest request_(&bench.host.server, &bench.client);
+            request_.setMethod(HTTP_POST);
+            std::string body_ = bench.form.body(round_);
+            if (!parseBody) {
+                bench.form.addParams(request_, round_);
+            }
+            Wrapper wrapper_(&request_);
+            Clock::time_point start_ = Clock::now();
+            if constexpr (std::is_same<Wrapper, AsyncWebRequestWrapper>::value) {
+                if (parseBody) {
+                    wrapper_.parseBody(reinterpret_cast<const uint8_t*>(body_.data()), body_.size(), 0, body_.size());
+                }
+            }
+            valid = bench.conf.validateForm(&wrapper_) && valid;
+            AsyncConfigItemAccess::updateItem(bench.conf.getRootParameterGroup(), &wrapper_);
+            total_ += microsPerRound(start_, 1);
+            valid = bench.form.mismatches(round_) == 0 && valid;
+        }
+        return total_ / rounds_;
+    }
+
+    // -- A post through the config handler and the save in doLoop().
+    double postAndSave(Bench& bench, bool& valid) {
+        uint32_t rounds_ = roundsFor(bench.form.size());
+        valid = true;
+        Clock::time_point start_ = Clock::now();
+        for (uint32_t round_ = 1; round_ <= rounds_; round_++) {
+            AsyncWebServerRequest* request_ = new AsyncWebServerRequest(&bench.host.server, &bench.client);
+            request_->setUrl("/config");
+            request_->setMethod(HTTP_POST);
+            request_->setContentType("application/x-www-form-urlencoded");
+            std::string body_ = bench.form.body(round_);
+            request_->setContentLength(body_.size());
+            AsyncWebHandler* handler_ = bench.host.server.findHandler(request_);
+            handler_->handleBody(request_, reinterpret_cast<uint8_t*>(&body_[0]), body_.size(), 0, body_.size());
+            handler_->handleRequest(request_);
+            valid = request_->response() != nullptr && request_->response()->code() == 200 && valid;
+            request_->disconnect();
+            delete request_;
+            bench.conf.doLoop();
+            valid = bench.form.mismatches(round_) == 0 && valid;
+        }
+        return microsPerRound(start_, rounds_);
+    }
+}
+
+TEST(savePathScaling) {
+    printf("%-6s %12s %12s %12s %12s\n", "params", "linear us", "index us", "body us", "post+loop us");
+    double linear500_ = 0;
+    double index500_ = 0;
+    for (size_t count_ : { 50, 200, 500 }) {
+        Bench bench_(count_);
+        bool linearValid_, indexValid_, bodyValid_, postValid_;
+        double linear_ = validateAndUpdate<LinearWrapper>(bench_, false, linearValid_);
+        double index_ = validateAndUpdate<AsyncWebRequestWrapper>(bench_, false, indexValid_);
+        double body_ = validateAndUpdate<AsyncWebRequestWrapper>(bench_, true, bodyValid_);
+        double post_ = postAndSave(bench_, postValid_);
+        printf("%-6u %12.1f %12.1f %12.1f %12.1f\n", (unsigned int)count_, linear_, index_, body_, post_);
+
+        // -- Every path must apply all posted values.
+        CHECK(linearValid_);
+        CHECK(indexValid_);
+        CHECK(bodyValid_);
+        CHECK(postValid_);
+        if (count_ == 500) {
+            linear500_ = linear_;
+            index500_ = index_;
+        }
+    }
+    // -- The linear lookup is quadratic, at 500 parameters the index must win clearly.
+    CHECK(index500_ * 2 < linear500_);
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+}
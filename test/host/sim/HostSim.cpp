@@ -0,0 +1,357 @@
+#include "HostSim.h"
+
+namespace {
+    enum Phase : uint8_t {
+        WAITING,
+        BODY,
+        UPLOAD,
+        RESPONSE,
+        DONE
+    };
+}
+
+struct HostSim::Client {
+    HostSimScript script;
+    HostSimResult result;
+    AsyncClient client;
+    AsyncWebServerRequest* request = nullptr;
+    AsyncWebHandler* handler = nullptr;
+    Phase phase = WAITING;
+    uint32_t due = 0;
+    size_t sent = 0;            // -- Body or upload bytes the server received
+    uint32_t waitingSince = 0;
+};
+
+HostSim::HostSim(AsyncWebServer& server, uint32_t seed) : _server(server), _random(seed) {
+}
+
+HostSim::~HostSim() {
+    for (Client* client_ : _clients) {
+        if (client_->request != nullptr) {
+            finish(*client_, true);
+        }
+        delete client_;
+    }
+}
+
+size_t HostSim::addClient(const HostSimScript& script) {
+    Client* client_ = new Client();
+    client_->script = script;
+    client_->due = script.startTick;
+    client_->result.body.reserve(script.keepBody);
+    client_->client._remotePort = static_cast<uint16_t>(50000 + _clients.size());
+    _clients.push_back(client_);
+    _buffer.resize(std::max(_buffer.size(), std::max({ script.maxMaxLen, script.uploadChunk, script.bodyPiece })));
+    return _clients.size() - 1;
+}
+
+const HostSimResult& HostSim::result(size_t client) const {
+    return _clients[client]->result;
+}
+
+const HostSimReport& HostSim::run(uint32_t maxTicks) {
+    // -- Everything the loop needs is allocated up front, the heap only sees the server.
+    _due.reserve(_clients.size());
+    _report = HostSimReport();
+    uint32_t leaked_ = AsyncWebServerRequest::leakedTempObjects();
+    uint32_t injected_ = HostHeap::injectedFailures();
+    HostHeap::Snapshot before_ = HostHeap::snapshot();
+    HostHeap::resetPeak();
+    _report.heapBefore = before_.liveBytes;
+    _report.allocationsBefore = before_.liveAllocations;
+    if (_failPeriod > 0) {
+        HostHeap::failEvery(_failPeriod);
+    }
+
+    size_t remaining_ = _clients.size();
+    for (_tick = 0; _tick < maxTicks && remaining_ > 0; _tick++) {
+        // -- The clients due in this tick are served in random order, one event each.
+        _due.clear();
+        for (Client* client_ : _clients) {
+            if (client_->phase != DONE && client_->due <= _tick) {
+                _due.push_back(client_);
+            }
+        }
+        std::shuffle(_due.begin(), _due.end(), _random);
+        for (Client* client_ : _due) {
+            if (!step(*client_)) {
+                remaining_--;
+            }
+        }
+        if (_onTick) {
+            _onTick(_tick);
+        }
+        hostAdvanceMicros(1000);
+    }
+
+    // -- Clients still open at the end time out.
+    for (Client* client_ : _clients) {
+        if (client_->phase != DONE) {
+            finish(*client_, true);
+        }
+    }
+    HostHeap::clearFailures();
+    if (_onFinish) {
+        _onFinish();
+    }
+
+    HostHeap::Snapshot after_ = HostHeap::snapshot();
+    _report.ticks = _tick;
+    _report.heapPeak = HostHeap::peakBytes();
+    _report.heapAfter = after_.liveBytes;
+    _report.allocationsAfter = after_.liveAllocations;
+    _report.liveWrappers = AsyncWebRequestWrapper::getLiveCount();
+    _report.leakedTempObjects = AsyncWebServerRequest::leakedTempObjects() - leaked_;
+    _report.injectedFailures = HostHeap::injectedFailures() - injected_;
+    return _report;
+}
+
+void HostSim::printReport(const char* name) const {
+    uint32_t complete_ = 0;
+    uint32_t disconnected_ = 0;
+    uint32_t closed_ = 0;
+    uint32_t busy_ = 0;
+    for (const Client* client_ : _clients) {
+        complete_ += client_->result.complete ? 1 : 0;
+        disconnected_ += client_->result.disconnected ? 1 : 0;
+        closed_ += client_->result.closed ? 1 : 0;
+        busy_ += client_->result.code == 503 ? 1 : 0;
+    }
+    printf("%s: %zu clients in %u ticks, %u open at once, %u complete, %u busy, %u disconnected, %u closed\n",
+        name, _clients.size(), _report.ticks, _report.maxOpen, complete_, busy_, disconnected_, closed_);
+    printf("%s: heap %lld -> peak %lld -> %lld bytes, allocations %lld -> %lld, wrappers %u, temp objects %u, failures %u%s\n",
+        name, (long long)_report.heapBefore, (long long)_report.heapPeak, (long long)_report.heapAfter,
+        (long long)_report.allocationsBefore, (long long)_report.allocationsAfter,
+        _report.liveWrappers, _report.leakedTempObjects, _report.injectedFailures,
+        _report.leaked() ? ", LEAK" : "");
+}
+
+bool HostSim::step(Client& client) {
+    switch (client.phase) {
+    case WAITING:
+        connect(client);
+        break;
+    case BODY:
+        receiveBody(client);
+        break;
+    case UPLOAD:
+        receiveUpload(client);
+        break;
+    case RESPONSE:
+        send(client);
+        break;
+    case DONE:
+        break;
+    }
+    return client.phase != DONE;
+}
+
+void HostSim::connect(Client& client) {
+    const HostSimScript& script_ = client.script;
+    AsyncWebServerRequest* request_ = new AsyncWebServerRequest(&_server, &client.client);
+    int query_ = script_.url.indexOf('?');
+    request_->setUrl(query_ < 0 ? script_.url : script_.url.substring(0, query_));
+    while (query_ >= 0) {
+        int next_ = script_.url.indexOf('&', query_ + 1);
+        String pair_ = script_.url.substring(query_ + 1, next_ < 0 ? script_.url.length() : next_);
+        int equals_ = pair_.indexOf('=');
+        request_->addParam(equals_ < 0 ? pair_ : pair_.substring(0, equals_), equals_ < 0 ? String() : pair_.substring(equals_ + 1));
+        query_ = next_;
+    }
+    request_->setMethod(script_.method);
+    if (script_.authorization != nullptr) {
+        request_->addHeader("Authorization", script_.authorization);
+    }
+    if (!script_.body.empty()) {
+        request_->setContentType("application/x-www-form-urlencoded");
+        request_->setContentLength(script_.body.size());
+    }
+    else if (script_.upload != nullptr) {
+        request_->setContentType("multipart/form-data; boundary=sim");
+        request_->setContentLength(script_.upload->size());
+    }
+    client.request = request_;
+    client.handler = _server.findHandler(request_);
+
+    _open++;
+    _report.maxOpen = std::max(_report.maxOpen, _open);
+    if (!script_.body.empty() && client.handler != nullptr) {
+        client.phase = BODY;
+    }
+    else if (script_.upload != nullptr && client.handler != nullptr) {
+        client.phase = UPLOAD;
+    }
+    else {
+        handle(client);
+    }
+    client.due = _tick + 1;
+}
+
+void HostSim::receiveBody(Client& client) {
+    if (dropped(client)) {
+        return;
+    }
+    const std::string& body_ = client.script.body;
+    size_t len_ = std::min(client.script.bodyPiece, body_.size() - client.sent);
+    memcpy(_buffer.data(), body_.data() + client.sent, len_);
+    client.handler->handleBody(client.request, _buffer.data(), len_, client.sent, body_.size());
+    client.sent += len_;
+    if (client.sent >= client.script.disconnectAfter) {
+        finish(client, true);
+        return;
+    }
+    if (client.sent == body_.size()) {
+        handle(client);
+    }
+    client.due = _tick + 1;
+}
+
+void HostSim::receiveUpload(Client& client) {
+    const std::vector<uint8_t>& upload_ = *client.script.upload;
+    // -- The peer waits while its window is used up, loop() acknowledges throttled data.
+    if (client.client._unacked >= client.script.uploadWindow) {
+        client.due = _tick + 1;
+        return;
+    }
+    if (dropped(client)) {
+        return;
+    }
+    size_t len_ = std::min(client.script.uploadChunk, upload_.size() - client.sent);
+    bool final_ = client.sent + len_ == upload_.size();
+    memcpy(_buffer.data(), upload_.data() + client.sent, len_);
+    client.handler->handleUpload(client.request, "firmware.bin", client.sent, _buffer.data(), len_, final_);
+    client.client.received(len_);
+    client.sent += len_;
+    if (client.sent >= client.script.disconnectAfter) {
+        finish(client, true);
+        return;
+    }
+    if (final_) {
+        handle(client);
+    }
+    client.due = _tick + 1;
+}
+
+void HostSim::handle(Client& client) {
+    if (client.handler != nullptr) {
+        client.handler->handleRequest(client.request);
+    }
+    else {
+        _server.handleNotFound(client.request);
+    }
+    client.phase = RESPONSE;
+    client.waitingSince = _tick;
+}
+
+void HostSim::send(Client& client) {
+    if (client.client._closeRequested) {
+        client.result.closed = true;
+        finish(client, false);
+        return;
+    }
+    AsyncWebServerResponse* response_ = client.request->response();
+    if (response_ == nullptr) {
+        if (_tick - client.waitingSince >= client.script.responseTimeout) {
+            finish(client, true);
+        }
+        else {
+            client.due = _tick + 1;
+        }
+        return;
+    }
+    HostSimResult& result_ = client.result;
+    result_.code = response_->code();
+
+    // -- The ACK that opens the send space, a lost one is retransmitted later.
+    if (dropped(client)) {
+        return;
+    }
+    std::uniform_int_distribution<size_t> space_(client.script.minMaxLen, client.script.maxMaxLen);
+    size_t maxLen_ = space_(_random);
+    size_t len_ = response_->fillBody(_buffer.data(), maxLen_);
+    result_.fillCalls++;
+    if (len_ == RESPONSE_TRY_AGAIN) {
+        result_.retries++;
+        client.due = _tick + 1;
+        return;
+    }
+    if (len_ == 0) {
+        if (result_.code == 503 && result_.busy++ < client.script.busyRetries) {
+            retry(client);
+            return;
+        }
+        result_.complete = true;
+        result_.matches = result_.matches &&
+            (client.script.expected == nullptr || result_.code != 200 || result_.bytes == client.script.expected->size());
+        finish(client, false);
+        return;
+    }
+    if (len_ > maxLen_) {
+        // -- More than the send space would corrupt the stream.
+        result_.matches = false;
+    }
+    const std::string* expected_ = client.script.expected;
+    if (expected_ != nullptr && result_.code == 200 && result_.matches) {
+        result_.matches = result_.bytes + len_ <= expected_->size() &&
+            memcmp(expected_->data() + result_.bytes, _buffer.data(), len_) == 0;
+    }
+    if (result_.body.size() < client.script.keepBody) {
+        result_.body.append(reinterpret_cast<const char*>(_buffer.data()),
+            std::min(len_, client.script.keepBody - result_.body.size()));
+    }
+    result_.bytes += len_;
+    result_.largestChunk = std::max(result_.largestChunk, len_);
+    if (result_.bytes >= client.script.disconnectAfter) {
+        finish(client, true);
+        return;
+    }
+    client.due = _tick + 1 + client.script.ackDelay;
+}
+
+void HostSim::finish(Client& client, bool disconnected) {
+    close(client);
+    client.result.disconnected = disconnected;
+    client.result.doneTick = _tick;
+    client.phase = DONE;
+}
+
+void HostSim::retry(Client& client) {
+    close(client);
+    // -- A new connection of the same client, the result starts over.
+    client.client = AsyncClient();
+    client.client._remotePort = static_cast<uint16_t>(client.client._remotePort + 1000);
+    client.sent = 0;
+    HostSimResult& result_ = client.result;
+    result_.code = 0;
+    result_.bytes = 0;
+    result_.body.clear();
+    result_.matches = true;
+    result_.largestChunk = 0;
+    client.phase = WAITING;
+    client.due = _tick + client.script.busyBackoff;
+}
+
+bool HostSim::dropped(Client& client) {
+    if (client.script.dropPercent == 0) {
+        return false;
+    }
+    std::uniform_int_distribution<uint32_t> percent_(0, 99);
+    if (percent_(_random) >= client.script.dropPercent) {
+        return false;
+    }
+    client.result.drops++;
+    client.due = _tick + client.script.retransmitTicks;
+    return true;
+}
+
+void HostSim::close(Client& client) {
+    if (client.request == nullptr) {
+        return;
+    }
+    // -- Like AsyncWebServer: the disconnect handler runs, then the request is deleted.
+    client.client._connected = false;
+    client.request->disconnect();
+    delete client.request;
+    client.request = nullptr;
+    _open--;
+}
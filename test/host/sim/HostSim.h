@@ -0,0 +1,161 @@
+/**
+ * HostSim.h -- Event loop of AsyncTCP and ESPAsyncWebServer for the host
+ *   tests. Virtual clients connect, send their body or upload and read the
+ *   response the way the single AsyncTCP task drives them: one event at a
+ *   time, clients interleaved, the send space offered per ACK. Slow readers,
+ *   lost segments, disconnects and allocation failures are part of a script,
+ *   a seed makes every run repeatable.
+ */
+
+#ifndef _HOST_SIM_h
+#define _HOST_SIM_h
+
+#include "HostFixture.h"
+
+#include <functional>
+#include <random>
+
+/**
+ * What one virtual client does.
+ */
+struct HostSimScript {
+    String url = "/config";                     // -- A query becomes GET parameters
+    WebRequestMethod method = HTTP_GET;
+    const char* authorization = HOST_AUTH_ADMIN;
+
+    // -- Urlencoded body, received by handleBody() in pieces of up to bodyPiece bytes.
+    std::string body;
+    size_t bodyPiece = 536;
+
+    // -- File received by handleUpload(). The peer stops sending while
+    //    uploadWindow bytes are not acknowledged.
+    const std::vector<uint8_t>* upload = nullptr;
+    size_t uploadChunk = 1436;
+    size_t uploadWindow = 5744;
+
+    // -- Send space offered per ACK, picked at random in this range.
+    size_t minMaxLen = 1460;
+    size_t maxMaxLen = 1460;
+    uint32_t ackDelay = 0;                      // -- Extra ticks per ACK, a slow reader
+    uint32_t startTick = 0;
+
+    // -- Share of segments lost in either direction, a lost one arrives again after retransmitTicks.
+    uint32_t dropPercent = 0;
+    uint32_t retransmitTicks = 200;
+
+    // -- The client goes away once it sent or received this many bytes.
+    size_t disconnectAfter = SIZE_MAX;
+
+    // -- Ticks the client waits for a response to begin.
+    uint32_t responseTimeout = 2000;
+
+    // -- A client turned away with 503 comes back after busyBackoff ticks, up to busyRetries times.
+    uint32_t busyRetries = 0;
+    uint32_t busyBackoff = 50;
+
+    // -- The 200 response compared byte by byte while it arrives, may be nullptr.
+    const std::string* expected = nullptr;
+    // -- Bytes of the response kept in HostSimResult::body.
+    size_t keepBody = 0;
+};
+
+/**
+ * What one virtual client saw.
+ */
+struct HostSimResult {
+    int code = 0;
+    size_t bytes = 0;                   // -- Response bytes received
+    std::string body;                   // -- The first keepBody bytes
+    bool complete = false;              // -- The response ended
+    bool disconnected = false;          // -- The client left before it ended
+    bool closed = false;                // -- The server closed the connection
+    bool matches = true;                // -- Every byte so far equals the expected response
+    uint32_t fillCalls = 0;
+    uint32_t retries = 0;               // -- RESPONSE_TRY_AGAIN answers
+    uint32_t drops = 0;
+    uint32_t busy = 0;                  // -- 503 answers, the last one included
+    size_t largestChunk = 0;
+    uint32_t doneTick = 0;
+};
+
+/**
+ * Heap and object accounting of a run, taken before the first and after
+ * the last connection.
+ */
+struct HostSimReport {
+    uint32_t ticks = 0;
+    uint32_t maxOpen = 0;               // -- Connections open at the same time
+    int64_t heapBefore = 0;
+    int64_t heapPeak = 0;
+    int64_t heapAfter = 0;
+    int64_t allocationsBefore = 0;
+    int64_t allocationsAfter = 0;
+    uint32_t liveWrappers = 0;
+    uint32_t leakedTempObjects = 0;
+    uint32_t injectedFailures = 0;
+
+    bool leaked() const {
+        return heapAfter != heapBefore || allocationsAfter != allocationsBefore ||
+            liveWrappers != 0 || leakedTempObjects != 0;
+    }
+};
+
+class HostSim {
+public:
+    // -- Called after every tick, the place for doLoop() and updater.loop().
+    typedef std::function<void(uint32_t tick)> TickHandler;
+    // -- Called after the last connection, before the heap is measured. The
+    //    place to check and release what the test itself kept on the heap.
+    typedef std::function<void()> FinishHandler;
+
+    HostSim(AsyncWebServer& server, uint32_t seed);
+    ~HostSim();
+
+    size_t addClient(const HostSimScript& script);
+    void onTick(TickHandler handler) { _onTick = handler; }
+    void onFinish(FinishHandler handler) { _onFinish = handler; }
+
+    /**
+     * Fail every period-th allocation of the library while the run lasts, 0 for none.
+     */
+    void failAllocations(uint32_t period) { _failPeriod = period; }
+
+    /**
+     * Run until every client is done or maxTicks passed. A tick is one
+     * millisecond of the host clock.
+     */
+    const HostSimReport& run(uint32_t maxTicks = 100000);
+
+    size_t size() const { return _clients.size(); }
+    const HostSimResult& result(size_t client) const;
+    const HostSimReport& report() const { return _report; }
+    void printReport(const char* name) const;
+
+private:
+    struct Client;
+
+    bool step(Client& client);
+    void connect(Client& client);
+    void receiveBody(Client& client);
+    void receiveUpload(Client& client);
+    void handle(Client& client);
+    void send(Client& client);
+    void finish(Client& client, bool disconnected);
+    void close(Client& client);
+    void retry(Client& client);
+    bool dropped(Client& client);
+
+    AsyncWebServer& _server;
+    std::mt19937 _random;
+    std::vector<Client*> _clients;
+    std::vector<Client*> _due;
+    std::vector<uint8_t> _buffer;
+    TickHandler _onTick;
+    FinishHandler _onFinish;
+    uint32_t _failPeriod = 0;
+    uint32_t _tick = 0;
+    uint32_t _open = 0;
+    HostSimReport _report;
+};
+
+#endif
@@ -0,0 +1,313 @@
+/**
+ * Arduino.h -- Host stand-in for the parts of the ESP32 Arduino core the
+ *   library uses, so it can be built and tested on Linux.
+ *
+ * String growth and the heap numbers of ESP go through HostHeap, which lets
+ * tests inject allocation failures. micros() and millis() follow a host clock
+ * that tests advance on their own, see hostAdvanceMicros().
+ */
+
+#ifndef _HOST_ARDUINO_h
+#define _HOST_ARDUINO_h
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "HostHeap.h"
+
+#define ARDUINO_HOST 1
+
+// -- Like the ESP32 core, which takes min() and max() from the standard library.
+using std::max;
+using std::min;
+
+#define PROGMEM
+#define F(x) (x)
+#define FPSTR(x) (x)
+#define PSTR(x) (x)
+typedef const char* PGM_P;
+typedef uint8_t byte;
+
+inline size_t strlen_P(const char* s) { return strlen(s); }
+inline void* memcpy_P(void* dest, const void* src, size_t n) { return memcpy(dest, src, n); }
+inline int strncmp_P(const char* a, const char* b, size_t n) { return strncmp(a, b, n); }
+inline int strcmp_P(const char* a, const char* b) { return strcmp(a, b); }
+inline uint8_t pgm_read_byte(const void* p) { return *static_cast<const uint8_t*>(p); }
+
+/**
+ * Arduino String over std::string. Like the original, a failed allocation
+ * leaves the string unchanged and is reported by concat() and reserve().
+ */
+class String {
+public:
+    String() {}
+    String(const char* cstr) { if (cstr) _s = cstr; }
+    String(const String& other) = default;
+    String(String&& other) = default;
+    explicit String(const std::string& s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(unsigned char v) : _s(std::to_string(v)) {}
+    explicit String(int v) : _s(std::to_string(v)) {}
+    explicit String(unsigned int v) : _s(std::to_string(v)) {}
+    explicit String(long v) : _s(std::to_string(v)) {}
+    explicit String(unsigned long v) : _s(std::to_string(v)) {}
+    explicit String(long long v) : _s(std::to_string(v)) {}
+    explicit String(unsigned long long v) : _s(std::to_string(v)) {}
+    explicit String(double v, unsigned int decimals = 2) {
+        char buffer_[64];
+        snprintf(buffer_, sizeof(buffer_), "%.*f", decimals, v);
+        _s = buffer_;
+    }
+
+    String& operator=(const String& other) = default;
+    String& operator=(String&& other) = default;
+    String& operator=(const char* cstr) { _s = cstr ? cstr : ""; return *this; }
+
+    unsigned int length() const { return static_cast<unsigned int>(_s.size()); }
+    const char* c_str() const { return _s.c_str(); }
+    bool isEmpty() const { return _s.empty(); }
+
+    bool reserve(unsigned int size) {
+        if (size <= _s.capacity()) {
+            return true;
+        }
+        if (!HostHeap::allowAllocation(size)) {
+            return false;
+        }
+        _s.reserve(size);
+        return true;
+    }
+
+    bool concat(const char* cstr, unsigned int length) {
+        if (cstr == nullptr) {
+            return false;
+        }
+        if (!grow(length)) {
+            return false;
+        }
+        _s.append(cstr, length);
+        return true;
+    }
+    bool concat(const char* cstr) { return cstr != nullptr && concat(cstr, static_cast<unsigned int>(strlen(cstr))); }
+    bool concat(const String& other) { return concat(other._s.data(), other.length()); }
+    bool concat(char c) { return concat(&c, 1); }
+    bool concat(int v) { return concat(String(v)); }
+    bool concat(unsigned int v) { return concat(String(v)); }
+    bool concat(long v) { return concat(String(v)); }
+    bool concat(unsigned long v) { return concat(String(v)); }
+
+    String& operator+=(const String& other) { concat(other); return *this; }
+    String& operator+=(const char* cstr) { concat(cstr); return *this; }
+    String& operator+=(char c) { concat(c); return *this; }
+    String& operator+=(int v) { concat(v); return *this; }
+    String& operator+=(unsigned int v) { concat(v); return *this; }
+    String& operator+=(long v) { concat(v); return *this; }
+    String& operator+=(unsigned long v) { concat(v); return *this; }
+
+    bool operator==(const String& other) const { return _s == other._s; }
+    bool operator==(const char* cstr) const { return _s == (cstr ? cstr : ""); }
+    bool operator!=(const String& other) const { return _s != other._s; }
+    bool operator!=(const char* cstr) const { return !(*this == cstr); }
+    bool operator<(const String& other) const { return _s < other._s; }
+    bool equals(const String& other) const { return _s == other._s; }
+    bool equalsIgnoreCase(const String& other) const { return strcasecmp(_s.c_str(), other._s.c_str()) == 0; }
+
+    char operator[](unsigned int index) const { return index < _s.size() ? _s[index] : '\0'; }
+    char& operator[](unsigned int index) { return _s[index]; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    int indexOf(char c, unsigned int from = 0) const { return position(_s.find(c, from)); }
+    int indexOf(const char* cstr, unsigned int from = 0) const { return position(_s.find(cstr, from)); }
+    int indexOf(const String& other, unsigned int from = 0) const { return position(_s.find(other._s, from)); }
+    int lastIndexOf(char c) const { return position(_s.rfind(c)); }
+    bool startsWith(const String& prefix) const { return _s.compare(0, prefix._s.size(), prefix._s) == 0; }
+    bool endsWith(const String& suffix) const {
+        return _s.size() >= suffix._s.size() && _s.compare(_s.size() - suffix._s.size(), suffix._s.size(), suffix._s) == 0;
+    }
+
+    String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) {
+            std::swap(from, to);
+        }
+        return from < _s.size() ? String(_s.substr(from, to - from)) : String();
+    }
+
+    void replace(const String& find, const String& replace) {
+        if (find._s.empty()) {
+            return;
+        }
+        size_t pos_ = 0;
+        while ((pos_ = _s.find(find._s, pos_)) != std::string::npos) {
+            _s.replace(pos_, find._s.size(), replace._s);
+            pos_ += replace._s.size();
+        }
+    }
+    void remove(unsigned int index) { if (index < _s.size()) _s.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < _s.size()) _s.erase(index, count); }
+    void toLowerCase() { for (char& c_ : _s) c_ = static_cast<char>(tolower(static_cast<unsigned char>(c_))); }
+    void toUpperCase() { for (char& c_ : _s) c_ = static_cast<char>(toupper(static_cast<unsigned char>(c_))); }
+    void trim() {
+        size_t first_ = _s.find_first_not_of(" \t\r\n");
+        if (first_ == std::string::npos) {
+            _s.clear();
+            return;
+        }
+        _s = _s.substr(first_, _s.find_last_not_of(" \t\r\n") - first_ + 1);
+    }
+    long toInt() const { return atol(_s.c_str()); }
+
+protected:
+    std::string _s;
+
+    bool grow(size_t length) {
+        size_t needed_ = _s.size() + length;
+        return needed_ <= _s.capacity() || HostHeap::allowAllocation(needed_);
+    }
+    static int position(size_t pos) { return pos == std::string::npos ? -1 : static_cast<int>(pos); }
+};
+
+inline String operator+(const String& a, const String& b) { String r_(a); r_ += b; return r_; }
+inline String operator+(const String& a, const char* b) { String r_(a); r_ += b; return r_; }
+inline String operator+(const char* a, const String& b) { String r_(a); r_ += b; return r_; }
+inline String operator+(const String& a, char b) { String r_(a); r_ += b; return r_; }
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n_ = 0;
+        while (size-- > 0 && write(*buffer++)) {
+            n_++;
+        }
+        return n_;
+    }
+    size_t write(const char* cstr) { return write(reinterpret_cast<const uint8_t*>(cstr), strlen(cstr)); }
+
+    size_t print(const String& s) { return write(reinterpret_cast<const uint8_t*>(s.c_str()), s.length()); }
+    size_t print(const char* cstr) { return write(cstr); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(int v) { return print(String(v)); }
+    size_t print(unsigned int v) { return print(String(v)); }
+    size_t print(long v) { return print(String(v)); }
+    size_t print(unsigned long v) { return print(String(v)); }
+    size_t print(double v) { return print(String(v)); }
+    size_t println() { return write("\n"); }
+    template<typename T> size_t println(const T& v) { return print(v) + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer_[256];
+        va_list args_;
+        va_start(args_, format);
+        int length_ = vsnprintf(buffer_, sizeof(buffer_), format, args_);
+        va_end(args_);
+        if (length_ < 0) {
+            return 0;
+        }
+        return write(reinterpret_cast<const uint8_t*>(buffer_), std::min(static_cast<size_t>(length_), sizeof(buffer_) - 1));
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+};
+
+/**
+ * Serial output is dropped unless echo is set (or IWC_HOST_SERIAL=1 in the
+ * environment). Tests that check the output set capture and read output.
+ */
+class HardwareSerial : public Stream {
+public:
+    bool echo = false;
+    bool capture = false;
+    std::string output;
+
+    void begin(unsigned long) {}
+    using Print::write;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (capture) {
+            output.append(reinterpret_cast<const char*>(buffer), size);
+        }
+        if (echo) {
+            fwrite(buffer, 1, size, stdout);
+        }
+        return size;
+    }
+};
+extern HardwareSerial Serial;
+
+class IPAddress {
+public:
+    IPAddress() : _address(0) {}
+    IPAddress(uint32_t address) : _address(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) :
+        _address(a | (b << 8) | (c << 16) | (static_cast<uint32_t>(d) << 24)) {}
+    operator uint32_t() const { return _address; }
+    uint8_t operator[](int index) const { return static_cast<uint8_t>(_address >> (index * 8)); }
+    String toString() const {
+        char buffer_[16];
+        snprintf(buffer_, sizeof(buffer_), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buffer_);
+    }
+private:
+    uint32_t _address;
+};
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void yield();
+long random(long max);
+uint32_t esp_random();
+inline bool psramFound() { return false; }
+
+/**
+ * Host clock. micros() advances by the step on every call, which simulates
+ * the time spent rendering. delay() advances the clock and is counted.
+ */
+void hostSetMicrosStep(unsigned long step);
+void hostAdvanceMicros(unsigned long us);
+void hostUseRealClock(bool real);
+uint32_t hostDelayCalls();
+
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return HostHeap::freeHeap(); }
+    uint32_t getMaxAllocHeap() { return HostHeap::maxAllocHeap(); }
+    uint32_t random() { return esp_random(); }
+    void restart() { restarts++; }
+    uint32_t restarts = 0;
+};
+extern EspClass ESP;
+
+// -- FreeRTOS, the tasks run as host threads.
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+#define pdPASS 1
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFFu
+
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void*), const char* name, uint32_t stackDepth, void* parameter,
+    unsigned int priority, TaskHandle_t* handle, int core);
+int xPortGetCoreID();
+void vTaskDelay(TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+void xTaskNotifyGive(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * AsyncTCP.h -- Host stand-in for the AsyncTCP client. The connection is driven
+ *   by the test, e.g. the simulator in test/host/sim: it decides how much send
+ *   space there is and whether received data was acknowledged.
+ */
+
+#ifndef _HOST_ASYNCTCP_h
+#define _HOST_ASYNCTCP_h
+
+#include "Arduino.h"
+
+class AsyncClient {
+public:
+    IPAddress localIP() const { return _localIP; }
+    uint16_t localPort() const { return 80; }
+    IPAddress remoteIP() const { return _remoteIP; }
+    uint16_t remotePort() const { return _remotePort; }
+    bool connected() const { return _connected; }
+    void setNoDelay(bool noDelay) { _noDelay = noDelay; }
+    bool getNoDelay() const { return _noDelay; }
+    void close(bool now = false) { (void)now; _closeRequested = true; }
+
+    /**
+     * Free space of the send buffer.
+     */
+    size_t space() const { return _connected ? _space : 0; }
+
+    /**
+     * Do not acknowledge the data of the current receive callback, the peer
+     * stops sending once its window is used up. ack() releases it later.
+     */
+    void ackLater() { _ackLater = true; }
+    size_t ack(size_t len) {
+        if (len > _unacked) {
+            len = _unacked;
+        }
+        _unacked -= len;
+        return len;
+    }
+
+    // -- Host side.
+    IPAddress _localIP = IPAddress(192, 168, 4, 1);
+    IPAddress _remoteIP = IPAddress(192, 168, 4, 2);
+    uint16_t _remotePort = 50000;
+    bool _connected = true;
+    bool _noDelay = false;
+    bool _closeRequested = false;
+    size_t _space = 5744;
+    bool _ackLater = false;
+    size_t _unacked = 0;
+
+    /**
+     * Account data passed to a receive callback, as AsyncTCP does after it returned.
+     */
+    void received(size_t len) {
+        if (_ackLater) {
+            _unacked += len;
+        }
+        _ackLater = false;
+    }
+};
+
+#endif
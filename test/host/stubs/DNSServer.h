@@ -0,0 +1,9 @@
+#ifndef _HOST_DNSSERVER_h
+#define _HOST_DNSSERVER_h
+
+class DNSServer {
+public:
+    void processNextRequest() {}
+};
+
+#endif
@@ -0,0 +1,354 @@
+/**
+ * ESPAsyncWebServer.h -- Host stand-in for the request, response and handler
+ *   classes of ESPAsyncWebServer 3.x. Requests are built and driven by the test
+ *   (see test/host/sim); responses keep their code, headers and body, so the
+ *   test can read them like a client would.
+ */
+
+#ifndef _HOST_ESPASYNCWEBSERVER_h
+#define _HOST_ESPASYNCWEBSERVER_h
+
+#include "Arduino.h"
+#include "AsyncTCP.h"
+
+#include <list>
+#include <memory>
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<String(const String&)> AwsTemplateProcessor;
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+namespace asyncsrv {
+    static constexpr const char* T_Cache_Control = "Cache-Control";
+}
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+
+class AsyncWebHeader {
+public:
+    AsyncWebHeader(const String& name, const String& value) : _name(name), _value(value) {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+private:
+    String _name;
+    String _value;
+};
+
+class AsyncWebParameter {
+public:
+    AsyncWebParameter(const String& name, const String& value, bool form = false, bool file = false, size_t size = 0) :
+        _name(name), _value(value), _size(size), _isForm(form), _isFile(file) {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+    size_t size() const { return _size; }
+    bool isPost() const { return _isForm; }
+    bool isFile() const { return _isFile; }
+private:
+    String _name;
+    String _value;
+    size_t _size;
+    bool _isForm;
+    bool _isFile;
+};
+
+class AsyncWebServerResponse {
+public:
+    virtual ~AsyncWebServerResponse() {}
+
+    void setCode(int code) { _code = code; }
+    void setContentLength(size_t len) { _contentLength = len; }
+    void setContentType(const String& type) { _contentType = type; }
+    bool addHeader(const char* name, const char* value, bool replaceExisting = true);
+    bool addHeader(const String& name, const String& value, bool replaceExisting = true) {
+        return addHeader(name.c_str(), value.c_str(), replaceExisting);
+    }
+    bool addHeader(const char* name, long value, bool replaceExisting = true) {
+        return addHeader(name, String(value).c_str(), replaceExisting);
+    }
+
+    // -- Host side.
+    int code() const { return _code; }
+    const String& contentType() const { return _contentType; }
+    size_t contentLength() const { return _contentLength; }
+    const std::vector<AsyncWebHeader>& headers() const { return _headers; }
+    const String* header(const char* name) const;
+
+    /**
+     * Next part of the body, like the response produces it for the send buffer.
+     * @return Bytes written, 0 at the end of the body or RESPONSE_TRY_AGAIN
+     */
+    virtual size_t fillBody(uint8_t* buffer, size_t maxLen) = 0;
+    virtual bool isChunked() const { return false; }
+
+protected:
+    int _code = 200;
+    String _contentType;
+    size_t _contentLength = 0;
+    std::vector<AsyncWebHeader> _headers;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+public:
+    AsyncBasicResponse(int code, const String& contentType = String(), const String& content = String());
+    size_t fillBody(uint8_t* buffer, size_t maxLen) override;
+private:
+    String _content;
+    size_t _sent = 0;
+};
+
+class AsyncProgmemResponse : public AsyncWebServerResponse {
+public:
+    AsyncProgmemResponse(int code, const String& contentType, const uint8_t* content, size_t len);
+    size_t fillBody(uint8_t* buffer, size_t maxLen) override;
+private:
+    const uint8_t* _content;
+    size_t _sent = 0;
+};
+
+class AsyncCallbackResponse : public AsyncWebServerResponse {
+public:
+    AsyncCallbackResponse(const String& contentType, size_t len, AwsResponseFiller callback);
+    size_t fillBody(uint8_t* buffer, size_t maxLen) override;
+private:
+    AwsResponseFiller _callback;
+    size_t _sent = 0;
+};
+
+class AsyncChunkedResponse : public AsyncWebServerResponse {
+public:
+    AsyncChunkedResponse(const String& contentType, AwsResponseFiller callback, AwsTemplateProcessor templateCallback = nullptr);
+    size_t fillBody(uint8_t* buffer, size_t maxLen) override;
+    bool isChunked() const override { return true; }
+private:
+    AwsResponseFiller _callback;
+    size_t _sent = 0;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+public:
+    AsyncResponseStream(const String& contentType, size_t bufferSize);
+    using Print::write;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t len) override;
+    size_t fillBody(uint8_t* buffer, size_t maxLen) override;
+private:
+    std::string _content;
+    size_t _sent = 0;
+};
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
+typedef std::function<void(void)> ArDisconnectHandler;
+
+class AsyncWebServerRequest {
+public:
+    void* _tempObject = nullptr;
+
+    AsyncWebServerRequest(AsyncWebServer* server, AsyncClient* client);
+    ~AsyncWebServerRequest();
+
+    AsyncClient* client() { return _client; }
+    AsyncWebServer* server() { return _server; }
+    const String& url() const { return _url; }
+    const String& host() const { return _host; }
+    WebRequestMethodComposite method() const { return _method; }
+    const String& contentType() const { return _contentType; }
+    size_t contentLength() const { return _contentLength; }
+
+    bool authenticate(const char* username, const char* password, const char* realm = nullptr, bool passwordIsHash = false);
+    void requestAuthentication(const char* realm = nullptr, bool isDigest = true);
+
+    size_t params() const { return _params.size(); }
+    const AsyncWebParameter* getParam(size_t num) const { return num < _params.size() ? &_params[num] : nullptr; }
+    const AsyncWebParameter* getParam(const char* name, bool post = false, bool file = false) const;
+    bool hasParam(const char* name, bool post = false, bool file = false) const { return getParam(name, post, file) != nullptr; }
+    size_t args() const { return _params.size(); }
+    bool hasArg(const char* name) const;
+    const String& arg(const char* name) const;
+    const String& arg(const String& name) const { return arg(name.c_str()); }
+
+    size_t headers() const { return _headers.size(); }
+    bool hasHeader(const char* name) const { return getHeader(name) != nullptr; }
+    const AsyncWebHeader* getHeader(const char* name) const;
+    const String& header(const char* name) const;
+
+    void onDisconnect(ArDisconnectHandler fn) { _onDisconnect = fn; }
+
+    void send(AsyncWebServerResponse* response);
+    void send(int code, const char* contentType = "", const char* content = "") {
+        send(beginResponse(code, contentType, content));
+    }
+    void send(int code, const String& contentType, const String& content = String()) {
+        send(beginResponse(code, contentType, content));
+    }
+    void redirect(const char* url, int code = 302);
+
+    AsyncWebServerResponse* beginResponse(int code, const char* contentType = "", const char* content = "") {
+        return new AsyncBasicResponse(code, contentType, content);
+    }
+    AsyncWebServerResponse* beginResponse(int code, const String& contentType, const String& content) {
+        return new AsyncBasicResponse(code, contentType, content);
+    }
+    AsyncWebServerResponse* beginResponse(int code, const char* contentType, const uint8_t* content, size_t len) {
+        return new AsyncProgmemResponse(code, contentType, content, len);
+    }
+    AsyncWebServerResponse* beginResponse_P(int code, const String& contentType, const uint8_t* content, size_t len) {
+        return new AsyncProgmemResponse(code, contentType, content, len);
+    }
+    AsyncWebServerResponse* beginResponse_P(int code, const String& contentType, PGM_P content) {
+        return new AsyncProgmemResponse(code, contentType, reinterpret_cast<const uint8_t*>(content), strlen_P(content));
+    }
+    AsyncWebServerResponse* beginResponse(const char* contentType, size_t len, AwsResponseFiller callback) {
+        return new AsyncCallbackResponse(contentType, len, callback);
+    }
+    AsyncWebServerResponse* beginChunkedResponse(const char* contentType, AwsResponseFiller callback) {
+        return new AsyncChunkedResponse(contentType, callback);
+    }
+    AsyncResponseStream* beginResponseStream(const char* contentType, size_t bufferSize = 1460) {
+        return new AsyncResponseStream(contentType, bufferSize);
+    }
+
+    // -- Host side, used to build the request and to read the response.
+    void setUrl(const String& url) { _url = url; }
+    void setMethod(WebRequestMethodComposite method) { _method = method; }
+    void setContentType(const String& contentType) { _contentType = contentType; }
+    void setContentLength(size_t contentLength) { _contentLength = contentLength; }
+    void addHeader(const String& name, const String& value) { _headers.emplace_back(name, value); }
+    void addParam(const String& name, const String& value, bool post = false) { _params.emplace_back(name, value, post); }
+    AsyncWebServerResponse* response() const { return _response; }
+    bool isSent() const { return _response != nullptr; }
+    uint32_t sendCalls() const { return _sendCalls; }
+
+    /**
+     * The client is gone: calls the disconnect handler, the caller deletes the
+     * request afterwards like AsyncWebServer does.
+     */
+    void disconnect();
+
+    /**
+     * Number of requests deleted while _tempObject was still set. ESPAsyncWebServer
+     * releases it with free(), which must never happen to an object made with new.
+     */
+    static uint32_t leakedTempObjects();
+
+private:
+    AsyncWebServer* _server;
+    AsyncClient* _client;
+    String _url;
+    String _host;
+    WebRequestMethodComposite _method = HTTP_GET;
+    String _contentType;
+    size_t _contentLength = 0;
+    std::vector<AsyncWebParameter> _params;
+    std::vector<AsyncWebHeader> _headers;
+    AsyncWebServerResponse* _response = nullptr;
+    uint32_t _sendCalls = 0;
+    ArDisconnectHandler _onDisconnect;
+};
+
+class AsyncWebHandler {
+public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest* request) const { (void)request; return false; }
+    virtual void handleRequest(AsyncWebServerRequest* request) { (void)request; }
+    virtual void handleUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
+        (void)request; (void)filename; (void)index; (void)data; (void)len; (void)final;
+    }
+    virtual void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+        (void)request; (void)data; (void)len; (void)index; (void)total;
+    }
+    virtual bool isRequestHandlerTrivial() const { return true; }
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+public:
+    AsyncCallbackWebHandler(const String& uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+        ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody) :
+        _uri(uri), _method(method), _onRequest(onRequest), _onUpload(onUpload), _onBody(onBody) {}
+
+    bool canHandle(AsyncWebServerRequest* request) const override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+    void handleUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) override;
+    void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) override;
+    bool isRequestHandlerTrivial() const override { return !_onUpload && !_onBody; }
+
+private:
+    String _uri;
+    WebRequestMethodComposite _method;
+    ArRequestHandlerFunction _onRequest;
+    ArUploadHandlerFunction _onUpload;
+    ArBodyHandlerFunction _onBody;
+};
+
+class AsyncEventSourceClient;
+typedef std::function<void(AsyncEventSourceClient* client)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler {
+public:
+    explicit AsyncEventSource(const String& url) : _url(url) {}
+    const char* url() const { return _url.c_str(); }
+    void setAuthentication(const char* username, const char* password) { _username = username; _password = password; }
+    void onConnect(ArEventHandlerFunction cb) { (void)cb; }
+    void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+    size_t count() const { return _clients; }
+    size_t avgPacketsWaiting() const { return 0; }
+    bool canHandle(AsyncWebServerRequest* request) const override { return request->url() == _url; }
+    void handleRequest(AsyncWebServerRequest* request) override;
+
+    // -- Host side.
+    size_t _clients = 0;
+    std::vector<String> _sent;
+private:
+    String _url;
+    String _username;
+    String _password;
+};
+
+class AsyncWebServer {
+public:
+    explicit AsyncWebServer(uint16_t port) : _port(port) {}
+    ~AsyncWebServer();
+
+    void begin() { _begun = true; }
+    void end() { _begun = false; }
+    AsyncWebHandler& addHandler(AsyncWebHandler* handler);
+    bool removeHandler(AsyncWebHandler* handler);
+    AsyncCallbackWebHandler& on(const char* uri, ArRequestHandlerFunction onRequest) {
+        return on(uri, HTTP_ANY, onRequest);
+    }
+    AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+        ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr);
+    void onNotFound(ArRequestHandlerFunction fn) { _notFound = fn; }
+
+    // -- Host side.
+    /**
+     * The handler that takes the request, like the server picks it: the first
+     * one that can handle it, nullptr for the not found handler.
+     */
+    AsyncWebHandler* findHandler(AsyncWebServerRequest* request);
+    void handleNotFound(AsyncWebServerRequest* request);
+    bool isBegun() const { return _begun; }
+
+private:
+    uint16_t _port;
+    bool _begun = false;
+    std::list<std::unique_ptr<AsyncWebHandler>> _handlers;
+    ArRequestHandlerFunction _notFound;
+};
+
+#endif
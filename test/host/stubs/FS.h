@@ -0,0 +1,30 @@
+#ifndef _HOST_FS_h
+#define _HOST_FS_h
+
+#include "Arduino.h"
+
+// -- Only what AsyncFsStorageFs needs to compile, the host tests use AsyncRamStorageFs.
+namespace fs {
+
+class File {
+public:
+    operator bool() const { return false; }
+    size_t size() { return 0; }
+    bool seek(size_t) { return false; }
+    size_t read(uint8_t*, size_t) { return 0; }
+    size_t write(const uint8_t*, size_t) { return 0; }
+    void flush() {}
+    void close() {}
+};
+
+class FS {
+public:
+    File open(const char*, const char*) { return File(); }
+    bool exists(const char*) { return false; }
+    bool rename(const char*, const char*) { return false; }
+    bool remove(const char*) { return false; }
+};
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+/**
+ * HTTPClient.h -- Host stand-in for the ESP32 HTTPClient, plain HTTP/1.1 GET
+ *   with Content-Length bodies, enough for AsyncUpdatePuller.
+ */
+
+#ifndef _HOST_HTTPCLIENT_h
+#define _HOST_HTTPCLIENT_h
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_PARTIAL_CONTENT 206
+#define HTTP_CODE_NOT_FOUND 404
+
+class HTTPClient {
+public:
+    bool begin(WiFiClient& client, const String& url);
+    void end();
+    void setTimeout(uint16_t timeout) { _timeout = timeout; }
+    void addHeader(const String& name, const String& value);
+
+    int GET();
+    /**
+     * Body length from Content-Length, -1 if there was none.
+     */
+    int getSize() const { return _size; }
+    String getString();
+    WiFiClient* getStreamPtr() { return _connected ? _client : nullptr; }
+
+    static String errorToString(int error);
+
+private:
+    WiFiClient* _client = nullptr;
+    String _host;
+    uint16_t _port = 80;
+    String _path;
+    String _headers;
+    uint16_t _timeout = 5000;
+    int _size = -1;
+    bool _connected = false;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace {
+    std::atomic<unsigned long> clockUs_{ 0 };
+    std::atomic<unsigned long> clockStep_{ 0 };
+    std::atomic<bool> realClock_{ false };
+    std::atomic<uint32_t> delayCalls_{ 0 };
+    uint32_t randomState_ = 0x12345678;
+
+    struct SerialEcho {
+        SerialEcho() {
+            const char* echo_ = getenv("IWC_HOST_SERIAL");
+            Serial.echo = echo_ != nullptr && strcmp(echo_, "1") == 0;
+        }
+    } serialEcho_;
+
+    unsigned long realMicros() {
+        return static_cast<unsigned long>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+unsigned long micros() {
+    if (realClock_.load()) {
+        return realMicros();
+    }
+    return clockUs_.fetch_add(clockStep_.load()) + clockStep_.load();
+}
+
+unsigned long millis() {
+    if (realClock_.load()) {
+        return realMicros() / 1000;
+    }
+    return clockUs_.load() / 1000;
+}
+
+void delay(unsigned long ms) {
+    delayCalls_++;
+    if (realClock_.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        return;
+    }
+    clockUs_ += ms * 1000;
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+long random(long max) {
+    randomState_ = randomState_ * 1103515245u + 12345u;
+    return max > 0 ? static_cast<long>((randomState_ >> 1) % static_cast<uint32_t>(max)) : 0;
+}
+
+uint32_t esp_random() {
+    randomState_ = randomState_ * 1103515245u + 12345u;
+    return randomState_;
+}
+
+void hostSetMicrosStep(unsigned long step) {
+    clockStep_.store(step);
+}
+
+void hostAdvanceMicros(unsigned long us) {
+    clockUs_ += us;
+}
+
+void hostUseRealClock(bool real) {
+    realClock_.store(real);
+}
+
+uint32_t hostDelayCalls() {
+    return delayCalls_.load();
+}
+
+// -- FreeRTOS tasks are detached threads, task notifications a counting semaphore per task.
+namespace {
+    struct HostTask {
+        std::mutex mutex;
+        std::condition_variable notified;
+        uint32_t notifications = 0;
+    };
+    thread_local HostTask* currentTask_ = nullptr;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void*), const char* name, uint32_t stackDepth, void* parameter,
+    unsigned int priority, TaskHandle_t* handle, int core) {
+    (void)name;
+    (void)stackDepth;
+    (void)priority;
+    (void)core;
+    HostTask* hostTask_ = new HostTask();
+    std::thread([task, parameter, hostTask_]() {
+        currentTask_ = hostTask_;
+        task(parameter);
+    }).detach();
+    if (handle != nullptr) {
+        *handle = hostTask_;
+    }
+    return pdPASS;
+}
+
+int xPortGetCoreID() {
+    return currentTask_ != nullptr ? 0 : 1;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50 * ticks));
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+    (void)ticksToWait;
+    HostTask* task_ = currentTask_;
+    std::unique_lock<std::mutex> lock_(task_->mutex);
+    task_->notified.wait(lock_, [task_]() { return task_->notifications > 0; });
+    uint32_t count_ = task_->notifications;
+    task_->notifications = clearOnExit ? 0 : count_ - 1;
+    return count_;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+    HostTask* task_ = static_cast<HostTask*>(task);
+    {
+        std::lock_guard<std::mutex> lock_(task_->mutex);
+        task_->notifications++;
+    }
+    task_->notified.notify_one();
+}
@@ -0,0 +1,308 @@
+#include "ESPAsyncWebServer.h"
+
+namespace {
+    std::atomic<uint32_t> leakedTempObjects_{ 0 };
+
+    String base64(const String& data) {
+        static const char digits_[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        String encoded_;
+        const uint8_t* bytes_ = reinterpret_cast<const uint8_t*>(data.c_str());
+        size_t length_ = data.length();
+        for (size_t i = 0; i < length_; i += 3) {
+            uint32_t block_ = bytes_[i] << 16;
+            if (i + 1 < length_) block_ |= bytes_[i + 1] << 8;
+            if (i + 2 < length_) block_ |= bytes_[i + 2];
+            encoded_ += digits_[(block_ >> 18) & 0x3F];
+            encoded_ += digits_[(block_ >> 12) & 0x3F];
+            encoded_ += i + 1 < length_ ? digits_[(block_ >> 6) & 0x3F] : '=';
+            encoded_ += i + 2 < length_ ? digits_[block_ & 0x3F] : '=';
+        }
+        return encoded_;
+    }
+
+    size_t copyBody(const uint8_t* content, size_t length, size_t& sent, uint8_t* buffer, size_t maxLen) {
+        size_t len_ = std::min(maxLen, length - sent);
+        memcpy(buffer, content + sent, len_);
+        sent += len_;
+        return len_;
+    }
+}
+
+bool AsyncWebServerResponse::addHeader(const char* name, const char* value, bool replaceExisting) {
+    for (AsyncWebHeader& header_ : _headers) {
+        if (strcasecmp(header_.name().c_str(), name) == 0) {
+            if (!replaceExisting) {
+                return false;
+            }
+            header_ = AsyncWebHeader(name, value);
+            return true;
+        }
+    }
+    _headers.emplace_back(name, value);
+    return true;
+}
+
+const String* AsyncWebServerResponse::header(const char* name) const {
+    for (const AsyncWebHeader& header_ : _headers) {
+        if (strcasecmp(header_.name().c_str(), name) == 0) {
+            return &header_.value();
+        }
+    }
+    return nullptr;
+}
+
+AsyncBasicResponse::AsyncBasicResponse(int code, const String& contentType, const String& content) : _content(content) {
+    _code = code;
+    _contentType = contentType;
+    _contentLength = content.length();
+}
+
+size_t AsyncBasicResponse::fillBody(uint8_t* buffer, size_t maxLen) {
+    return copyBody(reinterpret_cast<const uint8_t*>(_content.c_str()), _content.length(), _sent, buffer, maxLen);
+}
+
+AsyncProgmemResponse::AsyncProgmemResponse(int code, const String& contentType, const uint8_t* content, size_t len) : _content(content) {
+    _code = code;
+    _contentType = contentType;
+    _contentLength = len;
+}
+
+size_t AsyncProgmemResponse::fillBody(uint8_t* buffer, size_t maxLen) {
+    return copyBody(_content, _contentLength, _sent, buffer, maxLen);
+}
+
+AsyncCallbackResponse::AsyncCallbackResponse(const String& contentType, size_t len, AwsResponseFiller callback) : _callback(callback) {
+    _contentType = contentType;
+    _contentLength = len;
+}
+
+size_t AsyncCallbackResponse::fillBody(uint8_t* buffer, size_t maxLen) {
+    if (_sent >= _contentLength) {
+        return 0;
+    }
+    size_t len_ = _callback(buffer, std::min(maxLen, _contentLength - _sent), _sent);
+    if (len_ != RESPONSE_TRY_AGAIN) {
+        _sent += len_;
+    }
+    return len_;
+}
+
+AsyncChunkedResponse::AsyncChunkedResponse(const String& contentType, AwsResponseFiller callback, AwsTemplateProcessor templateCallback) :
+    _callback(callback) {
+    (void)templateCallback;
+    _contentType = contentType;
+}
+
+size_t AsyncChunkedResponse::fillBody(uint8_t* buffer, size_t maxLen) {
+    size_t len_ = _callback(buffer, maxLen, _sent);
+    if (len_ != RESPONSE_TRY_AGAIN) {
+        _sent += len_;
+    }
+    return len_;
+}
+
+AsyncResponseStream::AsyncResponseStream(const String& contentType, size_t bufferSize) {
+    _contentType = contentType;
+    _content.reserve(bufferSize);
+}
+
+size_t AsyncResponseStream::write(const uint8_t* data, size_t len) {
+    _content.append(reinterpret_cast<const char*>(data), len);
+    _contentLength = _content.size();
+    return len;
+}
+
+size_t AsyncResponseStream::fillBody(uint8_t* buffer, size_t maxLen) {
+    return copyBody(reinterpret_cast<const uint8_t*>(_content.data()), _content.size(), _sent, buffer, maxLen);
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* server, AsyncClient* client) :
+    _server(server), _client(client), _url("/"), _host("192.168.4.1") {
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+    delete _response;
+    // -- Like ESPAsyncWebServer, which releases it with free().
+    if (_tempObject != nullptr) {
+        leakedTempObjects_++;
+        free(_tempObject);
+    }
+}
+
+uint32_t AsyncWebServerRequest::leakedTempObjects() {
+    return leakedTempObjects_.load();
+}
+
+bool AsyncWebServerRequest::authenticate(const char* username, const char* password, const char* realm, bool passwordIsHash) {
+    (void)realm;
+    (void)passwordIsHash;
+    const AsyncWebHeader* header_ = getHeader("Authorization");
+    if (header_ == nullptr || !header_->value().startsWith("Basic ")) {
+        return false;
+    }
+    return header_->value().substring(6) == base64(String(username) + ":" + password);
+}
+
+void AsyncWebServerRequest::requestAuthentication(const char* realm, bool isDigest) {
+    (void)isDigest;
+    AsyncWebServerResponse* response_ = beginResponse(401);
+    response_->addHeader("WWW-Authenticate", String("Basic realm=\"") + (realm != nullptr ? realm : "Login Required") + "\"");
+    send(response_);
+}
+
+const AsyncWebParameter* AsyncWebServerRequest::getParam(const char* name, bool post, bool file) const {
+    for (const AsyncWebParameter& param_ : _params) {
+        if (param_.name() == name && param_.isPost() == post && param_.isFile() == file) {
+            return &param_;
+        }
+    }
+    return nullptr;
+}
+
+bool AsyncWebServerRequest::hasArg(const char* name) const {
+    for (const AsyncWebParameter& param_ : _params) {
+        if (param_.name() == name && !param_.isFile()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const String& AsyncWebServerRequest::arg(const char* name) const {
+    static const String empty_;
+    for (const AsyncWebParameter& param_ : _params) {
+        if (param_.name() == name) {
+            return param_.value();
+        }
+    }
+    return empty_;
+}
+
+const AsyncWebHeader* AsyncWebServerRequest::getHeader(const char* name) const {
+    for (const AsyncWebHeader& header_ : _headers) {
+        if (strcasecmp(header_.name().c_str(), name) == 0) {
+            return &header_;
+        }
+    }
+    return nullptr;
+}
+
+const String& AsyncWebServerRequest::header(const char* name) const {
+    static const String empty_;
+    const AsyncWebHeader* header_ = getHeader(name);
+    return header_ != nullptr ? header_->value() : empty_;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* response) {
+    _sendCalls++;
+    // -- The first response wins, ESPAsyncWebServer drops later ones.
+    if (_response != nullptr) {
+        delete response;
+        return;
+    }
+    _response = response;
+}
+
+void AsyncWebServerRequest::redirect(const char* url, int code) {
+    AsyncWebServerResponse* response_ = beginResponse(code);
+    response_->addHeader("Location", url);
+    send(response_);
+}
+
+void AsyncWebServerRequest::disconnect() {
+    if (_client != nullptr) {
+        _client->_connected = false;
+    }
+    if (_onDisconnect) {
+        ArDisconnectHandler handler_ = _onDisconnect;
+        _onDisconnect = nullptr;
+        handler_();
+    }
+}
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest* request) const {
+    if (!(_method & request->method())) {
+        return false;
+    }
+    return request->url() == _uri || request->url().startsWith(_uri + "/");
+}
+
+void AsyncCallbackWebHandler::handleRequest(AsyncWebServerRequest* request) {
+    if (_onRequest) {
+        _onRequest(request);
+    }
+    else {
+        request->send(500);
+    }
+}
+
+void AsyncCallbackWebHandler::handleUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
+    if (_onUpload) {
+        _onUpload(request, filename, index, data, len, final);
+    }
+}
+
+void AsyncCallbackWebHandler::handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    if (_onBody) {
+        _onBody(request, data, len, index, total);
+    }
+}
+
+void AsyncEventSource::handleRequest(AsyncWebServerRequest* request) {
+    if (_username.length() > 0 && _password.length() > 0 && !request->authenticate(_username.c_str(), _password.c_str())) {
+        request->requestAuthentication();
+        return;
+    }
+    // -- The connection stays open as event stream.
+    _clients++;
+    request->send(200, "text/event-stream", "");
+}
+
+void AsyncEventSource::send(const char* message, const char* event, uint32_t id, uint32_t reconnect) {
+    (void)id;
+    (void)reconnect;
+    _sent.push_back(String(event != nullptr ? event : "") + ":" + message);
+}
+
+AsyncWebServer::~AsyncWebServer() {
+}
+
+AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler) {
+    _handlers.emplace_back(handler);
+    return *handler;
+}
+
+bool AsyncWebServer::removeHandler(AsyncWebHandler* handler) {
+    for (auto it_ = _handlers.begin(); it_ != _handlers.end(); ++it_) {
+        if (it_->get() == handler) {
+            _handlers.erase(it_);
+            return true;
+        }
+    }
+    return false;
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+    ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody) {
+    AsyncCallbackWebHandler* handler_ = new AsyncCallbackWebHandler(uri, method, onRequest, onUpload, onBody);
+    addHandler(handler_);
+    return *handler_;
+}
+
+AsyncWebHandler* AsyncWebServer::findHandler(AsyncWebServerRequest* request) {
+    for (auto& handler_ : _handlers) {
+        if (handler_->canHandle(request)) {
+            return handler_.get();
+        }
+    }
+    return nullptr;
+}
+
+void AsyncWebServer::handleNotFound(AsyncWebServerRequest* request) {
+    if (_notFound) {
+        _notFound(request);
+    }
+    else {
+        request->send(404);
+    }
+}
@@ -0,0 +1,205 @@
+#include "HostHeap.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace {
+    std::atomic<int64_t> liveBytes_{ 0 };
+    std::atomic<int64_t> liveAllocations_{ 0 };
+    std::atomic<int64_t> peakBytes_{ 0 };
+
+    std::atomic<bool> failing_{ false };
+    std::atomic<uint32_t> skip_{ 0 };
+    std::atomic<uint32_t> failCount_{ 0 };   // 0: no limit
+    std::atomic<uint32_t> failPeriod_{ 0 };
+    std::atomic<uint32_t> requests_{ 0 };
+    std::atomic<uint32_t> injected_{ 0 };
+    std::atomic<size_t> failSize_{ 0 };
+
+    uint32_t heapSize_ = 320000;
+    uint32_t maxBlock_ = 110000;
+}
+
+extern "C" {
+    void* __real_malloc(size_t size);
+    void* __real_realloc(void* ptr, size_t size);
+    void __real_free(void* ptr);
+
+    void* __wrap_malloc(size_t size) {
+        if (!HostHeap::allowAllocation(size)) {
+            return nullptr;
+        }
+        void* ptr_ = __real_malloc(size);
+        if (ptr_ != nullptr) {
+            HostHeap::recordAllocation(malloc_usable_size(ptr_));
+        }
+        return ptr_;
+    }
+
+    void* __wrap_realloc(void* ptr, size_t size) {
+        if (size > 0 && !HostHeap::allowAllocation(size)) {
+            return nullptr;
+        }
+        size_t old_ = ptr != nullptr ? malloc_usable_size(ptr) : 0;
+        void* result_ = __real_realloc(ptr, size);
+        if (result_ != nullptr || size == 0) {
+            if (ptr != nullptr) {
+                HostHeap::recordFree(old_);
+            }
+            if (result_ != nullptr) {
+                HostHeap::recordAllocation(malloc_usable_size(result_));
+            }
+        }
+        return result_;
+    }
+
+    void __wrap_free(void* ptr) {
+        if (ptr != nullptr) {
+            HostHeap::recordFree(malloc_usable_size(ptr));
+        }
+        __real_free(ptr);
+    }
+}
+
+void* operator new(size_t size) {
+    void* ptr_ = __real_malloc(size > 0 ? size : 1);
+    if (ptr_ == nullptr) {
+        throw std::bad_alloc();
+    }
+    HostHeap::recordAllocation(malloc_usable_size(ptr_));
+    return ptr_;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr != nullptr) {
+        HostHeap::recordFree(malloc_usable_size(ptr));
+        __real_free(ptr);
+    }
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+HostHeap::Snapshot HostHeap::snapshot() {
+    return Snapshot{ liveBytes_.load(), liveAllocations_.load() };
+}
+
+int64_t HostHeap::liveBytes() {
+    return liveBytes_.load();
+}
+
+int64_t HostHeap::liveAllocations() {
+    return liveAllocations_.load();
+}
+
+int64_t HostHeap::peakBytes() {
+    return peakBytes_.load();
+}
+
+void HostHeap::resetPeak() {
+    peakBytes_.store(liveBytes_.load());
+}
+
+void HostHeap::failAfter(uint32_t after, uint32_t count) {
+    skip_.store(after);
+    failCount_.store(count);
+    failPeriod_.store(0);
+    failing_.store(true);
+}
+
+void HostHeap::failEvery(uint32_t period) {
+    skip_.store(0);
+    failCount_.store(0);
+    requests_.store(0);
+    failPeriod_.store(period);
+    failing_.store(period > 0);
+}
+
+void HostHeap::failSize(size_t size) {
+    failSize_.store(size);
+}
+
+void HostHeap::clearFailures() {
+    failing_.store(false);
+    failPeriod_.store(0);
+    failSize_.store(0);
+}
+
+uint32_t HostHeap::injectedFailures() {
+    return injected_.load();
+}
+
+bool HostHeap::allowAllocation(size_t size) {
+    size_t target_ = failSize_.load(std::memory_order_relaxed);
+    if (target_ != 0 && size == target_) {
+        injected_++;
+        return false;
+    }
+    if (!failing_.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    uint32_t period_ = failPeriod_.load();
+    if (period_ > 0) {
+        if ((requests_.fetch_add(1) + 1) % period_ != 0) {
+            return true;
+        }
+        injected_++;
+        return false;
+    }
+    uint32_t pending_ = skip_.load();
+    while (pending_ > 0) {
+        if (skip_.compare_exchange_weak(pending_, pending_ - 1)) {
+            return true;
+        }
+    }
+    uint32_t count_ = failCount_.load();
+    if (count_ > 0) {
+        if (count_ == 1) {
+            failing_.store(false);
+        }
+        failCount_.store(count_ - 1);
+    }
+    injected_++;
+    return false;
+}
+
+void HostHeap::setHeapSize(uint32_t freeHeap, uint32_t maxAllocHeap) {
+    heapSize_ = freeHeap;
+    maxBlock_ = maxAllocHeap;
+}
+
+uint32_t HostHeap::freeHeap() {
+    return heapSize_;
+}
+
+uint32_t HostHeap::maxAllocHeap() {
+    return maxBlock_;
+}
+
+void HostHeap::recordAllocation(size_t size) {
+    int64_t live_ = liveBytes_.fetch_add(static_cast<int64_t>(size)) + static_cast<int64_t>(size);
+    liveAllocations_++;
+    int64_t peak_ = peakBytes_.load();
+    while (live_ > peak_ && !peakBytes_.compare_exchange_weak(peak_, live_)) {
+    }
+}
+
+void HostHeap::recordFree(size_t size) {
+    liveBytes_.fetch_sub(static_cast<int64_t>(size));
+    liveAllocations_--;
+}
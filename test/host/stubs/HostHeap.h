@@ -0,0 +1,63 @@
+/**
+ * HostHeap.h -- Heap accounting and allocation fault injection for the host build.
+ *
+ * The host tests link HostHeap.cpp, which replaces operator new/delete and wraps
+ * malloc(), realloc() and free() of the library objects (-Wl,--wrap). Live bytes
+ * and allocations are counted, so a scenario can check that it gave everything
+ * back. Failures are injected where the ESP32 reports them: malloc() and
+ * realloc() return nullptr and String growth fails. operator new is counted but
+ * never fails, on the device it would abort.
+ */
+
+#ifndef _HOST_HEAP_h
+#define _HOST_HEAP_h
+
+#include <cstddef>
+#include <cstdint>
+
+class HostHeap {
+public:
+    struct Snapshot {
+        int64_t liveBytes;
+        int64_t liveAllocations;
+    };
+
+    static Snapshot snapshot();
+    static int64_t liveBytes();
+    static int64_t liveAllocations();
+    static int64_t peakBytes();
+    static void resetPeak();
+
+    /**
+     * Fail allocations from now on: skip the next `after` ones, then fail `count`
+     * of them (0 for all until clearFailures()).
+     */
+    static void failAfter(uint32_t after, uint32_t count = 0);
+    static void failEvery(uint32_t period);
+    /**
+     * Fail every allocation of exactly `size` bytes, 0 to stop. Targets one
+     * allocator, for example the arena blocks, and leaves the others working.
+     */
+    static void failSize(size_t size);
+    static void clearFailures();
+    static uint32_t injectedFailures();
+
+    /**
+     * Called for allocations that can fail, returns false to fail this one.
+     */
+    static bool allowAllocation(size_t size);
+
+    /**
+     * Values reported by ESP.getFreeHeap() and ESP.getMaxAllocHeap(), they do
+     * not follow the host allocations.
+     */
+    static void setHeapSize(uint32_t freeHeap, uint32_t maxAllocHeap);
+    static uint32_t freeHeap();
+    static uint32_t maxAllocHeap();
+
+    // -- Used by the allocation hooks.
+    static void recordAllocation(size_t size);
+    static void recordFree(size_t size);
+};
+
+#endif
@@ -0,0 +1,335 @@
+#include "IotWebConf.h"
+
+namespace iotwebconf {
+
+namespace {
+    String htmlEncode(const char* value) {
+        String encoded_;
+        for (const char* c_ = value; *c_ != '\0'; c_++) {
+            switch (*c_) {
+            case '&': encoded_ += "&amp;"; break;
+            case '<': encoded_ += "&lt;"; break;
+            case '>': encoded_ += "&gt;"; break;
+            case '\'': encoded_ += "&#39;"; break;
+            case '"': encoded_ += "&quot;"; break;
+            default: encoded_ += *c_; break;
+            }
+        }
+        return encoded_;
+    }
+
+    /**
+     * Give the buffer of a written part back. Assigning String() would keep its
+     * capacity, and the heap of a scenario would depend on the longest part so far.
+     */
+    void release(String& pending) {
+        String released_(std::move(pending));
+    }
+}
+
+Parameter::Parameter(const char* label, const char* id, char* valueBuffer, int length, const char* defaultValue) :
+    ConfigItem(id), label(label), valueBuffer(valueBuffer), defaultValue(defaultValue), _length(length) {
+    if (defaultValue != nullptr) {
+        strncpy(valueBuffer, defaultValue, length - 1);
+        valueBuffer[length - 1] = '\0';
+    }
+}
+
+String Parameter::renderFragment(bool dataArrived, WebRequestWrapper* webRequestWrapper) {
+    // -- A rejected post shows the posted values with their errors.
+    String value_ = dataArrived && webRequestWrapper != nullptr && webRequestWrapper->hasArg(_id)
+        ? webRequestWrapper->arg(_id) : String(valueBuffer);
+    if (strcmp(inputType(), "password") == 0) {
+        value_ = String();
+    }
+    String html_ = "<div class='";
+    html_ += errorMessage != nullptr ? "de" : "";
+    html_ += "'><label for='";
+    html_ += _id;
+    html_ += "'>";
+    html_ += label;
+    html_ += "</label><input type='";
+    html_ += inputType();
+    html_ += "' id='";
+    html_ += _id;
+    html_ += "' name='";
+    html_ += _id;
+    html_ += "' maxlength='";
+    html_ += String(_length - 1);
+    html_ += "' placeholder='";
+    html_ += placeholder != nullptr ? placeholder : "";
+    html_ += "' value='";
+    html_ += htmlEncode(value_.c_str());
+    html_ += "'/><div class='em'>";
+    html_ += errorMessage != nullptr ? errorMessage : "";
+    html_ += "</div></div>\n";
+    return html_;
+}
+
+bool Parameter::renderHtml(bool dataArrived, WebRequestWrapper* webRequestWrapper, HtmlChunkCallback writer) {
+    if (!visible) {
+        return true;
+    }
+    if (!_rendering) {
+        _pending = renderFragment(dataArrived, webRequestWrapper);
+        _rendering = true;
+    }
+    size_t written_ = writer(_pending.c_str(), _pending.length());
+    if (written_ < _pending.length()) {
+        _pending = _pending.substring(static_cast<unsigned int>(written_));
+        return false;
+    }
+    release(_pending);
+    _rendering = false;
+    return true;
+}
+
+void Parameter::storeValue(std::function<void(SerializationData* serializationData)> doStore) {
+    SerializationData serializationData_{ reinterpret_cast<byte*>(valueBuffer), _length };
+    doStore(&serializationData_);
+}
+
+void Parameter::loadValue(std::function<void(SerializationData* serializationData)> doLoad) {
+    SerializationData serializationData_{ reinterpret_cast<byte*>(valueBuffer), _length };
+    doLoad(&serializationData_);
+}
+
+void Parameter::update(WebRequestWrapper* webRequestWrapper) {
+    if (!webRequestWrapper->hasArg(_id)) {
+        return;
+    }
+    String value_ = webRequestWrapper->arg(_id);
+    strncpy(valueBuffer, value_.c_str(), _length - 1);
+    valueBuffer[_length - 1] = '\0';
+}
+
+void PasswordParameter::update(WebRequestWrapper* webRequestWrapper) {
+    if (webRequestWrapper->hasArg(_id) && webRequestWrapper->arg(_id).length() > 0) {
+        Parameter::update(webRequestWrapper);
+    }
+}
+
+bool ParameterGroup::writePending(HtmlChunkCallback& writer) {
+    size_t written_ = writer(_pending.c_str(), _pending.length());
+    if (written_ < _pending.length()) {
+        _pending = _pending.substring(static_cast<unsigned int>(written_));
+        return false;
+    }
+    release(_pending);
+    _pendingSet = false;
+    return true;
+}
+
+bool ParameterGroup::renderHtml(bool dataArrived, WebRequestWrapper* webRequestWrapper, HtmlChunkCallback writer) {
+    renderCalls++;
+    if (!visible) {
+        return true;
+    }
+    int count_ = static_cast<int>(_items.size());
+    while (_renderIndex <= count_) {
+        if (_renderIndex == -1 || _renderIndex == count_) {
+            if (!_pendingSet) {
+                if (_renderIndex == -1) {
+                    _pending = String("<fieldset id='") + _id + "'>";
+                    if (label != nullptr) {
+                        _pending += String("<legend>") + label + "</legend>";
+                    }
+                    _pending += "\n";
+                }
+                else {
+                    _pending = "</fieldset>\n";
+                }
+                _pendingSet = true;
+            }
+            if (!writePending(writer)) {
+                return false;
+            }
+        }
+        else if (!_items[_renderIndex]->renderHtml(dataArrived, webRequestWrapper, writer)) {
+            return false;
+        }
+        _renderIndex++;
+    }
+    _renderIndex = -1;
+    return true;
+}
+
+int ParameterGroup::getStorageSize() {
+    int size_ = 0;
+    for (ConfigItem* item_ : _items) {
+        size_ += item_->getStorageSize();
+    }
+    return size_;
+}
+
+void ParameterGroup::storeValue(std::function<void(SerializationData* serializationData)> doStore) {
+    for (ConfigItem* item_ : _items) {
+        item_->storeValue(doStore);
+    }
+}
+
+void ParameterGroup::loadValue(std::function<void(SerializationData* serializationData)> doLoad) {
+    for (ConfigItem* item_ : _items) {
+        item_->loadValue(doLoad);
+    }
+}
+
+void ParameterGroup::update(WebRequestWrapper* webRequestWrapper) {
+    for (ConfigItem* item_ : _items) {
+        item_->update(webRequestWrapper);
+    }
+}
+
+void ParameterGroup::clearErrorMessage() {
+    for (ConfigItem* item_ : _items) {
+        item_->clearErrorMessage();
+    }
+}
+
+bool ParameterGroup::validate(WebRequestWrapper* webRequestWrapper) {
+    bool valid_ = true;
+    for (ConfigItem* item_ : _items) {
+        valid_ = item_->validate(webRequestWrapper) && valid_;
+    }
+    return valid_;
+}
+
+String HtmlFormatProvider::getHead() { return IOTWEBCONF_HTML_HEAD; }
+String HtmlFormatProvider::getHeadEnd() { return IOTWEBCONF_HTML_HEAD_END; }
+String HtmlFormatProvider::getFormStart() { return IOTWEBCONF_HTML_FORM_START; }
+String HtmlFormatProvider::getFormEnd() { return IOTWEBCONF_HTML_FORM_END; }
+String HtmlFormatProvider::getFormSaved() { return IOTWEBCONF_HTML_SAVED; }
+String HtmlFormatProvider::getEnd() { return IOTWEBCONF_HTML_END; }
+String HtmlFormatProvider::getUpdate() { return IOTWEBCONF_HTML_UPDATE; }
+String HtmlFormatProvider::getConfigVer() { return IOTWEBCONF_HTML_CONFIG_VER; }
+String HtmlFormatProvider::getStyleInner() { return IOTWEBCONF_HTML_STYLE_INNER; }
+String HtmlFormatProvider::getScriptInner() { return IOTWEBCONF_HTML_SCRIPT_INNER; }
+
+IotWebConf::IotWebConf(const char* defaultThingName, DNSServer* dnsServer, WebServerWrapper* webServerWrapper,
+    const char* initialApPassword, const char* configVersion) :
+    _configVersion(configVersion),
+    _allParameters("iwcAll"),
+    _systemParameters("iwcSys", "System configuration"),
+    _customParameterGroups("iwcCustom"),
+    _thingNameParameter("Thing name", "iwcThingName", _thingName, IOTWEBCONF_WORD_LEN, defaultThingName),
+    _apPasswordParameter("AP password", "iwcApPassword", _apPassword, IOTWEBCONF_PASSWORD_LEN, initialApPassword),
+    _wifiSsidParameter("WiFi SSID", "iwcWifiSsid", _wifiSsid, IOTWEBCONF_WORD_LEN, ""),
+    _wifiPasswordParameter("WiFi password", "iwcWifiPassword", _wifiPassword, IOTWEBCONF_PASSWORD_LEN, ""),
+    _apTimeoutParameter("Startup delay (seconds)", "iwcApTimeout", _apTimeout, sizeof(_apTimeout), "30") {
+    (void)dnsServer;
+    (void)webServerWrapper;
+    _systemParameters.addItem(&_thingNameParameter);
+    _systemParameters.addItem(&_apPasswordParameter);
+    _systemParameters.addItem(&_wifiSsidParameter);
+    _systemParameters.addItem(&_wifiPasswordParameter);
+    _systemParameters.addItem(&_apTimeoutParameter);
+    _allParameters.addItem(&_systemParameters);
+    _allParameters.addItem(&_customParameterGroups);
+}
+
+bool IotWebConf::init() {
+    size_t versionLength_ = strlen(_configVersion);
+    if (_eeprom.size() < versionLength_ || memcmp(_eeprom.data(), _configVersion, versionLength_) != 0) {
+        _state = NotConfigured;
+        return false;
+    }
+    size_t offset_ = versionLength_;
+    _allParameters.loadValue([&](SerializationData* serializationData) {
+        size_t length_ = static_cast<size_t>(serializationData->length);
+        if (offset_ + length_ <= _eeprom.size()) {
+            memcpy(serializationData->data, _eeprom.data() + offset_, length_);
+        }
+        offset_ += length_;
+        });
+    _apTimeoutMs = atoi(_apTimeout) * 1000;
+    _state = ApMode;
+    return true;
+}
+
+void IotWebConf::doLoop() {
+    _loopCalls++;
+}
+
+void IotWebConf::saveConfig() {
+    _saveCalls++;
+    _eeprom.assign(_configVersion, _configVersion + strlen(_configVersion));
+    _allParameters.storeValue([&](SerializationData* serializationData) {
+        _eeprom.insert(_eeprom.end(), serializationData->data, serializationData->data + serializationData->length);
+        });
+    if (_configSavedCallback) {
+        _configSavedCallback();
+    }
+}
+
+bool IotWebConf::validateForm(WebRequestWrapper* webRequestWrapper) {
+    _allParameters.clearErrorMessage();
+    bool valid_ = _allParameters.validate(webRequestWrapper);
+    if (webRequestWrapper->arg(_thingNameParameter.getId()).length() < 3) {
+        _thingNameParameter.errorMessage = "Give a name with at least 3 characters.";
+        valid_ = false;
+    }
+    if (_formValidator) {
+        valid_ = _formValidator(webRequestWrapper) && valid_;
+    }
+    return valid_;
+}
+
+void IotWebConf::handleConfig(WebRequestWrapper* webRequestWrapper) {
+    if (_state == OnLine && !webRequestWrapper->authenticate(IOTWEBCONF_ADMIN_USER_NAME, _apPassword)) {
+        webRequestWrapper->requestAuthentication();
+        return;
+    }
+    if (!webRequestWrapper->hasArg("iotSave") || !validateForm(webRequestWrapper)) {
+        // -- The async library renders the page itself, the host only answers plainly.
+        webRequestWrapper->send(200, "text/html", String("<html></html>"));
+        return;
+    }
+    _allParameters.update(webRequestWrapper);
+    saveConfig();
+    _apTimeoutMs = atoi(_apTimeout) * 1000;
+    String page_ = getHtmlFormatProvider()->getHead();
+    page_.replace("{v}", "Config ESP");
+    page_ += getHtmlFormatProvider()->getHeadEnd();
+    page_ += getHtmlFormatProvider()->getFormSaved();
+    page_ += getHtmlFormatProvider()->getEnd();
+    webRequestWrapper->send(200, "text/html; charset=UTF-8", page_);
+    if (_state == NotConfigured) {
+        _state = ApMode;
+    }
+}
+
+void IotWebConf::handleNotFound(WebRequestWrapper* webRequestWrapper) {
+    if (handleCaptivePortal(webRequestWrapper)) {
+        return;
+    }
+    webRequestWrapper->send(404, "text/plain", String("Not found"));
+}
+
+bool IotWebConf::handleCaptivePortal(WebRequestWrapper* webRequestWrapper) {
+    if (_state != ApMode && _state != NotConfigured) {
+        return false;
+    }
+    String host_ = webRequestWrapper->hostHeader();
+    String ip_ = webRequestWrapper->localIP().toString();
+    if (host_.length() == 0 || host_ == ip_) {
+        return false;
+    }
+    webRequestWrapper->sendHeader("Location", String("http://") + ip_ + "/", true);
+    webRequestWrapper->send(302, "text/plain", String(""));
+    webRequestWrapper->stop();
+    return true;
+}
+
+String IotWebConf::getUpdateLinkHtml() {
+    String html_ = getHtmlFormatProvider()->getUpdate();
+    html_.replace("{u}", "/firmware");
+    return html_;
+}
+
+String IotWebConf::getConfigVersionHtml() {
+    String html_ = getHtmlFormatProvider()->getConfigVer();
+    html_.replace("{v}", _configVersion);
+    return html_;
+}
+
+}
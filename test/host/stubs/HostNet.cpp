@@ -0,0 +1,249 @@
+#include "HTTPClient.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+    stop();
+    (void)timeoutMs;
+    addrinfo hints_{};
+    hints_.ai_family = AF_INET;
+    hints_.ai_socktype = SOCK_STREAM;
+    addrinfo* result_ = nullptr;
+    char port_[8];
+    snprintf(port_, sizeof(port_), "%u", (unsigned int)port);
+    if (getaddrinfo(host, port_, &hints_, &result_) != 0 || result_ == nullptr) {
+        return 0;
+    }
+    int fd_ = socket(result_->ai_family, result_->ai_socktype, result_->ai_protocol);
+    if (fd_ >= 0 && ::connect(fd_, result_->ai_addr, result_->ai_addrlen) != 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    freeaddrinfo(result_);
+    if (fd_ < 0) {
+        return 0;
+    }
+    int one_ = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one_, sizeof(one_));
+    _fd = fd_;
+    _peerClosed = false;
+    _buffer.clear();
+    _position = 0;
+    return 1;
+}
+
+void WiFiClient::stop() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    _buffer.clear();
+    _position = 0;
+}
+
+void WiFiClient::fill(int waitMs) {
+    if (_fd < 0 || _peerClosed) {
+        return;
+    }
+    pollfd poll_{ _fd, POLLIN, 0 };
+    if (poll(&poll_, 1, waitMs) <= 0) {
+        return;
+    }
+    uint8_t data_[4096];
+    ssize_t read_ = recv(_fd, data_, sizeof(data_), MSG_DONTWAIT);
+    if (read_ == 0) {
+        _peerClosed = true;
+        return;
+    }
+    if (read_ < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            _peerClosed = true;
+        }
+        return;
+    }
+    if (_position > 0 && _position == _buffer.size()) {
+        _buffer.clear();
+        _position = 0;
+    }
+    _buffer.insert(_buffer.end(), data_, data_ + read_);
+}
+
+uint8_t WiFiClient::connected() {
+    if (_fd < 0) {
+        return 0;
+    }
+    if (_position < _buffer.size()) {
+        return 1;
+    }
+    fill(0);
+    return _position < _buffer.size() || !_peerClosed ? 1 : 0;
+}
+
+int WiFiClient::available() {
+    fill(0);
+    return static_cast<int>(_buffer.size() - _position);
+}
+
+int WiFiClient::read() {
+    uint8_t c_;
+    return read(&c_, 1) == 1 ? c_ : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+    if (_position == _buffer.size()) {
+        fill(0);
+    }
+    size_t len_ = std::min(size, _buffer.size() - _position);
+    if (len_ == 0) {
+        return _fd < 0 ? -1 : 0;
+    }
+    memcpy(buffer, _buffer.data() + _position, len_);
+    _position += len_;
+    return static_cast<int>(len_);
+}
+
+int WiFiClient::peek() {
+    if (_position == _buffer.size()) {
+        fill(0);
+    }
+    return _position < _buffer.size() ? _buffer[_position] : -1;
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+    if (_fd < 0) {
+        return 0;
+    }
+    size_t sent_ = 0;
+    while (sent_ < size) {
+        ssize_t result_ = send(_fd, buffer + sent_, size - sent_, MSG_NOSIGNAL);
+        if (result_ <= 0) {
+            break;
+        }
+        sent_ += static_cast<size_t>(result_);
+    }
+    return sent_;
+}
+
+bool WiFiClient::readLine(std::string& line, uint32_t timeoutMs) {
+    line.clear();
+    uint32_t waited_ = 0;
+    while (true) {
+        while (_position < _buffer.size()) {
+            char c_ = static_cast<char>(_buffer[_position++]);
+            if (c_ == '\n') {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                return true;
+            }
+            line += c_;
+        }
+        if (_fd < 0 || _peerClosed || waited_ >= timeoutMs) {
+            return false;
+        }
+        fill(10);
+        waited_ += 10;
+    }
+}
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+    end();
+    _client = &client;
+    _headers = String();
+    _size = -1;
+    String rest_ = url;
+    if (!rest_.startsWith("http://")) {
+        return false;
+    }
+    rest_ = rest_.substring(7);
+    int slash_ = rest_.indexOf('/');
+    String authority_ = slash_ < 0 ? rest_ : rest_.substring(0, slash_);
+    _path = slash_ < 0 ? String("/") : rest_.substring(slash_);
+    int colon_ = authority_.indexOf(':');
+    _host = colon_ < 0 ? authority_ : authority_.substring(0, colon_);
+    _port = colon_ < 0 ? 80 : static_cast<uint16_t>(authority_.substring(colon_ + 1).toInt());
+    return true;
+}
+
+void HTTPClient::end() {
+    if (_client != nullptr) {
+        _client->stop();
+    }
+    _connected = false;
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+    _headers += name + ": " + value + "\r\n";
+}
+
+int HTTPClient::GET() {
+    if (_client == nullptr || !_client->connect(_host.c_str(), _port, _timeout)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    _connected = true;
+    String request_ = "GET " + _path + " HTTP/1.1\r\nHost: " + _host + "\r\nConnection: close\r\n" + _headers + "\r\n";
+    if (_client->write(reinterpret_cast<const uint8_t*>(request_.c_str()), request_.length()) != request_.length()) {
+        end();
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+    std::string line_;
+    if (!_client->readLine(line_, _timeout)) {
+        end();
+        return HTTPC_ERROR_READ_TIMEOUT;
+    }
+    int code_ = 0;
+    if (sscanf(line_.c_str(), "HTTP/1.%*d %d", &code_) != 1) {
+        end();
+        return HTTPC_ERROR_CONNECTION_LOST;
+    }
+    while (true) {
+        if (!_client->readLine(line_, _timeout)) {
+            end();
+            return HTTPC_ERROR_CONNECTION_LOST;
+        }
+        if (line_.empty()) {
+            break;
+        }
+        if (strncasecmp(line_.c_str(), "Content-Length:", 15) == 0) {
+            _size = atoi(line_.c_str() + 15);
+        }
+    }
+    return code_;
+}
+
+String HTTPClient::getString() {
+    std::string body_;
+    uint8_t buffer_[1024];
+    uint32_t idle_ = 0;
+    while (_connected && (_size < 0 || body_.size() < static_cast<size_t>(_size))) {
+        int read_ = _client->read(buffer_, sizeof(buffer_));
+        if (read_ > 0) {
+            body_.append(reinterpret_cast<char*>(buffer_), read_);
+            idle_ = 0;
+            continue;
+        }
+        if (!_client->connected() || idle_ >= _timeout) {
+            break;
+        }
+        usleep(1000);
+        idle_++;
+    }
+    return String(body_);
+}
+
+String HTTPClient::errorToString(int error) {
+    switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return String("connection refused");
+    case HTTPC_ERROR_SEND_HEADER_FAILED: return String("send header failed");
+    case HTTPC_ERROR_NOT_CONNECTED: return String("not connected");
+    case HTTPC_ERROR_CONNECTION_LOST: return String("connection lost");
+    case HTTPC_ERROR_READ_TIMEOUT: return String("read Timeout");
+    default: return String();
+    }
+}
@@ -0,0 +1,408 @@
+#include "Update.h"
+
+// -- MD5 (RFC 1321).
+
+namespace {
+    const uint32_t MD5_K_[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+    const uint8_t MD5_R_[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+    };
+
+    uint32_t rotateLeft(uint32_t value, uint8_t bits) {
+        return (value << bits) | (value >> (32 - bits));
+    }
+}
+
+void MD5Builder::begin() {
+    _state[0] = 0x67452301;
+    _state[1] = 0xefcdab89;
+    _state[2] = 0x98badcfe;
+    _state[3] = 0x10325476;
+    _length = 0;
+    memset(_digest, 0, sizeof(_digest));
+}
+
+void MD5Builder::transform(const uint8_t* block) {
+    uint32_t m_[16];
+    for (int i = 0; i < 16; i++) {
+        m_[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16) | (static_cast<uint32_t>(block[i * 4 + 3]) << 24);
+    }
+    uint32_t a_ = _state[0], b_ = _state[1], c_ = _state[2], d_ = _state[3];
+    for (int i = 0; i < 64; i++) {
+        uint32_t f_;
+        int g_;
+        if (i < 16) {
+            f_ = (b_ & c_) | (~b_ & d_);
+            g_ = i;
+        }
+        else if (i < 32) {
+            f_ = (d_ & b_) | (~d_ & c_);
+            g_ = (5 * i + 1) % 16;
+        }
+        else if (i < 48) {
+            f_ = b_ ^ c_ ^ d_;
+            g_ = (3 * i + 5) % 16;
+        }
+        else {
+            f_ = c_ ^ (b_ | ~d_);
+            g_ = (7 * i) % 16;
+        }
+        uint32_t next_ = d_;
+        d_ = c_;
+        c_ = b_;
+        b_ = b_ + rotateLeft(a_ + f_ + MD5_K_[i] + m_[g_], MD5_R_[i]);
+        a_ = next_;
+    }
+    _state[0] += a_;
+    _state[1] += b_;
+    _state[2] += c_;
+    _state[3] += d_;
+}
+
+void MD5Builder::add(const uint8_t* data, size_t len) {
+    size_t used_ = static_cast<size_t>(_length % 64);
+    _length += len;
+    while (len > 0) {
+        size_t take_ = std::min(len, 64 - used_);
+        memcpy(_block + used_, data, take_);
+        used_ += take_;
+        data += take_;
+        len -= take_;
+        if (used_ == 64) {
+            transform(_block);
+            used_ = 0;
+        }
+    }
+}
+
+void MD5Builder::calculate() {
+    uint64_t bits_ = _length * 8;
+    uint8_t pad_ = 0x80;
+    add(&pad_, 1);
+    pad_ = 0;
+    while (_length % 64 != 56) {
+        add(&pad_, 1);
+    }
+    uint8_t length_[8];
+    for (int i = 0; i < 8; i++) {
+        length_[i] = static_cast<uint8_t>(bits_ >> (i * 8));
+    }
+    add(length_, 8);
+    for (int i = 0; i < 16; i++) {
+        _digest[i] = static_cast<uint8_t>(_state[i / 4] >> ((i % 4) * 8));
+    }
+}
+
+void MD5Builder::getChars(char* output) const {
+    for (int i = 0; i < 16; i++) {
+        snprintf(output + i * 2, 3, "%02x", _digest[i]);
+    }
+}
+
+String MD5Builder::toString() const {
+    char hex_[33];
+    getChars(hex_);
+    return String(hex_);
+}
+
+// -- Flash and OTA data.
+
+namespace {
+    esp_partition_t partitions_[3] = {
+        { ESP_PARTITION_TYPE_APP, 0x10, 0x010000, 0x140000, "app0", false },
+        { ESP_PARTITION_TYPE_APP, 0x11, 0x150000, 0x140000, "app1", false },
+        { ESP_PARTITION_TYPE_DATA, 0x82, 0x290000, 0x160000, "spiffs", false }
+    };
+    std::vector<uint8_t> contents_[3];
+    esp_ota_img_states_t states_[3];
+    const esp_partition_t* running_ = &partitions_[0];
+    const esp_partition_t* boot_ = &partitions_[0];
+    uint32_t bootSwitches_ = 0;
+    esp_err_t rollbackError_ = ESP_OK;
+
+    int indexOf(const esp_partition_t* partition) {
+        return static_cast<int>(partition - partitions_);
+    }
+    bool isApp(const esp_partition_t* partition) {
+        return partition == &partitions_[0] || partition == &partitions_[1];
+    }
+    const esp_partition_t* otherApp(const esp_partition_t* partition) {
+        return partition == &partitions_[0] ? &partitions_[1] : &partitions_[0];
+    }
+}
+
+namespace {
+    struct FlashInit {
+        FlashInit() { HostFlash::reset(); }
+    } flashInit_;
+}
+
+void HostFlash::reset() {
+    for (int i = 0; i < 3; i++) {
+        contents_[i].clear();
+        states_[i] = ESP_OTA_IMG_UNDEFINED;
+    }
+    states_[0] = ESP_OTA_IMG_VALID;
+    running_ = &partitions_[0];
+    boot_ = &partitions_[0];
+    bootSwitches_ = 0;
+    rollbackError_ = ESP_OK;
+}
+
+const esp_partition_t* HostFlash::partition(Partition partition) {
+    return &partitions_[partition];
+}
+
+std::vector<uint8_t>& HostFlash::content(const esp_partition_t* partition) {
+    return contents_[indexOf(partition)];
+}
+
+void HostFlash::setState(const esp_partition_t* partition, esp_ota_img_states_t state) {
+    states_[indexOf(partition)] = state;
+}
+
+void HostFlash::setRunning(const esp_partition_t* partition) {
+    running_ = partition;
+    boot_ = partition;
+}
+
+void HostFlash::setRollbackError(esp_err_t error) {
+    rollbackError_ = error;
+}
+
+uint32_t HostFlash::bootSwitches() {
+    return bootSwitches_;
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+    return running_;
+}
+
+const esp_partition_t* esp_ota_get_boot_partition() {
+    return boot_;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    return otherApp(start_from != nullptr ? start_from : running_);
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    if (partition == nullptr || !isApp(partition)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition != running_ && (contents_[indexOf(partition)].empty() || contents_[indexOf(partition)][0] != ESP_IMAGE_HEADER_MAGIC)) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (partition != running_) {
+        states_[indexOf(partition)] = ESP_OTA_IMG_NEW;
+    }
+    boot_ = partition;
+    bootSwitches_++;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state) {
+    if (partition == nullptr || !isApp(partition) || ota_state == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (states_[indexOf(partition)] == ESP_OTA_IMG_UNDEFINED) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *ota_state = states_[indexOf(partition)];
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_ota_get_last_invalid_partition() {
+    const esp_partition_t* other_ = otherApp(running_);
+    return states_[indexOf(other_)] == ESP_OTA_IMG_INVALID ? other_ : nullptr;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback() {
+    states_[indexOf(running_)] = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot() {
+    if (rollbackError_ != ESP_OK) {
+        return rollbackError_;
+    }
+    // -- The device reboots here, the host counts the restart and returns.
+    states_[indexOf(running_)] = ESP_OTA_IMG_INVALID;
+    boot_ = otherApp(running_);
+    ESP.restart();
+    return ESP_OK;
+}
+
+// -- Updater.
+
+UpdateClass Update;
+
+void UpdateClass::hostReset() {
+    _error = UPDATE_ERROR_OK;
+    _size = 0;
+    _progress = 0;
+    _partition = nullptr;
+    _targetMd5 = String();
+    failBegin = false;
+    failWriteAt = SIZE_MAX;
+    failEnd = false;
+    beginCalls = 0;
+    endCalls = 0;
+    abortCalls = 0;
+}
+
+void UpdateClass::fail(uint8_t error) {
+    _size = 0;
+    _progress = 0;
+    _partition = nullptr;
+    _targetMd5 = String();
+    _error = error;
+}
+
+bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, const char* label) {
+    (void)ledPin;
+    (void)ledOn;
+    (void)label;
+    beginCalls++;
+    if (_size > 0) {
+        return false;
+    }
+    _error = UPDATE_ERROR_OK;
+    _targetMd5 = String();
+    if (size == 0) {
+        _error = UPDATE_ERROR_SIZE;
+        return false;
+    }
+    if (failBegin) {
+        _error = UPDATE_ERROR_ERASE;
+        return false;
+    }
+    if (command == U_FLASH) {
+        _partition = esp_ota_get_next_update_partition(nullptr);
+        contents_[indexOf(_partition)].clear();
+    }
+    else if (command == U_SPIFFS) {
+        _partition = HostFlash::partition(HostFlash::SPIFFS);
+    }
+    else {
+        _error = UPDATE_ERROR_BAD_ARGUMENT;
+        return false;
+    }
+    if (size == UPDATE_SIZE_UNKNOWN) {
+        size = _partition->size;
+    }
+    else if (size > _partition->size) {
+        _partition = nullptr;
+        _error = UPDATE_ERROR_SIZE;
+        return false;
+    }
+    _command = command;
+    _size = size;
+    _progress = 0;
+    _md5.begin();
+    return true;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t len) {
+    if (hasError() || !isRunning()) {
+        return 0;
+    }
+    if (len > remaining()) {
+        fail(UPDATE_ERROR_SPACE);
+        return 0;
+    }
+    if (_progress + len > failWriteAt) {
+        fail(UPDATE_ERROR_WRITE);
+        return 0;
+    }
+    // -- The file system partition is overwritten in place, there is no second copy.
+    std::vector<uint8_t>& content_ = contents_[indexOf(_partition)];
+    if (content_.size() < _progress + len) {
+        content_.resize(_progress + len, 0xFF);
+    }
+    memcpy(content_.data() + _progress, data, len);
+    _md5.add(data, len);
+    _progress += len;
+    if (_progressCallback) {
+        _progressCallback(_progress, _size);
+    }
+    return len;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+    endCalls++;
+    if (hasError() || _size == 0) {
+        return false;
+    }
+    if (!isFinished() && !evenIfRemaining) {
+        fail(UPDATE_ERROR_ABORT);
+        return false;
+    }
+    _size = _progress;
+    if (_targetMd5.length() > 0) {
+        _md5.calculate();
+        if (_targetMd5 != _md5.toString()) {
+            fail(UPDATE_ERROR_MD5);
+            return false;
+        }
+    }
+    if (failEnd) {
+        fail(UPDATE_ERROR_READ);
+        return false;
+    }
+    if (_command == U_FLASH) {
+        const std::vector<uint8_t>& content_ = contents_[indexOf(_partition)];
+        if (content_.empty() || content_[0] != ESP_IMAGE_HEADER_MAGIC) {
+            fail(UPDATE_ERROR_MAGIC_BYTE);
+            return false;
+        }
+        if (esp_ota_set_boot_partition(_partition) != ESP_OK) {
+            fail(UPDATE_ERROR_ACTIVATE);
+            return false;
+        }
+    }
+    _size = 0;
+    _progress = 0;
+    _partition = nullptr;
+    _targetMd5 = String();
+    return true;
+}
+
+void UpdateClass::abort() {
+    abortCalls++;
+    fail(UPDATE_ERROR_ABORT);
+}
+
+bool UpdateClass::setMD5(const char* expected_md5) {
+    if (strlen(expected_md5) != 32) {
+        return false;
+    }
+    _targetMd5 = expected_md5;
+    _targetMd5.toLowerCase();
+    return true;
+}
+
+const char* UpdateClass::errorString() const {
+    static const char* const ERRORS_[] = {
+        "No Error", "Flash Write Failed", "Flash Erase Failed", "Flash Read Failed", "Not Enough Space",
+        "Bad Size Given", "Stream Read Timeout", "MD5 Check Failed", "Wrong Magic Byte",
+        "Could Not Activate The Firmware", "Partition Could Not be Found", "Bad Argument", "Aborted"
+    };
+    return _error <= UPDATE_ERROR_ABORT ? ERRORS_[_error] : "UNKNOWN";
+}
+
+void UpdateClass::printError(Print& out) {
+    out.println(errorString());
+}
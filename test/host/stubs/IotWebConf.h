@@ -0,0 +1,265 @@
+/**
+ * IotWebConf.h -- Host stand-in for the IotWebConf fork the library builds on:
+ *   parameters and groups with the resumable renderHtml(), the HTML format
+ *   provider with the original markup, and IotWebConf itself with its config
+ *   saved to a host EEPROM image.
+ */
+
+#ifndef _HOST_IOTWEBCONF_h
+#define _HOST_IOTWEBCONF_h
+
+#include "Arduino.h"
+#include "DNSServer.h"
+#include "IotWebConfWebServerWrapper.h"
+
+#define IOTWEBCONF_ADMIN_USER_NAME "admin"
+#define IOTWEBCONF_WORD_LEN 33
+#define IOTWEBCONF_PASSWORD_LEN 33
+#define IOTWEBCONF_DEBUG_LINE(x)
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+// -- Markup of IotWebConf 3.x, pages rendered on the host have the size of the real ones.
+const char IOTWEBCONF_HTML_HEAD[] PROGMEM = "<!DOCTYPE html><html lang=\"en\"><head><meta name=\"viewport\" content=\"width=device-width, initial-scale=1, user-scalable=no\"/><title>{v}</title>\n";
+const char IOTWEBCONF_HTML_STYLE_INNER[] PROGMEM = ".de{background-color:#ffaaaa;} .em{font-size:0.8em;color:#bb0000;padding-bottom:0px;} .c{text-align: center;} div,input,select{padding:5px;font-size:1em;} input{width:95%;} select{width:100%} input[type=checkbox]{width:auto;scale:1.5;margin:10px;} body{text-align: center;font-family:verdana;} button{border:0;border-radius:0.3rem;background-color:#16A1E7;color:#fff;line-height:2.4rem;font-size:1.2rem;width:100%;} fieldset{border-radius:0.3rem;margin: 0px;}\n";
+const char IOTWEBCONF_HTML_SCRIPT_INNER[] PROGMEM = "function c(l){document.getElementById('s').value=l.innerText||l.textContent;document.getElementById('p').focus();}; function pw(id) { var x=document.getElementById(id); if(x.type==='password') x.type='text'; else x.type='password';};\n";
+const char IOTWEBCONF_HTML_HEAD_END[] PROGMEM = "</head><body><div style='text-align:left;display:inline-block;min-width:260px;'>\n";
+const char IOTWEBCONF_HTML_FORM_START[] PROGMEM = "<form action='' method='post'><input type='hidden' name='iotSave' value='true'>\n";
+const char IOTWEBCONF_HTML_FORM_END[] PROGMEM = "<button type='submit' style='margin-top: 10px;'>Apply</button></form>\n";
+const char IOTWEBCONF_HTML_SAVED[] PROGMEM = "<div>Configuration saved<br />Return to <a href='/'>home page</a>.</div>\n";
+const char IOTWEBCONF_HTML_END[] PROGMEM = "</div></body></html>";
+const char IOTWEBCONF_HTML_UPDATE[] PROGMEM = "<div style='padding-top:25px;'><a href='{u}'>Firmware update</a></div>\n";
+const char IOTWEBCONF_HTML_CONFIG_VER[] PROGMEM = "<div style='font-size: .6em;'>Version '{v}'</div>\n";
+
+/**
+ * Receives a part of the rendered HTML.
+ * @return Bytes taken, the rest is offered again on the next renderHtml() call
+ */
+typedef std::function<size_t(const char* data, size_t len)> HtmlChunkCallback;
+
+namespace iotwebconf {
+
+enum NetworkState {
+    Boot,
+    NotConfigured,
+    ApMode,
+    Connecting,
+    OnLine,
+    OffLine
+};
+
+typedef struct SerializationData {
+    byte* data;
+    int length;
+} SerializationData;
+
+class ConfigItem {
+public:
+    explicit ConfigItem(const char* id) : _id(id) {}
+    virtual ~ConfigItem() {}
+    const char* getId() const { return _id; }
+    bool visible = true;
+
+protected:
+    virtual int getStorageSize() = 0;
+    virtual void storeValue(std::function<void(SerializationData* serializationData)> doStore) = 0;
+    virtual void loadValue(std::function<void(SerializationData* serializationData)> doLoad) = 0;
+    virtual void update(WebRequestWrapper* webRequestWrapper) = 0;
+    virtual void clearErrorMessage() = 0;
+    virtual bool validate(WebRequestWrapper* webRequestWrapper) = 0;
+
+    /**
+     * HTML of the item, resumable like ParameterGroup::renderHtml().
+     */
+    virtual bool renderHtml(bool dataArrived, WebRequestWrapper* webRequestWrapper, HtmlChunkCallback writer) = 0;
+
+    const char* _id;
+
+    friend class ParameterGroup;
+    friend class IotWebConf;
+};
+
+class Parameter : public ConfigItem {
+public:
+    Parameter(const char* label, const char* id, char* valueBuffer, int length, const char* defaultValue = nullptr);
+
+    const char* label;
+    char* valueBuffer;
+    const char* defaultValue;
+    const char* errorMessage = nullptr;
+    const char* placeholder = nullptr;
+    int getLength() const { return _length; }
+
+protected:
+    int _length;
+    String _pending;
+    bool _rendering = false;
+
+    virtual const char* inputType() const { return "text"; }
+    virtual String renderFragment(bool dataArrived, WebRequestWrapper* webRequestWrapper);
+
+    int getStorageSize() override { return _length; }
+    void storeValue(std::function<void(SerializationData* serializationData)> doStore) override;
+    void loadValue(std::function<void(SerializationData* serializationData)> doLoad) override;
+    void update(WebRequestWrapper* webRequestWrapper) override;
+    void clearErrorMessage() override { errorMessage = nullptr; }
+    bool validate(WebRequestWrapper* webRequestWrapper) override { (void)webRequestWrapper; return true; }
+    bool renderHtml(bool dataArrived, WebRequestWrapper* webRequestWrapper, HtmlChunkCallback writer) override;
+};
+
+class TextParameter : public Parameter {
+public:
+    using Parameter::Parameter;
+};
+
+class NumberParameter : public Parameter {
+public:
+    using Parameter::Parameter;
+protected:
+    const char* inputType() const override { return "number"; }
+};
+
+class PasswordParameter : public Parameter {
+public:
+    using Parameter::Parameter;
+protected:
+    const char* inputType() const override { return "password"; }
+    // -- An empty post keeps the password.
+    void update(WebRequestWrapper* webRequestWrapper) override;
+};
+
+class ParameterGroup : public ConfigItem {
+public:
+    explicit ParameterGroup(const char* id, const char* label = nullptr) : ConfigItem(id), label(label) {}
+
+    void addItem(ConfigItem* configItem) { _items.push_back(configItem); }
+    const std::vector<ConfigItem*>& items() const { return _items; }
+    const char* label;
+
+    /**
+     * Render the group, writer may take only a part of the HTML.
+     * @return True once the group is complete, false to be called again
+     */
+    bool renderHtml(bool dataArrived, WebRequestWrapper* webRequestWrapper, HtmlChunkCallback writer) override;
+
+    // -- Host side, number of renderHtml() calls.
+    uint32_t renderCalls = 0;
+
+protected:
+    std::vector<ConfigItem*> _items;
+    // -- -1: group start, 0..n-1: items, n: group end.
+    int _renderIndex = -1;
+    String _pending;
+    bool _pendingSet = false;
+
+    int getStorageSize() override;
+    void storeValue(std::function<void(SerializationData* serializationData)> doStore) override;
+    void loadValue(std::function<void(SerializationData* serializationData)> doLoad) override;
+    void update(WebRequestWrapper* webRequestWrapper) override;
+    void clearErrorMessage() override;
+    bool validate(WebRequestWrapper* webRequestWrapper) override;
+
+    bool writePending(HtmlChunkCallback& writer);
+
+    friend class IotWebConf;
+};
+
+class HtmlFormatProvider {
+public:
+    virtual ~HtmlFormatProvider() {}
+    virtual String getHead();
+    virtual String getStyle() { return String("<style>") + getStyleInner() + "</style>"; }
+    virtual String getScript() { return String("<script>") + getScriptInner() + "</script>"; }
+    virtual String getHeadExtension() { return String(); }
+    virtual String getHeadEnd();
+    virtual String getFormStart();
+    virtual String getFormEnd();
+    virtual String getFormSaved();
+    virtual String getEnd();
+    virtual String getUpdate();
+    virtual String getConfigVer();
+
+protected:
+    virtual String getStyleInner();
+    virtual String getScriptInner();
+};
+
+class IotWebConf {
+public:
+    IotWebConf(const char* defaultThingName, DNSServer* dnsServer, WebServerWrapper* webServerWrapper,
+        const char* initialApPassword, const char* configVersion = "init");
+    virtual ~IotWebConf() {}
+
+    /**
+     * Load the config from the EEPROM image.
+     * @return True if a config of this version was stored
+     */
+    bool init();
+    void doLoop();
+
+    void handleConfig(WebRequestWrapper* webRequestWrapper);
+    void handleNotFound(WebRequestWrapper* webRequestWrapper);
+    bool handleCaptivePortal(WebRequestWrapper* webRequestWrapper);
+
+    void addParameterGroup(ParameterGroup* group) { _customParameterGroups.addItem(group); }
+    void saveConfig();
+    void setConfigSavedCallback(std::function<void()> func) { _configSavedCallback = func; }
+    void setFormValidator(std::function<bool(WebRequestWrapper* webRequestWrapper)> func) { _formValidator = func; }
+
+    NetworkState getState() { return _state; }
+    char* getThingName() { return _thingName; }
+    char* getApPassword() { return _apPassword; }
+    void setApTimeoutMs(unsigned long apTimeoutMs) { _apTimeoutMs = apTimeoutMs; }
+    unsigned long getApTimeoutMs() const { return _apTimeoutMs; }
+
+    HtmlFormatProvider* getHtmlFormatProvider() { return _htmlFormatProvider; }
+    void setHtmlFormatProvider(HtmlFormatProvider* provider) { _htmlFormatProvider = provider; }
+
+    ParameterGroup* getRootParameterGroup() { return &_allParameters; }
+    ParameterGroup* getSystemParameterGroup() { return &_systemParameters; }
+    ParameterGroup* getCustomParameterGroup() { return &_customParameterGroups; }
+    Parameter* getApTimeoutParameter() { return &_apTimeoutParameter; }
+
+    String getUpdateLinkHtml();
+    String getConfigVersionHtml();
+
+    // -- Host side.
+    void hostSetState(NetworkState state) { _state = state; }
+    std::vector<uint8_t>& hostEeprom() { return _eeprom; }
+    uint32_t saveCalls() const { return _saveCalls; }
+    uint32_t loopCalls() const { return _loopCalls; }
+
+protected:
+    bool validateForm(WebRequestWrapper* webRequestWrapper);
+
+private:
+    const char* _configVersion;
+    NetworkState _state = Boot;
+    unsigned long _apTimeoutMs = 30000;
+    HtmlFormatProvider _defaultHtmlFormatProvider;
+    HtmlFormatProvider* _htmlFormatProvider = &_defaultHtmlFormatProvider;
+    std::function<void()> _configSavedCallback;
+    std::function<bool(WebRequestWrapper* webRequestWrapper)> _formValidator;
+
+    char _thingName[IOTWEBCONF_WORD_LEN];
+    char _apPassword[IOTWEBCONF_PASSWORD_LEN];
+    char _wifiSsid[IOTWEBCONF_WORD_LEN];
+    char _wifiPassword[IOTWEBCONF_PASSWORD_LEN];
+    char _apTimeout[8];
+
+    ParameterGroup _allParameters;
+    ParameterGroup _systemParameters;
+    ParameterGroup _customParameterGroups;
+    TextParameter _thingNameParameter;
+    PasswordParameter _apPasswordParameter;
+    TextParameter _wifiSsidParameter;
+    PasswordParameter _wifiPasswordParameter;
+    NumberParameter _apTimeoutParameter;
+
+    std::vector<uint8_t> _eeprom;
+    uint32_t _saveCalls = 0;
+    uint32_t _loopCalls = 0;
+};
+
+}
+
+#endif
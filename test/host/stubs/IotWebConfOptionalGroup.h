@@ -0,0 +1,22 @@
+#ifndef _HOST_IOTWEBCONFOPTIONALGROUP_h
+#define _HOST_IOTWEBCONFOPTIONALGROUP_h
+
+#include "IotWebConf.h"
+
+namespace iotwebconf {
+
+class OptionalGroupHtmlFormatProvider : public HtmlFormatProvider {
+protected:
+    String getStyleInner() override {
+        return HtmlFormatProvider::getStyleInner() +
+            ".hide{display:none;}\n.oi{margin-top:1em;}\n";
+    }
+    String getScriptInner() override {
+        return HtmlFormatProvider::getScriptInner() +
+            "function show(id){document.getElementById(id).classList.remove('hide');}\n";
+    }
+};
+
+}
+
+#endif
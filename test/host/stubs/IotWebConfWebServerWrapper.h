@@ -0,0 +1,35 @@
+#ifndef _HOST_IOTWEBCONFWEBSERVERWRAPPER_h
+#define _HOST_IOTWEBCONFWEBSERVERWRAPPER_h
+
+#include "Arduino.h"
+
+namespace iotwebconf {
+
+class WebRequestWrapper {
+public:
+    virtual ~WebRequestWrapper() {}
+    virtual const String hostHeader() const = 0;
+    virtual IPAddress localIP() = 0;
+    virtual uint16_t localPort() = 0;
+    virtual const String uri() const = 0;
+    virtual bool authenticate(const char* username, const char* password) = 0;
+    virtual void requestAuthentication() = 0;
+    virtual bool hasArg(const String& name) = 0;
+    virtual String arg(const String name) = 0;
+    virtual void sendHeader(const String& name, const String& value, bool first = false) = 0;
+    virtual void setContentLength(const size_t contentLength) = 0;
+    virtual void send(int code, const char* content_type = nullptr, const String& content = String("")) = 0;
+    virtual void sendContent(const String& content) = 0;
+    virtual void stop() = 0;
+};
+
+class WebServerWrapper {
+public:
+    virtual ~WebServerWrapper() {}
+    virtual void handleClient() = 0;
+    virtual void begin() = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _HOST_MD5BUILDER_h
+#define _HOST_MD5BUILDER_h
+
+#include "Arduino.h"
+
+class MD5Builder {
+public:
+    void begin();
+    void add(const uint8_t* data, size_t len);
+    void add(const char* data) { add(reinterpret_cast<const uint8_t*>(data), strlen(data)); }
+    void add(const String& data) { add(reinterpret_cast<const uint8_t*>(data.c_str()), data.length()); }
+    void calculate();
+    void getBytes(uint8_t* output) const { memcpy(output, _digest, sizeof(_digest)); }
+    void getChars(char* output) const;
+    String toString() const;
+
+private:
+    uint32_t _state[4];
+    uint64_t _length;
+    uint8_t _block[64];
+    uint8_t _digest[16];
+
+    void transform(const uint8_t* block);
+};
+
+#endif
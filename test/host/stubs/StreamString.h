@@ -0,0 +1,15 @@
+#ifndef _HOST_STREAMSTRING_h
+#define _HOST_STREAMSTRING_h
+
+#include "Arduino.h"
+
+class StreamString : public Stream, public String {
+public:
+    using Print::write;
+    size_t write(uint8_t c) override { return concat(static_cast<char>(c)) ? 1 : 0; }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        return concat(reinterpret_cast<const char*>(buffer), size) ? size : 0;
+    }
+};
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * Update.h -- Host stand-in for the ESP32 UpdateClass. It follows the core:
+ *   U_FLASH writes the next OTA slot and end() checks the MD5 and the image
+ *   magic byte before it switches the boot partition. U_SPIFFS overwrites the
+ *   file system partition while the data arrives.
+ */
+
+#ifndef _HOST_UPDATE_h
+#define _HOST_UPDATE_h
+
+#include "Arduino.h"
+#include "MD5Builder.h"
+#include "esp_ota_ops.h"
+
+#define UPDATE_ERROR_OK (0)
+#define UPDATE_ERROR_WRITE (1)
+#define UPDATE_ERROR_ERASE (2)
+#define UPDATE_ERROR_READ (3)
+#define UPDATE_ERROR_SPACE (4)
+#define UPDATE_ERROR_SIZE (5)
+#define UPDATE_ERROR_STREAM (6)
+#define UPDATE_ERROR_MD5 (7)
+#define UPDATE_ERROR_MAGIC_BYTE (8)
+#define UPDATE_ERROR_ACTIVATE (9)
+#define UPDATE_ERROR_NO_PARTITION (10)
+#define UPDATE_ERROR_BAD_ARGUMENT (11)
+#define UPDATE_ERROR_ABORT (12)
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+#define U_AUTH 200
+
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
+
+class UpdateClass {
+public:
+    typedef std::function<void(size_t, size_t)> THandlerFunction_Progress;
+
+    UpdateClass& onProgress(THandlerFunction_Progress fn) { _progressCallback = fn; return *this; }
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = 0, const char* label = nullptr);
+    size_t write(uint8_t* data, size_t len);
+    bool end(bool evenIfRemaining = false);
+    void abort();
+    void printError(Print& out);
+    const char* errorString() const;
+    bool setMD5(const char* expected_md5);
+
+    uint8_t getError() const { return _error; }
+    bool hasError() const { return _error != UPDATE_ERROR_OK; }
+    bool isRunning() const { return _size > 0; }
+    bool isFinished() const { return _progress == _size; }
+    size_t size() const { return _size; }
+    size_t progress() const { return _progress; }
+    size_t remaining() const { return _size - _progress; }
+
+    // -- Host side, fault injection, cleared by hostReset().
+    bool failBegin = false;
+    size_t failWriteAt = SIZE_MAX;      // fail the write that reaches this offset
+    bool failEnd = false;
+    uint32_t beginCalls = 0;
+    uint32_t endCalls = 0;
+    uint32_t abortCalls = 0;
+    void hostReset();
+
+private:
+    uint8_t _error = UPDATE_ERROR_OK;
+    size_t _size = 0;
+    size_t _progress = 0;
+    int _command = U_FLASH;
+    const esp_partition_t* _partition = nullptr;
+    String _targetMd5;
+    MD5Builder _md5;
+    THandlerFunction_Progress _progressCallback;
+
+    void fail(uint8_t error);
+};
+
+extern UpdateClass Update;
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef _HOST_WIFI_h
+#define _HOST_WIFI_h
+
+#include "Arduino.h"
+
+#endif
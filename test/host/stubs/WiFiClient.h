@@ -0,0 +1,48 @@
+/**
+ * WiFiClient.h -- Host stand-in for the WiFi TCP client on a POSIX socket.
+ *   Reads never block, like on the device, available() only reports data
+ *   that already arrived.
+ */
+
+#ifndef _HOST_WIFICLIENT_h
+#define _HOST_WIFICLIENT_h
+
+#include "Arduino.h"
+
+class WiFiClient : public Stream {
+public:
+    WiFiClient() {}
+    ~WiFiClient() { stop(); }
+    WiFiClient(const WiFiClient&) = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+
+    int connect(const char* host, uint16_t port, int32_t timeoutMs = 3000);
+    void stop();
+    uint8_t connected();
+    operator bool() { return connected() != 0; }
+
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size);
+    int peek() override;
+    using Print::write;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+
+    /**
+     * Read up to the end of a line, waiting at most timeoutMs for it.
+     * @return False on timeout or when the peer closed before the line ended
+     */
+    bool readLine(std::string& line, uint32_t timeoutMs);
+
+private:
+    int _fd = -1;
+    bool _peerClosed = false;
+    std::vector<uint8_t> _buffer;
+    size_t _position = 0;
+
+    // -- Move the bytes the socket has to the buffer, waiting at most waitMs.
+    void fill(int waitMs);
+};
+
+#endif
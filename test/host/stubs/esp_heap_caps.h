@@ -0,0 +1,14 @@
+#ifndef _HOST_ESP_HEAP_CAPS_h
+#define _HOST_ESP_HEAP_CAPS_h
+
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+inline void* heap_caps_realloc(void* ptr, size_t size, unsigned int caps) {
+    (void)caps;
+    return realloc(ptr, size);
+}
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * esp_ota_ops.h -- Host stand-in for the OTA partition API. The host flash has
+ *   two app slots (app0, app1) and a file system partition (spiffs), each with
+ *   its content in RAM, so tests can check what an update left behind.
+ */
+
+#ifndef _HOST_ESP_OTA_OPS_h
+#define _HOST_ESP_OTA_OPS_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    uint8_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+} esp_partition_t;
+
+typedef enum {
+    ESP_OTA_IMG_NEW = 0x0U,
+    ESP_OTA_IMG_PENDING_VERIFY = 0x1U,
+    ESP_OTA_IMG_VALID = 0x2U,
+    ESP_OTA_IMG_INVALID = 0x3U,
+    ESP_OTA_IMG_ABORTED = 0x4U,
+    ESP_OTA_IMG_UNDEFINED = 0xFFFFFFFFU
+} esp_ota_img_states_t;
+
+const esp_partition_t* esp_ota_get_running_partition();
+const esp_partition_t* esp_ota_get_boot_partition();
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state);
+const esp_partition_t* esp_ota_get_last_invalid_partition();
+esp_err_t esp_ota_mark_app_valid_cancel_rollback();
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot();
+
+/**
+ * Host flash. reset() empties all partitions and boots from app0.
+ */
+namespace HostFlash {
+    enum Partition {
+        APP0,
+        APP1,
+        SPIFFS
+    };
+
+    void reset();
+    const esp_partition_t* partition(Partition partition);
+    std::vector<uint8_t>& content(const esp_partition_t* partition);
+    void setState(const esp_partition_t* partition, esp_ota_img_states_t state);
+
+    /**
+     * Boot from and run an app partition, as after a reboot into it.
+     */
+    void setRunning(const esp_partition_t* partition);
+
+    /**
+     * Error returned by the next esp_ota_mark_app_invalid_rollback_and_reboot()
+     * calls, which then neither mark nor reboot. ESP_OK until reset().
+     */
+    void setRollbackError(esp_err_t error);
+
+    /**
+     * Number of esp_ota_set_boot_partition() calls since reset().
+     */
+    uint32_t bootSwitches();
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _HOST_ESP_TASK_WDT_h
+#define _HOST_ESP_TASK_WDT_h
+
+#include "esp_err.h"
+
+typedef struct {
+    unsigned int timeout_ms;
+    unsigned int idle_core_mask;
+    bool trigger_panic;
+} esp_task_wdt_config_t;
+
+// -- The watchdog is reported as not initialized, like in a sketch without one.
+inline esp_err_t esp_task_wdt_status(void*) { return ESP_ERR_INVALID_STATE; }
+inline esp_err_t esp_task_wdt_deinit() { return ESP_OK; }
+inline esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t*) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_add(void*) { return ESP_OK; }
+
+#endif
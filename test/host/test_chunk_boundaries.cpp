@@ -0,0 +1,208 @@
+/**
+ * The chunker must send the same page whatever send space AsyncTCP offers.
+ * Each page is rendered in one shot, then again with every maxLen from 1 to
+ * 8192 and with random maxLen sequences, and compared byte for byte. The
+ * render cache, groups rendered again and groups cut by the render budget or
+ * the internal buffer each take their own path through renderChunk(). Call
+ * counts and bytes per call are printed, so a change to the chunker shows
+ * what it costs.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+#include "IotWebConfAsyncTab.h"
+
+#include <random>
+
+namespace {
+    const size_t MAX_LEN = 8192;
+    const size_t ONE_SHOT = 65536;
+    const size_t SEQUENCES = 200;
+
+    enum Mode {
+        CACHED,         // -- Groups sent from the render cache
+        RENDERED,       // -- Cache invalidated, every group through renderHtml()
+        SLICED          // -- As RENDERED, and the render budget runs out inside the groups
+    };
+
+    const char* modeName(Mode mode) {
+        return mode == CACHED ? "cached" : mode == RENDERED ? "rendered" : "sliced";
+    }
+
+    /**
+     * What a client saw of one page.
+     */
+    struct Fetch {
+        std::string body;
+        uint32_t calls = 0;             // -- fillBody() calls, the final empty one included
+        uint32_t retries = 0;           // -- RESPONSE_TRY_AGAIN answers
+        uint32_t shortCalls = 0;        // -- Calls that left send space unused and were not the last
+        uint32_t oversized = 0;         // -- Calls that returned more than maxLen
+    };
+
+    /**
+     * Fetch the config page, nextLen() gives the send space of every call.
+     */
+    Fetch fetch(AsyncWebServer& server, const std::function<size_t()>& nextLen) {
+        Fetch fetch_;
+        AsyncClient client_;
+        AsyncWebServerRequest* request_ = new AsyncWebServerRequest(&server, &client_);
+        request_->setUrl("/config");
+        request_->setMethod(HTTP_GET);
+        request_->addHeader("Authorization", HOST_AUTH_ADMIN);
+        server.findHandler(request_)->handleRequest(request_);
+        AsyncWebServerResponse* response_ = request_->response();
+        std::vector<uint8_t> buffer_(ONE_SHOT);
+        bool short_ = false;
+        while (response_ != nullptr && fetch_.retries < 100000) {
+            size_t maxLen_ = nextLen();
+            size_t len_ = response_->fillBody(buffer_.data(), maxLen_);
+            fetch_.calls++;
+            if (len_ == RESPONSE_TRY_AGAIN) {
+                fetch_.retries++;
+                continue;
+            }
+            if (len_ == 0) {
+                break;
+            }
+            fetch_.shortCalls += short_ ? 1 : 0;
+            short_ = len_ < maxLen_;
+            fetch_.oversized += len_ > maxLen_ ? 1 : 0;
+            fetch_.body.append(reinterpret_cast<const char*>(buffer_.data()), std::min(len_, maxLen_));
+        }
+        request_->disconnect();
+        delete request_;
+        return fetch_;
+    }
+
+    Fetch fetch(AsyncWebServer& server, size_t maxLen) {
+        return fetch(server, [maxLen]() { return maxLen; });
+    }
+
+    /**
+     * Render every chunk size and the random sequences in one mode and
+     * compare each page with the one-shot render.
+     */
+    void sweep(const char* page, AsyncWebServer& server, AsyncIotWebConf& conf, Mode mode, uint32_t seed) {
+        HostPage oneShot_ = hostFetch(server, "/config", ONE_SHOT);
+        CHECK_EQ(oneShot_.code, 200);
+        const std::string& expected_ = oneShot_.body;
+        const AsyncIotWebConfMetrics& metrics_ = conf.getMetrics();
+        uint32_t truncated_ = metrics_.truncatedPages;
+        uint64_t chunkBytes_ = metrics_.chunkBytes;
+        uint64_t bytes_ = 0;
+        uint64_t calls_ = 0;
+        uint32_t shortCalls_ = 0;
+        uint32_t failures_ = 0;
+
+        auto check_ = [&](const Fetch& fetch, const char* what, size_t value) {
+            bytes_ += fetch.body.size();
+            calls_ += fetch.calls;
+            shortCalls_ += fetch.shortCalls;
+            bool same_ = fetch.body == expected_ && fetch.oversized == 0;
+            // -- Without a budget every call but the last one fills its send space.
+            bool full_ = mode == SLICED || fetch.shortCalls == 0;
+            if ((!same_ || !full_) && failures_++ < 5) {
+                CHECK(same_);
+                CHECK(full_);
+                printf("%s, %s: %s %zu, %zu of %zu bytes, %u oversized, %u short calls\n", page, modeName(mode),
+                    what, value, fetch.body.size(), expected_.size(), fetch.oversized, fetch.shortCalls);
+            }
+        };
+        auto prepare_ = [&]() {
+            if (mode != CACHED) {
+                conf.invalidateRenderCache();
+            }
+        };
+
+        printf("%s, %s: %zu bytes\n", page, modeName(mode), expected_.size());
+        hostSetMicrosStep(mode == SLICED ? 250 : 0);
+        for (size_t maxLen_ = 1; maxLen_ <= MAX_LEN; maxLen_++) {
+            prepare_();
+            Fetch fetch_ = fetch(server, maxLen_);
+            check_(fetch_, "maxLen", maxLen_);
+            if (maxLen_ == 1 || maxLen_ == 64 || maxLen_ == 536 || maxLen_ == 1460 || maxLen_ == MAX_LEN) {
+                printf("  maxLen %5zu: %6u calls, %7.1f bytes per call, %u short\n", maxLen_, fetch_.calls,
+                    static_cast<double>(fetch_.body.size()) / fetch_.calls, fetch_.shortCalls);
+            }
+        }
+        std::mt19937 random_(seed);
+        for (size_t i = 0; i < SEQUENCES; i++) {
+            // -- Half of the sequences mostly offer a few bytes, like a slow reader.
+            size_t high_ = i % 2 == 0 ? MAX_LEN : 64;
+            std::uniform_int_distribution<size_t> len_(1, high_);
+            prepare_();
+            check_(fetch(server, [&]() { return len_(random_); }), "sequence", i);
+        }
+        hostSetMicrosStep(0);
+
+        printf("  %zu pages: %llu calls, %.1f bytes per call, %u short calls\n", MAX_LEN + SEQUENCES,
+            (unsigned long long)calls_, static_cast<double>(bytes_) / calls_, shortCalls_);
+        CHECK_EQ(failures_, 0);
+        CHECK_EQ(metrics_.truncatedPages, truncated_);
+        CHECK_EQ(metrics_.chunkBytes - chunkBytes_, bytes_);
+        CHECK_EQ(metrics_.lastPageBytes, expected_.size());
+        CHECK_EQ(conf.getActiveRenders(), 0);
+        CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+    }
+
+    struct BasePage {
+        explicit BasePage(size_t parameters, size_t perGroup) :
+            form(parameters, perGroup),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "chunks") {
+            form.addTo(conf);
+            conf.init();
+            conf.setupWebHandlers("/config");
+            conf.hostSetState(iotwebconf::ApMode);
+        }
+
+        HostServer host;
+        HostForm form;
+        AsyncIotWebConf conf;
+    };
+
+    struct TabPage {
+        TabPage() :
+            form(12, 4),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "tabs") {
+            conf.addParameterGroup(form.groups[0].get(), "Sensors");
+            conf.addParameterGroup(form.groups[1].get(), "Network");
+            conf.addParameterGroup(form.groups[2].get(), "Sensors");
+            conf.init();
+            conf.setupWebHandlers("/config");
+            conf.hostSetState(iotwebconf::OnLine);
+        }
+
+        HostServer host;
+        HostForm form;
+        AsyncIotWebConfTab conf;
+    };
+}
+
+TEST(basePage) {
+    BasePage page_(20, 10);
+    std::string reference_ = hostFetch(page_.host.server, "/config", ONE_SHOT).body;
+    for (Mode mode_ : { CACHED, RENDERED, SLICED }) {
+        sweep("base page", page_.host.server, page_.conf, mode_, HostTest::seed(46) + mode_);
+    }
+    CHECK(hostFetch(page_.host.server, "/config", ONE_SHOT).body == reference_);
+}
+
+TEST(tabPage) {
+    TabPage page_;
+    std::string reference_ = hostFetch(page_.host.server, "/config", ONE_SHOT).body;
+    CHECK(reference_.find("<div id='Network' class='tabcontent'") != std::string::npos);
+    for (Mode mode_ : { CACHED, RENDERED, SLICED }) {
+        sweep("tab page", page_.host.server, page_.conf, mode_, HostTest::seed(146) + mode_);
+    }
+    CHECK(hostFetch(page_.host.server, "/config", ONE_SHOT).body == reference_);
+}
+
+TEST(groupOverInternalBuffer) {
+    // -- One group of more than MAX_INTERNAL_BUFFER bytes, renderHtml() stops when the buffer is full.
+    BasePage page_(200, 200);
+    std::string reference_ = hostFetch(page_.host.server, "/config", ONE_SHOT).body;
+    CHECK(reference_.size() > 32000);
+    sweep("large group", page_.host.server, page_.conf, RENDERED, HostTest::seed(246));
+    CHECK(hostFetch(page_.host.server, "/config", ONE_SHOT).body == reference_);
+}
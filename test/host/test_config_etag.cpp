@@ -0,0 +1,142 @@
+/**
+ * Conditional requests of the config page. A request carrying the current ETag
+ * in If-None-Match gets an empty 304, a save or a new format provider changes
+ * the ETag, so the browser gets the new page. Each tag of a list is compared
+ * as a whole, a tag that only contains the current one does not match.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+namespace {
+    struct ETagBench {
+        ETagBench() :
+            form(8),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "etag") {
+            form.addTo(conf);
+            conf.init();
+            conf.setupWebHandlers("/config");
+            conf.hostSetState(iotwebconf::ApMode);
+        }
+
+        HostServer host;
+        HostForm form;
+        AsyncIotWebConf conf;
+    };
+
+    struct Answer {
+        int code = 0;
+        std::string etag;
+        std::string body;
+    };
+
+    /**
+     * Get the config page, with the If-None-Match header unless it is nullptr.
+     */
+    Answer get(ETagBench& bench, const char* ifNoneMatch) {
+        Answer answer_;
+        AsyncClient client_;
+        AsyncWebServerRequest* request_ = new AsyncWebServerRequest(&bench.host.server, &client_);
+        request_->setUrl("/config");
+        request_->setMethod(HTTP_GET);
+        if (ifNoneMatch != nullptr) {
+            request_->addHeader("If-None-Match", ifNoneMatch);
+        }
+        bench.host.server.findHandler(request_)->handleRequest(request_);
+        AsyncWebServerResponse* response_ = request_->response();
+        if (response_ != nullptr) {
+            answer_.code = response_->code();
+            const String* etag_ = response_->header("ETag");
+            answer_.etag = etag_ != nullptr ? etag_->c_str() : "";
+            uint8_t buffer_[1460];
+            size_t len_;
+            while ((len_ = response_->fillBody(buffer_, sizeof(buffer_))) != 0 && len_ != RESPONSE_TRY_AGAIN) {
+                answer_.body.append(reinterpret_cast<const char*>(buffer_), len_);
+            }
+        }
+        request_->disconnect();
+        delete request_;
+        return answer_;
+    }
+
+    Answer get(ETagBench& bench, const std::string& ifNoneMatch) {
+        return get(bench, ifNoneMatch.c_str());
+    }
+
+    void save(ETagBench& bench, uint32_t round) {
+        AsyncClient client_;
+        AsyncWebServerRequest* request_ = new AsyncWebServerRequest(&bench.host.server, &client_);
+        request_->setUrl("/config");
+        request_->setMethod(HTTP_POST);
+        bench.form.addParams(*request_, round);
+        bench.host.server.findHandler(request_)->handleRequest(request_);
+        CHECK(request_->response() != nullptr && request_->response()->code() == 200);
+        request_->disconnect();
+        delete request_;
+        bench.conf.doLoop();
+        CHECK_EQ(bench.form.mismatches(round), 0);
+    }
+}
+
+TEST(matchingETagIsNotModified) {
+    ETagBench bench_;
+    Answer page_ = get(bench_, nullptr);
+    CHECK_EQ(page_.code, 200);
+    CHECK(page_.etag.size() > 2 && page_.etag.front() == '"' && page_.etag.back() == '"');
+
+    uint32_t notModified_ = bench_.conf.getMetrics().notModified;
+    Answer again_ = get(bench_, page_.etag);
+    CHECK_EQ(again_.code, 304);
+    CHECK(again_.etag == page_.etag);
+    CHECK(again_.body.empty());
+    CHECK_EQ(bench_.conf.getMetrics().notModified, notModified_ + 1);
+    CHECK_EQ(bench_.conf.getActiveRenders(), 0);
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+}
+
+TEST(saveChangesETag) {
+    ETagBench bench_;
+    Answer before_ = get(bench_, nullptr);
+    save(bench_, 2);
+
+    Answer after_ = get(bench_, before_.etag);
+    CHECK_EQ(after_.code, 200);
+    CHECK(after_.etag != before_.etag);
+    CHECK(!after_.body.empty());
+    CHECK(after_.body.find(bench_.form.value(0)) != std::string::npos);
+    CHECK_EQ(get(bench_, after_.etag).code, 304);
+}
+
+TEST(formatProviderChangesETag) {
+    ETagBench bench_;
+    Answer before_ = get(bench_, nullptr);
+    TabOptionalGroupHtmlFormatProvider provider_;
+    bench_.conf.setHtmlFormatProvider(&provider_);
+    Answer after_ = get(bench_, before_.etag);
+    CHECK_EQ(after_.code, 200);
+    CHECK(after_.etag != before_.etag);
+}
+
+TEST(etagLists) {
+    ETagBench bench_;
+    const std::string etag_ = get(bench_, nullptr).etag;
+    const std::string inner_ = etag_.substr(1, etag_.size() - 2);
+
+    // -- Lists, weak tags and the wildcard.
+    CHECK_EQ(get(bench_, "\"other\", " + etag_).code, 304);
+    CHECK_EQ(get(bench_, etag_ + ",\"other\"").code, 304);
+    CHECK_EQ(get(bench_, "\"a,b\" ,\t" + etag_).code, 304);
+    CHECK_EQ(get(bench_, "W/" + etag_).code, 304);
+    CHECK_EQ(get(bench_, "\"other\", W/" + etag_).code, 304);
+    CHECK_EQ(get(bench_, "*").code, 304);
+
+    // -- A tag containing the current one, or the current one without its quotes, does not match.
+    CHECK_EQ(get(bench_, "\"x" + etag_).code, 200);
+    CHECK_EQ(get(bench_, "\"x" + inner_ + "\"").code, 200);
+    CHECK_EQ(get(bench_, "\"" + inner_ + "x\"").code, 200);
+    CHECK_EQ(get(bench_, inner_).code, 200);
+    CHECK_EQ(get(bench_, "\"other\"").code, 200);
+    CHECK_EQ(get(bench_, "").code, 200);
+    CHECK_EQ(get(bench_, "**").code, 200);
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+}
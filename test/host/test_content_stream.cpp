@@ -0,0 +1,118 @@
+/**
+ * Pages streamed with sendContent(): content that does not fit the queue
+ * aborts the response instead of leaving a gap in the page, a producer in
+ * another task waits for space with waitContentSpace().
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+#include <thread>
+
+namespace {
+    struct ContentStream {
+        ContentStream() : request(&host.server, &client), wrapper(&request) {
+            wrapper.setContentLength(CONTENT_LENGTH_UNKNOWN);
+            wrapper.send(200, "text/plain", "");
+        }
+
+        /**
+         * Drain the response like hostFetch().
+         */
+        std::string drain(size_t maxLen = 1460) {
+            std::string body_;
+            std::vector<uint8_t> buffer_(maxLen);
+            for (uint32_t retries_ = 0; retries_ < 1000000;) {
+                size_t len_ = request.response()->fillBody(buffer_.data(), maxLen);
+                if (len_ == RESPONSE_TRY_AGAIN) {
+                    retries_++;
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (len_ == 0) {
+                    break;
+                }
+                body_.append(reinterpret_cast<const char*>(buffer_.data()), len_);
+            }
+            return body_;
+        }
+
+        HostServer host;
+        AsyncClient client;
+        AsyncWebServerRequest request;
+        AsyncWebRequestWrapper wrapper;
+    };
+
+    String part(size_t index, size_t length) {
+        String part_;
+        part_.reserve(length);
+        for (size_t i = 0; i < length; i++) {
+            part_ += static_cast<char>('a' + (index + i) % 26);
+        }
+        return part_;
+    }
+}
+
+TEST(pageWithinQueueIsSent) {
+    ContentStream stream_;
+    std::string expected_;
+    for (size_t i = 0; i < 8; i++) {
+        String part_ = part(i, 1000);
+        stream_.wrapper.sendContent(part_);
+        expected_ += part_.c_str();
+    }
+    stream_.wrapper.stop();
+    CHECK(stream_.drain() == expected_);
+    CHECK(!stream_.client._closeRequested);
+}
+
+TEST(overflowAbortsResponse) {
+    HostServer host_;
+    AsyncIotWebConf conf_("thing", &host_.dnsServer, &host_.wrapper, "password", "stream");
+    uint32_t aborted_ = conf_.getMetrics().abortedStreams;
+
+    ContentStream stream_;
+    size_t parts_ = IOTWEBCONFASYNC_CONTENT_QUEUE_SIZE / 1000 + 2;
+    for (size_t i = 0; i < parts_; i++) {
+        stream_.wrapper.sendContent(part(i, 1000));
+    }
+    // -- A small part after the overflow must not be sent after the gap either.
+    stream_.wrapper.sendContent("tail");
+    stream_.wrapper.stop();
+
+    std::string body_ = stream_.drain();
+    CHECK(stream_.client._closeRequested);
+    CHECK(body_.find("tail") == std::string::npos);
+    CHECK_EQ(conf_.getMetrics().abortedStreams, aborted_ + 1);
+}
+
+TEST(producerTaskWaitsForSpace) {
+    hostUseRealClock(true);
+    ContentStream stream_;
+    const size_t parts_ = 200;
+    std::string expected_;
+    for (size_t i = 0; i < parts_; i++) {
+        expected_ += part(i, 700).c_str();
+    }
+    uint32_t aborted_ = AsyncWebRequestWrapper::getAbortedStreams();
+
+    bool waited_ = true;
+    std::thread producer_([&]() {
+        for (size_t i = 0; i < parts_; i++) {
+            String part_ = part(i, 700);
+            waited_ = stream_.wrapper.waitContentSpace(part_.length(), 5000) && waited_;
+            stream_.wrapper.sendContent(part_);
+        }
+        stream_.wrapper.stop();
+        });
+    std::string body_ = stream_.drain(536);
+    producer_.join();
+
+    CHECK(waited_);
+    CHECK(body_ == expected_);
+    CHECK(!stream_.client._closeRequested);
+    CHECK_EQ(AsyncWebRequestWrapper::getAbortedStreams(), aborted_);
+    // -- A finished response has no space to wait for.
+    CHECK(!stream_.wrapper.waitContentSpace(1, 10));
+    hostUseRealClock(false);
+}
@@ -0,0 +1,358 @@
+/**
+ * The config portal under the event loop of AsyncTCP, see sim/HostSim.h:
+ * many clients at once, slow readers, lost segments, clients that leave in
+ * the middle of a page, saves and uploads between the pages and allocation
+ * failures. Every page that arrives must be the page, and once the last
+ * connection is gone the heap must be where it was before the first one.
+ * IWC_HOST_SEED picks another run.
+ */
+
+#include "HostTest.h"
+#include "sim/HostSim.h"
+#include "IotWebConfAsyncUpdateServer.h"
+
+#include <Update.h>
+
+namespace {
+    const size_t CLIENTS = 50;
+
+    struct Portal {
+        Portal() :
+            form(40),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "sim") {
+            form.addTo(conf);
+            conf.init();
+            conf.setupWebHandlers("/config");
+            conf.hostSetState(iotwebconf::ApMode);
+            // -- The first render fills the render cache, it stays for the lifetime of the portal.
+            reference = hostFetch(host.server, "/config").body;
+        }
+
+        HostServer host;
+        HostForm form;
+        AsyncIotWebConf conf;
+        std::string reference;
+    };
+
+    uint32_t pick(std::mt19937& random, uint32_t low, uint32_t high) {
+        return std::uniform_int_distribution<uint32_t>(low, high)(random);
+    }
+
+    /**
+     * Check what every client got: a page that arrives is the page, every
+     * connection ends, nothing is left behind.
+     * @return Number of pages that were not the page
+     */
+    uint32_t checkRun(HostSim& sim, Portal& portal, const char* name, bool exact = true) {
+        const HostSimReport& report_ = sim.report();
+        sim.printReport(name);
+        uint32_t different_ = 0;
+        for (size_t i = 0; i < sim.size(); i++) {
+            const HostSimResult& result_ = sim.result(i);
+            different_ += result_.matches ? 0 : 1;
+            if (exact && !CHECK(result_.matches)) {
+                printf("%s: client %zu got a different page, %zu bytes, code %d\n", name, i, result_.bytes, result_.code);
+            }
+            CHECK(result_.complete || result_.disconnected || result_.closed);
+            CHECK(result_.code != 0 || result_.disconnected);
+        }
+        CHECK(!report_.leaked());
+        CHECK_EQ(report_.liveWrappers, 0);
+        CHECK_EQ(report_.leakedTempObjects, 0);
+        CHECK_EQ(portal.conf.getActiveRenders(), 0);
+        return different_;
+    }
+}
+
+TEST(fiftyClients) {
+    Portal portal_;
+    std::mt19937 random_(HostTest::seed(45));
+    HostSim sim_(portal_.host.server, random_());
+    for (size_t i = 0; i < CLIENTS; i++) {
+        HostSimScript script_;
+        script_.startTick = pick(random_, 0, 40);
+        script_.minMaxLen = 64;
+        script_.maxMaxLen = 1460;
+        script_.busyRetries = 50;
+        script_.busyBackoff = pick(random_, 5, 50);
+        script_.expected = &portal_.reference;
+        sim_.addClient(script_);
+    }
+    sim_.run();
+    checkRun(sim_, portal_, "fiftyClients");
+
+    // -- Clients overlap, the render slot turns the ones that do not fit away until it is free.
+    uint32_t busy_ = 0;
+    for (size_t i = 0; i < sim_.size(); i++) {
+        CHECK_EQ(sim_.result(i).code, 200);
+        CHECK(sim_.result(i).complete);
+        busy_ += sim_.result(i).busy;
+    }
+    CHECK(sim_.report().maxOpen > 1);
+    CHECK(busy_ > 0);
+}
+
+TEST(slowReadersAndLostSegments) {
+    Portal portal_;
+    std::mt19937 random_(HostTest::seed(46));
+    HostSim sim_(portal_.host.server, random_());
+    for (size_t i = 0; i < CLIENTS; i++) {
+        HostSimScript script_;
+        script_.startTick = i * 20;
+        script_.busyRetries = 1000;
+        script_.busyBackoff = pick(random_, 50, 200);
+        script_.minMaxLen = 1;
+        script_.maxMaxLen = pick(random_, 1, 600);
+        script_.ackDelay = pick(random_, 0, 4);
+        script_.dropPercent = 10;
+        script_.retransmitTicks = pick(random_, 20, 300);
+        // -- A third of the clients leaves in the middle of the page.
+        if (i % 3 == 0) {
+            script_.disconnectAfter = pick(random_, 1, portal_.reference.size() - 1);
+        }
+        script_.expected = &portal_.reference;
+        sim_.addClient(script_);
+    }
+    sim_.run(10000000);
+    checkRun(sim_, portal_, "slowReadersAndLostSegments");
+    for (size_t i = 0; i < sim_.size(); i++) {
+        const HostSimResult& result_ = sim_.result(i);
+        CHECK_EQ(result_.code, 200);
+        CHECK(result_.largestChunk <= 600);
+        CHECK(result_.drops > 0);
+        CHECK(result_.complete != (i % 3 == 0));
+    }
+
+    // -- The slot of a client that left is free again.
+    CHECK(hostFetch(portal_.host.server, "/config").body == portal_.reference);
+}
+
+TEST(clientsLeaveInsideAGroup) {
+    Portal portal_;
+    std::mt19937 random_(HostTest::seed(50));
+    HostSim sim_(portal_.host.server, random_());
+    // -- A slow render uses up its budget inside a group, renderHtml() returns
+    //    there and a client that leaves next must not cut the next page.
+    hostSetMicrosStep(200);
+    sim_.onTick([&](uint32_t tick) { portal_.conf.invalidateRenderCache(); });
+    // -- The chunk buffer keeps the size of a group cut short until the next page.
+    sim_.onFinish([&]() { hostFetch(portal_.host.server, "/config"); });
+    for (size_t i = 0; i < CLIENTS; i++) {
+        HostSimScript script_;
+        script_.startTick = i * 5;
+        script_.busyRetries = 1000;
+        script_.busyBackoff = pick(random_, 5, 20);
+        script_.minMaxLen = 64;
+        script_.maxMaxLen = 1460;
+        if (i % 2 == 0) {
+            script_.disconnectAfter = pick(random_, 1, portal_.reference.size() - 1);
+        }
+        script_.expected = &portal_.reference;
+        sim_.addClient(script_);
+    }
+    sim_.run();
+    hostSetMicrosStep(0);
+    checkRun(sim_, portal_, "clientsLeaveInsideAGroup");
+    for (size_t i = 1; i < sim_.size(); i += 2) {
+        CHECK(sim_.result(i).complete);
+    }
+    CHECK(portal_.conf.getMetrics().abortedRenders > 0);
+    CHECK(hostFetch(portal_.host.server, "/config").body == portal_.reference);
+}
+
+TEST(savesBetweenPages) {
+    Portal portal_;
+    std::mt19937 random_(HostTest::seed(47));
+    // -- The first save allocates the EEPROM of the host, it goes before the baseline.
+    CHECK(portal_.conf.saveConfig());
+    HostSim sim_(portal_.host.server, random_());
+    sim_.onTick([&](uint32_t tick) { portal_.conf.doLoop(); });
+    std::vector<size_t> saves_;
+    std::vector<std::string> values_(portal_.form.size());
+    sim_.onFinish([&]() {
+        // -- The render cache and the EEPROM hold the saved values, with the
+        //    values of the baseline they have to come back to the baseline size.
+        for (size_t p = 0; p < portal_.form.size(); p++) {
+            values_[p] = portal_.form.value(p);
+            strcpy(portal_.form.value(p), "default");
+        }
+        portal_.conf.saveConfig();
+        hostFetch(portal_.host.server, "/config");
+        });
+    for (size_t i = 0; i < CLIENTS; i++) {
+        HostSimScript script_;
+        script_.startTick = pick(random_, 0, 200);
+        script_.minMaxLen = 128;
+        script_.maxMaxLen = 1460;
+        if (i % 5 == 0) {
+            script_.method = HTTP_POST;
+            script_.body = portal_.form.body(static_cast<uint32_t>(i + 1));
+            script_.bodyPiece = pick(random_, 16, 536);
+            script_.dropPercent = 5;
+            script_.keepBody = 4096;
+            saves_.push_back(sim_.addClient(script_));
+        }
+        else {
+            script_.keepBody = portal_.reference.size() * 2;
+            sim_.addClient(script_);
+        }
+    }
+    sim_.run();
+    checkRun(sim_, portal_, "savesBetweenPages");
+
+    // -- The values are those of one of the saves, never a mix.
+    uint32_t accepted_ = 0;
+    uint32_t last_ = 0;
+    for (size_t client_ : saves_) {
+        accepted_ += sim_.result(client_).code == 200 ? 1 : 0;
+        uint32_t matching_ = 0;
+        for (size_t p = 0; p < values_.size(); p++) {
+            matching_ += values_[p] == HostForm::postedValue(p, client_ + 1) ? 1 : 0;
+        }
+        CHECK(matching_ == 0 || matching_ == values_.size());
+        last_ += matching_ == values_.size() ? 1 : 0;
+    }
+    CHECK(accepted_ > 0);
+    CHECK_EQ(last_, 1);
+    CHECK_EQ(portal_.conf.getSavedGeneration(), portal_.conf.getSaveGeneration());
+
+    // -- A page is whole and shows the values of one save or of none.
+    for (size_t i = 0; i < sim_.size(); i++) {
+        const HostSimResult& result_ = sim_.result(i);
+        if (i % 5 == 0 || result_.code != 200 || !result_.complete) {
+            continue;
+        }
+        CHECK(result_.body.find("</html>") != std::string::npos);
+        size_t round_ = 0;
+        for (size_t save_ : saves_) {
+            if (result_.body.find("value='" + HostForm::postedValue(0, save_ + 1) + "'") != std::string::npos) {
+                round_ = save_ + 1;
+            }
+        }
+        for (size_t p = 1; p < portal_.form.size(); p++) {
+            std::string value_ = round_ == 0 ? std::string("value='default'") :
+                "value='" + HostForm::postedValue(p, round_) + "'";
+            CHECK(result_.body.find(value_) != std::string::npos);
+        }
+    }
+}
+
+TEST(uploadBetweenPages) {
+    HostFlash::reset();
+    Update.hostReset();
+    Portal portal_;
+    AsyncUpdateServer updater_;
+    updater_.setup(&portal_.host.server);
+    updater_.setWriteRate(200000);
+    std::vector<uint8_t> image_(60000);
+    for (size_t i = 0; i < image_.size(); i++) {
+        image_[i] = static_cast<uint8_t>(i * 13);
+    }
+    image_[0] = ESP_IMAGE_HEADER_MAGIC;
+
+    HostSimScript upload_;
+    upload_.url = "/update";
+    upload_.method = HTTP_POST;
+    upload_.upload = &image_;
+    upload_.keepBody = 4096;
+    bool written_ = false;
+    auto checkFlash_ = [&]() {
+        // -- The host flash lives on the heap, the image is compared and dropped.
+        std::vector<uint8_t>& flash_ = HostFlash::content(esp_ota_get_boot_partition());
+        written_ = flash_.size() >= image_.size() && std::equal(image_.begin(), image_.end(), flash_.begin());
+        std::vector<uint8_t>().swap(HostFlash::content(HostFlash::partition(HostFlash::APP0)));
+        std::vector<uint8_t>().swap(HostFlash::content(HostFlash::partition(HostFlash::APP1)));
+        };
+
+    // -- The result page parses its template once and keeps it, a failed update
+    //    shows that page as well and goes before the baseline.
+    {
+        HostSim first_(portal_.host.server, 1);
+        first_.onTick([&](uint32_t tick) { updater_.loop(); });
+        first_.onFinish(checkFlash_);
+        first_.addClient(upload_);
+        Update.failEnd = true;
+        first_.run();
+        Update.failEnd = false;
+        CHECK(first_.result(0).complete);
+        CHECK(first_.result(0).body.find("Update error") != std::string::npos);
+    }
+
+    std::mt19937 random_(HostTest::seed(48));
+    HostSim sim_(portal_.host.server, random_());
+    sim_.onTick([&](uint32_t tick) { updater_.loop(); });
+    sim_.onFinish(checkFlash_);
+    written_ = false;
+    uint32_t aborts_ = Update.abortCalls;
+
+    // -- The first upload is cut off, the second one takes over the updater.
+    HostSimScript cut_ = upload_;
+    cut_.disconnectAfter = 20000;
+    size_t cutClient_ = sim_.addClient(cut_);
+    upload_.dropPercent = 5;
+    upload_.startTick = 200;
+    size_t uploadClient_ = sim_.addClient(upload_);
+    for (size_t i = 0; i < CLIENTS - 2; i++) {
+        HostSimScript script_;
+        script_.startTick = pick(random_, 0, 400);
+        script_.minMaxLen = 256;
+        script_.maxMaxLen = 1460;
+        script_.busyRetries = 20;
+        script_.expected = &portal_.reference;
+        sim_.addClient(script_);
+    }
+    sim_.run();
+    checkRun(sim_, portal_, "uploadBetweenPages");
+
+    CHECK(sim_.result(cutClient_).disconnected);
+    CHECK_EQ(sim_.result(uploadClient_).code, 200);
+    CHECK(sim_.result(uploadClient_).complete);
+    CHECK(sim_.result(uploadClient_).drops > 0);
+    CHECK(written_);
+    CHECK(updater_.isFinished());
+    CHECK_EQ(Update.abortCalls, aborts_ + 1);
+}
+
+TEST(allocationFailures) {
+    Portal portal_;
+    std::mt19937 random_(HostTest::seed(49));
+    for (uint32_t period_ : { 3u, 7u, 31u }) {
+        HostSim sim_(portal_.host.server, random_());
+        // -- A dirty render cache makes every page render its groups again. Fragments
+        //    lost to a failure are rendered once more before the heap is measured.
+        sim_.onTick([&](uint32_t tick) {
+            portal_.conf.doLoop();
+            if (tick % 10 == 0) {
+                portal_.conf.invalidateRenderCache();
+            }
+            });
+        sim_.onFinish([&]() {
+            portal_.conf.invalidateRenderCache();
+            hostFetch(portal_.host.server, "/config");
+            });
+        sim_.failAllocations(period_);
+        for (size_t i = 0; i < CLIENTS; i++) {
+            HostSimScript script_;
+            script_.startTick = pick(random_, 0, 100);
+            script_.minMaxLen = 32;
+            script_.maxMaxLen = 1460;
+            if (i % 10 == 0) {
+                script_.url = "/config?saveStatus";
+            }
+            else if (i % 10 == 5) {
+                script_.url = "/generate_204";
+            }
+            else {
+                script_.expected = &portal_.reference;
+            }
+            sim_.addClient(script_);
+        }
+        sim_.run();
+        // -- IotWebConf builds parts of the page with String sums, a failed one loses
+        //    text without a sign, on the device as well. Those pages are counted.
+        uint32_t different_ = checkRun(sim_, portal_, "allocationFailures", false);
+        printf("allocationFailures: every %u. allocation failed, %u pages differ\n", period_, different_);
+        CHECK(sim_.report().injectedFailures > 0);
+    }
+    CHECK(hostFetch(portal_.host.server, "/config").body == portal_.reference);
+}
@@ -0,0 +1,69 @@
+/**
+ * AsyncHtmlTemplate past 64 KB and the head template of the config page,
+ * which is scanned once per format provider.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+namespace {
+    const char* const SLOTS[] = { "v" };
+
+    class CountingProvider : public iotwebconf::HtmlFormatProvider {
+    public:
+        explicit CountingProvider(const char* marker) : _marker(marker) {}
+        String getHead() override {
+            headCalls++;
+            return String("<!DOCTYPE html><html><head><title>{v}</title><meta name='p' content='") + _marker + "'/>";
+        }
+        uint32_t headCalls = 0;
+
+    private:
+        const char* _marker;
+    };
+}
+
+TEST(templateBeyond64k) {
+    // -- Literal and slot positions past 65535 must not wrap.
+    std::string source_(70000, 'a');
+    source_ += "{v}";
+    source_ += std::string(70000, 'b');
+    AsyncHtmlTemplate template_(source_.c_str(), false, SLOTS, 1, '{', '}');
+    AsyncTemplateValue values_[] = { AsyncTemplateValue::ram("VALUE") };
+
+    CHECK_EQ(template_.length(values_), 140005);
+    std::string expanded_(140005, '\0');
+    size_t read_ = 0;
+    while (read_ < expanded_.size()) {
+        size_t len_ = template_.read(read_, reinterpret_cast<uint8_t*>(&expanded_[read_]), 4096, values_);
+        if (!CHECK(len_ > 0)) {
+            break;
+        }
+        read_ += len_;
+    }
+    CHECK(expanded_ == std::string(70000, 'a') + "VALUE" + std::string(70000, 'b'));
+}
+
+TEST(headTemplateScannedOncePerProvider) {
+    HostServer host_;
+    AsyncIotWebConf conf_("thing", &host_.dnsServer, &host_.wrapper, "password", "head");
+    conf_.init();
+    conf_.setupWebHandlers("/config");
+    conf_.hostSetState(iotwebconf::OnLine);
+
+    CountingProvider first_("first");
+    conf_.setHtmlFormatProvider(&first_);
+    for (int i = 0; i < 3; i++) {
+        HostPage page_ = hostFetch(host_.server, "/config");
+        CHECK_EQ(page_.code, 200);
+        CHECK(page_.body.find("<title>Config thing</title><meta name='p' content='first'/>") != std::string::npos);
+    }
+    CHECK_EQ(first_.headCalls, 1);
+
+    // -- Another provider brings its own head.
+    CountingProvider second_("second");
+    conf_.setHtmlFormatProvider(&second_);
+    HostPage page_ = hostFetch(host_.server, "/config");
+    CHECK(page_.body.find("content='second'") != std::string::npos);
+    CHECK_EQ(second_.headCalls, 1);
+}
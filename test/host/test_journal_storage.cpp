@@ -0,0 +1,193 @@
+/**
+ * Power loss at any point of a save or a compaction must leave the journal
+ * with the values of the last completed save. The journal lives in an
+ * AsyncRamStorageFs, a power loss is a cut or a changed byte in its file.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+namespace {
+    const char* JOURNAL = "/test.jnl";
+    const char* JOURNAL_TEMP = "/test.jnl.tmp";
+
+    /**
+     * A file system whose rename can fail, like a reset during a compaction.
+     */
+    class HostCrashFs : public AsyncRamStorageFs {
+    public:
+        bool rename(const char* from, const char* to) override {
+            return !failRename && AsyncRamStorageFs::rename(from, to);
+        }
+
+        void put(const char* path, const std::vector<uint8_t>& content) {
+            _files[path] = content;
+        }
+
+        bool failRename = false;
+    };
+
+    struct Values {
+        uint8_t key0[8];
+        uint8_t key1[8];
+        uint8_t key2[8];
+    };
+
+    Values valuesOf(uint8_t round) {
+        Values values_;
+        memset(values_.key0, round, sizeof(values_.key0));
+        memset(values_.key1, round + 1, sizeof(values_.key1));
+        memset(values_.key2, round + 2, sizeof(values_.key2));
+        return values_;
+    }
+
+    bool save(AsyncJournalStorage& storage, const Values& values) {
+        return storage.store(0, values.key0, sizeof(values.key0)) &&
+            storage.store(1, values.key1, sizeof(values.key1)) &&
+            storage.store(2, values.key2, sizeof(values.key2)) &&
+            storage.commit();
+    }
+
+    /**
+     * Open the journal like after a reset and compare its values.
+     */
+    bool holds(HostCrashFs& fs, const Values& values) {
+        AsyncJournalStorage storage_(fs, JOURNAL);
+        if (!storage_.begin("v1")) {
+            return false;
+        }
+        Values loaded_;
+        return storage_.load(0, loaded_.key0, sizeof(loaded_.key0)) &&
+            storage_.load(1, loaded_.key1, sizeof(loaded_.key1)) &&
+            storage_.load(2, loaded_.key2, sizeof(loaded_.key2)) &&
+            memcmp(&loaded_, &values, sizeof(values)) == 0;
+    }
+
+    /**
+     * A journal with the saves of round 1 and round 2.
+     * @return Size after the first save
+     */
+    size_t twoSaves(HostCrashFs& fs) {
+        AsyncJournalStorage storage_(fs, JOURNAL);
+        storage_.begin("v1");
+        save(storage_, valuesOf(1));
+        size_t first_ = storage_.getJournalSize();
+        save(storage_, valuesOf(2));
+        return first_;
+    }
+}
+
+TEST(tornSaveIsDropped) {
+    HostCrashFs fs_;
+    size_t first_ = twoSaves(fs_);
+    std::vector<uint8_t> journal_ = *fs_.data(JOURNAL);
+
+    // -- A cut anywhere in the second save keeps the first one.
+    for (size_t cut_ = first_; cut_ <= journal_.size(); cut_++) {
+        HostCrashFs cutFs_;
+        cutFs_.put(JOURNAL, std::vector<uint8_t>(journal_.begin(), journal_.begin() + cut_));
+        bool complete_ = cut_ == journal_.size();
+        if (!CHECK(holds(cutFs_, valuesOf(complete_ ? 2 : 1)))) {
+            printf("cut at %zu of %zu\n", cut_, journal_.size());
+        }
+    }
+}
+
+TEST(corruptRecordIsDropped) {
+    HostCrashFs fs_;
+    size_t first_ = twoSaves(fs_);
+    std::vector<uint8_t> journal_ = *fs_.data(JOURNAL);
+
+    for (size_t offset_ = first_; offset_ < journal_.size(); offset_++) {
+        HostCrashFs flippedFs_;
+        std::vector<uint8_t> flipped_ = journal_;
+        flipped_[offset_] ^= 0x5A;
+        flippedFs_.put(JOURNAL, flipped_);
+        if (!CHECK(holds(flippedFs_, valuesOf(1)))) {
+            printf("byte %zu flipped\n", offset_);
+        }
+    }
+}
+
+TEST(saveAfterUncommittedTail) {
+    HostCrashFs fs_;
+    twoSaves(fs_);
+    {
+        // -- The values reach the journal, the reset comes before the commit record.
+        AsyncJournalStorage storage_(fs_, JOURNAL);
+        storage_.begin("v1");
+        Values values_ = valuesOf(3);
+        CHECK(storage_.store(0, values_.key0, sizeof(values_.key0)));
+        CHECK(storage_.store(1, values_.key1, sizeof(values_.key1)));
+    }
+    CHECK(holds(fs_, valuesOf(2)));
+
+    // -- The next save must not commit the orphaned records along with it.
+    {
+        AsyncJournalStorage storage_(fs_, JOURNAL);
+        storage_.begin("v1");
+        Values values_ = valuesOf(2);
+        memset(values_.key2, 9, sizeof(values_.key2));
+        CHECK(storage_.store(2, values_.key2, sizeof(values_.key2)));
+        CHECK(storage_.commit());
+        CHECK(holds(fs_, values_));
+    }
+}
+
+TEST(interruptedCompaction) {
+    HostCrashFs fs_;
+    twoSaves(fs_);
+    std::vector<uint8_t> journal_ = *fs_.data(JOURNAL);
+
+    // -- The reset comes before the rename: the old journal stays, the partial copy goes.
+    {
+        AsyncJournalStorage storage_(fs_, JOURNAL);
+        storage_.begin("v1");
+        fs_.failRename = true;
+        CHECK(!storage_.compact());
+        fs_.failRename = false;
+    }
+    CHECK(fs_.exists(JOURNAL));
+    CHECK(holds(fs_, valuesOf(2)));
+    CHECK(!fs_.exists(JOURNAL_TEMP));
+
+    // -- A copy cut short next to the journal is dropped as well.
+    fs_.put(JOURNAL_TEMP, std::vector<uint8_t>(journal_.begin(), journal_.begin() + journal_.size() / 2));
+    CHECK(holds(fs_, valuesOf(2)));
+    CHECK(!fs_.exists(JOURNAL_TEMP));
+
+    // -- The reset comes between remove and rename: the complete copy takes over.
+    {
+        AsyncJournalStorage storage_(fs_, JOURNAL);
+        storage_.begin("v1");
+        CHECK(storage_.compact());
+        CHECK(storage_.getJournalSize() < journal_.size());
+    }
+    std::vector<uint8_t> compacted_ = *fs_.data(JOURNAL);
+    fs_.remove(JOURNAL);
+    fs_.put(JOURNAL_TEMP, compacted_);
+    CHECK(holds(fs_, valuesOf(2)));
+    CHECK(!fs_.exists(JOURNAL_TEMP));
+}
+
+TEST(saveConfigWritesStorage) {
+    HostServer host_;
+    HostForm form_(4);
+    HostCrashFs fs_;
+    AsyncJournalStorage storage_(fs_, JOURNAL);
+    AsyncIotWebConf conf_("thing", &host_.dnsServer, &host_.wrapper, "password", "v1");
+    form_.addTo(conf_);
+    conf_.setConfigStorage(&storage_);
+    conf_.init();
+
+    strcpy(form_.value(2), "from code");
+    CHECK(conf_.saveConfig());
+    CHECK_EQ(conf_.saveCalls(), 1);
+
+    // -- After a reset the storage brings the value back.
+    strcpy(form_.value(2), "lost");
+    AsyncJournalStorage reopened_(fs_, JOURNAL);
+    CHECK(reopened_.begin("v1"));
+    CHECK(reopened_.loadItems(conf_.getRootParameterGroup()) > 0);
+    CHECK(strcmp(form_.value(2), "from code") == 0);
+}
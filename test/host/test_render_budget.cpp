@@ -0,0 +1,113 @@
+/**
+ * A render that used up its budget hands the AsyncTCP task back and resumes
+ * with the next callback, the page must come out the same. Built twice: the
+ * inline render returns a short chunk, the render task answers
+ * RESPONSE_TRY_AGAIN until it produced data. The latency histogram the
+ * budget is tuned with is checked against a known sample set.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+namespace {
+    const uint32_t BUDGET_US = 1000;
+
+    struct BudgetBench {
+        BudgetBench() :
+            form(40),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "budget") {
+            form.addTo(conf);
+            conf.init();
+            conf.setupWebHandlers("/config");
+            conf.hostSetState(iotwebconf::ApMode);
+        }
+
+        HostServer host;
+        HostForm form;
+        AsyncIotWebConf conf;
+    };
+}
+
+TEST(histogramPercentiles) {
+    AsyncLatencyHistogram histogram_;
+    CHECK_EQ(histogram_.percentile(50), 0);
+
+    // -- Bucket i holds 2^i to 2^(i+1)-1, bucket 0 holds 0 and 1.
+    for (uint32_t us_ : { 0u, 1u, 2u, 3u, 4u, 7u, 8u, 100u, 1000u, 5000u }) {
+        histogram_.record(us_);
+    }
+    CHECK_EQ(histogram_.count, 10);
+    CHECK_EQ(histogram_.maxUs, 5000);
+    CHECK_EQ(histogram_.buckets[0], 2);
+    CHECK_EQ(histogram_.buckets[1], 2);
+    CHECK_EQ(histogram_.buckets[2], 2);
+    CHECK_EQ(histogram_.buckets[3], 1);
+    CHECK_EQ(histogram_.buckets[6], 1);
+    CHECK_EQ(histogram_.buckets[9], 1);
+    CHECK_EQ(histogram_.buckets[12], 1);
+
+    // -- The upper bound of the bucket holding the rank, never more than the maximum.
+    CHECK_EQ(histogram_.percentile(10), 1);
+    CHECK_EQ(histogram_.percentile(20), 1);
+    CHECK_EQ(histogram_.percentile(21), 3);
+    CHECK_EQ(histogram_.percentile(50), 7);
+    CHECK_EQ(histogram_.percentile(70), 8 * 2 - 1);
+    CHECK_EQ(histogram_.percentile(80), 127);
+    CHECK_EQ(histogram_.percentile(90), 1023);
+    CHECK_EQ(histogram_.percentile(99), 5000);
+    CHECK_EQ(histogram_.percentile(100), 5000);
+
+    // -- Durations past the last bucket are kept there and reported as the maximum.
+    histogram_.record(0xFFFFFFFFu);
+    CHECK_EQ(histogram_.buckets[AsyncLatencyHistogram::BUCKETS - 1], 1);
+    CHECK_EQ(histogram_.percentile(100), 0xFFFFFFFFu);
+}
+
+TEST(budgetedPageIsTheSame) {
+    BudgetBench bench_;
+#if IOTWEBCONFASYNC_RENDER_OFFLOAD
+    hostUseRealClock(true);
+    CHECK(bench_.conf.enableRenderOffload());
+#endif
+    bench_.conf.setRenderBudget(0);
+    HostPage unlimited_ = hostFetch(bench_.host.server, "/config", 8192);
+    CHECK_EQ(unlimited_.code, 200);
+
+    // -- Every micros() call costs 100 us, the budget runs out after a few steps.
+    bench_.conf.setRenderBudget(BUDGET_US);
+    bench_.conf.invalidateRenderCache();
+#if !IOTWEBCONFASYNC_RENDER_OFFLOAD
+    hostSetMicrosStep(100);
+#endif
+    const AsyncIotWebConfMetrics& metrics_ = bench_.conf.getMetrics();
+    uint32_t calls_ = metrics_.chunkCalls;
+    uint32_t empty_ = metrics_.emptyChunkCalls;
+    uint32_t latencies_ = metrics_.renderLatency.count;
+    HostPage budgeted_ = hostFetch(bench_.host.server, "/config", 8192);
+    hostSetMicrosStep(0);
+
+    CHECK_EQ(budgeted_.code, 200);
+    CHECK(budgeted_.body == unlimited_.body);
+    CHECK_EQ(metrics_.truncatedPages, 0);
+    CHECK_EQ(metrics_.lastPageBytes, unlimited_.body.size());
+#if IOTWEBCONFASYNC_RENDER_OFFLOAD
+    // -- Every callback is counted and timed, the one ending the response as well.
+    uint32_t timed_ = budgeted_.fillCalls;
+#else
+    // -- Every callback but the one ending the response is counted and timed.
+    uint32_t timed_ = budgeted_.fillCalls - 1;
+#endif
+    CHECK_EQ(metrics_.chunkCalls - calls_, timed_);
+    CHECK_EQ(metrics_.renderLatency.count - latencies_, timed_);
+    CHECK_EQ(metrics_.emptyChunkCalls - empty_, budgeted_.retries);
+#if IOTWEBCONFASYNC_RENDER_OFFLOAD
+    // -- The render task was not done when AsyncTCP asked, the callback came again.
+    CHECK(budgeted_.retries > 0);
+    hostUseRealClock(false);
+#else
+    // -- The budget cut the page into more chunks than the send space needed.
+    CHECK_EQ(budgeted_.retries, 0);
+    CHECK(budgeted_.fillCalls > unlimited_.fillCalls);
+#endif
+    CHECK_EQ(bench_.conf.getActiveRenders(), 0);
+}
@@ -0,0 +1,157 @@
+/**
+ * A client that disconnects while the render task renders its page must not
+ * block the AsyncTCP task. The task holds its own reference to the wrapper,
+ * it keeps reading the wrapper after the request is gone and drops it once
+ * it sees the cancel.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * A parameter whose render waits until the test opens the gate, so the
+     * render task is caught in the middle of the page.
+     */
+    class GateParameter : public iotwebconf::TextParameter {
+    public:
+        GateParameter(char* valueBuffer) : TextParameter("Gate", "gate", valueBuffer, 16, "gate") {}
+
+        void close() {
+            std::lock_guard<std::mutex> lock_(_mutex);
+            _open = false;
+            _entered = false;
+        }
+
+        void open() {
+            {
+                std::lock_guard<std::mutex> lock_(_mutex);
+                _open = true;
+            }
+            _changed.notify_all();
+        }
+
+        bool waitEntered() {
+            std::unique_lock<std::mutex> lock_(_mutex);
+            return _changed.wait_for(lock_, std::chrono::seconds(5), [this]() { return _entered; });
+        }
+
+        // -- Read by the render after the disconnect.
+        String lastArg;
+
+    protected:
+        bool renderHtml(bool dataArrived, iotwebconf::WebRequestWrapper* webRequestWrapper, HtmlChunkCallback writer) override {
+            {
+                std::unique_lock<std::mutex> lock_(_mutex);
+                _entered = true;
+                _changed.notify_all();
+                _changed.wait(lock_, [this]() { return _open; });
+            }
+            lastArg = webRequestWrapper->arg("gate");
+            return TextParameter::renderHtml(dataArrived, webRequestWrapper, writer);
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _changed;
+        bool _open = true;
+        bool _entered = false;
+    };
+
+    struct OffloadBench {
+        OffloadBench() :
+            form(40),
+            gateGroup("gated", "Gated"),
+            gate(gateValue),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "offload") {
+            form.addTo(conf);
+            gateGroup.addItem(&gate);
+            conf.addParameterGroup(&gateGroup);
+            conf.init();
+            conf.setupWebHandlers("/config");
+        }
+
+        HostServer host;
+        HostForm form;
+        iotwebconf::ParameterGroup gateGroup;
+        char gateValue[16] = {};
+        GateParameter gate;
+        AsyncIotWebConf conf;
+    };
+
+    bool waitForLiveCount(uint32_t count) {
+        Clock::time_point start_ = Clock::now();
+        while (AsyncWebRequestWrapper::getLiveCount() != count) {
+            if (Clock::now() - start_ > std::chrono::seconds(5)) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+}
+
+TEST(offloadedPageIsComplete) {
+    hostUseRealClock(true);
+    OffloadBench bench_;
+    HostPage inline_ = hostFetch(bench_.host.server, "/config");
+    CHECK(bench_.conf.enableRenderOffload());
+    HostPage offloaded_ = hostFetch(bench_.host.server, "/config", 128);
+    CHECK_EQ(offloaded_.code, 200);
+    CHECK(offloaded_.body == inline_.body);
+    CHECK(waitForLiveCount(0));
+    hostUseRealClock(false);
+}
+
+TEST(disconnectDoesNotWaitForRenderTask) {
+    hostUseRealClock(true);
+    OffloadBench bench_;
+    CHECK(bench_.conf.enableRenderOffload());
+    uint32_t leaked_ = AsyncWebServerRequest::leakedTempObjects();
+
+    bench_.gate.close();
+    AsyncClient client_;
+    AsyncWebServerRequest* request_ = new AsyncWebServerRequest(&bench_.host.server, &client_);
+    request_->setUrl("/config");
+    request_->setMethod(HTTP_GET);
+    request_->addHeader("Authorization", HOST_AUTH_ADMIN);
+    bench_.host.server.findHandler(request_)->handleRequest(request_);
+    CHECK(request_->response() != nullptr);
+    CHECK(bench_.gate.waitEntered());
+
+    // -- The old cancel waited for the render task, which is stuck in the gate.
+    Clock::time_point start_ = Clock::now();
+    request_->disconnect();
+    delete request_;
+    long long elapsedMs_ = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_).count();
+    CHECK(elapsedMs_ < 50);
+    CHECK_EQ(bench_.conf.getMetrics().abortedRenders, 1);
+
+    // -- The render task still owns the wrapper, a new page has to wait.
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 1);
+    CHECK_EQ(hostFetch(bench_.host.server, "/config").code, 503);
+
+    bench_.gate.open();
+    CHECK(waitForLiveCount(0));
+    CHECK(bench_.gate.lastArg.length() == 0);
+    CHECK_EQ(AsyncWebServerRequest::leakedTempObjects(), leaked_);
+
+    // -- Once the task dropped the render, the page is served again.
+    Clock::time_point retry_ = Clock::now();
+    HostPage page_ = hostFetch(bench_.host.server, "/config");
+    while (page_.code == 503 && Clock::now() - retry_ < std::chrono::seconds(5)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        page_ = hostFetch(bench_.host.server, "/config");
+    }
+    CHECK_EQ(page_.code, 200);
+    CHECK(page_.body.find("id='gate'") != std::string::npos);
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+    hostUseRealClock(false);
+}
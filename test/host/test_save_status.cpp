@@ -0,0 +1,189 @@
+/**
+ * A save the config storage does not take must not be reported as saved,
+ * neither by the response nor by the save status. Built twice, with and
+ * without IOTWEBCONFASYNC_DEFER_SAVE. A deferred save waits for a running
+ * render, so a page is never rendered from half written values.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+namespace {
+    class HostFailingStorage : public AsyncConfigStorage {
+    public:
+        bool begin(const char* version) override { return true; }
+        bool load(uint16_t key, uint8_t* data, size_t length) override { return false; }
+        bool store(uint16_t key, const uint8_t* data, size_t length) override { return true; }
+        bool commit() override {
+            commits++;
+            return !fail;
+        }
+
+        bool fail = false;
+        uint32_t commits = 0;
+    };
+
+    class SaveIotWebConf : public AsyncIotWebConf {
+    public:
+        using AsyncIotWebConf::AsyncIotWebConf;
+        void hostSetSaving(bool saving) { _savingConfig.store(saving); }
+    };
+
+    struct SaveBench {
+        SaveBench() :
+            form(8),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "save") {
+            form.addTo(conf);
+            conf.setConfigStorage(&storage);
+            conf.init();
+            conf.setupWebHandlers("/config");
+            conf.hostSetState(iotwebconf::ApMode);
+        }
+
+        HostServer host;
+        HostForm form;
+        HostFailingStorage storage;
+        SaveIotWebConf conf;
+    };
+
+    AsyncWebServerRequest* beginRequest(SaveBench& bench, AsyncClient& client, WebRequestMethod method) {
+        AsyncWebServerRequest* request_ = new AsyncWebServerRequest(&bench.host.server, &client);
+        request_->setUrl("/config");
+        request_->setMethod(method);
+        return request_;
+    }
+
+    /**
+     * Drain the response of a handled request and close its connection.
+     */
+    HostPage finish(AsyncWebServerRequest* request) {
+        HostPage page_;
+        AsyncWebServerResponse* response_ = request->response();
+        if (response_ != nullptr) {
+            page_.code = response_->code();
+            uint8_t buffer_[1460];
+            size_t len_;
+            while ((len_ = response_->fillBody(buffer_, sizeof(buffer_))) != 0 && page_.retries < 100000) {
+                if (len_ == RESPONSE_TRY_AGAIN) {
+                    page_.retries++;
+                    continue;
+                }
+                page_.body.append(reinterpret_cast<const char*>(buffer_), len_);
+            }
+        }
+        request->disconnect();
+        delete request;
+        return page_;
+    }
+
+    HostPage post(SaveBench& bench, uint32_t round) {
+        AsyncClient client_;
+        AsyncWebServerRequest* request_ = beginRequest(bench, client_, HTTP_POST);
+        bench.form.addParams(*request_, round);
+        bench.host.server.findHandler(request_)->handleRequest(request_);
+        return finish(request_);
+    }
+
+    std::string saveStatus(SaveBench& bench) {
+        AsyncClient client_;
+        AsyncWebServerRequest* request_ = beginRequest(bench, client_, HTTP_GET);
+        request_->addParam("saveStatus", "", false);
+        bench.host.server.findHandler(request_)->handleRequest(request_);
+        return finish(request_).body;
+    }
+}
+
+TEST(failedSaveIsReported) {
+    SaveBench bench_;
+    bench_.storage.fail = true;
+    HostPage page_ = post(bench_, 1);
+#if IOTWEBCONFASYNC_DEFER_SAVE
+    // -- The answer only promises to save, the status tells the outcome.
+    CHECK_EQ(page_.code, 200);
+    CHECK(page_.body.find("Saving configuration...") != std::string::npos);
+    bench_.conf.doLoop();
+#else
+    CHECK_EQ(page_.code, 500);
+    CHECK(page_.body.find("Saving the configuration failed.") != std::string::npos);
+#endif
+    CHECK_EQ(bench_.storage.commits, 1);
+    CHECK_EQ(bench_.conf.getFailedGeneration(), 1);
+    CHECK_EQ(bench_.conf.getSavedGeneration(), 0);
+    CHECK(saveStatus(bench_) == "{\"generation\":1,\"saved\":0,\"failed\":1}");
+
+    bench_.storage.fail = false;
+    page_ = post(bench_, 2);
+    bench_.conf.doLoop();
+    CHECK_EQ(page_.code, 200);
+    CHECK_EQ(bench_.conf.getSavedGeneration(), 2);
+    CHECK(saveStatus(bench_) == "{\"generation\":2,\"saved\":2,\"failed\":1}");
+    CHECK_EQ(bench_.form.mismatches(2), 0);
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+}
+
+#if IOTWEBCONFASYNC_DEFER_SAVE
+TEST(saveWaitsForRender) {
+    SaveBench bench_;
+    CHECK_EQ(post(bench_, 1).code, 200);
+
+    // -- A render started before doLoop() ran keeps the save pending.
+    AsyncClient client_;
+    AsyncWebServerRequest* request_ = beginRequest(bench_, client_, HTTP_GET);
+    bench_.host.server.findHandler(request_)->handleRequest(request_);
+    uint8_t buffer_[64];
+    CHECK(request_->response()->fillBody(buffer_, sizeof(buffer_)) > 0);
+    bench_.conf.doLoop();
+    CHECK_EQ(bench_.conf.getSavedGeneration(), 0);
+    CHECK_EQ(bench_.form.mismatches(1), bench_.form.size());
+
+    HostPage page_ = finish(request_);
+    CHECK_EQ(page_.code, 200);
+    bench_.conf.doLoop();
+    CHECK_EQ(bench_.conf.getSavedGeneration(), 1);
+    CHECK_EQ(bench_.form.mismatches(1), 0);
+}
+
+TEST(saveDoesNotWaitForOpenConnections) {
+    SaveBench bench_;
+
+    // -- A page sent completely, its client keeps the connection open.
+    AsyncClient pageClient_;
+    AsyncWebServerRequest* page_ = beginRequest(bench_, pageClient_, HTTP_GET);
+    bench_.host.server.findHandler(page_)->handleRequest(page_);
+    uint8_t buffer_[1460];
+    size_t len_;
+    while ((len_ = page_->response()->fillBody(buffer_, sizeof(buffer_))) != 0) {
+        CHECK(len_ != RESPONSE_TRY_AGAIN);
+    }
+
+    // -- A save posted as body, the client keeps this connection open as well.
+    AsyncClient postClient_;
+    AsyncWebServerRequest* post_ = beginRequest(bench_, postClient_, HTTP_POST);
+    post_->setContentType("application/x-www-form-urlencoded");
+    std::string body_ = bench_.form.body(1);
+    post_->setContentLength(body_.size());
+    AsyncWebHandler* handler_ = bench_.host.server.findHandler(post_);
+    handler_->handleBody(post_, reinterpret_cast<uint8_t*>(&body_[0]), body_.size(), 0, body_.size());
+    handler_->handleRequest(post_);
+    CHECK_EQ(post_->response()->code(), 200);
+
+    bench_.conf.doLoop();
+    CHECK_EQ(bench_.conf.getSavedGeneration(), 1);
+    CHECK_EQ(bench_.form.mismatches(1), 0);
+    CHECK_EQ(bench_.conf.getActiveRenders(), 0);
+
+    finish(post_);
+    finish(page_);
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+}
+
+TEST(renderDuringSaveIsBusy) {
+    SaveBench bench_;
+    bench_.conf.hostSetSaving(true);
+    CHECK_EQ(hostFetch(bench_.host.server, "/config").code, 503);
+    bench_.conf.hostSetSaving(false);
+    CHECK_EQ(hostFetch(bench_.host.server, "/config").code, 200);
+    CHECK_EQ(bench_.conf.getActiveRenders(), 0);
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+}
+#endif
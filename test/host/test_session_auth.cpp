@@ -0,0 +1,152 @@
+/**
+ * Session tokens of AsyncSessionAuth. The MAC is checked against the reference
+ * vectors of SipHash-2-4, a token is only accepted from the client it was
+ * issued to, with the same credentials, before it expires and byte for byte.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+
+namespace {
+    const uint32_t LIFETIME = 600;
+
+    class HostSessionAuth : public AsyncSessionAuth {
+    public:
+        using AsyncSessionAuth::AsyncSessionAuth;
+        using AsyncSessionAuth::sipHash;
+    };
+
+    struct Session {
+        Session() : auth("iwc_session", LIFETIME) {}
+
+        /**
+         * Check a request of client that carries the cookie header and no credentials.
+         */
+        AsyncSessionAuth::Result check(AsyncClient& client, const std::string& cookie,
+            const char* username = "admin", const char* password = "password") {
+            AsyncWebServerRequest request_(&server, &client);
+            request_.setUrl("/config");
+            request_.setMethod(HTTP_GET);
+            if (!cookie.empty()) {
+                request_.addHeader("Cookie", cookie.c_str());
+            }
+            return auth.check(&request_, username, password);
+        }
+
+        /**
+         * Log in with the credentials, returns the token of the cookie sent back.
+         */
+        std::string login(AsyncClient& client) {
+            AsyncWebServerRequest request_(&server, &client);
+            request_.setUrl("/config");
+            request_.setMethod(HTTP_GET);
+            request_.addHeader("Authorization", HOST_AUTH_ADMIN);
+            if (!CHECK_EQ(auth.check(&request_, "admin", "password"), AsyncSessionAuth::SESSION_NEW)) {
+                return std::string();
+            }
+            std::string cookie_ = auth.createCookie(&request_, "admin", "password").c_str();
+            std::string prefix_ = "iwc_session=";
+            CHECK(cookie_.compare(0, prefix_.size(), prefix_) == 0);
+            CHECK(cookie_.find("; Max-Age=600; Path=/; HttpOnly; SameSite=Strict") == prefix_.size() + AsyncSessionAuth::TOKEN_LENGTH);
+            return cookie_.substr(prefix_.size(), AsyncSessionAuth::TOKEN_LENGTH);
+        }
+
+        AsyncWebServer server{ 80 };
+        HostSessionAuth auth;
+    };
+
+    std::vector<uint8_t> sequence(size_t len) {
+        std::vector<uint8_t> data_(len);
+        for (size_t i = 0; i < len; i++) {
+            data_[i] = static_cast<uint8_t>(i);
+        }
+        return data_;
+    }
+}
+
+TEST(sipHashReferenceVectors) {
+    // -- Key 00 01 .. 0f, message 00 01 .. len-1, from the SipHash reference implementation.
+    std::vector<uint8_t> key_ = sequence(16);
+    const struct {
+        size_t len;
+        uint64_t hash;
+    } vectors_[] = {
+        { 0, 0x726fdb47dd0e0e31ULL },
+        { 8, 0x93f5f5799a932462ULL },
+        { 15, 0xa129ca6149be45e5ULL },
+        { 63, 0x958a324ceb064572ULL }
+    };
+    for (const auto& vector_ : vectors_) {
+        std::vector<uint8_t> data_ = sequence(vector_.len);
+        CHECK_EQ(HostSessionAuth::sipHash(key_.data(), data_.data(), data_.size()), vector_.hash);
+    }
+}
+
+TEST(tokenRoundTrip) {
+    Session session_;
+    AsyncClient client_;
+    CHECK_EQ(session_.check(client_, std::string()), AsyncSessionAuth::SESSION_DENIED);
+    std::string token_ = session_.login(client_);
+    CHECK_EQ(token_.size(), AsyncSessionAuth::TOKEN_LENGTH);
+
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_), AsyncSessionAuth::SESSION_VALID);
+    // -- Other cookies around it, the name must match as a whole.
+    CHECK_EQ(session_.check(client_, "theme=dark; iwc_session=" + token_ + "; lang=en"), AsyncSessionAuth::SESSION_VALID);
+    CHECK_EQ(session_.check(client_, "xiwc_session=" + token_), AsyncSessionAuth::SESSION_DENIED);
+    CHECK_EQ(session_.check(client_, "iwc_update_session=" + token_), AsyncSessionAuth::SESSION_DENIED);
+
+    // -- Other credentials and a new key end the session.
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_, "admin", "changed"), AsyncSessionAuth::SESSION_DENIED);
+    session_.auth.reset();
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_), AsyncSessionAuth::SESSION_DENIED);
+}
+
+TEST(tokenExpires) {
+    Session session_;
+    AsyncClient client_;
+    std::string token_ = session_.login(client_);
+    hostAdvanceMicros((uint64_t)(LIFETIME - 2) * 1000000);
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_), AsyncSessionAuth::SESSION_VALID);
+    hostAdvanceMicros((uint64_t)2 * 1000000);
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_), AsyncSessionAuth::SESSION_DENIED);
+}
+
+TEST(tokenBoundToClientAddress) {
+    Session session_;
+    AsyncClient client_;
+    std::string token_ = session_.login(client_);
+    AsyncClient other_;
+    other_._remoteIP = IPAddress(192, 168, 4, 3);
+    CHECK_EQ(session_.check(other_, "iwc_session=" + token_), AsyncSessionAuth::SESSION_DENIED);
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_), AsyncSessionAuth::SESSION_VALID);
+}
+
+TEST(alteredTokenDenied) {
+    Session session_;
+    AsyncClient client_;
+    std::string token_ = session_.login(client_);
+
+    // -- Every digit changed on its own: expiry, nonce and both halves of the MAC.
+    uint32_t accepted_ = 0;
+    for (size_t i = 0; i < token_.size(); i++) {
+        std::string altered_ = token_;
+        altered_[i] = altered_[i] == '0' ? '1' : '0';
+        accepted_ += session_.check(client_, "iwc_session=" + altered_) != AsyncSessionAuth::SESSION_DENIED ? 1 : 0;
+    }
+    CHECK_EQ(accepted_, 0);
+
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_.substr(0, token_.size() - 1)), AsyncSessionAuth::SESSION_DENIED);
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_.substr(0, token_.size() - 1) + "; lang=en"), AsyncSessionAuth::SESSION_DENIED);
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_ + "0"), AsyncSessionAuth::SESSION_DENIED);
+    CHECK_EQ(session_.check(client_, "iwc_session="), AsyncSessionAuth::SESSION_DENIED);
+
+    // -- Only lower case hex is issued, anything else is not parsed.
+    std::string upper_ = token_;
+    for (char& c_ : upper_) {
+        c_ = static_cast<char>(toupper(c_));
+    }
+    if (upper_ != token_) {
+        CHECK_EQ(session_.check(client_, "iwc_session=" + upper_), AsyncSessionAuth::SESSION_DENIED);
+    }
+    CHECK_EQ(session_.check(client_, "iwc_session=" + token_), AsyncSessionAuth::SESSION_VALID);
+}
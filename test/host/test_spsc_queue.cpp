@@ -0,0 +1,127 @@
+/**
+ * Stress test of AsyncSpscQueue with a real producer and consumer thread.
+ * Both sides use random block sizes, so pushes and pops wrap around the ring
+ * at every offset. The bytes follow a pattern derived from their stream
+ * position, any lost, doubled or torn byte shows up at the consumer.
+ */
+
+#include "HostTest.h"
+#include "IotWebConfAsyncSpscQueue.h"
+
+#include <random>
+#include <thread>
+
+namespace {
+    uint8_t patternAt(size_t position) {
+        return static_cast<uint8_t>(position * 131 + (position >> 8));
+    }
+
+    size_t streamBytes() {
+        const char* bytes_ = getenv("IWC_SPSC_BYTES");
+        return bytes_ != nullptr ? static_cast<size_t>(strtoull(bytes_, nullptr, 0)) : 1500000;
+    }
+
+    struct Result {
+        size_t corruptAt = SIZE_MAX;
+        size_t received = 0;
+        size_t maxAvailable = 0;
+    };
+
+    Result runStream(AsyncSpscQueue& queue, size_t total, uint32_t seed) {
+        Result result_;
+        std::thread producer_([&]() {
+            std::mt19937 random_(seed);
+            uint8_t block_[300];
+            size_t position_ = 0;
+            while (position_ < total) {
+                size_t len_ = std::min<size_t>(random_() % sizeof(block_) + 1, total - position_);
+                for (size_t i = 0; i < len_; i++) {
+                    block_[i] = patternAt(position_ + i);
+                }
+                size_t offset_ = 0;
+                while (offset_ < len_) {
+                    size_t pushed_ = queue.push(block_ + offset_, len_ - offset_);
+                    offset_ += pushed_;
+                    if (pushed_ == 0) {
+                        std::this_thread::yield();
+                    }
+                }
+                position_ += len_;
+            }
+            });
+        std::thread consumer_([&]() {
+            std::mt19937 random_(seed + 1);
+            uint8_t block_[300];
+            size_t position_ = 0;
+            while (position_ < total) {
+                result_.maxAvailable = std::max(result_.maxAvailable, queue.available());
+                size_t len_ = queue.pop(block_, random_() % sizeof(block_) + 1);
+                if (len_ == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < len_ && result_.corruptAt == SIZE_MAX; i++) {
+                    if (block_[i] != patternAt(position_ + i)) {
+                        result_.corruptAt = position_ + i;
+                    }
+                }
+                position_ += len_;
+            }
+            result_.received = position_;
+            });
+        producer_.join();
+        consumer_.join();
+        return result_;
+    }
+}
+
+TEST(capacityRoundsUpToPowerOfTwo) {
+    CHECK_EQ(AsyncSpscQueue(1).capacity(), 1);
+    CHECK_EQ(AsyncSpscQueue(3).capacity(), 4);
+    CHECK_EQ(AsyncSpscQueue(64).capacity(), 64);
+    CHECK_EQ(AsyncSpscQueue(4097).capacity(), 8192);
+}
+
+TEST(pushStopsAtCapacity) {
+    AsyncSpscQueue queue_(8);
+    uint8_t data_[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    CHECK_EQ(queue_.push(data_, sizeof(data_)), 8);
+    CHECK_EQ(queue_.push(data_, 1), 0);
+    uint8_t out_[12];
+    CHECK_EQ(queue_.pop(out_, 5), 5);
+    // -- The next push wraps around the end of the ring.
+    CHECK_EQ(queue_.push(data_ + 8, 4), 4);
+    CHECK_EQ(queue_.pop(out_ + 5, sizeof(out_)), 7);
+    for (int i = 0; i < 8; i++) {
+        CHECK_EQ(out_[i], i + 1);
+    }
+    CHECK_EQ(out_[8], 9);
+    CHECK_EQ(out_[11], 12);
+    CHECK_EQ(queue_.available(), 0);
+}
+
+TEST(clearDropsQueuedBytes) {
+    AsyncSpscQueue queue_(16);
+    uint8_t data_[10] = {};
+    queue_.push(data_, sizeof(data_));
+    queue_.clear();
+    CHECK_EQ(queue_.available(), 0);
+    CHECK_EQ(queue_.push(data_, sizeof(data_)), 10);
+}
+
+TEST(threadedStream) {
+    size_t total_ = streamBytes();
+    uint32_t seed_ = HostTest::seed(1);
+    printf("seed %u\n", (unsigned int)seed_);
+    for (size_t capacity_ : { 1, 3, 64, 4096 }) {
+        AsyncSpscQueue queue_(capacity_);
+        Result result_ = runStream(queue_, total_, seed_);
+        if (!CHECK_EQ(result_.corruptAt, SIZE_MAX)) {
+            printf("capacity %u: corrupt byte at %zu\n", (unsigned int)capacity_, result_.corruptAt);
+        }
+        CHECK_EQ(result_.received, total_);
+        CHECK(result_.maxAvailable <= queue_.capacity());
+        CHECK_EQ(queue_.available(), 0);
+        printf("capacity %u: %zu bytes\n", (unsigned int)queue_.capacity(), result_.received);
+    }
+}
@@ -0,0 +1,48 @@
+/**
+ * The tab page must come out the same when the render arena cannot get a
+ * block: every chunk built in the arena falls back to the heap string.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+#include "IotWebConfAsyncTab.h"
+
+namespace {
+    // -- malloc() size of a regular arena block.
+    const size_t ARENA_BLOCK_ALLOCATION = sizeof(void*) + 2 * sizeof(size_t) + IOTWEBCONFASYNC_ARENA_BLOCK_SIZE;
+
+    struct TabBench {
+        TabBench() :
+            form(12, 4),
+            conf("thing", &host.dnsServer, &host.wrapper, "password", "tabs") {
+            conf.addParameterGroup(form.groups[0].get(), "Sensors");
+            conf.addParameterGroup(form.groups[1].get(), "Network");
+            conf.addParameterGroup(form.groups[2].get(), "Sensors");
+            conf.init();
+            conf.setupWebHandlers("/config");
+            conf.hostSetState(iotwebconf::OnLine);
+        }
+
+        HostServer host;
+        HostForm form;
+        AsyncIotWebConfTab conf;
+    };
+}
+
+TEST(tabPageWithoutArena) {
+    TabBench bench_;
+    HostPage expected_ = hostFetch(bench_.host.server, "/config");
+    CHECK_EQ(expected_.code, 200);
+    CHECK(expected_.body.find("<div class='tab'>") != std::string::npos);
+    CHECK(expected_.body.find("<div id='Network' class='tabcontent'") != std::string::npos);
+
+    HostHeap::failSize(ARENA_BLOCK_ALLOCATION);
+    uint32_t injected_ = HostHeap::injectedFailures();
+    HostPage page_ = hostFetch(bench_.host.server, "/config");
+    HostHeap::clearFailures();
+
+    CHECK(HostHeap::injectedFailures() > injected_);
+    CHECK_EQ(page_.code, 200);
+    CHECK(page_.body == expected_.body);
+    CHECK_EQ(AsyncWebRequestWrapper::getLiveCount(), 0);
+}
@@ -0,0 +1,164 @@
+/**
+ * Update bundles against the host flash. A bundle must only change the boot
+ * partition and reach the config handler once every section was verified,
+ * a failure in any section has to leave the device booting the running image.
+ */
+
+#include "HostTest.h"
+#include "IotWebConfAsyncUpdateServer.h"
+#include "IotWebConfAsyncBundle.h"
+
+#include <Update.h>
+
+namespace {
+    typedef std::vector<uint8_t> Bytes;
+
+    Bytes image(size_t size, uint8_t seed) {
+        Bytes image_(size);
+        for (size_t i = 0; i < size; i++) {
+            image_[i] = static_cast<uint8_t>(seed + i * 7);
+        }
+        // -- Firmware images start with the ESP image magic byte.
+        image_[0] = ESP_IMAGE_HEADER_MAGIC;
+        return image_;
+    }
+
+    struct Section {
+        uint8_t type;
+        Bytes payload;
+        bool corruptMd5;
+    };
+
+    Bytes bundle(const std::vector<Section>& sections) {
+        Bytes bundle_ = { 'I', 'W', 'C', 'B', IOTWEBCONFASYNC_BUNDLE_VERSION, static_cast<uint8_t>(sections.size()), 0, 0 };
+        for (const Section& section_ : sections) {
+            uint32_t size_ = section_.payload.size();
+            uint8_t header_[IOTWEBCONFASYNC_BUNDLE_SECTION_HEADER_SIZE] = { section_.type, 0, 0, 0,
+                static_cast<uint8_t>(size_), static_cast<uint8_t>(size_ >> 8), static_cast<uint8_t>(size_ >> 16), static_cast<uint8_t>(size_ >> 24) };
+            MD5Builder md5_;
+            md5_.begin();
+            md5_.add(section_.payload.data(), section_.payload.size());
+            md5_.calculate();
+            md5_.getBytes(header_ + 8);
+            if (section_.corruptMd5) {
+                header_[8] ^= 0xFF;
+            }
+            bundle_.insert(bundle_.end(), header_, header_ + sizeof(header_));
+            bundle_.insert(bundle_.end(), section_.payload.begin(), section_.payload.end());
+        }
+        return bundle_;
+    }
+
+    struct Run {
+        bool success;
+        String error;
+        uint32_t configCalls;
+        bool configSawOldBoot;
+    };
+
+    /**
+     * Stream a bundle in 512 byte pieces, the way AsyncUpdatePuller does.
+     */
+    Run stream(const Bytes& data, bool acceptConfig = true, size_t truncate = SIZE_MAX) {
+        AsyncUpdateServer server_;
+        Run run_{ false, String(), 0, false };
+        server_.onConfigSection([&](const uint8_t* config, size_t len) {
+            run_.configCalls++;
+            run_.configSawOldBoot = esp_ota_get_boot_partition() == HostFlash::partition(HostFlash::APP0);
+            return acceptConfig;
+            });
+        size_t size_ = std::min(truncate, data.size());
+        if (!server_.beginStream(data.size(), String())) {
+            return run_;
+        }
+        for (size_t pos_ = 0; pos_ < size_; pos_ += 512) {
+            if (!server_.writeStream(data.data() + pos_, std::min<size_t>(512, size_ - pos_))) {
+                server_.abortStream();
+                run_.error = server_.getUpdaterError();
+                return run_;
+            }
+        }
+        run_.success = server_.endStream();
+        run_.error = server_.getUpdaterError();
+        return run_;
+    }
+
+    const Bytes FIRMWARE = image(3000, 1);
+    const Bytes FILESYSTEM = image(5000, 2);
+    const Bytes CONFIG = { 'c', 'o', 'n', 'f', 'i', 'g' };
+
+    void reset() {
+        HostFlash::reset();
+        Update.hostReset();
+    }
+
+    bool bootsRunningImage() {
+        return esp_ota_get_boot_partition() == HostFlash::partition(HostFlash::APP0);
+    }
+}
+
+TEST(completeBundleActivatesAtTheEnd) {
+    reset();
+    Run run_ = stream(bundle({ { BUNDLE_SECTION_FIRMWARE, FIRMWARE, false }, { BUNDLE_SECTION_FILESYSTEM, FILESYSTEM, false },
+        { BUNDLE_SECTION_CONFIG, CONFIG, false } }));
+    CHECK(run_.success);
+    CHECK_EQ(run_.configCalls, 1);
+    // -- The config is applied before the new firmware becomes the boot partition.
+    CHECK(run_.configSawOldBoot);
+    CHECK(esp_ota_get_boot_partition() == HostFlash::partition(HostFlash::APP1));
+    CHECK(HostFlash::content(HostFlash::partition(HostFlash::APP1)) == FIRMWARE);
+    CHECK(HostFlash::content(HostFlash::partition(HostFlash::SPIFFS)) == FILESYSTEM);
+}
+
+TEST(firmwareFailure) {
+    reset();
+    Run run_ = stream(bundle({ { BUNDLE_SECTION_CONFIG, CONFIG, false }, { BUNDLE_SECTION_FIRMWARE, FIRMWARE, true } }));
+    CHECK(!run_.success);
+    CHECK_EQ(run_.configCalls, 0);
+    CHECK(bootsRunningImage());
+}
+
+TEST(filesystemFailureAfterFirmware) {
+    reset();
+    Update.failWriteAt = 4000;
+    Run run_ = stream(bundle({ { BUNDLE_SECTION_FIRMWARE, FIRMWARE, false }, { BUNDLE_SECTION_FILESYSTEM, FILESYSTEM, false },
+        { BUNDLE_SECTION_CONFIG, CONFIG, false } }));
+    CHECK(!run_.success);
+    CHECK_EQ(run_.configCalls, 0);
+    // -- The firmware was verified, but the bundle as a whole was not.
+    CHECK(bootsRunningImage());
+}
+
+TEST(filesystemMd5Failure) {
+    reset();
+    Run run_ = stream(bundle({ { BUNDLE_SECTION_FIRMWARE, FIRMWARE, false }, { BUNDLE_SECTION_FILESYSTEM, FILESYSTEM, true } }));
+    CHECK(!run_.success);
+    CHECK(bootsRunningImage());
+}
+
+TEST(configMd5Failure) {
+    reset();
+    Run run_ = stream(bundle({ { BUNDLE_SECTION_FIRMWARE, FIRMWARE, false }, { BUNDLE_SECTION_CONFIG, CONFIG, true } }));
+    CHECK(!run_.success);
+    CHECK_EQ(run_.configCalls, 0);
+    CHECK(bootsRunningImage());
+    CHECK(run_.error.indexOf("MD5") >= 0);
+}
+
+TEST(configRejectedByHandler) {
+    reset();
+    Run run_ = stream(bundle({ { BUNDLE_SECTION_FIRMWARE, FIRMWARE, false }, { BUNDLE_SECTION_CONFIG, CONFIG, false } }), false);
+    CHECK(!run_.success);
+    CHECK_EQ(run_.configCalls, 1);
+    CHECK(bootsRunningImage());
+    CHECK(run_.error.indexOf("rejected") >= 0);
+}
+
+TEST(truncatedBundle) {
+    reset();
+    Bytes data_ = bundle({ { BUNDLE_SECTION_FIRMWARE, FIRMWARE, false }, { BUNDLE_SECTION_CONFIG, CONFIG, false } });
+    Run run_ = stream(data_, true, data_.size() - 3);
+    CHECK(!run_.success);
+    CHECK_EQ(run_.configCalls, 0);
+    CHECK(bootsRunningImage());
+}
@@ -0,0 +1,351 @@
+/**
+ * AsyncUpdatePuller against an HTTP server on the loopback interface. The
+ * server drops connections and ignores ranges on request, so the resume
+ * paths run on real sockets. The download runs on the host clock, one
+ * millisecond per loop() call, which makes the bandwidth cap measurable.
+ */
+
+#include "HostTest.h"
+#include "IotWebConfAsyncUpdatePuller.h"
+
+#include <Update.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+    typedef std::vector<uint8_t> Bytes;
+
+    /**
+     * Serves /manifest.txt and /fw.bin, one connection at a time.
+     */
+    class HttpStandIn {
+    public:
+        struct Request {
+            std::string path;
+            std::string range;
+        };
+
+        HttpStandIn() {
+            _fd = socket(AF_INET, SOCK_STREAM, 0);
+            int one_ = 1;
+            setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one_, sizeof(one_));
+            sockaddr_in address_{};
+            address_.sin_family = AF_INET;
+            address_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(_fd, reinterpret_cast<sockaddr*>(&address_), sizeof(address_));
+            socklen_t length_ = sizeof(address_);
+            getsockname(_fd, reinterpret_cast<sockaddr*>(&address_), &length_);
+            _port = ntohs(address_.sin_port);
+            listen(_fd, 4);
+            _thread = std::thread([this]() { serve(); });
+        }
+
+        ~HttpStandIn() {
+            _stop = true;
+            _thread.join();
+            close(_fd);
+        }
+
+        String url(const char* path) const {
+            return String("http://127.0.0.1:") + String(_port) + path;
+        }
+
+        std::vector<Request> requests() {
+            std::lock_guard<std::mutex> lock_(_mutex);
+            return _requests;
+        }
+
+        size_t imageRequests() {
+            size_t count_ = 0;
+            for (const Request& request_ : requests()) {
+                count_ += request_.path == "/fw.bin" ? 1 : 0;
+            }
+            return count_;
+        }
+
+        std::string manifest;
+        Bytes image;
+        bool ignoreRange = false;
+        // -- Image body bytes sent before the n-th image response is cut off.
+        std::vector<size_t> dropAfter;
+
+    private:
+        int _fd;
+        uint16_t _port;
+        std::atomic<bool> _stop{ false };
+        std::thread _thread;
+        std::mutex _mutex;
+        std::vector<Request> _requests;
+        size_t _imageResponses = 0;
+
+        void serve() {
+            while (!_stop) {
+                pollfd poll_{ _fd, POLLIN, 0 };
+                if (poll(&poll_, 1, 10) <= 0) {
+                    continue;
+                }
+                int client_ = accept(_fd, nullptr, nullptr);
+                if (client_ >= 0) {
+                    handle(client_);
+                    close(client_);
+                }
+            }
+        }
+
+        void handle(int client) {
+            std::string head_;
+            char c_;
+            while (head_.find("\r\n\r\n") == std::string::npos && recv(client, &c_, 1, 0) == 1) {
+                head_ += c_;
+            }
+            Request request_;
+            size_t pathStart_ = head_.find(' ') + 1;
+            request_.path = head_.substr(pathStart_, head_.find(' ', pathStart_) - pathStart_);
+            size_t range_ = head_.find("Range: bytes=");
+            if (range_ != std::string::npos) {
+                request_.range = head_.substr(range_ + 13, head_.find("\r\n", range_) - range_ - 13);
+            }
+            {
+                std::lock_guard<std::mutex> lock_(_mutex);
+                _requests.push_back(request_);
+            }
+
+            if (request_.path == "/manifest.txt") {
+                respond(client, "200 OK", "", reinterpret_cast<const uint8_t*>(manifest.data()), manifest.size(), SIZE_MAX);
+            }
+            else if (request_.path == "/fw.bin") {
+                size_t drop_ = _imageResponses < dropAfter.size() ? dropAfter[_imageResponses] : SIZE_MAX;
+                _imageResponses++;
+                size_t offset_ = request_.range.empty() || ignoreRange ? 0 : strtoul(request_.range.c_str(), nullptr, 10);
+                if (offset_ > 0) {
+                    std::string contentRange_ = "Content-Range: bytes " + std::to_string(offset_) + "-" +
+                        std::to_string(image.size() - 1) + "/" + std::to_string(image.size()) + "\r\n";
+                    respond(client, "206 Partial Content", contentRange_, image.data() + offset_, image.size() - offset_, drop_);
+                }
+                else {
+                    respond(client, "200 OK", "", image.data(), image.size(), drop_);
+                }
+            }
+            else {
+                respond(client, "404 Not Found", "", nullptr, 0, SIZE_MAX);
+            }
+        }
+
+        void respond(int client, const char* status, const std::string& headers, const uint8_t* body, size_t length, size_t drop) {
+            std::string head_ = std::string("HTTP/1.1 ") + status + "\r\nContent-Length: " + std::to_string(length) +
+                "\r\nConnection: close\r\n" + headers + "\r\n";
+            send(client, head_.data(), head_.size(), MSG_NOSIGNAL);
+            size_t sent_ = 0;
+            size_t end_ = std::min(length, drop);
+            while (sent_ < end_) {
+                ssize_t result_ = send(client, body + sent_, end_ - sent_, MSG_NOSIGNAL);
+                if (result_ <= 0) {
+                    return;
+                }
+                sent_ += result_;
+            }
+        }
+    };
+
+    Bytes firmware(size_t size) {
+        Bytes image_(size);
+        for (size_t i = 0; i < size; i++) {
+            image_[i] = static_cast<uint8_t>(i * 13 + (i >> 9));
+        }
+        image_[0] = ESP_IMAGE_HEADER_MAGIC;
+        return image_;
+    }
+
+    std::string md5Hex(const Bytes& data) {
+        MD5Builder md5_;
+        md5_.begin();
+        md5_.add(data.data(), data.size());
+        md5_.calculate();
+        return md5_.toString().c_str();
+    }
+
+    std::string manifestFor(const Bytes& image, const char* version = "2.0.0", const char* url = "fw.bin") {
+        return std::string("version=") + version + "\nurl=" + url + "\nsize=" + std::to_string(image.size()) +
+            "\nmd5=" + md5Hex(image) + "\n";
+    }
+
+    struct Pull {
+        AsyncUpdateServer updater;
+        AsyncUpdatePuller puller{ updater };
+        // -- Largest amount written by one loop() call and the host time of the download.
+        size_t largestStep = 0;
+        unsigned long startMs = 0;
+        unsigned long endMs = 0;
+
+        void run(HttpStandIn& server, uint32_t maxLoops = 200000) {
+            HostFlash::reset();
+            Update.hostReset();
+            puller.begin(server.url("/manifest.txt"), "1.0.0");
+            startMs = millis();
+            for (uint32_t i = 0; i < maxLoops && puller.isRunning(); i++) {
+                size_t before_ = puller.getProgress();
+                puller.loop();
+                largestStep = std::max(largestStep, puller.getProgress() - before_);
+                // -- Waiting for a retry does not need to take real time.
+                hostAdvanceMicros(puller.getState() == AsyncUpdatePuller::PULL_CONNECT ? 100000 : 1000);
+                std::this_thread::sleep_for(std::chrono::microseconds(10));
+            }
+            endMs = millis();
+        }
+    };
+
+    bool flashed(const Bytes& image) {
+        return esp_ota_get_boot_partition() == HostFlash::partition(HostFlash::APP1) &&
+            HostFlash::content(HostFlash::partition(HostFlash::APP1)) == image;
+    }
+}
+
+TEST(upToDate) {
+    HttpStandIn server_;
+    server_.image = firmware(4000);
+    server_.manifest = manifestFor(server_.image, "1.0.0");
+    Pull pull_;
+    pull_.run(server_);
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_UP_TO_DATE);
+    CHECK_EQ(server_.imageRequests(), 0);
+}
+
+TEST(invalidManifest) {
+    HttpStandIn server_;
+    server_.image = firmware(4000);
+    server_.manifest = "version=2.0.0\nurl=fw.bin\nsize=4000\n";
+    Pull pull_;
+    pull_.run(server_);
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_FAILED);
+    CHECK(pull_.puller.getError() == "Invalid manifest");
+    CHECK_EQ(server_.imageRequests(), 0);
+}
+
+TEST(manifestWithoutMd5AfterAnother) {
+    // -- The md5 of the first manifest must not stand in for the missing one of the second.
+    HttpStandIn server_;
+    server_.image = firmware(4000);
+    server_.manifest = manifestFor(server_.image, "1.0.0");
+    Pull pull_;
+    pull_.run(server_);
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_UP_TO_DATE);
+    server_.manifest = "version=2.0.0\nurl=fw.bin\nsize=4000\n";
+    pull_.run(server_);
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_FAILED);
+    CHECK(pull_.puller.getError() == "Invalid manifest");
+    CHECK_EQ(server_.imageRequests(), 0);
+}
+
+TEST(sizeNotPositive) {
+    HttpStandIn server_;
+    server_.image = firmware(4000);
+    for (const char* size_ : { "-4000", "0", "none" }) {
+        server_.manifest = std::string("version=2.0.0\nurl=fw.bin\nsize=") + size_ + "\nmd5=" +
+            md5Hex(server_.image) + "\n";
+        Pull pull_;
+        pull_.run(server_);
+        CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_FAILED);
+        CHECK(pull_.puller.getError() == "Invalid manifest");
+        CHECK_EQ(pull_.puller.getSize(), 0);
+    }
+    CHECK_EQ(server_.imageRequests(), 0);
+}
+
+TEST(missingManifest) {
+    HttpStandIn server_;
+    Pull pull_;
+    HostFlash::reset();
+    pull_.puller.begin(server_.url("/missing.txt"), "1.0.0");
+    pull_.puller.loop();
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_FAILED);
+    CHECK(pull_.puller.getError().indexOf("404") >= 0);
+}
+
+TEST(plainDownload) {
+    HttpStandIn server_;
+    server_.image = firmware(50000);
+    // -- An absolute path, resolved against the manifest host.
+    server_.manifest = manifestFor(server_.image, "2.0.0", "/fw.bin");
+    Pull pull_;
+    pull_.run(server_);
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_DONE);
+    CHECK(pull_.updater.isFinished());
+    CHECK(flashed(server_.image));
+    std::vector<HttpStandIn::Request> requests_ = server_.requests();
+    CHECK_EQ(requests_.size(), 2);
+    CHECK(requests_.back().range.empty());
+}
+
+TEST(resumeWithRange) {
+    HttpStandIn server_;
+    server_.image = firmware(60000);
+    server_.manifest = manifestFor(server_.image);
+    server_.dropAfter = { 10000, 25000 };
+    Pull pull_;
+    pull_.run(server_);
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_DONE);
+    CHECK(flashed(server_.image));
+
+    // -- Every resume asks for the rest, starting at what was written.
+    std::vector<HttpStandIn::Request> requests_ = server_.requests();
+    if (CHECK_EQ(requests_.size(), 4)) {
+        CHECK(requests_[1].range.empty());
+        CHECK(requests_[2].range == "10000-");
+        CHECK(requests_[3].range == "35000-");
+    }
+}
+
+TEST(serverIgnoresRange) {
+    HttpStandIn server_;
+    server_.image = firmware(60000);
+    server_.manifest = manifestFor(server_.image);
+    server_.ignoreRange = true;
+    server_.dropAfter = { 20000 };
+    Pull pull_;
+    pull_.run(server_);
+    // -- The full image comes again, the part already written is skipped.
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_DONE);
+    CHECK(flashed(server_.image));
+    CHECK_EQ(server_.imageRequests(), 2);
+}
+
+TEST(retriesExhausted) {
+    HttpStandIn server_;
+    server_.image = firmware(20000);
+    server_.manifest = manifestFor(server_.image);
+    server_.dropAfter = std::vector<size_t>(IOTWEBCONFASYNCUPDATE_PULL_MAX_RETRIES + 1, 0);
+    Pull pull_;
+    pull_.run(server_);
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_FAILED);
+    CHECK(pull_.puller.getError().startsWith("Connection lost"));
+    CHECK_EQ(server_.imageRequests(), IOTWEBCONFASYNCUPDATE_PULL_MAX_RETRIES + 1);
+    CHECK(!pull_.updater.isUpdating());
+    CHECK(esp_ota_get_boot_partition() == HostFlash::partition(HostFlash::APP0));
+}
+
+TEST(bandwidthCap) {
+    const uint32_t bandwidth_ = 20000;
+    HttpStandIn server_;
+    server_.image = firmware(60000);
+    server_.manifest = manifestFor(server_.image);
+    Pull pull_;
+    pull_.puller.setBandwidth(bandwidth_);
+    pull_.run(server_);
+    CHECK_EQ(pull_.puller.getState(), AsyncUpdatePuller::PULL_DONE);
+    CHECK(flashed(server_.image));
+
+    // -- The token bucket holds at most one buffer, apart from that the rate is capped.
+    unsigned long elapsedMs_ = pull_.endMs - pull_.startMs;
+    unsigned long minimumMs_ = (server_.image.size() - IOTWEBCONFASYNCUPDATE_PULL_BUFFER_SIZE) * 1000ULL / bandwidth_;
+    printf("60000 bytes at %u B/s: %lu ms, largest step %zu\n", (unsigned int)bandwidth_, elapsedMs_, pull_.largestStep);
+    CHECK(elapsedMs_ >= minimumMs_);
+    CHECK(elapsedMs_ < minimumMs_ * 3 / 2);
+    CHECK(pull_.largestStep <= IOTWEBCONFASYNCUPDATE_PULL_BUFFER_SIZE);
+}
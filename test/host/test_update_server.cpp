@@ -0,0 +1,312 @@
+/**
+ * AsyncUpdateServer lifetime, serial output and boot verification.
+ */
+
+#include "HostTest.h"
+#include "HostFixture.h"
+#include "IotWebConfAsyncUpdateServer.h"
+
+#include <Update.h>
+#include <memory>
+
+namespace {
+    // -- Stream half of an image and let loop() report the progress.
+    std::string progressOutput(bool serialDebug) {
+        HostFlash::reset();
+        Update.hostReset();
+        AsyncWebServer server_(80);
+        AsyncUpdateServer updater_(serialDebug);
+        updater_.setup(&server_);
+        std::vector<uint8_t> image_(4000, 0x11);
+        image_[0] = ESP_IMAGE_HEADER_MAGIC;
+        updater_.beginStream(image_.size() * 2, String());
+        updater_.writeStream(image_.data(), image_.size());
+
+        Serial.capture = true;
+        Serial.output.clear();
+        hostAdvanceMicros(IOTWEBCONFASYNCUPDATE_PROGRESS_INTERVAL_MS * 1000);
+        updater_.loop();
+        Serial.capture = false;
+        updater_.abortStream();
+        return Serial.output;
+    }
+
+    const unsigned long HEALTH_TIMEOUT_MS = 30000;
+
+    // -- The running image app1 was just flashed and waits for verification.
+    void bootNewImage() {
+        HostFlash::reset();
+        Update.hostReset();
+        HostFlash::setRunning(HostFlash::partition(HostFlash::APP1));
+        HostFlash::setState(HostFlash::partition(HostFlash::APP1), ESP_OTA_IMG_PENDING_VERIFY);
+    }
+
+    esp_ota_img_states_t stateOf(HostFlash::Partition partition) {
+        esp_ota_img_states_t state_ = ESP_OTA_IMG_UNDEFINED;
+        esp_ota_get_state_partition(HostFlash::partition(partition), &state_);
+        return state_;
+    }
+
+    std::string status(AsyncWebServer& server) {
+        HostPage page_ = hostFetch(server, "/update/status", 1460, nullptr);
+        CHECK_EQ(page_.code, 200);
+        return page_.body;
+    }
+}
+
+TEST(progressOnlyWithSerialDebug) {
+    CHECK(progressOutput(false).find("Progress:") == std::string::npos);
+    CHECK(progressOutput(true).find("Progress: 50%") != std::string::npos);
+}
+
+TEST(uploadLogsOnlyWithSerialDebug) {
+    for (bool serialDebug_ : { false, true }) {
+        HostFlash::reset();
+        Update.hostReset();
+        AsyncWebServer server_(80);
+        AsyncUpdateServer updater_(serialDebug_);
+        updater_.setup(&server_, "/update");
+        std::vector<uint8_t> image_(4000, 0x22);
+        image_[0] = ESP_IMAGE_HEADER_MAGIC;
+        AsyncClient firstClient_;
+        AsyncClient secondClient_;
+        std::unique_ptr<AsyncWebServerRequest> first_(new AsyncWebServerRequest(&server_, &firstClient_));
+        std::unique_ptr<AsyncWebServerRequest> second_(new AsyncWebServerRequest(&server_, &secondClient_));
+        for (AsyncWebServerRequest* request_ : { first_.get(), second_.get() }) {
+            request_->setUrl("/update");
+            request_->setMethod(HTTP_POST);
+            request_->setContentLength(image_.size());
+        }
+        AsyncWebHandler* handler_ = server_.findHandler(first_.get());
+
+        Serial.capture = true;
+        Serial.output.clear();
+        handler_->handleUpload(first_.get(), "firmware.bin", 0, image_.data(), 100, false);
+        handler_->handleUpload(second_.get(), "firmware.bin", 0, image_.data(), 100, false);
+        handler_->handleUpload(first_.get(), "firmware.bin", 100, image_.data() + 100, image_.size() - 100, true);
+        handler_->handleRequest(first_.get());
+        Serial.capture = false;
+        CHECK(updater_.isFinished());
+        if (serialDebug_) {
+            CHECK(Serial.output.find("Update started...") != std::string::npos);
+            CHECK(Serial.output.find("another update is running") != std::string::npos);
+        }
+        else {
+            CHECK(Serial.output.empty());
+        }
+    }
+}
+
+TEST(serverOwnsEventSource) {
+    // -- Either may go first, the event source is deleted once, by the server.
+    {
+        std::unique_ptr<AsyncWebServer> server_(new AsyncWebServer(80));
+        std::unique_ptr<AsyncUpdateServer> updater_(new AsyncUpdateServer());
+        updater_->setup(server_.get());
+        updater_.reset();
+        server_.reset();
+    }
+    {
+        std::unique_ptr<AsyncWebServer> server_(new AsyncWebServer(80));
+        std::unique_ptr<AsyncUpdateServer> updater_(new AsyncUpdateServer());
+        updater_->setup(server_.get());
+        server_.reset();
+        updater_.reset();
+    }
+    CHECK(true);
+}
+
+TEST(pendingImageConfirmed) {
+    bootNewImage();
+    bool healthy_ = false;
+    AsyncWebServer server_(80);
+    AsyncUpdateServer updater_;
+    updater_.setHealthCheck([&healthy_]() { return healthy_; }, HEALTH_TIMEOUT_MS);
+    updater_.setup(&server_, "/update");
+    CHECK_EQ(updater_.getBootState(), AsyncUpdateServer::BOOT_PENDING_VERIFY);
+    CHECK(status(server_) == "{\"boot\":\"pending\",\"updating\":false,\"finished\":false,\"partition\":\"app1\",\"error\":\"\"}");
+
+    updater_.loop();
+    CHECK_EQ(updater_.getBootState(), AsyncUpdateServer::BOOT_PENDING_VERIFY);
+    healthy_ = true;
+    hostAdvanceMicros((HEALTH_TIMEOUT_MS / 2) * 1000);
+    updater_.loop();
+    CHECK_EQ(updater_.getBootState(), AsyncUpdateServer::BOOT_CONFIRMED);
+    CHECK_EQ(stateOf(HostFlash::APP1), ESP_OTA_IMG_VALID);
+    CHECK(status(server_).find("\"boot\":\"confirmed\"") != std::string::npos);
+
+    // -- Past the timeout a confirmed image stays.
+    uint32_t restarts_ = ESP.restarts;
+    hostAdvanceMicros(HEALTH_TIMEOUT_MS * 2000);
+    updater_.loop();
+    CHECK_EQ(updater_.getBootState(), AsyncUpdateServer::BOOT_CONFIRMED);
+    CHECK_EQ(ESP.restarts, restarts_);
+}
+
+TEST(pendingImageRolledBack) {
+    bootNewImage();
+    AsyncWebServer server_(80);
+    AsyncUpdateServer updater_;
+    updater_.setHealthCheck([]() { return false; }, HEALTH_TIMEOUT_MS);
+    updater_.setup(&server_, "/update");
+    uint32_t restarts_ = ESP.restarts;
+    updater_.loop();
+    CHECK_EQ(updater_.getBootState(), AsyncUpdateServer::BOOT_PENDING_VERIFY);
+    CHECK_EQ(ESP.restarts, restarts_);
+
+    hostAdvanceMicros((HEALTH_TIMEOUT_MS + 1) * 1000);
+    updater_.loop();
+    CHECK_EQ(updater_.getBootState(), AsyncUpdateServer::BOOT_ROLLED_BACK);
+    CHECK_EQ(ESP.restarts, restarts_ + 1);
+    CHECK_EQ(stateOf(HostFlash::APP1), ESP_OTA_IMG_INVALID);
+    CHECK(esp_ota_get_boot_partition() == HostFlash::partition(HostFlash::APP0));
+
+    // -- Once rolled back the health check is not run again.
+    updater_.loop();
+    CHECK_EQ(ESP.restarts, restarts_ + 1);
+
+    // -- The previous image reports the rollback after the reboot.
+    HostFlash::setRunning(HostFlash::partition(HostFlash::APP0));
+    AsyncWebServer rebooted_(80);
+    AsyncUpdateServer previous_;
+    previous_.setup(&rebooted_, "/update");
+    CHECK_EQ(previous_.getBootState(), AsyncUpdateServer::BOOT_ROLLED_BACK);
+    CHECK(status(rebooted_) == "{\"boot\":\"rolledback\",\"updating\":false,\"finished\":false,\"partition\":\"app0\",\"error\":\"Previous update was rolled back\"}");
+}
+
+TEST(failedRollbackIsNotRepeated) {
+    bootNewImage();
+    HostFlash::setRollbackError(ESP_FAIL);
+    AsyncWebServer server_(80);
+    AsyncUpdateServer updater_;
+    int checks_ = 0;
+    updater_.setHealthCheck([&checks_]() { checks_++; return false; }, HEALTH_TIMEOUT_MS);
+    updater_.setup(&server_, "/update");
+    uint32_t restarts_ = ESP.restarts;
+    hostAdvanceMicros((HEALTH_TIMEOUT_MS + 1) * 1000);
+    updater_.loop();
+    CHECK_EQ(updater_.getBootState(), AsyncUpdateServer::BOOT_ROLLBACK_FAILED);
+    CHECK(updater_.getUpdaterError() == "Rollback failed: -1");
+    int afterRollback_ = checks_;
+    for (int i = 0; i < 10; i++) {
+        updater_.loop();
+    }
+    CHECK_EQ(checks_, afterRollback_);
+    CHECK_EQ(ESP.restarts, restarts_);
+    CHECK_EQ(stateOf(HostFlash::APP1), ESP_OTA_IMG_PENDING_VERIFY);
+    CHECK(status(server_) == "{\"boot\":\"rollbackfailed\",\"updating\":false,\"finished\":false,\"partition\":\"app1\",\"error\":\"Rollback failed: -1\"}");
+    HostFlash::reset();
+}
+
+TEST(concurrentUploadRejected) {
+    HostFlash::reset();
+    Update.hostReset();
+    AsyncWebServer server_(80);
+    AsyncUpdateServer updater_;
+    updater_.setup(&server_, "/update");
+    std::vector<uint8_t> image_(4000);
+    for (size_t i = 0; i < image_.size(); i++) {
+        image_[i] = static_cast<uint8_t>(i * 7);
+    }
+    image_[0] = ESP_IMAGE_HEADER_MAGIC;
+    const size_t half_ = image_.size() / 2;
+
+    AsyncClient firstClient_;
+    AsyncClient secondClient_;
+    std::unique_ptr<AsyncWebServerRequest> first_(new AsyncWebServerRequest(&server_, &firstClient_));
+    std::unique_ptr<AsyncWebServerRequest> second_(new AsyncWebServerRequest(&server_, &secondClient_));
+    for (AsyncWebServerRequest* request_ : { first_.get(), second_.get() }) {
+        request_->setUrl("/update");
+        request_->setMethod(HTTP_POST);
+        request_->setContentLength(image_.size());
+    }
+    AsyncWebHandler* handler_ = server_.findHandler(first_.get());
+    CHECK(handler_ != nullptr);
+
+    handler_->handleUpload(first_.get(), "firmware.bin", 0, image_.data(), half_, false);
+    CHECK(updater_.isUpdating());
+
+    // -- The second upload gets 409 right away, its data is dropped.
+    std::vector<uint8_t> other_(image_.size(), 0xAA);
+    other_[0] = ESP_IMAGE_HEADER_MAGIC;
+    handler_->handleUpload(second_.get(), "firmware.bin", 0, other_.data(), half_, false);
+    CHECK(second_->response() != nullptr && second_->response()->code() == 409);
+    handler_->handleUpload(second_.get(), "firmware.bin", half_, other_.data() + half_, other_.size() - half_, true);
+    second_->disconnect();
+    CHECK(updater_.isUpdating());
+    CHECK(first_->response() == nullptr);
+    CHECK_EQ(updater_.getProgress().written, half_);
+
+    // -- The first one is written as if it had been alone.
+    handler_->handleUpload(first_.get(), "firmware.bin", half_, image_.data() + half_, image_.size() - half_, true);
+    CHECK(updater_.isFinished());
+    CHECK(!updater_.isUpdating());
+    CHECK(updater_.getUpdaterError() == "");
+    CHECK(first_->response() != nullptr && first_->response()->code() == 200);
+    CHECK(esp_ota_get_boot_partition() == HostFlash::partition(HostFlash::APP1));
+    CHECK(HostFlash::content(HostFlash::partition(HostFlash::APP1)) == image_);
+}
+
+namespace {
+    /**
+     * Response of a GET request, nullptr if it was not answered.
+     */
+    AsyncWebServerResponse* get(AsyncWebServer& server, AsyncWebServerRequest& request, const char* url,
+        const char* authorization, const std::string& cookie) {
+        request.setUrl(url);
+        request.setMethod(HTTP_GET);
+        if (authorization != nullptr) {
+            request.addHeader("Authorization", authorization);
+        }
+        if (!cookie.empty()) {
+            request.addHeader("Cookie", cookie.c_str());
+        }
+        AsyncWebHandler* handler_ = server.findHandler(&request);
+        if (handler_ == nullptr) {
+            return nullptr;
+        }
+        handler_->handleRequest(&request);
+        return request.response();
+    }
+
+    int eventsCode(AsyncWebServer& server, const char* authorization, const std::string& cookie = std::string()) {
+        AsyncClient client_;
+        AsyncWebServerRequest request_(&server, &client_);
+        AsyncWebServerResponse* response_ = get(server, request_, "/update/events", authorization, cookie);
+        return response_ != nullptr ? response_->code() : 0;
+    }
+}
+
+TEST(eventsAcceptSessionCookie) {
+    AsyncWebServer server_(80);
+    std::unique_ptr<AsyncUpdateServer> updater_(new AsyncUpdateServer());
+    updater_->setup(&server_, "/update", "admin", "password");
+    CHECK_EQ(eventsCode(server_, nullptr), 401);
+    CHECK_EQ(eventsCode(server_, "Basic d3Jvbmc6d3Jvbmc="), 401);
+    CHECK_EQ(eventsCode(server_, HOST_AUTH_ADMIN), 200);
+
+    // -- The cookie the form page sent is enough for the event stream.
+    std::string cookie_;
+    {
+        AsyncClient client_;
+        AsyncWebServerRequest request_(&server_, &client_);
+        AsyncWebServerResponse* response_ = get(server_, request_, "/update", HOST_AUTH_ADMIN, std::string());
+        const String* setCookie_ = response_ != nullptr ? response_->header("Set-Cookie") : nullptr;
+        if (CHECK(setCookie_ != nullptr)) {
+            cookie_ = setCookie_->c_str();
+            cookie_ = cookie_.substr(0, cookie_.find(';'));
+        }
+    }
+    CHECK(cookie_.find("iwc_update_session=") == 0);
+    CHECK_EQ(eventsCode(server_, nullptr, cookie_), 200);
+    CHECK_EQ(eventsCode(server_, nullptr, "iwc_update_session=00000000000000000000000000000000"), 401);
+
+    // -- New credentials end the session.
+    updater_->updateCredentials("admin", "changed");
+    CHECK_EQ(eventsCode(server_, nullptr, cookie_), 401);
+    CHECK_EQ(eventsCode(server_, HOST_AUTH_ADMIN), 401);
+
+    // -- The server keeps the handler after the update server is gone.
+    updater_.reset();
+    CHECK_EQ(eventsCode(server_, HOST_AUTH_ADMIN), 404);
+}
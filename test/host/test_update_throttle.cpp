@@ -0,0 +1,98 @@
+/**
+ * Write rate limit of uploads. The upload callback runs in the async TCP task
+ * and must never pause it: data received ahead of the rate is left
+ * unacknowledged and loop() acknowledges it when the rate allows.
+ */
+
+#include "HostTest.h"
+#include "IotWebConfAsyncUpdateServer.h"
+
+#include <Update.h>
+
+namespace {
+    const size_t CHUNK = 1000;
+
+    struct Upload {
+        Upload() {
+            HostFlash::reset();
+            Update.hostReset();
+            hostSetMicrosStep(0);
+            updater.setup(&server);
+            updater.setWriteRate(10000);
+            request = new AsyncWebServerRequest(&server, &client);
+            request->setUrl("/update");
+            request->setMethod(HTTP_POST);
+            request->setContentLength(100000);
+            handler = server.findHandler(request);
+            image.assign(CHUNK, 0x55);
+            image[0] = ESP_IMAGE_HEADER_MAGIC;
+        }
+
+        ~Upload() {
+            delete request;
+        }
+
+        // -- One upload callback, accounted by the client as AsyncTCP does after it returned.
+        void receive(size_t index) {
+            handler->handleUpload(request, "firmware.bin", index, image.data(), image.size(), false);
+            client.received(image.size());
+        }
+
+        AsyncWebServer server{ 80 };
+        AsyncUpdateServer updater;
+        AsyncClient client;
+        AsyncWebServerRequest* request;
+        AsyncWebHandler* handler;
+        std::vector<uint8_t> image;
+    };
+}
+
+TEST(throttleDefersAcknowledge) {
+    Upload upload_;
+    uint32_t delays_ = hostDelayCalls();
+
+    // -- 5000 bytes at 10000 B/s are due after 500 ms, they arrive at once.
+    for (size_t i = 0; i < 5; i++) {
+        upload_.receive(i * CHUNK);
+    }
+    CHECK_EQ(hostDelayCalls(), delays_);
+    CHECK_EQ(upload_.client._unacked, 5 * CHUNK);
+
+    hostAdvanceMicros(400000);
+    upload_.updater.loop();
+    CHECK_EQ(upload_.client._unacked, 5 * CHUNK);
+
+    hostAdvanceMicros(100000);
+    upload_.updater.loop();
+    CHECK_EQ(upload_.client._unacked, 0);
+
+    // -- Data within the rate is acknowledged right away.
+    hostAdvanceMicros(200000);
+    upload_.receive(5 * CHUNK);
+    CHECK_EQ(upload_.client._unacked, 0);
+    CHECK_EQ(hostDelayCalls(), delays_);
+}
+
+TEST(disconnectDropsPendingAcknowledge) {
+    Upload upload_;
+    upload_.receive(0);
+    upload_.receive(CHUNK);
+    CHECK(upload_.client._unacked > 0);
+    size_t unacked_ = upload_.client._unacked;
+
+    upload_.request->disconnect();
+    CHECK(!upload_.updater.isUpdating());
+    // -- The client is gone, loop() must not acknowledge it anymore.
+    hostAdvanceMicros(1000000);
+    upload_.updater.loop();
+    CHECK_EQ(upload_.client._unacked, unacked_);
+}
+
+TEST(unlimitedRateAcknowledgesAll) {
+    Upload upload_;
+    upload_.updater.setWriteRate(0);
+    for (size_t i = 0; i < 5; i++) {
+        upload_.receive(i * CHUNK);
+    }
+    CHECK_EQ(upload_.client._unacked, 0);
+}